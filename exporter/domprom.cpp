@@ -48,6 +48,23 @@
 #define ENV_DOMPROM_MAINTENANCE_START    "domprom_maintenance_start"
 #define ENV_DOMPROM_MAINTENANCE_END      "domprom_maintenance_end"
 #define ENV_DOMPROM_PROBE_CLOSE_SESSION  "domprom_probe_close_session"
+#define ENV_DOMPROM_FSYNC                "domprom_fsync"
+#define ENV_DOMPROM_HTTP_PORT            "domprom_http_port"
+#define ENV_DOMPROM_HTTP_BIND            "domprom_http_bind"
+#define ENV_DOMPROM_HTTP_NO_FILE         "domprom_http_no_file"
+#define ENV_DOMPROM_INPLACE              "domprom_inplace"
+#define ENV_DOMPROM_RELABEL_RULES        "domprom_relabel_rules"
+#define ENV_DOMPROM_FILTER_RULES         "domprom_filter_rules"
+#define ENV_DOMPROM_FILTER_INCLUDE       "domprom_filter_include"
+#define ENV_DOMPROM_FILTER_EXCLUDE       "domprom_filter_exclude"
+#define ENV_DOMPROM_FACILITY_DISCOVERY   "domprom_facility_discovery"
+#define ENV_DOMPROM_FORECAST_INTERVAL    "domprom_forecast_interval"
+#define ENV_DOMPROM_WORKERS              "domprom_workers"
+#define ENV_DOMPROM_COLLECTOR_TIMEOUT    "domprom_collector_timeout"
+#define ENV_DOMPROM_REMOTE_WRITE_URL     "domprom_remote_write_url"
+#define ENV_DOMPROM_REMOTE_WRITE_WAL     "domprom_remote_write_wal"
+#define ENV_DOMPROM_REMOTE_WRITE_BATCH   "domprom_remote_write_batch"
+#define ENV_DOMPROM_REMOTE_WRITE_WAL_MB  "domprom_remote_write_wal_max_mb"
 
 #define ENV_DOMPROM_BUSINESSDAYS_ENABLED "domprom_businessdays_enabled"
 #define ENV_DOMPROM_BUSINESSDAYS         "domprom_businessdays"
@@ -64,6 +81,12 @@
 #define DOMPROM_DEFAULT_TRANS_INTERVAL_SEC   180
 #define DOMPROM_DEFAULT_IOSTAT_INTERVAL_SEC  600
 #define DOMPROM_DEFAULT_MBOX_INTERVAL_SEC    300
+#define DOMPROM_DEFAULT_COLLECTOR_TIMEOUT_SEC 20
+#define DOMPROM_DEFAULT_WORKERS                4
+#define DOMPROM_DEFAULT_FACILITY_DISCOVERY_SEC 300
+#define DOMPROM_DEFAULT_FORECAST_INTERVAL_SEC  300
+#define DOMPROM_ENV_CHECK_INTERVAL_SEC        30
+#define DOMPROM_MAX_WAIT_SLICE_MSEC         1000
 
 #define DOMPROM_MINIMUM_INTERVAL_SEC          10
 #define DOMPROM_MINIMUM_TRANS_INTERVAL_SEC    60
@@ -78,6 +101,15 @@
 #define DOMPROM_DISK_COMPONENT_NOTES_TEMP    "NotesTemp"
 #define DOMPROM_DISK_COMPONENT_VIEW_REBUILD  "ViewRebuild"
 #define DOMPROM_DISK_COMPONENT_NOTES_LOG_DIR "NotesLogDir"
+#define DOMPROM_DISK_MAX_COMPONENTS          8
+
+#define DOMPROM_DISKSTATS_FILE               "/proc/diskstats"
+#define DOMPROM_DISKSTATS_SECTOR_BYTES       512
+
+#define DOMPROM_TRANSLOG_EXTENSION           ".TXN"
+
+#define DOMPROM_FORECAST_SAMPLES             32
+#define DOMPROM_FORECAST_MIN_SAMPLES         4
 
 #define SERVER_STATE_AVAILABLE     0
 #define SERVER_STATE_RESTRICTED    1 // Restricted
@@ -94,17 +126,31 @@
 /* Includes */
 
 #ifdef _WIN32
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
   #include <windows.h>
+  #include <io.h>
 #else
   #include <unistd.h>
   #include <dirent.h>
   #include <sys/statvfs.h>
+  #include <sys/sysmacros.h>
+  #include <sys/inotify.h>
+  #include <sys/mman.h>
+  #include <sys/socket.h>
+  #include <sys/select.h>
+  #include <netinet/in.h>
+  #include <arpa/inet.h>
+  #include <netdb.h>
   #include <limits.h>
 #endif
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -139,17 +185,40 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
 #include <cstdio>
 #include <cinttypes>
 #include <algorithm>
 #include <ctime>
 #include <cstdint>
 #include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <chrono>
+#include <string_view>
+#include <cmath>
+#include <new>
+#include <queue>
+#include <functional>
 
 
 #ifdef _WIN32
   #define strcasecmp _stricmp
   #define strtok_r strtok_s
+  #define CloseSocket closesocket
+  #define SEND_FLAGS 0
+  typedef SOCKET SOCKET_TYPE;
+  typedef int    SOCKET_IO_TYPE;
+#else
+  #define CloseSocket close
+  #define INVALID_SOCKET (-1)
+  #define SEND_FLAGS MSG_NOSIGNAL
+  typedef int     SOCKET_TYPE;
+  typedef ssize_t SOCKET_IO_TYPE;
 #endif
 
 /* Types */
@@ -172,8 +241,13 @@ struct CONTEXT_STRUCT_TYPE
     size_t CountTime;
     size_t CountInvalid;
     size_t CountUnknown;
+    size_t CountFiltered;
+    size_t CountDuplicate;
 
-    FILE *fp;
+    class ExpositionBuffer  *pOut;
+    class StatMetadataCache *pCache;       // Filter, descriptions and relabel rules used for the statistics
+    class DuplicateStatSet  *pDuplicates;
+    class FacilityPlanner   *pPlanner;     // NULL when statistics are passed to DomExportTraverse without StatTraverse
 };
 
 
@@ -250,6 +324,7 @@ char  g_szNotesTemp[MAXPATH+1]     = {0};
 char  g_szViewRebuild[MAXPATH+1]   = {0};
 char  g_szNotesLogDir[MAXPATH+1]   = {0};
 char  g_szStatsFilename[2*MAXPATH+200] = {0};
+char  g_szRemoteWriteUrl[MAXSPRINTF+1] = {0};
 char  g_szTransFilename[2*MAXPATH+200] = {0};
 
 char  g_szPromTypeGauge[]     = "gauge";
@@ -261,18 +336,17 @@ char  g_szEvents4[]           = "events4.nsf";
 WORD   g_wTranslogLogType          = 0;
 WORD   g_wServerRestricted         = 0;
 int    g_StatusDAOS                = 0;
-size_t g_TranslogMinLogExtend      = 0;
-size_t g_TranslogMaxLogExtend      = 0;
 WORD   g_wWriteDominoHealthStats   = 1;
 WORD   g_wCollectDominoTransStats  = 0;
 WORD   g_wCollectDominoIOStat      = 0;
 WORD   g_wCollectMailboxStats      = 0;
 WORD   g_ProbeCloseSession         = 0;
-WORD   g_MailBoxes                 = 0;
+WORD   g_wFsync                    = 0;
+WORD   g_wHttpPort                 = 0;
+WORD   g_wHttpNoFile               = 0;
+WORD   g_wInPlace                  = 0;
+std::atomic<WORD> g_MailBoxes      {0};
 
-TIMEDATE g_tNextTransStatsUpdate   = {0};
-TIMEDATE g_tNextIOStatUpdate       = {0};
-TIMEDATE g_tNextMailboxStatsUpdate = {0};
 TIMEDATE g_tMaintenanceStart       = {0};
 TIMEDATE g_tMaintenanceEnd         = {0};
 WORD     g_wMaintenanceEnabled     = 0;
@@ -286,6 +360,7 @@ BOOL g_bBusinessHours        = TRUE;
 BUSINESS_DAYS_TYPE g_BusinessHours = {0};
 
 MAILBOX_STATS_TYPE g_MailboxStats = {0};
+std::mutex         g_MailboxStatsMutex;
 
 #define MAX_CONFIG_VALUE_OVERRIDE 99
 
@@ -302,30 +377,18 @@ DWORD g_dwIntervalSec         = DOMPROM_DEFAULT_INTERVAL_SEC;
 DWORD g_dwTransIntervalSec    = DOMPROM_DEFAULT_TRANS_INTERVAL_SEC;
 DWORD g_dwIOStatIntervalSec   = DOMPROM_DEFAULT_IOSTAT_INTERVAL_SEC;
 DWORD g_dwMboxStatIntervalSec = DOMPROM_DEFAULT_MBOX_INTERVAL_SEC;
+DWORD g_dwCollectorTimeoutSec = DOMPROM_DEFAULT_COLLECTOR_TIMEOUT_SEC;
+DWORD g_dwFacilityDiscoverySec = DOMPROM_DEFAULT_FACILITY_DISCOVERY_SEC;
+DWORD g_dwForecastIntervalSec = DOMPROM_DEFAULT_FORECAST_INTERVAL_SEC;
 DWORD g_dwDAOSCatalogStatus   = 0;
 
-/* Helper list to process disk stats and write them separately (Totals and Free) */
-
-std::list<std::string> g_ListDiskTotalStats;
-std::list<std::string> g_ListDiskFreeStats;
-
-/* Helper list to process transactions and write them separately (count and total) */
-
-std::list<std::string> g_ListTransCountStats;
-std::list<std::string> g_ListTransTotalSecondsStats;
-
-/* Currently the value is unused. But on purpose this is a map which can later hold values as well */
-
-static std::unordered_map<std::string, double> g_DominoStat;
-static std::unordered_map<std::string, std::string> g_DominoStatDescription;
-
-
-static size_t g_DominoStatCount = 0;
-static size_t g_DominoStatMax   = 0;
-
 #define DOMSTAT_NEW                 0
 #define DOMSTAT_DUPLICATE_SAME      1
 #define DOMSTAT_DUPLICATE_DIFFERENT 2
+#define DOMSTAT_INITIAL_SLOTS       4096
+#define DOMSTAT_HELP_INITIAL_SLOTS  2048
+#define DOMPROM_TRANS_INITIAL_SLOTS 256
+#define DOMSTAT_HELP_NONE           0xFFFFFFFF
 
 
 #ifdef _WIN32
@@ -358,2746 +421,8362 @@ uint64_t GetTimeSec(void)
 }
 
 
-BOOL GetEnviromentLong (const char *pszName, LONG *retplValue)
+uint64_t GetTimeUs(void)
 {
-    char szEnvValue [MAXSPRINTF+1] = {0};
+    return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    if (retplValue)
-        *retplValue = 0;
 
-    if (FALSE == OSGetEnvironmentString ("", szEnvValue, sizeof (szEnvValue)-1))
-        return FALSE;
+/* CPU time of the calling thread in microseconds */
 
-    if (retplValue)
-    {
-        *retplValue = atoi (szEnvValue);
-    }
+#ifdef _WIN32
 
-    return TRUE;
+uint64_t GetThreadCpuUs(void)
+{
+    FILETIME ftCreation = {0};
+    FILETIME ftExit     = {0};
+    FILETIME ftKernel   = {0};
+    FILETIME ftUser     = {0};
+
+    if (FALSE == GetThreadTimes (GetCurrentThread(), &ftCreation, &ftExit, &ftKernel, &ftUser))
+        return 0;
+
+    /* 100 ns units */
+    return ((((uint64_t) ftKernel.dwHighDateTime << 32) | ftKernel.dwLowDateTime) +
+            (((uint64_t) ftUser.dwHighDateTime   << 32) | ftUser.dwLowDateTime)) / 10ULL;
 }
 
+#else
 
-void BeginDominoStatCollection()
+uint64_t GetThreadCpuUs(void)
 {
-    g_DominoStat.clear();
+    struct timespec ts;
 
-    if (g_DominoStatMax > 0)
-    {
-        g_DominoStat.reserve (g_DominoStatMax);
-    }
+    if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
 
-    g_DominoStatCount = 0;
+    return ((uint64_t)ts.tv_sec * 1000000ULL) +
+           ((uint64_t)ts.tv_nsec / 1000ULL);
 }
 
+#endif
+
 
-int RegisterDominoStat (const char *pszName, double value)
+/* Self instrumentation: wall clock histogram and CPU time summary per exporter phase */
+
+enum PHASE_ID
 {
-    if (pszName == nullptr)
-    {
-        return DOMSTAT_DUPLICATE_SAME;
-    }
+    PHASE_PROBE = 0,
+    PHASE_TRANS,
+    PHASE_IOSTAT,
+    PHASE_MAILBOX,
+    PHASE_STAT_TRAVERSE,
+    PHASE_RENDER,
+    PHASE_FILE_WRITE,
+    PHASE_EVENTS4_LOAD,
+    PHASE_COUNT
+};
+
+const char *g_pszPhaseNames[PHASE_COUNT] = { "probe", "trans", "iostat", "mailbox", "stat_traverse", "render", "file_write", "events4_load" };
+
+/* Histogram upper bounds in microseconds */
+const uint64_t g_PhaseBucketsUs[] = { 1000, 5000, 10000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 30000000, 60000000 };
+
+#define PHASE_BUCKETS (sizeof (g_PhaseBucketsUs) / sizeof (g_PhaseBucketsUs[0]))
+
+
+struct PHASE_STATS_TYPE
+{
+    uint64_t Buckets[PHASE_BUCKETS];
+    uint64_t Count;
+    uint64_t WallUs;
+    uint64_t CpuUs;
+};
+
 
-    auto result = g_DominoStat.emplace (std::string (pszName), value);
+class PhaseStats
+{
+public:
 
-    if (result.second)
+    void Observe (PHASE_ID Phase, uint64_t WallUs, uint64_t CpuUs)
     {
-        ++g_DominoStatCount;
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        PHASE_STATS_TYPE &Stats = m_Phases[Phase];
 
-        if (g_DominoStatCount > g_DominoStatMax)
+        for (size_t i = 0; i < PHASE_BUCKETS; i++)
         {
-            g_DominoStatMax = g_DominoStatCount;
+            if (WallUs <= g_PhaseBucketsUs[i])
+            {
+                Stats.Buckets[i]++;
+                break;
+            }
         }
 
-        return DOMSTAT_NEW;
+        Stats.Count++;
+        Stats.WallUs += WallUs;
+        Stats.CpuUs  += CpuUs;
     }
 
-    if (result.first->second == value)
+    PHASE_STATS_TYPE Get (int Phase)
     {
-        return DOMSTAT_DUPLICATE_SAME;
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        return m_Phases[Phase];
     }
 
-    result.first->second = value;
-    return DOMSTAT_DUPLICATE_DIFFERENT;
-}
+
+private:
+
+    PHASE_STATS_TYPE m_Phases[PHASE_COUNT] = {};
+    std::mutex       m_Mutex;
+};
 
 
-class PrefixFilter
+PhaseStats g_PhaseStats;
+
+
+/* Chrome trace-event recording of the next collection cycles ("tell domprom trace <n>").
+   Spans are kept in memory and written as JSON when the last requested cycle completed */
+
+#define DOMPROM_TRACE_MAX_EVENTS 200000
+#define DOMPROM_TRACE_MAX_CYCLES 100
+#define DOMPROM_TRACE_FILENAME   "domprom_trace.json"
+
+thread_local DWORD       t_dwTraceThreadId     = 0;
+thread_local const char *t_pszTraceThreadName  = "domprom";
+
+std::atomic<DWORD> g_dwTraceThreadSeq {0};
+
+
+struct TRACE_EVENT_TYPE
 {
+    const char *pszName;
+    const char *pszThreadName;
+    DWORD       dwThreadId;
+    uint64_t    StartUs;
+    uint64_t    DurationUs;
+};
 
+
+class TraceRecorder
+{
 public:
 
-    void AddInclude (const std::string& p)
+    /* Records from the next cycle start for dwCycles complete cycles */
+    void Start (DWORD dwCycles, const char *pszFilename)
     {
-        m_include.push_back(p);
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+
+        m_Events.clear();
+        m_Filename    = pszFilename;
+        m_dwCycles    = dwCycles;
+        m_dwDropped   = 0;
+        m_bArmed      = true;
+        m_bActive     = false;
     }
 
-    void AddExclude (const std::string& p)
+    bool IsActive () const
     {
-        m_exclude.push_back(p);
+        return m_bActive;
     }
 
-    // Sort include/exclude by len for faster matching and simple logic. the longest match wins
-    void Finalize ()
+    /* Called at the start of each statistics cycle. Writes the trace once the requested cycles are complete */
+    void BeginCycle ()
     {
-        auto byLengthDesc = [] (const std::string& a, const std::string& b)
+        std::vector<TRACE_EVENT_TYPE> Events;
+        std::string Filename;
+        DWORD dwDropped = 0;
+
         {
-            return a.size() > b.size();
-        };
+            std::lock_guard<std::mutex> Lock (m_Mutex);
 
-        std::sort (m_include.begin(), m_include.end(), byLengthDesc);
-        std::sort (m_exclude.begin(), m_exclude.end(), byLengthDesc);
-    }
+            if (false == m_bArmed)
+                return;
 
-    // default include if not found
+            if (false == m_bActive)
+            {
+                m_bActive = true;
+                return;
+            }
 
-    bool ShouldInclude (const std::string& name) const
-    {
-        if (Matches(m_include, name))
-            return true;
+            if (--m_dwCycles)
+                return;
 
-        if (Matches(m_exclude, name))
-            return false;
+            m_bArmed  = false;
+            m_bActive = false;
 
-        return true;
+            Events.swap (m_Events);
+            Filename  = m_Filename;
+            dwDropped = m_dwDropped;
+        }
+
+        Write (Events, Filename.c_str(), dwDropped);
     }
 
-    bool ShouldExclude (const std::string& name) const
+    void AddSpan (const char *pszName, uint64_t StartUs, uint64_t DurationUs)
     {
-        if (Matches (m_include, name))
-            return false;
+        if (0 == t_dwTraceThreadId)
+            t_dwTraceThreadId = ++g_dwTraceThreadSeq;
 
-        if (Matches (m_exclude, name))
-            return true;
+        std::lock_guard<std::mutex> Lock (m_Mutex);
 
-        return false;
+        if (false == m_bActive)
+            return;
+
+        if (m_Events.size() >= DOMPROM_TRACE_MAX_EVENTS)
+        {
+            m_dwDropped++;
+            return;
+        }
+
+        m_Events.push_back ({ pszName, t_pszTraceThreadName, t_dwTraceThreadId, StartUs, DurationUs });
     }
 
 
 private:
 
-    static bool Matches (const std::vector<std::string>& prefixes,
-                         const std::string& value)
+    void Write (const std::vector<TRACE_EVENT_TYPE> &Events, const char *pszFilename, DWORD dwDropped)
     {
-        for (const auto& p : prefixes)
+        std::vector<DWORD> ThreadIds;
+        FILE *fp = NULL;
+        bool bFirst = true;
+
+        fp = fopen (pszFilename, "w");
+
+        if (NULL == fp)
         {
-            if (value.compare(0, p.size(), p) == 0)
-                return true;
+            AddInLogMessageText ("%s: Cannot create trace file: %s", 0, g_szTask, pszFilename);
+            return;
         }
-        return false;
+
+        fprintf (fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+        for (const auto &Event : Events)
+        {
+            /* Thread names as metadata events, once per thread */
+            if (ThreadIds.end() == std::find (ThreadIds.begin(), ThreadIds.end(), Event.dwThreadId))
+            {
+                ThreadIds.push_back (Event.dwThreadId);
+
+                fprintf (fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                         bFirst ? "" : ",\n", Event.dwThreadId, Event.pszThreadName);
+                bFirst = false;
+            }
+
+            fprintf (fp, "%s{\"name\":\"%s\",\"cat\":\"domprom\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 "}",
+                     bFirst ? "" : ",\n", Event.pszName, Event.dwThreadId, Event.StartUs, Event.DurationUs);
+            bFirst = false;
+        }
+
+        fprintf (fp, "\n]}\n");
+        fclose (fp);
+
+        AddInLogMessageText ("%s: Trace written: %s (%u events, %u dropped)", 0, g_szTask, pszFilename, (DWORD) Events.size(), dwDropped);
     }
 
-    std::vector<std::string> m_include;
-    std::vector<std::string> m_exclude;
+    std::vector<TRACE_EVENT_TYPE> m_Events;
+    std::string m_Filename;
+    DWORD       m_dwCycles  = 0;
+    DWORD       m_dwDropped = 0;
+    bool        m_bArmed    = false;
+
+    std::atomic<bool> m_bActive {false};
+    std::mutex        m_Mutex;
 };
 
 
-PrefixFilter g_StatsFilter;
+TraceRecorder g_Trace;
 
 
-void TruncateAtFirstBlank (char *pszBuffer)
+void TraceSetThreadName (const char *pszName)
 {
-    char *p = pszBuffer;
+    t_pszTraceThreadName = pszName;
+}
 
-    if (NULL == p)
-        return;
+/* Span around a single Notes API call: Start = TraceBegin(); call; TraceEnd ("name", Start); */
 
-    while (*p)
-    {
-        if (' ' == *p)
-        {
-            *p = '\0';
-            break;
-        }
+uint64_t TraceBegin ()
+{
+    return g_Trace.IsActive() ? GetTimeUs() : 0;
+}
 
-        p++;
-    } /* while */
+void TraceEnd (const char *pszName, uint64_t StartUs)
+{
+    if (StartUs && g_Trace.IsActive())
+        g_Trace.AddSpan (pszName, StartUs, GetTimeUs() - StartUs);
 }
 
 
-void ReplaceChars (char *pszBuffer)
+/* Measures the scope it lives in as one run of a phase */
+
+class PhaseTimer
 {
-    char *p = pszBuffer;
+public:
 
-    if (NULL == p)
-        return;
+    PhaseTimer (PHASE_ID Phase) : m_Phase (Phase), m_StartUs (GetTimeUs()), m_StartCpuUs (GetThreadCpuUs())
+    {
+    }
 
-    while (*p)
+    ~PhaseTimer ()
     {
-        if ( ((*p >= 'a') && (*p <= 'z')) ||
-             ((*p >= 'A') && (*p <= 'Z')) ||
-             ((*p >= '0') && (*p <= '9')) )
-        {
-            /* Valid chars */
-        }
+        uint64_t WallUs = GetTimeUs() - m_StartUs;
 
-        else if ('/' == *p)
-        {
-            /* LATER: Root disk on Linux needs special handling */
-            *p = 'C';
-        }
-        else
-        {
-            *p = '_';
-        }
+        g_PhaseStats.Observe (m_Phase, WallUs, GetThreadCpuUs() - m_StartCpuUs);
 
-        p++;
-    } /* while */
-}
+        if (g_Trace.IsActive())
+            g_Trace.AddSpan (g_pszPhaseNames[m_Phase], m_StartUs, WallUs);
+    }
 
+    PhaseTimer (const PhaseTimer &) = delete;
+    PhaseTimer &operator= (const PhaseTimer &) = delete;
 
-bool IsNullStr (const char *pszStr)
-{
-    if (NULL == pszStr)
-        return true;
 
-    if ('\0' == *pszStr)
-        return true;
+private:
 
-    return false;
-}
+    PHASE_ID m_Phase;
+    uint64_t m_StartUs;
+    uint64_t m_StartCpuUs;
+};
 
 
-int FileExists (const char *pszFilename)
-{
-    int ret = 0;
+/* Statistics seen, filtered and duplicate over all collection cycles */
+std::atomic<uint64_t> g_StatsSeenTotal      {0};
+std::atomic<uint64_t> g_StatsFilteredTotal  {0};
+std::atomic<uint64_t> g_StatsDuplicateTotal {0};
+std::atomic<uint64_t> g_BytesWrittenTotal   {0};
 
-#ifdef _WIN32
-    struct _stat Filestat = {0};
-#else
-    struct stat Filestat = {0};
-#endif
 
-    if (IsNullStr (pszFilename))
-        return 0;
+BOOL GetEnviromentLong (const char *pszName, LONG *retplValue)
+{
+    char szEnvValue [MAXSPRINTF+1] = {0};
 
-#ifdef _WIN32
-        ret = _stat (pszFilename, &Filestat);
-#else
-        ret = stat (pszFilename, &Filestat);
+    if (retplValue)
+        *retplValue = 0;
 
-#endif
+    if (FALSE == OSGetEnvironmentString ("", szEnvValue, sizeof (szEnvValue)-1))
+        return FALSE;
 
-    if (ret)
-        return 0;
+    if (retplValue)
+    {
+        *retplValue = atoi (szEnvValue);
+    }
 
-    if (S_IFDIR & Filestat.st_mode)
-        return 2;
-    else
-        return 1;
+    return TRUE;
 }
 
 
-int RemoveFile (const char *pszFilename, WORD wLogLevel)
+/* Case insensitive set of the statistic names written in the current cycle.
+   Flat open addressing table with linear probing. Names are copied lower case into a per-cycle arena and the slots
+   refer to them by offset. A slot is only valid if its generation matches the current cycle,
+   so starting a new cycle is O(1) and in steady state nothing is allocated.
+   Currently the value is unused. But on purpose the set can hold values as well */
+
+class DuplicateStatSet
 {
-    int ret = 0;
+public:
 
-    if (IsNullStr (pszFilename))
-        return 0;
+    DuplicateStatSet ()
+    {
+        m_Slots.resize (DOMSTAT_INITIAL_SLOTS);
+    }
 
-    if (0 == FileExists (pszFilename))
+    void Begin ()
     {
-        if (wLogLevel > 1)
+        m_Generation++;
+
+        /* After a wrap around old slots could look valid again */
+        if (0 == m_Generation)
         {
-            AddInLogMessageText ("%s: File does not exist when deleting: %s", 0, g_szTask, pszFilename);
+            for (auto &Slot : m_Slots)
+                Slot.Generation = 0;
+
+            m_Generation = 1;
         }
 
-        return 0;
+        m_Arena.clear();
+        m_Count = 0;
     }
 
-    ret = remove (pszFilename);
-
-    if (FileExists (pszFilename))
-    {
-        AddInLogMessageText ("%s: File cannot be deleted: %s", 0, g_szTask, pszFilename);
-    }
-    else
+    int Register (const char *pszName, double Value)
     {
-        if (wLogLevel)
+        size_t   Len   = strlen (pszName);
+        uint32_t Hash  = 2166136261U;
+        size_t   Mask  = 0;
+        size_t   Pos   = 0;
+        size_t   Start = m_Arena.size();
+
+        m_Arena.append (pszName, Len);
+
+        char *pName = &m_Arena[Start];
+
+        /* FNV-1a over the lower case name, converted in place in the arena */
+        for (size_t i = 0; i < Len; i++)
         {
-            AddInLogMessageText ("%s: Info: File deleted %s", 0, g_szTask, pszFilename);
+            if ((pName[i] >= 'A') && (pName[i] <= 'Z'))
+                pName[i] += 'a' - 'A';
+
+            Hash = (Hash ^ (unsigned char) pName[i]) * 16777619U;
         }
-    }
 
-    return ret;
-}
+        std::string_view Name (pName, Len);
 
+        /* Keep the load factor at or below 1/2 */
+        if (2 * (m_Count + 1) > m_Slots.size())
+            Grow();
 
-bool CreateDirIfNotExists (const char *pszFilename)
-{
-    int  ret = 0;
-    bool bCreated = false;
+        Mask = m_Slots.size() - 1;
+        Pos  = Hash & Mask;
 
-    if (IsNullStr (pszFilename))
-        return false;
+        while (m_Slots[Pos].Generation == m_Generation)
+        {
+            DOMSTAT_SLOT &Slot = m_Slots[Pos];
 
-    ret = FileExists (pszFilename);
+            if ((Slot.Hash == Hash) && (Name == std::string_view (m_Arena.data() + Slot.Offset, Slot.Len)))
+            {
+                /* Known name, the arena copy is not needed */
+                m_Arena.resize (Start);
 
-    /* Directory already exists */
-    if (2 == ret)
-        return true;
+                if (Slot.Value == Value)
+                    return DOMSTAT_DUPLICATE_SAME;
 
-    /* A file with the same name already exists */
-    if (1 == ret)
+                Slot.Value = Value;
+                return DOMSTAT_DUPLICATE_DIFFERENT;
+            }
+
+            Pos = (Pos + 1) & Mask;
+        }
+
+        m_Slots[Pos] = { m_Generation, Hash, (uint32_t) Start, (uint32_t) Len, Value };
+        m_Count++;
+
+        return DOMSTAT_NEW;
+    }
+
+    size_t Size () const
     {
-        AddInLogMessageText ("%s: Cannot create directory because a file with the same name exists: %s", 0, g_szTask, pszFilename);
-        return false;
+        return m_Count;
     }
 
-#ifdef _WIN32
-        if (TRUE == CreateDirectory (pszFilename, NULL))
-        {
-            bCreated = true;
-        }
-        else
-        {
-            perror ("Cannot create directory");
-        }
 
-#else
-        if (0 == mkdir (pszFilename, 0770))
-        {
-            bCreated = true;
-        }
-        else
-        {
-            perror ("Cannot create directory");
-        }
+private:
 
-#endif
+    struct DOMSTAT_SLOT
+    {
+        uint32_t Generation;
+        uint32_t Hash;
+        uint32_t Offset;
+        uint32_t Len;
+        double   Value;
+    };
 
-    if (bCreated)
-        AddInLogMessageText ("%s: Directory created: %s", 0, g_szTask, pszFilename);
-    else
-        AddInLogMessageText ("%s: Cannot create directory: %s", 0, g_szTask, pszFilename);
+    /* Only grows. The table size and the arena capacity of the largest cycle are kept */
+    void Grow ()
+    {
+        std::vector<DOMSTAT_SLOT> Old;
+        size_t Mask = 0;
+        size_t Pos  = 0;
 
-    return bCreated;
-}
+        Old.swap (m_Slots);
+        m_Slots.resize (Old.size() * 2);
+        Mask = m_Slots.size() - 1;
 
+        for (const auto &Slot : Old)
+        {
+            if (Slot.Generation != m_Generation)
+                continue;
 
-BOOL GetNotesTimeDateSting (TIMEDATE *pTimedate, WORD wRetBufferSize, char *retpszBuffer)
-{
-    BOOL bError = TRUE;
-    TIME NotesTime  = {0};
+            Pos = Slot.Hash & Mask;
 
-    if ((NULL == retpszBuffer) || (0 == wRetBufferSize))
-        return FALSE;
+            while (m_Slots[Pos].Generation == m_Generation)
+                Pos = (Pos + 1) & Mask;
 
-     *retpszBuffer = '\0';
+            m_Slots[Pos] = Slot;
+        }
+    }
 
-    if (NULL == pTimedate)
-        return FALSE;
+    std::vector<DOMSTAT_SLOT> m_Slots;
+    std::string m_Arena;
+    uint32_t    m_Generation = 1;
+    size_t      m_Count      = 0;
+};
 
-    memcpy (&(NotesTime.GM), pTimedate, sizeof (TIMEDATE));
 
-    bError = TimeGMToLocalZone (&NotesTime);
+DuplicateStatSet g_DominoStatSet;
 
-    if (bError)
-    {
-        *retpszBuffer = '\0';
-        goto Done;
-    }
 
-    snprintf (retpszBuffer,
-              wRetBufferSize,
-              "%04u-%02u-%02uT%02u:%02u:%02u:%02uZ",
-              NotesTime.year,
-              NotesTime.month,
-              NotesTime.day,
-              NotesTime.hour,
-              NotesTime.minute,
-              NotesTime.second,
-              NotesTime.hundredth);
+/* Include/exclude prefix rules for Domino statistic names (lowercase).
+   The rules are compiled into a character trie. One pass over the name finds the longest matching prefix, which decides.
+   A later rule with the same prefix replaces the action of an earlier one, so notes.ini and file rules can override defaults.
 
-Done:
-    return bError;
-}
+   Rules file (notes.ini domprom_filter_rules), one rule per line, '#' starts a comment:
 
+   exclude <prefix>
+   include <prefix> */
 
-STATUS DumpBufferToFile (const char *pszFileName, const char *pszBuffer)
+class PrefixFilter
 {
-    STATUS error = NOERROR;
-    FILE *pFile = NULL;
-    pFile = fopen (pszFileName, "wb");
 
-    if (IsNullStr (pszFileName))
-        return ERR_MISC_INVALID_ARGS;
+public:
 
-    if (IsNullStr (pszBuffer))
-        return ERR_MISC_INVALID_ARGS;
+    void AddInclude (const std::string& p)
+    {
+        AddRule (p, true);
+    }
 
-    fwrite ((const char *) pszBuffer, 1, strlen (pszBuffer), pFile);
+    void AddExclude (const std::string& p)
+    {
+        AddRule (p, false);
+    }
 
-    if (pFile)
+    void AddRule (const std::string& Prefix, bool bInclude)
     {
-        fclose (pFile);
-        pFile = NULL;
+        std::string Lower (Prefix);
+
+        std::transform (Lower.begin(), Lower.end(), Lower.begin(), [] (unsigned char c) { return (char) tolower (c); });
+
+        for (auto &Rule : m_Rules)
+        {
+            if (Rule.Prefix == Lower)
+            {
+                Rule.bInclude = bInclude;
+                return;
+            }
+        }
+
+        m_Rules.push_back ({ Lower, bInclude });
     }
 
-    return error;
-}
+    /* Comma separated list of prefixes from notes.ini */
+    size_t AddList (const char *pszList, bool bInclude)
+    {
+        std::string Prefix;
+        size_t Count = 0;
 
+        if (NULL == pszList)
+            return 0;
 
-#ifdef _WIN32
-bool LmbcsToWide (const char *pszPathLMBCS, wchar_t *retpwszBuffer, DWORD dwBufferLen)
-{
-    if (retpwszBuffer && dwBufferLen)
-        *retpwszBuffer = '\0';
+        for (const char *p = pszList; ; p++)
+        {
+            if ((',' == *p) || ('\0' == *p))
+            {
+                if (Prefix.size())
+                {
+                    AddRule (Prefix, bInclude);
+                    Count++;
+                }
 
-    if (NULL == pszPathLMBCS)
-        return false;
+                Prefix.clear();
 
-    OSTranslate32 (OS_TRANSLATE_LMBCS_TO_UNICODE, pszPathLMBCS, MAXDWORD, (char *) retpwszBuffer, dwBufferLen);
-    return true;
-}
-#else
-bool LmbcsToUtf8 (const char *pszPathLMBCS, char *retpszBuffer, DWORD dwBufferLen)
-{
-    if (retpszBuffer && dwBufferLen)
-        *retpszBuffer = '\0';
+                if ('\0' == *p)
+                    break;
+            }
+            else if (' ' != *p)
+            {
+                Prefix.push_back (*p);
+            }
+        }
 
-    if (NULL == pszPathLMBCS)
-        return false;
+        return Count;
+    }
 
-    OSTranslate32 (OS_TRANSLATE_LMBCS_TO_UTF8, pszPathLMBCS, MAXDWORD, (char *) retpszBuffer, dwBufferLen);
-    return true;
-}
-#endif
+    size_t LoadFile (const char *pszFilename)
+    {
+        FILE   *fp     = NULL;
+        DWORD  dwLine  = 0;
+        char   szLine[1024]    = {0};
+        char   szKeyword[32]   = {0};
+        char   szPrefix[1024]  = {0};
+        int    Count  = 0;
+        size_t Loaded = 0;
 
+        if ((NULL == pszFilename) || ('\0' == *pszFilename))
+            return 0;
 
-bool GetDiskUsageFrom (const char *pszPathLMBCS,
-                       uint64_t   *retpTotalBytes,
-                       uint64_t   *retpFreeBytes)
-{
-#ifdef _WIN32
-    wchar_t pwszPath[MAX_PATH+1] = {0};
-    ULARGE_INTEGER freeAvail  = {0};
-    ULARGE_INTEGER total      = {0};
-    ULARGE_INTEGER freeTotal  = {0};
+        fp = fopen (pszFilename, "r");
 
-    if (!LmbcsToWide (pszPathLMBCS, pwszPath, sizeof (pwszPath)-1))
-        return false;
+        if (NULL == fp)
+        {
+            AddInLogMessageText ("%s: Cannot open filter rules file: %s", 0, g_szTask, pszFilename);
+            return 0;
+        }
 
-    if (!GetDiskFreeSpaceExW (pwszPath, &freeAvail, &total, &freeTotal))
-        return false;
+        while (fgets (szLine, sizeof (szLine), fp))
+        {
+            dwLine++;
 
-    if (retpTotalBytes)
-        *retpTotalBytes = (uint64_t)total.QuadPart;
+            *szKeyword = '\0';
+            *szPrefix  = '\0';
 
-    if (retpFreeBytes)
-        *retpFreeBytes = (uint64_t)freeAvail.QuadPart;
+            Count = sscanf (szLine, "%31s %1023s", szKeyword, szPrefix);
 
-    return true;
+            if ((Count <= 0) || ('#' == *szKeyword))
+                continue;
 
-#else
-    char pszPathUtf8[PATH_MAX+1] = {0};
-    struct statvfs s  = {0};
+            if ((2 == Count) && (0 == strcasecmp (szKeyword, "include")))
+            {
+                AddRule (szPrefix, true);
+            }
+            else if ((2 == Count) && (0 == strcasecmp (szKeyword, "exclude")))
+            {
+                AddRule (szPrefix, false);
+            }
+            else
+            {
+                AddInLogMessageText ("%s: Invalid filter rule in %s line %u", 0, g_szTask, pszFilename, dwLine);
+                continue;
+            }
 
-    if (!LmbcsToUtf8 (pszPathLMBCS, pszPathUtf8, sizeof(pszPathUtf8)-1))
-        return false;
+            Loaded++;
+        }
 
-    if (statvfs(pszPathUtf8, &s) != 0)
-        return false;
+        fclose (fp);
+        fp = NULL;
 
-    uint64_t blockSize = (s.f_frsize != 0) ? (uint64_t)s.f_frsize : (uint64_t)s.f_bsize;
+        AddInLogMessageText ("%s: Loaded %u filter rules from %s", 0, g_szTask, (DWORD) Loaded, pszFilename);
 
-    if (retpTotalBytes)
-        *retpTotalBytes = (uint64_t)s.f_blocks * blockSize;
+        return Loaded;
+    }
 
-    if (retpFreeBytes)
-        *retpFreeBytes = (uint64_t)s.f_bavail * blockSize;
+    /* Compiles the rules into the trie. Nodes are numbered breadth first and the edges of a node are stored sorted and contiguous */
+    void Finalize ()
+    {
+        std::vector<std::map<char, uint32_t>> Children (1);
+        std::vector<int> NodeRule (1, -1);
+        std::vector<uint32_t> Order;
+        std::vector<uint32_t> NewIndex;
+        uint32_t Node = 0;
 
-    return true;
-#endif
-}
+        for (size_t r = 0; r < m_Rules.size(); r++)
+        {
+            Node = 0;
 
+            for (char ch : m_Rules[r].Prefix)
+            {
+                auto it = Children[Node].find (ch);
 
-int CompareCaseInsensitive (const char *pszStr1, const char *pszStr2)
-{
-    if (NULL == pszStr1)
-        return 0;
+                if (it != Children[Node].end())
+                {
+                    Node = it->second;
+                    continue;
+                }
 
-    if (NULL == pszStr2)
-        return 0;
+                Children[Node][ch] = (uint32_t) Children.size();
+                Node = (uint32_t) Children.size();
 
-    return ( IntlTextCompare (pszStr1, (WORD)strlen(pszStr1), pszStr2,(WORD)strlen (pszStr2), 0));
-}
+                Children.emplace_back();
+                NodeRule.push_back (-1);
+            }
 
+            NodeRule[Node] = (int) r;
+        }
 
-uint64_t EpochFromUtcTm (struct tm* pUtcTm)
-{
-#ifdef _WIN32
-    return static_cast<uint64_t>(_mkgmtime64(pUtcTm));
-#else
-    return static_cast<uint64_t>(timegm(pUtcTm));
-#endif
-}
+        Order.push_back (0);
 
+        for (size_t i = 0; i < Order.size(); i++)
+        {
+            for (const auto &Child : Children[Order[i]])
+                Order.push_back (Child.second);
+        }
 
-uint64_t TimeDateToEpoch (const TIMEDATE* pTimeDate)
-{
-    if (NULL == pTimeDate)
-        return 0;
+        NewIndex.resize (Order.size());
 
-    TIME t = {};
-    struct tm utc_tm = {};
+        for (size_t i = 0; i < Order.size(); i++)
+            NewIndex[Order[i]] = (uint32_t) i;
 
-    t.GM = *pTimeDate;
-    t.zone = 0;
-    t.dst  = 0;
+        m_Nodes.clear();
+        m_Edges.clear();
 
-    if (TimeGMToLocalZone (&t))
-    {
-        return 0;
+        for (uint32_t Old : Order)
+        {
+            m_Nodes.push_back ({ NodeRule[Old], (uint32_t) m_Edges.size(), (uint32_t) Children[Old].size() });
+
+            for (const auto &Child : Children[Old])
+                m_Edges.push_back ({ Child.first, NewIndex[Child.second] });
+        }
+
+        m_Hits = std::vector<std::atomic<uint64_t>> (m_Rules.size());
     }
 
-    if (t.year < 1900)
+    /* Returns the index of the longest matching rule or -1 */
+    int Match (const char *pszName) const
     {
-        return 0;
-    }
+        const FILTER_NODE *pNode = NULL;
+        const FILTER_EDGE *pEdge = NULL;
+        const FILTER_EDGE *pEnd  = NULL;
+        int Rule = -1;
 
-    utc_tm.tm_year  = t.year - 1900;
-    utc_tm.tm_mon   = t.month - 1;
-    utc_tm.tm_mday  = t.day;
-    utc_tm.tm_hour  = t.hour;
-    utc_tm.tm_min   = t.minute;
-    utc_tm.tm_sec   = t.second;
-    utc_tm.tm_isdst = 0;
+        if (m_Nodes.empty() || (NULL == pszName))
+            return -1;
 
-    return EpochFromUtcTm (&utc_tm);
-}
+        pNode = &m_Nodes[0];
 
+        for (const char *p = pszName; *p; p++)
+        {
+            pEdge = m_Edges.data() + pNode->FirstEdge;
+            pEnd  = pEdge + pNode->EdgeCount;
 
-STATUS StatUpdateText (const char *pszStatPkg, const char *pszName, const char *pszText)
-{
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+            while ((pEdge < pEnd) && (pEdge->ch != *p))
+                pEdge++;
 
-    if (NULL == pszText)
-        return ERR_MISC_INVALID_ARGS;
+            if (pEdge == pEnd)
+                break;
 
-    return StatUpdate (pszStatPkg, pszName, ST_UNIQUE, VT_TEXT, pszText);
-}
+            pNode = &m_Nodes[pEdge->Node];
 
+            if (pNode->Rule >= 0)
+                Rule = pNode->Rule;
+        }
 
-STATUS StatUpdateLong (const char *pszStatPkg, const char *pszName, LONG lValue)
-{
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+        return Rule;
+    }
 
-    return StatUpdate(pszStatPkg, pszName, ST_UNIQUE, VT_LONG, &lValue);
-}
+    /* True if an include rule is longer than the prefix and starts with it */
+    bool HasIncludeRuleBelow (const char *pszPrefix) const
+    {
+        std::vector<uint32_t> Stack;
+        const FILTER_NODE *pNode = NULL;
+        const FILTER_EDGE *pEdge = NULL;
+        const FILTER_EDGE *pEnd  = NULL;
 
+        if (m_Nodes.empty() || (NULL == pszPrefix))
+            return false;
 
-STATUS StatUpdateNumber (const char *pszStatPkg, const char *pszName, NUMBER *pnValue)
-{
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+        pNode = &m_Nodes[0];
 
-    if (NULL == pnValue)
-    {
-        StatDelete (pszStatPkg, pszName);
-        return NOERROR;
-    }
+        for (const char *p = pszPrefix; *p; p++)
+        {
+            pEdge = m_Edges.data() + pNode->FirstEdge;
+            pEnd  = pEdge + pNode->EdgeCount;
 
-    return StatUpdate(pszStatPkg, pszName, ST_UNIQUE, VT_NUMBER, pnValue);
-}
+            while ((pEdge < pEnd) && (pEdge->ch != *p))
+                pEdge++;
 
+            if (pEdge == pEnd)
+                return false;
 
-STATUS StatUpdateNumber (const char *pszStatPkg, const char *pszName, uint64_t Int64Value)
-{
-    NUMBER nNumber = {0};
+            pNode = &m_Nodes[pEdge->Node];
+        }
 
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+        for (uint32_t e = 0; e < pNode->EdgeCount; e++)
+            Stack.push_back (m_Edges[pNode->FirstEdge + e].Node);
 
-    nNumber = (NUMBER) Int64Value;
+        while (Stack.size())
+        {
+            pNode = &m_Nodes[Stack.back()];
+            Stack.pop_back();
 
-    return StatUpdate(pszStatPkg, pszName, ST_UNIQUE, VT_NUMBER, &nNumber);
-}
-
-
-STATUS StatUpdateNumberBytesInMB (const char *pszStatPkg, const char *pszName, NUMBER *pnBytes)
-{
-    NUMBER nMB = {0};
-
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
-
-    nMB = round (((*pnBytes) / 1048576.0) * 1000.0)/1000.0;
-
-    return StatUpdateNumber (pszStatPkg, pszName, &nMB);
-}
-
-
-STATUS StatUpdateNumberBytesInMB (const char *pszStatPkg, const char *pszName, uint64_t Int64Value)
-{
-    NUMBER nMB = {0};
-
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+            if ((pNode->Rule >= 0) && m_Rules[pNode->Rule].bInclude)
+                return true;
 
-    nMB = round (((NUMBER) Int64Value / 1048576.0)*1000.0)/1000.0;
+            for (uint32_t e = 0; e < pNode->EdgeCount; e++)
+                Stack.push_back (m_Edges[pNode->FirstEdge + e].Node);
+        }
 
-    return StatUpdateNumber (pszStatPkg, pszName, &nMB);
-}
+        return false;
+    }
 
+    // default include if not found
 
-STATUS StatUpdateTimedate (const char *pszStatPkg, const char *pszName, TIMEDATE *ptdTimedateValue)
-{
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+    bool ShouldInclude (const std::string& name) const
+    {
+        return false == ShouldExclude (name);
+    }
 
-    if (NULL == ptdTimedateValue)
+    bool ShouldExclude (const std::string& name) const
     {
-        StatDelete (pszStatPkg, pszName);
-        return NOERROR;
+        return IsExcludeRule (Match (name.c_str()));
     }
 
-    return StatUpdate (pszStatPkg, pszName, ST_UNIQUE, VT_TIMEDATE, ptdTimedateValue);
-}
+    bool IsExcludeRule (int Rule) const
+    {
+        return (Rule >= 0) && (false == m_Rules[Rule].bInclude);
+    }
 
+    /* Counted per collection cycle for the statistics matched by the rule. Only the collection thread counts,
+       a plain load and store is enough. The atomic keeps readers on other threads free of a data race */
+    void CountHit (int Rule, uint64_t Count = 1)
+    {
+        m_Hits[Rule].store (m_Hits[Rule].load (std::memory_order_relaxed) + Count, std::memory_order_relaxed);
+    }
 
-STATUS DeleteStat (const char *pszStatPkg, const char *pszName)
-{
-    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
-        return ERR_MISC_INVALID_ARGS;
+    size_t RuleCount () const
+    {
+        return m_Rules.size();
+    }
 
-    return NOERROR;
-}
+    void WriteStats (ExpositionBuffer *pOut) const;
 
-STATUS DeleteAllStatsForPackage (const char *pszStatPkg)
-{
-    if (IsNullStr (pszStatPkg))
-        return ERR_MISC_INVALID_ARGS;
 
-    StatDelete (pszStatPkg, "");
+private:
 
-    return NOERROR;
-}
+    struct FILTER_RULE
+    {
+        std::string Prefix;
+        bool        bInclude;
+    };
 
+    struct FILTER_NODE
+    {
+        int      Rule;
+        uint32_t FirstEdge;
+        uint32_t EdgeCount;
+    };
 
-void UpdateIdleStatus()
-{
-    char szStatus [MAXSPRINTF+1] = {0};
+    struct FILTER_EDGE
+    {
+        char     ch;
+        uint32_t Node;
+    };
 
-    if (g_wCollectDominoTransStats)
+    std::vector<FILTER_RULE> m_Rules;
+    std::vector<FILTER_NODE> m_Nodes;
+    std::vector<FILTER_EDGE> m_Edges;
+    std::vector<std::atomic<uint64_t>> m_Hits;
+};
 
-        snprintf (szStatus, sizeof (szStatus), "Idle (collect int: %u sec / trans int: %u sec)", g_dwIntervalSec, g_dwTransIntervalSec);
-    else
-        snprintf (szStatus, sizeof (szStatus), "Idle (collect interval: %u sec)", g_dwIntervalSec);
 
-    AddInSetStatusText (szStatus);
-}
+PrefixFilter g_StatsFilter;
 
 
-size_t GetTranslogExtendNumber (const char *pszFilename)
+void TruncateAtFirstBlank (char *pszBuffer)
 {
-    size_t num   = 0;
-    size_t digit = 0;
-    const char *p = pszFilename;
+    char *p = pszBuffer;
 
     if (NULL == p)
-        return 0;
-
-    if ('S' != *p)
-        return 0;
-
-    p++;
+        return;
 
     while (*p)
     {
-        if ((*p >= '0') && (*p <= '9'))
-        {
-            digit = *p - '0';
-            num = num * 10 + digit;
-        }
-        else if ('.' == *p)
+        if (' ' == *p)
         {
+            *p = '\0';
             break;
         }
-        else
-        {
-            return 0;
-        }
 
         p++;
-    }
-
-    return num;
+    } /* while */
 }
 
 
-bool WriteHelpAndType (FILE *fp, const char *pszPrefix, const char *pszStatName, const char *pszType, const char *pszDescription)
+char GetMetricNameChar (char ch)
 {
-    if (NULL == fp)
-        return false;
+    if ( ((ch >= 'a') && (ch <= 'z')) ||
+         ((ch >= 'A') && (ch <= 'Z')) ||
+         ((ch >= '0') && (ch <= '9')) )
+    {
+        /* Valid chars */
+        return ch;
+    }
 
-    if (NULL == pszPrefix)
-        return false;
+    if ('/' == ch)
+    {
+        /* LATER: Root disk on Linux needs special handling */
+        return 'C';
+    }
 
-    if (NULL == pszStatName)
-        return false;
+    return '_';
+}
 
-    if (IsNullStr (pszType))
-        pszType = g_szPromTypeGauge;
 
-    if (NULL == pszDescription)
-        pszDescription = g_szEmpty;
+void ReplaceChars (char *pszBuffer)
+{
+    char *p = pszBuffer;
 
-    fprintf (fp, "# HELP %s_%s %s\n", pszPrefix, pszStatName, pszDescription);
-    fprintf (fp, "# TYPE %s_%s %s\n", pszPrefix, pszStatName, pszType);
+    if (NULL == p)
+        return;
 
-    return true;
+    while (*p)
+    {
+        *p = GetMetricNameChar (*p);
+        p++;
+    } /* while */
 }
 
 
-bool WriteStatsEntryToFile (FILE *fp, const char *pszPrefix, const char *pszStatName, const char *pszDescription, uint64_t ValueNum)
+bool IsNullStr (const char *pszStr)
 {
-    if (NULL == fp)
-        return false;
+    if (NULL == pszStr)
+        return true;
 
-    if (NULL == pszPrefix)
-        return false;
+    if ('\0' == *pszStr)
+        return true;
 
-    if (NULL == pszStatName)
-        return false;
+    return false;
+}
 
-    if (false == WriteHelpAndType (fp, pszPrefix, pszStatName, NULL, pszDescription))
-        return false;
 
-    fprintf (fp, "%s_%s %" PRIu64 "\n", pszPrefix, pszStatName, ValueNum);
+/* Locale independent value formatting for the exposition based on std::to_chars.
+   All functions write into a caller provided buffer of at least MAX_PROM_VALUE bytes and return the length */
 
-    return true;
-}
+#define MAX_PROM_VALUE 64
 
+/* Fixed value width for in-place updated files. Fits all fixed-point and shortest double values */
+#define DOMPROM_VALUE_SLOT_WIDTH 24
 
-bool WriteStatsEntryToFile (FILE *fp, const char *pszPrefix, const char *pszStatName, const char *pszDescription, const char *pszValueString)
+size_t FormatPromSpecial (char *pBuffer, double Value)
 {
-    if (NULL == fp)
-        return false;
-
-    if (NULL == pszPrefix)
-        return false;
+    const char *pszValue = NULL;
 
-    if (NULL == pszStatName)
-        return false;
+    if (std::isnan (Value))
+        pszValue = "NaN";
+    else if (Value > 0)
+        pszValue = "+Inf";
+    else
+        pszValue = "-Inf";
 
-    if (NULL == pszValueString)
-        return false;
+    memcpy (pBuffer, pszValue, strlen (pszValue) + 1);
+    return strlen (pszValue);
+}
 
-    if (false == WriteHelpAndType (fp, pszPrefix, pszStatName, NULL, pszDescription))
-        return false;
 
-    fprintf (fp, "%s_%s %s\n", pszPrefix, pszStatName, pszValueString);
+size_t FormatPromU64 (char *pBuffer, uint64_t Value)
+{
+    std::to_chars_result Result = std::to_chars (pBuffer, pBuffer + MAX_PROM_VALUE - 1, Value);
 
-    return true;
+    *Result.ptr = '\0';
+    return (size_t) (Result.ptr - pBuffer);
 }
 
 
-static bool WriteStatsEntryToFileMSecToSeconds (FILE *fp, const char *pszPrefix, const char *pszStatName, const char *pszDescription, DWORD dwValue)
+size_t FormatPromI64 (char *pBuffer, int64_t Value)
 {
-    if (NULL == fp)
-        return false;
-    if (NULL == pszPrefix)
-        return false;
-    if (NULL == pszStatName)
-        return false;
+    std::to_chars_result Result = std::to_chars (pBuffer, pBuffer + MAX_PROM_VALUE - 1, Value);
 
-    if (!WriteHelpAndType(fp, pszPrefix, pszStatName, NULL, pszDescription))
-        return false;
+    *Result.ptr = '\0';
+    return (size_t) (Result.ptr - pBuffer);
+}
 
-    size_t sec  = dwValue / 1000;
-    size_t frac = dwValue % 1000;
 
-    fprintf(fp, "%s_%s %zu.%03zu\n", pszPrefix, pszStatName, sec, frac);
+// Shortest representation which parses back to the same double
+size_t FormatPromDouble (char *pBuffer, double Value)
+{
+    if (false == std::isfinite (Value))
+        return FormatPromSpecial (pBuffer, Value);
 
-    return true;
+    std::to_chars_result Result = std::to_chars (pBuffer, pBuffer + MAX_PROM_VALUE - 1, Value);
+
+    *Result.ptr = '\0';
+    return (size_t) (Result.ptr - pBuffer);
 }
 
 
-static bool WriteTimedateStat (FILE *fp, const char *pszStatName, const char *pszDescription, void *pValue)
+// Integer part and exactly 3 decimals. Same rounding as before (half away from zero)
+size_t FormatPromFixed3 (char *pBuffer, double Value)
 {
-    uint64_t EpochTime = 0;
+    char     *p = pBuffer;
+    uint64_t Scaled = 0;
+    uint64_t Frac   = 0;
 
+    if (false == std::isfinite (Value))
+        return FormatPromSpecial (pBuffer, Value);
 
-    if (NULL == fp)
-        return false;
+    /* Values which don't fit into the fixed-point range are rare. Don't lose precision for them */
+    if (fabs (Value) >= 9.0e15)
+        return FormatPromDouble (pBuffer, Value);
 
-    if (NULL == pszStatName)
-        return false;
+    Scaled = (uint64_t) (fabs (Value) * 1000.0 + 0.5);
 
-    if (NULL == pValue)
-        return false;
+    if ((Value < 0) && Scaled)
+        *p++ = '-';
 
-    EpochTime = TimeDateToEpoch ((TIMEDATE *) pValue);
+    Frac = Scaled % 1000;
+    p = std::to_chars (p, pBuffer + MAX_PROM_VALUE - 5, Scaled / 1000).ptr;
 
-    if (0 == EpochTime)
-        return false;
+    p[0] = '.';
+    p[1] = (char) ('0' + Frac / 100);
+    p[2] = (char) ('0' + (Frac / 10) % 10);
+    p[3] = (char) ('0' + Frac % 10);
+    p[4] = '\0';
+
+    return (size_t) (p + 4 - pBuffer);
+}
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, pszStatName, pszDescription, EpochTime);
 
-    return true;
+size_t FormatPromMSecToSeconds (char *pBuffer, uint64_t Msec)
+{
+    char     *p   = std::to_chars (pBuffer, pBuffer + MAX_PROM_VALUE - 5, Msec / 1000).ptr;
+    uint64_t Frac = Msec % 1000;
+
+    p[0] = '.';
+    p[1] = (char) ('0' + Frac / 100);
+    p[2] = (char) ('0' + (Frac / 10) % 10);
+    p[3] = (char) ('0' + Frac % 10);
+    p[4] = '\0';
+
+    return (size_t) (p + 4 - pBuffer);
 }
 
 
-STATUS AddIDUnique (void far *phNoteIDTable, SEARCH_MATCH far *pSearchInfo, ITEM_TABLE far *pSummaryInfo)
+/* Renders a complete exposition snapshot into one growable buffer, which is kept across cycles.
+   The result is committed with a single write into a temp file and a rename */
+
+class ExpositionBuffer
 {
-    DHANDLE       hNoteIDTable = NULLHANDLE;
-    STATUS        error        = NOERROR;
-    BOOL          bFlagOK      = FALSE;
-    SEARCH_MATCH  SearchMatch  = {0};
 
-    if (NULL == pSearchInfo)
-        return ERR_MISC_INVALID_ARGS;
+public:
 
-    memcpy((char*)(&SearchMatch), (char *)pSearchInfo, sizeof (SEARCH_MATCH));
+    void Reset ()
+    {
+        // clear() keeps the capacity, so steady-state cycles don't allocate
+        m_Data.clear();
+        m_Slots.clear();
+    }
 
-    if (!(SearchMatch.SERetFlags & SE_FMATCH)) return(NOERROR);
+    void Append (const char *pData, size_t len)
+    {
+        m_Data.append (pData, len);
+    }
 
-    if (phNoteIDTable)
+    void Append (const char *psz)
     {
-        hNoteIDTable = *((DHANDLE far *)phNoteIDTable);
-        if (hNoteIDTable)
-        {
-            error = IDInsert(hNoteIDTable, SearchMatch.ID.NoteID, &bFlagOK);
-        }
+        if (psz)
+            m_Data.append (psz);
     }
 
-    return ERR(error);
-}
+    void Append (char ch)
+    {
+        m_Data.push_back (ch);
+    }
 
+    // All sample values are written via AppendValue. With value slots enabled, each value is right aligned
+    // into a fixed width field and its offset is recorded, so a file can be patched in place later
+    void AppendValue (const char *pValue, size_t len)
+    {
+        if (m_bValueSlots && (len < DOMPROM_VALUE_SLOT_WIDTH))
+        {
+            m_Slots.push_back (m_Data.size());
+            m_Data.append (DOMPROM_VALUE_SLOT_WIDTH - len, ' ');
+        }
 
-DWORD GetDocsByFormula (DBHANDLE hDb, char *pszFormulaText, char *pszLookupDisplay, DHANDLE *retphNoteIDTable)
-{
-    STATUS error = NOERROR;
-    WORD   wdc         = 0;
-    WORD   wFormulaLen = 0;
-    DWORD  dwEntries   = 0;
+        m_Data.append (pValue, len);
+    }
 
-    FORMULAHANDLE hFormula = NULLHANDLE;
+    void AppendValue (const char *pszValue)
+    {
+        if (pszValue)
+            AppendValue (pszValue, strlen (pszValue));
+    }
 
-    if (NULLHANDLE == *retphNoteIDTable)
+    // Sample line in the format "name{labels} value" formatted by the caller
+    void AppendSampleLine (const std::string &Line)
     {
-        error = IDCreateTable(sizeof (NOTEID), retphNoteIDTable);
+        size_t Pos = Line.rfind (' ');
 
-        if (error)
+        if (std::string::npos == Pos)
         {
-            goto Done;
+            m_Data.append (Line);
         }
+        else
+        {
+            m_Data.append (Line, 0, Pos + 1);
+            AppendValue (Line.data() + Pos + 1, Line.size() - Pos - 1);
+        }
+
+        m_Data.push_back ('\n');
     }
 
-    error = NSFFormulaCompile( NULL,
-                               0,
-                               pszFormulaText,
-                               (WORD) strlen (pszFormulaText),
-                               &hFormula,
-                               &wFormulaLen,
-                               &wdc,
-                               &wdc,
-                               &wdc,
-                               &wdc,
-                               &wdc);
+    void SetValueSlots (bool bEnabled)
+    {
+        m_bValueSlots = bEnabled;
+    }
 
-    if (error)
+    bool HasValueSlots () const
     {
-        AddInLogMessageText ("%s: Error compiling search formula", error, g_szTask);
-        hFormula = NULLHANDLE;
-        goto Done;
+        return m_bValueSlots;
     }
 
-    error = NSFSearch(hDb,                /* database handle */
-                      hFormula,           /* selection formula */
-                      NULL,               /* title of view in selection formula */
-                      0,                  /* search flags */
-                      NOTE_CLASS_DOCUMENT,/* note class to find */
-                      NULL,               /* starting date(unused) */
-                      AddIDUnique,        /* call for each note found */
-                      retphNoteIDTable,   /* argument to AddIDUnique */
-                      NULL);              /* returned ending date(unused) */
+    // Hands the rendered snapshot to another buffer without copying. Both keep their capacity for reuse
+    void Swap (ExpositionBuffer &Other)
+    {
+        m_Data.swap (Other.m_Data);
+        m_Slots.swap (Other.m_Slots);
+        std::swap (m_bValueSlots, Other.m_bValueSlots);
+    }
 
-    if (error)
+    const std::vector<size_t> &Slots () const
     {
-        goto Done;
+        return m_Slots;
     }
 
-    dwEntries = IDEntries (*retphNoteIDTable);
+    void AppendU64 (uint64_t Value)
+    {
+        char szValue[MAX_PROM_VALUE] = {0};
+        AppendValue (szValue, FormatPromU64 (szValue, Value));
+    }
 
-Done:
+    void AppendI64 (int64_t Value)
+    {
+        char szValue[MAX_PROM_VALUE] = {0};
+        AppendValue (szValue, FormatPromI64 (szValue, Value));
+    }
 
-    if (hFormula)
+    void AppendFixed3 (double Value)
     {
-        OSMemFree(hFormula);
-        hFormula = NULLHANDLE;
+        char szValue[MAX_PROM_VALUE] = {0};
+        AppendValue (szValue, FormatPromFixed3 (szValue, Value));
     }
 
-    return dwEntries;
-}
+    void AppendDouble (double Value)
+    {
+        char szValue[MAX_PROM_VALUE] = {0};
+        AppendValue (szValue, FormatPromDouble (szValue, Value));
+    }
 
+    void AppendMSecToSeconds (uint64_t Msec)
+    {
+        char szValue[MAX_PROM_VALUE] = {0};
+        AppendValue (szValue, FormatPromMSecToSeconds (szValue, Msec));
+    }
 
-void SanitizeHelpString(char *pszText)
-{
-    char *pchRead  = NULL;
-    char *pchWrite = NULL;
-    unsigned char ch = 0;
-    bool fLastWasSpace = true;   // treat start as "space" to trim leading spaces
+    void AppendMetricName (const char *pszPrefix, const char *pszStatName)
+    {
+        Append (pszPrefix);
+        Append ('_');
+        Append (pszStatName);
+    }
 
-    if (!pszText)
-        return;
+    void AppendFormat (const char *pszFormat, ...)
+    {
+        char szBuffer[1024] = {0};
+        int  len = 0;
+        va_list Args;
 
-    pchRead  = pszText;
-    pchWrite = pszText;
+        va_start (Args, pszFormat);
+        len = vsnprintf (szBuffer, sizeof (szBuffer), pszFormat, Args);
+        va_end (Args);
 
-    for (; *pchRead; ++pchRead)
-    {
-        ch = (unsigned char)*pchRead;
+        if (len <= 0)
+            return;
 
-        // Skip all control characters
-        if (ch < 32)
-            continue;
+        if ((size_t) len >= sizeof (szBuffer))
+            len = sizeof (szBuffer) - 1;
 
-        if (ch == ' ')
-        {
-            if (fLastWasSpace)
-                continue;  // collapse multiple / leading spaces
+        m_Data.append (szBuffer, (size_t) len);
+    }
 
-            fLastWasSpace = true;
-            *pchWrite++ = ' ';
-            continue;
-        }
+    const char *Data () const
+    {
+        return m_Data.data();
+    }
 
-        *pchWrite++ = *pchRead;
-        fLastWasSpace = false;
+    size_t Size () const
+    {
+        return m_Data.size();
     }
 
-    // Trim trailing space
-    if (pchWrite > pszText && pchWrite[-1] == ' ')
-        --pchWrite;
+    // Write buffer into <filename>.tmp with one write and rename it to the final name
+    bool CommitToFile (const char *pszFilename, bool bFsync) const
+    {
+        char   szTempFilename[MAXPATH+1] = {0};
+        const  char *p = m_Data.data();
+        size_t Remaining = m_Data.size();
+        bool   bSuccess  = false;
+        int    fd = -1;
 
-    *pchWrite = '\0';
-}
+        if (IsNullStr (pszFilename))
+            return false;
 
+        snprintf (szTempFilename, sizeof (szTempFilename), "%s.tmp", pszFilename);
 
-STATUS AddStatDescriptionToTable (const char *pszStatName, char *pszDescription)
-{
-    STATUS error = NOERROR;
-    char szStatsNameLower[MAX_STAT_NAME+1] = {0};
+#ifdef _WIN32
+        fd = _open (szTempFilename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd = open (szTempFilename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
 
-    if (IsNullStr (pszStatName))
-        return ERR_MISC_INVALID_ARGS;
+        if (fd < 0)
+        {
+            perror ("Cannot create stats temp file");
+            return false;
+        }
 
-    if (IsNullStr (pszDescription))
-        return ERR_MISC_INVALID_ARGS;
+        while (Remaining)
+        {
+#ifdef _WIN32
+            int written = _write (fd, p, (unsigned int) std::min (Remaining, (size_t) 0x40000000));
+#else
+            ssize_t written = write (fd, p, Remaining);
+#endif
+            if (written <= 0)
+            {
+                perror ("Cannot write stats temp file");
+                goto Done;
+            }
 
-    OSTranslate32 (OS_TRANSLATE_UPPER_TO_LOWER, pszStatName, MAXDWORD, szStatsNameLower, sizeof (szStatsNameLower));
+            p += written;
+            Remaining -= (size_t) written;
+        }
 
-    SanitizeHelpString (pszDescription);
+        if (bFsync)
+        {
+#ifdef _WIN32
+            _commit (fd);
+#else
+            fsync (fd);
+#endif
+        }
 
-    g_DominoStatDescription.emplace (std::string (szStatsNameLower), std::string (pszDescription));
+        bSuccess = true;
 
-    return error;
-}
+Done:
 
+#ifdef _WIN32
+        _close (fd);
+#else
+        close (fd);
+#endif
 
-const char *GetStatDescriptionFromTable (const char *pszStatNameLower)
-{
-    const char* pszDesc = NULL;
+        if (false == bSuccess)
+        {
+            remove (szTempFilename);
+            return false;
+        }
 
-    if (IsNullStr (pszStatNameLower))
-        return NULL;
+#ifdef _WIN32
+        /* rename() does not replace an existing file on Windows */
+        if (FALSE == MoveFileExA (szTempFilename, pszFilename, MOVEFILE_REPLACE_EXISTING))
+            return false;
+#else
+        if (rename (szTempFilename, pszFilename))
+            return false;
+#endif
 
-    auto it = g_DominoStatDescription.find (pszStatNameLower);
-    if (it != g_DominoStatDescription.end())
-    {
-        pszDesc = it->second.c_str();
+        return true;
     }
 
-    return pszDesc;
-}
 
+private:
 
-STATUS ProcessStatDocument (DBHANDLE hDb, NOTEID NoteID)
-{
-    STATUS error = NOERROR;
-    NOTEHANDLE hNote = NULLHANDLE;
+    std::string m_Data;
+    std::vector<size_t> m_Slots;
+    bool m_bValueSlots = false;
+};
 
-    char szStatName[MAX_STAT_NAME+1]    = {0};
-    char szUnits[40]                    = {0};
-    char szBuffer[MAX_STAT_DESC*2]      = {0};
-    char szDescription[MAX_STAT_DESC+1] = {0};
 
-    if (NULLHANDLE == hDb)
-        return ERR_MISC_INVALID_ARGS;
+ExpositionBuffer g_StatsOut;
+ExpositionBuffer g_TransOut;
 
-    if (0 == NoteID)
-        return ERR_MISC_INVALID_ARGS;
 
-    error = NSFNoteOpen (hDb, NoteID, 0, &hNote);
+/* Minimal HTTP listener serving the last rendered snapshot on /metrics.
+   The listener thread never calls Notes APIs. It only reads an immutable snapshot, which the
+   add-in thread replaces atomically after each cycle. So a scrape never waits for a collection */
 
-    if (error)
-    {
-        AddInLogMessageText ("%s: Cannot open Statistics note 0x%x in %s", error, g_szTask, NoteID, g_szEvents4);
-        goto Done;
-    }
+/* Clients are served on their own short-lived threads, so a slow or idle connection does not delay other scrapes.
+   Connections above the limit are answered with 503 on the listener thread */
 
-    NSFItemGetText (hNote, "StatName",    szStatName,    sizeofstring (szStatName));
-    NSFItemGetText (hNote, "Description", szDescription, sizeofstring (szDescription));
-    NSFItemGetText (hNote, "Units",       szUnits,       sizeofstring (szUnits));
+#define DOMPROM_HTTP_MAX_CLIENTS       8
+#define DOMPROM_HTTP_CLIENT_TIMEOUT_SEC 5
 
-    if (*szUnits)
-    {
-        snprintf (szBuffer, sizeof (szBuffer), "%s [%s]", szDescription, szUnits);
-        AddStatDescriptionToTable (szStatName, szBuffer);
-    }
-    else
-    {
-        AddStatDescriptionToTable (szStatName, szDescription);
-    }
+class MetricsHttpServer
+{
 
-Done:
+public:
 
-    if (hNote)
+    ~MetricsHttpServer ()
     {
-        NSFNoteClose (hNote);
-        hNote = NULLHANDLE;
+        Stop();
     }
 
-    return error;
+    bool Start (WORD wPort, const char *pszBindAddress)
+    {
+        struct sockaddr_in Addr = {0};
+        int    On = 1;
 
-}
+        Stop();
 
-#ifdef _WIN32
-static uint64_t TickMs(void)
-{
-    LARGE_INTEGER liFreq = {0};
-    LARGE_INTEGER liCtr  = {0};
+        if (0 == wPort)
+            return false;
 
-    if (QueryPerformanceFrequency(&liFreq) && liFreq.QuadPart != 0 &&
-        QueryPerformanceCounter(&liCtr))
-    {
-        return (uint64_t)((liCtr.QuadPart * 1000ULL) / liFreq.QuadPart);
-    }
-    return (uint64_t)GetTickCount64();
-}
-#else  /* UNIX / Linux */
-static uint64_t TickMs(void)
-{
-    struct timespec tsNow = {0};
+#ifdef _WIN32
+        WSADATA WsaData = {0};
 
-    clock_gettime(CLOCK_MONOTONIC, &tsNow);
-    return (uint64_t)((uint64_t)tsNow.tv_sec * 1000ULL +
-                   (uint64_t)tsNow.tv_nsec / 1000000ULL);
-}
+        if (WSAStartup (MAKEWORD (2, 2), &WsaData))
+            return false;
 #endif
 
+        Addr.sin_family      = AF_INET;
+        Addr.sin_port        = htons (wPort);
+        Addr.sin_addr.s_addr = htonl (INADDR_ANY);
 
-STATUS GetServerResponseTimeMsec(const char *pszServerName, DWORD *retpdwMsec)
-{
-    STATUS   error       = NOERROR;
-    DBHANDLE hDb         = NULLHANDLE;
-    uint64_t qwTickStart = 0;
-    uint64_t qwTickEnd   = 0;
-    char     szFullDbPath [MAXPATH + 1] = {0};
+        if (false == IsNullStr (pszBindAddress))
+        {
+            if (1 != inet_pton (AF_INET, pszBindAddress, &Addr.sin_addr))
+            {
+                AddInLogMessageText ("%s: Invalid HTTP bind address: %s", 0, g_szTask, pszBindAddress);
+                goto Error;
+            }
+        }
 
-    if (retpdwMsec)
-        *retpdwMsec = 0;
+        m_Socket = socket (AF_INET, SOCK_STREAM, 0);
 
-    error = OSPathNetConstruct(NULL, (pszServerName)? pszServerName : "", "names.nsf", szFullDbPath);
+        if (INVALID_SOCKET == m_Socket)
+        {
+            AddInLogMessageText ("%s: Cannot create HTTP listener socket", 0, g_szTask);
+            goto Error;
+        }
 
-    if (error)
-        goto Done;
+        setsockopt (m_Socket, SOL_SOCKET, SO_REUSEADDR, (const char *) &On, sizeof (On));
 
-    qwTickStart = TickMs();
-    error = NSFDbOpen(szFullDbPath, &hDb);
-    qwTickEnd = TickMs();
+        if (bind (m_Socket, (struct sockaddr *) &Addr, sizeof (Addr)) || listen (m_Socket, 16))
+        {
+            AddInLogMessageText ("%s: Cannot listen on HTTP port %u", 0, g_szTask, wPort);
+            CloseSocket (m_Socket);
+            m_Socket = INVALID_SOCKET;
+            goto Error;
+        }
 
-    if (error)
-        goto Done;
+        m_bStop   = false;
+        m_Thread  = std::thread (&MetricsHttpServer::Listen, this);
+        m_wPort   = wPort;
+        m_bActive = true;
 
-    if (retpdwMsec)
-        *retpdwMsec = (DWORD)(qwTickEnd - qwTickStart);
+        AddInLogMessageText ("%s: Serving metrics on HTTP port %u", 0, g_szTask, wPort);
+        return true;
 
-Done:
+Error:
 
-    if (hDb)
+#ifdef _WIN32
+        /* Balances the WSAStartup above, Stop only cleans up a running listener */
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    void Stop ()
     {
-        /* Close session allows to test including authenticaiton but causes a new session log entry quite often */
-        if (g_ProbeCloseSession)
-            NSFDbCloseSession(hDb);
-        else
-            NSFDbClose(hDb);
+        if (false == m_Thread.joinable())
+            return;
 
-        hDb = NULLHANDLE;
-    }
+        m_bActive = false;
+        m_bStop   = true;
+        m_Thread.join();
 
-    return error;
-}
+        /* Client threads end after their socket timeouts at the latest */
+        {
+            std::unique_lock<std::mutex> Lock (m_ClientMutex);
+            m_ClientDone.wait (Lock, [this] { return 0 == m_dwClients; });
+        }
 
+        CloseSocket (m_Socket);
+        m_Socket = INVALID_SOCKET;
+        m_wPort  = 0;
 
-STATUS GetServerPingLatency (const char *pszServerName, DWORD *retpdwMsec)
-{
-    STATUS error  = NOERROR;
-    DWORD  dwMsec = 0;
-    DWORD  dwIndex = 0;
-    DWORD  dwClientToServerMS = 0;
-    DWORD  dwServerToClientMS = 0;
-    WORD   wServerVersion     = 0;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
 
-    if (retpdwMsec)
-        *retpdwMsec = 0;
+    WORD GetPort () const
+    {
+        return m_wPort;
+    }
 
-    if (IsNullStr (pszServerName))
+    // Called on the snapshot writer thread. Statistics and transactions are rendered at different intervals
+    void PublishStats (const ExpositionBuffer &Stats)
     {
-        return ERR_MISC_INVALID_ARGS;
+        m_Stats.assign (Stats.Data(), Stats.Size());
+        Publish();
     }
 
-    error = NSPingServer(const_cast<char *>(pszServerName), &dwIndex, NULL);
+    void PublishTrans (const ExpositionBuffer &Trans)
+    {
+        m_Trans.assign (Trans.Data(), Trans.Size());
+        Publish();
+    }
 
-    if (error)
-        goto Done;
+    void ClearTrans ()
+    {
+        m_Trans.clear();
+        Publish();
+    }
 
-    error = NSFGetServerLatency((char *) pszServerName, 0, &dwClientToServerMS, &dwServerToClientMS, &wServerVersion);
 
-    dwMsec = dwClientToServerMS + dwServerToClientMS;
+private:
 
-    if (retpdwMsec)
-        *retpdwMsec = dwMsec;
+    void Publish ()
+    {
+        if (false == m_bActive)
+            return;
 
-Done:
+        std::shared_ptr<const std::string> pSnapshot = std::make_shared<const std::string> (m_Stats + m_Trans);
+        std::atomic_store (&m_pSnapshot, pSnapshot);
+    }
 
-    return error;
-}
+    void Listen ()
+    {
+        SOCKET_TYPE Client = INVALID_SOCKET;
+        fd_set ReadSet;
+        struct timeval Timeout = {0};
 
+        while (false == m_bStop)
+        {
+            FD_ZERO (&ReadSet);
+            FD_SET (m_Socket, &ReadSet);
 
-STATUS ReadStatisticsInfoFromEvents4()
-{
-    STATUS   error        = NOERROR;
-    DBHANDLE hDb          = NULLHANDLE;
-    DHANDLE  hNoteIDTable = NULLHANDLE;
+            /* Wake up once a second to check for shutdown */
+            Timeout.tv_sec  = 1;
+            Timeout.tv_usec = 0;
 
-    NOTEID   NoteID    = 0;
-    DWORD    dwEntries = 0;
-    BOOL     bFound    = FALSE;
+            if (select ((int) m_Socket + 1, &ReadSet, NULL, NULL, &Timeout) <= 0)
+                continue;
 
-    error = NSFDbOpen (g_szEvents4, &hDb);
+            Client = accept (m_Socket, NULL, NULL);
 
-    if (error)
-    {
-        AddInLogMessageText ("%s: Cannot open %s", error, g_szTask, g_szEvents4);
-        goto Done;
-    }
+            if (INVALID_SOCKET == Client)
+                continue;
 
-    dwEntries = GetDocsByFormula (hDb, "+(Form = {Statistic})", "Search statistics descriptions in events4.nsf", &hNoteIDTable);
+            SetClientTimeouts (Client);
 
-    if (g_wLogLevel)
-        AddInLogMessageText ("%s: Statistics descriptions found in %s: %u", 0, g_szTask, g_szEvents4, dwEntries);
+            {
+                std::lock_guard<std::mutex> Lock (m_ClientMutex);
 
-    if (0 == dwEntries)
-    {
-        goto Done;
-    }
+                if (m_dwClients < DOMPROM_HTTP_MAX_CLIENTS)
+                {
+                    m_dwClients++;
+                    Client = StartClientThread (Client);
+                }
+            }
 
-    bFound = IDScan (hNoteIDTable, TRUE, &NoteID);
+            if (INVALID_SOCKET == Client)
+                continue;
 
-    while (bFound)
-    {
-        error = ProcessStatDocument (hDb, NoteID);
-        bFound = IDScan (hNoteIDTable, FALSE, &NoteID);
+            SendAll (Client, "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            CloseSocket (Client);
+        }
     }
 
-Done:
+    /* Returns INVALID_SOCKET if the client thread owns the socket. Called with the client mutex held */
+    SOCKET_TYPE StartClientThread (SOCKET_TYPE Client)
+    {
+        try
+        {
+            std::thread (&MetricsHttpServer::ClientThread, this, Client).detach();
+            return INVALID_SOCKET;
+        }
+        catch (const std::system_error &)
+        {
+            m_dwClients--;
+            return Client;
+        }
+    }
 
-    if (hNoteIDTable)
+    void ClientThread (SOCKET_TYPE Client)
     {
-        IDDestroyTable(hNoteIDTable);
-        hNoteIDTable = NULLHANDLE;
+        ServeClient (Client);
+        CloseSocket (Client);
+
+        std::lock_guard<std::mutex> Lock (m_ClientMutex);
+
+        m_dwClients--;
+        m_ClientDone.notify_all();
     }
 
-    if (hDb)
+    static void SetClientTimeouts (SOCKET_TYPE Client)
     {
-        NSFDbClose (hDb);
-        hDb = NULLHANDLE;
+#ifdef _WIN32
+        DWORD dwTimeoutMsec = DOMPROM_HTTP_CLIENT_TIMEOUT_SEC * 1000;
+        setsockopt (Client, SOL_SOCKET, SO_RCVTIMEO, (const char *) &dwTimeoutMsec, sizeof (dwTimeoutMsec));
+        setsockopt (Client, SOL_SOCKET, SO_SNDTIMEO, (const char *) &dwTimeoutMsec, sizeof (dwTimeoutMsec));
+#else
+        struct timeval Timeout = {DOMPROM_HTTP_CLIENT_TIMEOUT_SEC, 0};
+        setsockopt (Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof (Timeout));
+        setsockopt (Client, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof (Timeout));
+#endif
     }
 
-    return error;
-}
+    void ServeClient (SOCKET_TYPE Client)
+    {
+        char   szRequest[2048] = {0};
+        char   szHeader[256]   = {0};
+        size_t Received = 0;
+        SOCKET_IO_TYPE ret = 0;
 
+        /* Only the request line is evaluated. Read until the end of the header or the buffer is full */
+        while (Received < sizeof (szRequest) - 1)
+        {
+            ret = recv (Client, szRequest + Received, (int) (sizeof (szRequest) - 1 - Received), 0);
 
-STATUS LNCALLBACK DomExportTraverse (void *pContext, char *pszFacility, char *pszStatName, WORD wValueType, void *pValue)
-{
-    STATUS error = NOERROR;
-    int    len   = 0;
+            if (ret <= 0)
+                break;
 
-    char   szDescription[MAX_STAT_DESC+1] = {0};
-    char   szMetric[1024]      = {0};
-    char   szMetricLower[1024] = {0};
-    char   szValue[1024]       = {0};
+            Received += (size_t) ret;
+            szRequest[Received] = '\0';
 
-    const char *pszDescription = NULL;
+            if (strstr (szRequest, "\r\n\r\n") || strstr (szRequest, "\n\n"))
+                break;
+        }
 
-    CONTEXT_STRUCT_TYPE *pStats = (CONTEXT_STRUCT_TYPE*)pContext;
+        if ((0 != strncmp (szRequest, "GET /metrics ", 13)) && (0 != strncmp (szRequest, "GET /metrics?", 13)))
+        {
+            SendAll (Client, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
 
-    if (NULL == pStats)
-        return ERR_MISC_INVALID_ARGS;
+        std::shared_ptr<const std::string> pSnapshot = std::atomic_load (&m_pSnapshot);
 
-    if (NULL == pStats->fp)
-        return ERR_MISC_INVALID_ARGS;
+        if (!pSnapshot)
+        {
+            SendAll (Client, "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
 
-    pStats->CountAll++;
+        snprintf (szHeader, sizeof (szHeader),
+                  "HTTP/1.0 200 OK\r\n"
+                  "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                  "Content-Length: %zu\r\n"
+                  "Connection: close\r\n\r\n",
+                  pSnapshot->size());
 
-    if (NULL == pszFacility)
-    {
-        pStats->CountInvalid++;
-        return ERR_MISC_INVALID_ARGS;
+        if (SendAll (Client, szHeader))
+            SendAll (Client, pSnapshot->data(), pSnapshot->size());
     }
 
-    if (NULL == pszStatName)
+    static bool SendAll (SOCKET_TYPE Client, const char *pszData)
     {
-        pStats->CountInvalid++;
-        return ERR_MISC_INVALID_ARGS;
+        return SendAll (Client, pszData, strlen (pszData));
     }
 
-    if (NULL == pValue)
-        return NOERROR;
-
-    /* Exclude Domino Health stats because they are maintained in this application */
-    if (g_wWriteDominoHealthStats)
+    static bool SendAll (SOCKET_TYPE Client, const char *pData, size_t len)
     {
-        if (0 == CompareCaseInsensitive (pszFacility, g_szDominoHealth))
-        {
-            return NOERROR;
-        }
-    }
-
-    snprintf (szMetric, sizeof (szMetric), "%s.%s", pszFacility, pszStatName);
+        SOCKET_IO_TYPE ret = 0;
 
-    OSTranslate32 (OS_TRANSLATE_UPPER_TO_LOWER, szMetric, MAXDWORD, szMetricLower, sizeof (szMetricLower));
+        while (len)
+        {
+            ret = send (Client, pData, (int) std::min (len, (size_t) 0x40000000), SEND_FLAGS);
 
-    if (g_StatsFilter.ShouldExclude (szMetricLower))
-    {
-        return NOERROR;
-    }
+            if (ret <= 0)
+                return false;
 
-    /* Compare if the statistic case insensitive was written before and log case sensitive */
-    if (RegisterDominoStat (szMetricLower, 0))
-    {
-        if (g_wLogLevel)
-        {
-            AddInLogMessageText ("%s: Duplicate Domino statistic found for: %s", 0, g_szTask, szMetric);
+            pData += ret;
+            len   -= (size_t) ret;
         }
-        return NOERROR;
+
+        return true;
     }
 
-    /* Use the combined and converted metric for statistic name conversion */
-    ReplaceChars (szMetric);
+    SOCKET_TYPE       m_Socket = INVALID_SOCKET;
+    std::atomic<WORD> m_wPort {0};   // Read by the collector threads
+    std::atomic<bool> m_bStop {false};
+    std::atomic<bool> m_bActive {false};
+    std::thread       m_Thread;
 
-    pszDescription = GetStatDescriptionFromTable (szMetricLower);
+    std::mutex              m_ClientMutex;
+    std::condition_variable m_ClientDone;
+    DWORD                   m_dwClients = 0;
 
-    if (pszDescription)
-        snprintf (szDescription, sizeof (szDescription), "%s", pszDescription);
-    else
-        snprintf (szDescription, sizeof (szDescription), "Domino Stat - %s.%s", pszFacility, pszStatName);
+    std::string m_Stats;
+    std::string m_Trans;
 
-    switch (wValueType)
-    {
-        case VT_TEXT:
+    std::shared_ptr<const std::string> m_pSnapshot;
+};
 
-            pStats->CountText++;
 
-            if (0 == CompareCaseInsensitive (szMetric, "DominoBackup_LastBackup_DB_Status"))
-            {
-                WriteStatsEntryToFile (pStats->fp, g_szDominoHealth, "LastBackup_DB_Status", szDescription, CompareCaseInsensitive ((const char *)pValue, "Successful") ? 1 : 0);
-            }
-            else if (0 == CompareCaseInsensitive (szMetric, "DominoBackup_LastBackup_TL_Status"))
-            {
-                WriteStatsEntryToFile (pStats->fp, g_szDominoHealth, "LastBackup_TL_Status", szDescription, CompareCaseInsensitive ((const char *)pValue, "Successful") ? 1 : 0);
-            }
-            else if (0 == CompareCaseInsensitive (szMetric, "DominoBackup_LastBackup_TL_LastLogExtend"))
-            {
-                WriteStatsEntryToFile (pStats->fp, g_szDominoHealth, "LastBackup_TL_LastLogExtendNumber", szDescription, CompareCaseInsensitive ((const char *)pValue, "Successful") ? 1 : 0);
-            }
+MetricsHttpServer g_HttpServer;
 
-            if (pStats->bExportText)
-            {
-                snprintf (szValue, sizeof (szValue), "%s", (char *)pValue);
 
-                TruncateAtFirstBlank (szValue);
-                WriteStatsEntryToFile (pStats->fp, pStats->szPrefix, szMetric, szDescription, szValue);
-            }
-            break;
+/* Prometheus remote_write push sink (notes.ini domprom_remote_write_url).
+   Each snapshot is converted into WriteRequest batches (protobuf, snappy block format) on the add-in thread and appended
+   to a write-ahead log. A push thread sends the records in order and removes them after the receiver accepted them.
+   While the receiver is down, records stay in the WAL and are retried with exponential backoff, also across restarts */
 
-        case VT_LONG:
+#define DOMPROM_REMOTE_WRITE_DEFAULT_BATCH     2000
+#define DOMPROM_REMOTE_WRITE_DEFAULT_WAL_MB    64
+#define DOMPROM_REMOTE_WRITE_TIMEOUT_SEC       10
+#define DOMPROM_REMOTE_WRITE_MIN_BACKOFF_MSEC  1000
+#define DOMPROM_REMOTE_WRITE_MAX_BACKOFF_MSEC  60000
+#define DOMPROM_REMOTE_WRITE_WAL_MAGIC         "DPWAL001"
+#define DOMPROM_REMOTE_WRITE_WAL_HEADER        16
+#define DOMPROM_REMOTE_WRITE_COMPACT_BYTES     (1024 * 1024)
 
-            if (0 == CompareCaseInsensitive (szMetric, "Server_MailBoxes"))
-            {
-                if (*(LONG *) pValue)
-                {
-                    g_MailBoxes = *(WORD *) pValue;
-                }
-            }
+/* Snappy block format compressor (greedy hash based matching, 64 KB blocks like the reference implementation) */
 
-            pStats->CountLong++;
+static void SnappyAppendVarint (std::string &Out, uint64_t Value)
+{
+    while (Value >= 0x80)
+    {
+        Out.push_back ((char) ((Value & 0x7F) | 0x80));
+        Value >>= 7;
+    }
 
-            if (pStats->bExportLong)
-            {
-                WriteStatsEntryToFile (pStats->fp, pStats->szPrefix, szMetric, szDescription, *(LONG *) pValue);
-            }
-            break;
+    Out.push_back ((char) Value);
+}
 
-        case VT_NUMBER:
+static void SnappyEmitLiteral (std::string &Out, const char *pData, size_t Len)
+{
+    size_t n = Len - 1;
 
-            pStats->CountNumber++;
+    if (n < 60)
+    {
+        Out.push_back ((char) (n << 2));
+    }
+    else if (n < 0x100)
+    {
+        Out.push_back ((char) (60 << 2));
+        Out.push_back ((char) n);
+    }
+    else
+    {
+        Out.push_back ((char) (61 << 2));
+        Out.push_back ((char) (n & 0xFF));
+        Out.push_back ((char) (n >> 8));
+    }
 
-            {
-                double val = *(NUMBER *)pValue;
+    Out.append (pData, Len);
+}
 
-                /* Scale to 3 decimal fixed-point */
-                int64_t scaled    = (int64_t)(val * 1000.0 + (val >= 0 ? 0.5 : -0.5));
-                int64_t int_part  = scaled / 1000;
-                int64_t frac_part = llabs(scaled % 1000);
+static void SnappyEmitCopy (std::string &Out, size_t Offset, size_t Len)
+{
+    /* Copies with 2 byte offset encode up to 64 bytes */
+    while (Len > 0)
+    {
+        size_t n = std::min (Len, (size_t) 64);
 
-                /* Format into string buffer */
-                len = snprintf(szValue, sizeof(szValue), "%" PRId64 ".%03" PRId64, int_part, frac_part);
+        // Don't leave a remainder below the minimum copy length of 4
+        if ((Len > 64) && (Len - 64 < 4))
+            n = 60;
 
-                if (len <= 0)
-                {
-                    pStats->CountInvalid++;
-                }
-                else
-                {
-                    WriteStatsEntryToFile (pStats->fp, pStats->szPrefix, szMetric, szDescription, szValue);
-                }
-            }
+        Out.push_back ((char) (((n - 1) << 2) | 2));
+        Out.push_back ((char) (Offset & 0xFF));
+        Out.push_back ((char) (Offset >> 8));
 
-            break;
+        Len -= n;
+    }
+}
 
-        case VT_TIMEDATE:
+static void SnappyCompress (const char *pData, size_t Len, std::string &Out)
+{
+    const  size_t BlockSize = 65536;
+    const  int    HashBits  = 14;
+    uint16_t Table[1 << HashBits];
 
-            pStats->CountTime++;
+    Out.clear();
+    SnappyAppendVarint (Out, Len);
 
-            if (0 == CompareCaseInsensitive (szMetric, "DominoBackup_LastBackup_DB_Time"))
-            {
-                WriteTimedateStat (pStats->fp, "LastBackup_DB_Time", szDescription, pValue);
-            }
+    for (size_t BlockStart = 0; BlockStart < Len; BlockStart += BlockSize)
+    {
+        const char *pBlock = pData + BlockStart;
+        size_t BlockLen    = std::min (BlockSize, Len - BlockStart);
+        size_t Pos         = 0;
+        size_t Literal     = 0;
+        uint32_t Cur       = 0;
+        uint32_t Hash      = 0;
+        size_t Candidate   = 0;
+        size_t MatchLen    = 0;
 
-            else if (0 == CompareCaseInsensitive (szMetric, "DominoBackup_LastBackup_TL_Time"))
-            {
-                WriteTimedateStat (pStats->fp, "LastBackup_TL_Time", szDescription, pValue);
-            }
+        memset (Table, 0, sizeof (Table));
 
-            else if (0 == CompareCaseInsensitive (szMetric, "Server_Time_Start"))
-            {
-                WriteTimedateStat (pStats->fp, "Server_Time_Start", szDescription, pValue);
-            }
+        while (BlockLen >= 4 && Pos + 4 <= BlockLen)
+        {
+            memcpy (&Cur, pBlock + Pos, 4);
+            Hash = (Cur * 0x1E35A7BD) >> (32 - HashBits);
+            Candidate = Table[Hash];
+            Table[Hash] = (uint16_t) Pos;
 
-            if (pStats->bExportTime)
+            if ((Candidate < Pos) && (0 == memcmp (pBlock + Candidate, pBlock + Pos, 4)))
             {
-                if (GetNotesTimeDateSting ((TIMEDATE *)pValue, sizeof (szValue), szValue))
-                {
-                    pStats->CountInvalid++;
-                }
-                else
-                {
-                    WriteStatsEntryToFile (pStats->fp, pStats->szPrefix, szMetric, szDescription, (const char*) szValue);
-                }
-            }
-            break;
+                if (Pos > Literal)
+                    SnappyEmitLiteral (Out, pBlock + Literal, Pos - Literal);
 
-        default:
-
-            pStats->CountUnknown++;
-            break;
+                MatchLen = 4;
 
-    } /* switch */
+                while ((Pos + MatchLen < BlockLen) && (pBlock[Candidate + MatchLen] == pBlock[Pos + MatchLen]))
+                    MatchLen++;
 
-    return error;
-}
+                SnappyEmitCopy (Out, Pos - Candidate, MatchLen);
 
+                Pos    += MatchLen;
+                Literal = Pos;
+                continue;
+            }
 
-void AddDiskStats (const char *pszHealthPrefix, const char *pszComponent, const char *pszPathName, uint64_t TotalBytes, uint64_t FreeBytes)
-{
-    char szBuffer[1024] = {0};
+            Pos++;
+        }
 
-    // total bytes
-    snprintf(
-        szBuffer,
-        sizeof (szBuffer),
-        "%s_disk_total_bytes{component=\"%s\", path=\"%s\"} %" PRIu64,
-        pszHealthPrefix,
-        pszComponent,
-        pszPathName,
-        TotalBytes);
+        if (BlockLen > Literal)
+            SnappyEmitLiteral (Out, pBlock + Literal, BlockLen - Literal);
+    }
+}
 
-    g_ListDiskTotalStats.emplace_back (szBuffer);
 
-    // free bytes
-    snprintf(
-        szBuffer,
-        sizeof(szBuffer),
-        "%s_disk_free_bytes{component=\"%s\", path=\"%s\"} %" PRIu64,
-        pszHealthPrefix,
-        pszComponent,
-        pszPathName,
-        FreeBytes);
+/* Protobuf wire format for prometheus.WriteRequest, TimeSeries, Label and Sample */
 
-    g_ListDiskFreeStats.emplace_back (szBuffer);
+static void PbAppendTag (std::string &Out, uint32_t Field, uint32_t WireType)
+{
+    SnappyAppendVarint (Out, (Field << 3) | WireType);
 }
 
-STATUS ProcessSingleDiskStat (const char *pszPathName, const char *pszComponent)
+static void PbAppendString (std::string &Out, uint32_t Field, const char *pData, size_t Len)
 {
-    bool     bFound     = false;
-    uint64_t TotalBytes = 0;
-    uint64_t FreeBytes  = 0;
-    char     szMetric[1024] = {0};
+    PbAppendTag (Out, Field, 2);
+    SnappyAppendVarint (Out, Len);
+    Out.append (pData, Len);
+}
 
-    if (IsNullStr (pszPathName))
-        return ERR_MISC_INVALID_ARGS;
+static void PbAppendMessage (std::string &Out, uint32_t Field, const std::string &Message)
+{
+    PbAppendString (Out, Field, Message.data(), Message.size());
+}
 
-    if (IsNullStr (pszComponent))
-        return ERR_MISC_INVALID_ARGS;
 
-    bFound = GetDiskUsageFrom (pszPathName, &TotalBytes, &FreeBytes);
+static uint32_t Crc32 (const char *pData, size_t Len)
+{
+    uint32_t Crc = 0xFFFFFFFF;
 
-    if (g_wWriteDominoHealthStats)
+    while (Len--)
     {
-        snprintf (szMetric, sizeof (szMetric), "Disk.%s.Total_MB", pszComponent);
-        StatUpdateNumberBytesInMB (g_szDominoHealth, szMetric, TotalBytes);
-
-        snprintf (szMetric, sizeof (szMetric), "Disk.%s.Free_MB", pszComponent);
-        StatUpdateNumberBytesInMB (g_szDominoHealth, szMetric, FreeBytes);
-
-        snprintf (szMetric, sizeof (szMetric), "Disk.%s.Path", pszComponent);
-        StatUpdateText (g_szDominoHealth, szMetric, pszPathName);
-    }
+        Crc ^= (unsigned char) *pData++;
 
-    if (false == bFound)
-    {
-        return NOERROR;
+        for (int Bit = 0; Bit < 8; Bit++)
+            Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
     }
 
-    AddDiskStats (g_szDominoHealth, pszComponent, pszPathName, TotalBytes, FreeBytes);
-
-    return NOERROR;
+    return ~Crc;
 }
 
 
-STATUS ProcessDiskStats (FILE *fp)
+struct REMOTE_WRITE_LABEL
 {
-    if (NULL == fp)
-        return ERR_MISC_INVALID_ARGS;
-
-    ProcessSingleDiskStat (g_szDataDir,     DOMPROM_DISK_COMPONENT_NOTESDATA);
-    ProcessSingleDiskStat (g_szDirTranslog, DOMPROM_DISK_COMPONENT_TRANSLOG);
-    ProcessSingleDiskStat (g_szDirDAOS,     DOMPROM_DISK_COMPONENT_DAOS);
-    ProcessSingleDiskStat (g_szDirNIF,      DOMPROM_DISK_COMPONENT_NIF);
-    ProcessSingleDiskStat (g_szDirFT,       DOMPROM_DISK_COMPONENT_FT);
-    ProcessSingleDiskStat (g_szNotesTemp,   DOMPROM_DISK_COMPONENT_NOTES_TEMP);
-    ProcessSingleDiskStat (g_szViewRebuild, DOMPROM_DISK_COMPONENT_VIEW_REBUILD);
-    ProcessSingleDiskStat (g_szNotesLogDir, DOMPROM_DISK_COMPONENT_NOTES_LOG_DIR);
-
-    WriteHelpAndType (fp, g_szDominoHealth, "disk_total_bytes", NULL, "Total disk size in bytes");
+    std::string Name;
+    std::string Value;
+};
 
-    for (const auto &pszLine : g_ListDiskTotalStats)
-    {
-        fprintf (fp, "%s\n", pszLine.c_str());
-    }
 
-    g_ListDiskTotalStats.clear();
+class RemoteWriteSink
+{
 
-    WriteHelpAndType (fp, g_szDominoHealth, "disk_free_bytes", NULL, "Free disk space in bytes");
+public:
 
-    for (const auto &pszLine : g_ListDiskFreeStats)
+    ~RemoteWriteSink ()
     {
-        fprintf (fp, "%s\n", pszLine.c_str());
+        Stop();
     }
 
-    g_ListDiskFreeStats.clear();
-
-    return NOERROR;
-}
-
+    bool Start (const char *pszUrl, const char *pszWalFilename, DWORD dwBatchSamples, DWORD dwWalMaxMB)
+    {
+        Stop();
 
-STATUS ProcessDaosStats (FILE *fp)
-{
-    if (NULL == fp)
-        return ERR_MISC_INVALID_ARGS;
+        std::lock_guard<std::mutex> ApiLock (m_ApiMutex);
 
-    if (g_wWriteDominoHealthStats)
-    {
-        StatUpdateNumber (g_szDominoHealth, "DAOS.Status", g_StatusDAOS);
-        StatUpdateNumber (g_szDominoHealth, "DAOS.Catalog.Status", g_dwDAOSCatalogStatus);
-    }
+        if (false == ParseUrl (pszUrl))
+        {
+            AddInLogMessageText ("%s: Invalid remote write URL (only http:// is supported): %s", 0, g_szTask, pszUrl);
+            return false;
+        }
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "daos_status", "Domino DAOS enabled", g_StatusDAOS);
+        m_WalFilename   = pszWalFilename;
+        m_BatchSamples  = dwBatchSamples ? dwBatchSamples : DOMPROM_REMOTE_WRITE_DEFAULT_BATCH;
+        m_WalMaxBytes   = (uint64_t) (dwWalMaxMB ? dwWalMaxMB : DOMPROM_REMOTE_WRITE_DEFAULT_WAL_MB) * 1024 * 1024;
 
-    if (g_StatusDAOS)
-    {
-        WriteStatsEntryToFile (fp, g_szDominoHealth, "daos_catalog_status",     "DAOS Catalog status (0=Unavailable, 1=Synced, 2=Needs Resync, 3=Resyncing, 4=Readonly, 5=Rebuilding)", g_dwDAOSCatalogStatus);
-        WriteStatsEntryToFile (fp, g_szDominoHealth, "daos_catalog_not_synced", "Domino DAOS Catalog status (0 = in sync)", (1 == g_dwDAOSCatalogStatus) ? 0:1);
-    }
+        if (false == OpenWal())
+        {
+            AddInLogMessageText ("%s: Cannot open remote write WAL: %s", 0, g_szTask, m_WalFilename.c_str());
+            return false;
+        }
 
-    return NOERROR;
-}
+#ifdef _WIN32
+        WSADATA WsaData = {0};
 
+        if (WSAStartup (MAKEWORD (2, 2), &WsaData))
+        {
+            CloseWal();
+            return false;
+        }
+#endif
 
-int HasFileExtension (const char *pszFilename, const char *pszExt)
-{
-    size_t len_f = strlen (pszFilename);
-    size_t len_e = strlen (pszExt);
+        m_bStop   = false;
+        m_Thread  = std::thread (&RemoteWriteSink::PushThread, this);
+        m_bActive = true;
 
-    if (len_f < len_e)
-        return 0;
+        AddInLogMessageText ("%s: Remote write to %s (pending: %u bytes)", 0, g_szTask, pszUrl, (DWORD) PendingBytes());
+        return true;
+    }
 
-    return strcmp (pszFilename + len_f - len_e, pszExt) == 0;
-}
+    void Stop ()
+    {
+        std::lock_guard<std::mutex> ApiLock (m_ApiMutex);
 
+        if (false == m_Thread.joinable())
+            return;
 
-STATUS CheckTransLogExtend (const char *pszTranslogExtend)
-{
-    size_t num = 0;
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
+            m_bStop   = true;
+            m_bActive = false;
+        }
 
-    if (NULL == pszTranslogExtend)
-        return ERR_MISC_INVALID_ARGS;
+        m_Wakeup.notify_all();
+        m_Thread.join();
 
-    num = GetTranslogExtendNumber (pszTranslogExtend);
+        /* Records not sent yet stay in the WAL for the next start */
+        CloseWal();
 
-    if (0 == g_TranslogMinLogExtend)
-    {
-        g_TranslogMinLogExtend = num;
-    }
-    else
-    {
-        if (num < g_TranslogMinLogExtend)
-            g_TranslogMinLogExtend = num;
+#ifdef _WIN32
+        WSACleanup();
+#endif
     }
 
-    if (0 == g_TranslogMaxLogExtend)
+    bool IsActive () const
     {
-        g_TranslogMaxLogExtend = num;
-    }
-    else
-    {
-        if (num > g_TranslogMaxLogExtend)
-            g_TranslogMaxLogExtend = num;
+        return m_bActive;
     }
 
-    return NOERROR;
-}
+    /* Called on the snapshot writer thread after a snapshot was rendered */
 
+    void Enqueue (const ExpositionBuffer &Snapshot)
+    {
+        std::lock_guard<std::mutex> ApiLock (m_ApiMutex);
 
-#ifdef _WIN32
+        const char *p    = Snapshot.Data();
+        const char *pEnd = p + Snapshot.Size();
+        const char *pEol = NULL;
+        int64_t  TimestampMsec = 0;
+        DWORD    dwSamples = 0;
 
-size_t CountFilesWithExtension (const char *pszPath, const char *pszExt)
-{
-    char szPattern[MAX_PATH] = {0};
-    size_t count = 0;
-    WIN32_FIND_DATAA FindData;
-    HANDLE hFile = INVALID_HANDLE_VALUE;
+        if (false == IsActive())
+            return;
 
-    snprintf (szPattern, sizeof (szPattern), "%s\\*%s", pszPath, pszExt);
+        TimestampMsec = std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::system_clock::now().time_since_epoch()).count();
 
-    hFile = FindFirstFileA (szPattern, &FindData);
-    if (hFile == INVALID_HANDLE_VALUE)
-        return 0;
+        m_Request.clear();
 
-    do
-    {
-        if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        while (p < pEnd)
         {
-            if (HasFileExtension (FindData.cFileName, pszExt))
+            pEol = (const char *) memchr (p, '\n', pEnd - p);
+
+            if (NULL == pEol)
+                pEol = pEnd;
+
+            if ((pEol > p) && ('#' != *p))
             {
-                CheckTransLogExtend (FindData.cFileName);
-                count++;
+                if (AppendTimeSeries (p, pEol, TimestampMsec))
+                    dwSamples++;
             }
-        }
-    } while (FindNextFileA(hFile, &FindData));
 
-    FindClose(hFile);
-    return count;
-}
+            p = pEol + 1;
 
-#else
+            if (dwSamples >= m_BatchSamples)
+            {
+                AppendRecord();
+                dwSamples = 0;
+            }
+        }
 
-size_t CountFilesWithExtension (const char *pszPath, const char *pszExt)
-{
-    struct dirent *pEntry = NULL;
-    size_t count = 0;
+        if (dwSamples)
+            AppendRecord();
 
-    DIR *pDir = opendir (pszPath);
+        m_Wakeup.notify_all();
+    }
 
-    if (NULL == pDir)
+    uint64_t PendingBytes ()
     {
-        perror("opendir");
-        goto Done;
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        return m_WalSize - m_ReadOffset;
     }
 
-    while ((pEntry = readdir(pDir)) != NULL)
+    uint64_t SentRequests () const
     {
-        if (pEntry->d_type == DT_DIR)
-            continue;
-
-        if (HasFileExtension (pEntry->d_name, pszExt))
-        {
-            CheckTransLogExtend (pEntry->d_name);
-            count++;
-        }
+        return m_Sent;
     }
 
-Done:
+    uint64_t FailedRequests () const
+    {
+        return m_Failed;
+    }
 
-    if (pDir)
+    uint64_t DroppedRequests () const
     {
-        closedir (pDir);
-        pDir = NULL;
+        return m_Dropped;
     }
 
-    return count;
-}
 
-#endif
+private:
 
+    bool ParseUrl (const char *pszUrl)
+    {
+        const char *pHost = NULL;
+        const char *pPath = NULL;
+        const char *pPort = NULL;
 
-STATUS ProcessTranslogStats (FILE *fp)
-{
-    size_t NumTranslogFiles = 0;
+        if (IsNullStr (pszUrl))
+            return false;
 
-    g_TranslogMinLogExtend = 0;
-    g_TranslogMaxLogExtend = 0;
+        if (strncmp (pszUrl, "http://", 7))
+            return false;
 
-    if (NULL == fp)
-        return ERR_MISC_INVALID_ARGS;
+        pHost = pszUrl + 7;
+        pPath = strchr (pHost, '/');
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "translog_style", "Domino Statistic Database.RM.Sys.Log.Type", g_wTranslogLogType);
+        if (NULL == pPath)
+            pPath = pHost + strlen (pHost);
 
-    if (g_wWriteDominoHealthStats)
-    {
-        StatUpdateNumber (g_szDominoHealth, "Translog.Style", g_wTranslogLogType);
-    }
+        pPort = (const char *) memchr (pHost, ':', pPath - pHost);
 
-    if (g_wTranslogLogType != TRANSLOG_STYLE_ARCHIVE)
-    {
-        goto Done;
-    }
+        m_Host.assign (pHost, (pPort ? pPort : pPath) - pHost);
+        m_Port = pPort ? std::string (pPort + 1, pPath - pPort - 1) : std::string ("80");
+        m_Path = *pPath ? pPath : "/";
 
-    if (IsNullStr (g_szDirTranslog))
-    {
-        goto Done;
+        return (false == m_Host.empty()) && (false == m_Port.empty());
     }
 
-    NumTranslogFiles = CountFilesWithExtension (g_szDirTranslog, ".TXN");
+    /* Parses one exposition sample line and appends it as TimeSeries to the current request */
 
-    if (g_wWriteDominoHealthStats)
+    bool AppendTimeSeries (const char *pLine, const char *pEol, int64_t TimestampMsec)
     {
-        StatUpdateNumber (g_szDominoHealth, "Translog.File.Count", NumTranslogFiles);
-        StatUpdateNumber (g_szDominoHealth, "Translog.File.Min",   g_TranslogMinLogExtend);
-        StatUpdateNumber (g_szDominoHealth, "Translog.File.Max",   g_TranslogMaxLogExtend);
-    }
+        const char *p       = pLine;
+        const char *pName   = pLine;
+        const char *pValue  = NULL;
+        char  *pValueEnd    = NULL;
+        char  szValue[MAX_PROM_VALUE+1] = {0};
+        size_t Count  = 0;
+        double Value  = 0;
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "translog_file_count", "Number of current Transaction Log Extends in Translog directory", NumTranslogFiles);
+        while ((p < pEol) && (' ' != *p) && ('{' != *p))
+            p++;
 
-    if (0 == NumTranslogFiles)
-    {
-        goto Done;
-    }
+        if (p == pName)
+            return false;
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "translog_file_min", "Lowest Transaction Log Extend Number in Translog directory", g_TranslogMinLogExtend);
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "translog_file_max", "Highest Transaction Log Extend Number in Translog directory", g_TranslogMaxLogExtend);
+        m_Labels.resize (1);
+        m_Labels[0].Name  = "__name__";
+        m_Labels[0].Value.assign (pName, p - pName);
+        Count = 1;
 
-Done:
+        if ((p < pEol) && ('{' == *p))
+        {
+            p++;
 
-    return NOERROR;
-}
+            while ((p < pEol) && ('}' != *p))
+            {
+                while ((p < pEol) && ((' ' == *p) || (',' == *p)))
+                    p++;
 
+                if ((p >= pEol) || ('}' == *p))
+                    break;
 
-bool ParseSkipToNextLine (const char **ppsz)
-{
-    const char *psz = NULL;
+                if (m_Labels.size() <= Count)
+                    m_Labels.resize (Count + 1);
 
-    if (NULL == ppsz)
-        return false;
+                REMOTE_WRITE_LABEL &Label = m_Labels[Count++];
 
-    psz = *ppsz;
+                Label.Name.clear();
+                Label.Value.clear();
 
-    if (NULL == psz)
-        return false;
+                while ((p < pEol) && ('=' != *p))
+                    Label.Name.push_back (*p++);
 
-    if ('\0' == *psz)
-        return false;
+                if ((p + 1 >= pEol) || ('"' != p[1]))
+                    return false;
 
-    /* find line break */
-    while (*psz)
-    {
-        if (*psz < 32)
-            break;
-        psz++;
-    }
+                p += 2;
 
-    /* skip over line breaks */
-    while (*psz)
-    {
-        if (*psz >= 32)
-            break;
-        psz++;
-    }
+                while ((p < pEol) && ('"' != *p))
+                {
+                    if (('\\' == *p) && (p + 1 < pEol))
+                    {
+                        p++;
+                        Label.Value.push_back (('n' == *p) ? '\n' : *p);
+                    }
+                    else
+                    {
+                        Label.Value.push_back (*p);
+                    }
 
-    *ppsz = psz;
-    return true;
-}
+                    p++;
+                }
 
+                if (p >= pEol)
+                    return false;
 
-bool ParseGetString (const char **ppsz, char *pszOut, size_t szOut)
-{
-    const char *psz = NULL;
-    const char *pszEnd = NULL;
+                p++;
+            }
 
-    if (NULL == ppsz)
-        return false;
+            if (p >= pEol)
+                return false;
 
-    psz = *ppsz;
+            p++;
+        }
 
-    if (NULL == psz)
-        return false;
+        while ((p < pEol) && (' ' == *p))
+            p++;
 
-    if ('\0' == *psz)
-        return false;
+        pValue = p;
 
-    while (*psz)
-    {
-        if (psz[0] == ' ' && psz[1] == ' ')
-        {
-            pszEnd = psz;
-            break;
-        }
+        while ((p < pEol) && (' ' != *p))
+            p++;
 
-        psz++;
-    }
+        if ((p == pValue) || ((size_t) (p - pValue) > MAX_PROM_VALUE))
+            return false;
 
-    if (!pszEnd)
-        return false;
+        memcpy (szValue, pValue, p - pValue);
+        szValue[p - pValue] = '\0';
 
-    size_t szLen = (size_t)(pszEnd - *ppsz);
-    if (szLen >= szOut)
-        szLen = szOut - 1;
+        /* Text values are not supported by remote write */
+        Value = strtod (szValue, &pValueEnd);
 
-    memcpy(pszOut, *ppsz, szLen);
-    pszOut[szLen] = '\0';
+        if (*pValueEnd)
+            return false;
 
-    psz = pszEnd;
-    while (*psz == ' ')
-        psz++;
+        /* Labels must be sorted by name, __name__ sorts like any other label */
+        std::sort (m_Labels.begin(), m_Labels.begin() + Count, [] (const REMOTE_WRITE_LABEL &a, const REMOTE_WRITE_LABEL &b)
+        {
+            return a.Name < b.Name;
+        });
 
-    *ppsz = psz;
-    return true;
-}
+        m_Series.clear();
 
-bool ParseGetNumber (const char **ppsz, int *piOut)
-{
-    const char *psz = NULL;
-    char *pszEnd = NULL;
+        for (size_t i = 0; i < Count; i++)
+        {
+            m_Label.clear();
+            PbAppendString (m_Label, 1, m_Labels[i].Name.data(),  m_Labels[i].Name.size());
+            PbAppendString (m_Label, 2, m_Labels[i].Value.data(), m_Labels[i].Value.size());
+            PbAppendMessage (m_Series, 1, m_Label);
+        }
 
-    if (NULL == ppsz)
-        return false;
+        m_Label.clear();
+        PbAppendTag (m_Label, 1, 1);
+        m_Label.append ((const char *) &Value, sizeof (Value)); // Little endian on all supported platforms
+        PbAppendTag (m_Label, 2, 0);
+        SnappyAppendVarint (m_Label, (uint64_t) TimestampMsec);
+        PbAppendMessage (m_Series, 2, m_Label);
 
-    psz = *ppsz;
+        PbAppendMessage (m_Request, 1, m_Series);
+        return true;
+    }
 
-    if (NULL == psz)
-        return false;
+    /* WAL header: magic and the offset of the first record not delivered yet. Updated after each delivered request,
+       so a restart continues after the last request the receiver accepted.
+       WAL record: payload length, CRC32 of the payload, snappy compressed WriteRequest */
 
-    if ('\0' == *psz)
-        return false;
+    void AppendRecord ()
+    {
+        uint32_t Header[2] = {0};
 
-    while (*psz == ' ')
-        psz++;
+        SnappyCompress (m_Request.data(), m_Request.size(), m_Compressed);
+        m_Request.clear();
 
-    if (!isdigit((unsigned char)*psz) && *psz != '-')
-    {
-        return false;
-    }
+        Header[0] = (uint32_t) m_Compressed.size();
+        Header[1] = Crc32 (m_Compressed.data(), m_Compressed.size());
 
-    *piOut = (int)strtol(psz, &pszEnd, 10);
-    *ppsz = pszEnd;
-    return true;
-}
+        std::lock_guard<std::mutex> Lock (m_Mutex);
 
+        if (NULL == m_fpWal)
+            return;
 
-/* ---------- data ---------- */
+        /* Make room by removing the delivered records first */
+        if ((m_WalSize + sizeof (Header) + m_Compressed.size() > m_WalMaxBytes) && (m_ReadOffset > DOMPROM_REMOTE_WRITE_WAL_HEADER))
+            CompactWal();
 
-typedef struct _STAT_ROW {
-    char szName[64];
-    int  iCount;
-    int  iMin;
-    int  iMax;
-    int  iTotal;
-    int  iAverage;
-} STAT_ROW;
+        if (NULL == m_fpWal)
+            return;
 
-/* ---------- parser ---------- */
+        if (m_WalSize + sizeof (Header) + m_Compressed.size() > m_WalMaxBytes)
+        {
+            if (0 == m_Dropped++)
+                AddInLogMessageText ("%s: Remote write WAL full, dropping new samples", 0, g_szTask);
 
-bool ParseOneTransStatsRow (const char **ppsz, STAT_ROW *pRow)
-{
-    if (false == ParseGetString (ppsz, pRow->szName, sizeof(pRow->szName)))
-        return false;
+            return;
+        }
 
-     if (false == ParseGetNumber (ppsz, &pRow->iCount))
-         return false;
+        /* A torn record at the end is overwritten */
+        if (fseek (m_fpWal, (long) m_WalSize, SEEK_SET) ||
+            (1 != fwrite (Header, sizeof (Header), 1, m_fpWal)) ||
+            (1 != fwrite (m_Compressed.data(), m_Compressed.size(), 1, m_fpWal)) ||
+            fflush (m_fpWal))
+        {
+            AddInLogMessageText ("%s: Cannot write remote write WAL: %s", 0, g_szTask, m_WalFilename.c_str());
+            return;
+        }
 
-     if (false == ParseGetNumber (ppsz, &pRow->iMin))
-         return false;
+        m_WalSize += sizeof (Header) + m_Compressed.size();
+    }
 
-     if (false == ParseGetNumber (ppsz, &pRow->iMax))
-         return false;
+    /* Opens an existing WAL and keeps all complete records. A torn record at the end is cut off.
+       Sending continues at the committed offset if it is a record boundary, else all records are sent again */
 
-     if (false == ParseGetNumber (ppsz, &pRow->iTotal))
-         return false;
+    bool OpenWal ()
+    {
+        uint32_t Header[2] = {0};
+        char     szMagic[sizeof (DOMPROM_REMOTE_WRITE_WAL_MAGIC) - 1] = {0};
+        uint64_t Committed = 0;
+        std::string Payload;
 
-     if (false == ParseGetNumber (ppsz, &pRow->iAverage))
-         return false;
+        m_WalSize    = 0;
+        m_ReadOffset = 0;
 
-     ParseSkipToNextLine (ppsz);
-     return true;
-}
+        m_fpWal = fopen (m_WalFilename.c_str(), "r+b");
 
+        if (NULL == m_fpWal)
+            return ResetWal();
 
-static bool AddUnique (std::list<std::string> &list, const char *pszValue)
-{
-    for (const auto &entry : list)
-    {
-        if (entry == pszValue)
+        if ((1 != fread (szMagic, sizeof (szMagic), 1, m_fpWal)) || memcmp (szMagic, DOMPROM_REMOTE_WRITE_WAL_MAGIC, sizeof (szMagic)) ||
+            (1 != fread (&Committed, sizeof (Committed), 1, m_fpWal)))
         {
-            return false; // already present
+            AddInLogMessageText ("%s: Invalid remote write WAL, starting with an empty one: %s", 0, g_szTask, m_WalFilename.c_str());
+            return ResetWal();
         }
-    }
 
-    list.emplace_back (pszValue);
+        m_WalSize    = DOMPROM_REMOTE_WRITE_WAL_HEADER;
+        m_ReadOffset = DOMPROM_REMOTE_WRITE_WAL_HEADER;
 
-    return true;
-}
+        while (1 == fread (Header, sizeof (Header), 1, m_fpWal))
+        {
+            if (Committed == m_WalSize)
+                m_ReadOffset = m_WalSize;
 
+            Payload.resize (Header[0]);
 
-bool AddTransactionStats (const char *pszMetricPrefix, const char *pszOp, int Count, int TotalMs)
-{
-    char szBuffer[1024] = {0};
+            if (Header[0] && (1 != fread (&Payload[0], Header[0], 1, m_fpWal)))
+                break;
 
-    if (IsNullStr (pszMetricPrefix))
-        return false;
+            if (Crc32 (Payload.data(), Payload.size()) != Header[1])
+                break;
 
-    if (IsNullStr (pszOp))
-        return false;
+            m_WalSize += sizeof (Header) + Header[0];
+        }
 
-    // count
-    snprintf(
-        szBuffer,
-        sizeof(szBuffer),
-        "%s_count{op=\"%s\"} %d",
-        pszMetricPrefix,
-        pszOp,
-        Count);
+        if (Committed == m_WalSize)
+            m_ReadOffset = m_WalSize;
 
-    AddUnique (g_ListTransCountStats, szBuffer);
+        if (m_ReadOffset >= m_WalSize)
+            return ResetWal();
 
-    snprintf(
-        szBuffer,
-        sizeof(szBuffer),
-        "%s_total_seconds{op=\"%s\"} %d.%03d",
-        pszMetricPrefix,
-        pszOp,
-        TotalMs / 1000,
-        TotalMs % 1000);
+        return true;
+    }
 
-    AddUnique (g_ListTransTotalSecondsStats, szBuffer);
+    bool ResetWal ()
+    {
+        if (m_fpWal)
+            fclose (m_fpWal);
 
-    return true;
-}
+        m_fpWal      = fopen (m_WalFilename.c_str(), "w+b");
+        m_WalSize    = DOMPROM_REMOTE_WRITE_WAL_HEADER;
+        m_ReadOffset = DOMPROM_REMOTE_WRITE_WAL_HEADER;
 
+        if (NULL == m_fpWal)
+            return false;
 
-void PrintAndClearTransStats (FILE *fp)
-{
-    if (NULL == fp)
-        return;
+        if ((1 != fwrite (DOMPROM_REMOTE_WRITE_WAL_MAGIC, sizeof (DOMPROM_REMOTE_WRITE_WAL_MAGIC) - 1, 1, m_fpWal)) || (false == CommitReadOffset()))
+        {
+            fclose (m_fpWal);
+            m_fpWal = NULL;
+            return false;
+        }
 
-    WriteHelpAndType (fp, g_szDominoTrans, "count", "counter", "Transaction count");
+        return true;
+    }
 
-    for (const auto &pszLine : g_ListTransCountStats)
+    bool CommitReadOffset ()
     {
-        fprintf(fp, "%s\n", pszLine.c_str());
+        if (fseek (m_fpWal, sizeof (DOMPROM_REMOTE_WRITE_WAL_MAGIC) - 1, SEEK_SET) ||
+            (1 != fwrite (&m_ReadOffset, sizeof (m_ReadOffset), 1, m_fpWal)) ||
+            fflush (m_fpWal))
+        {
+            AddInLogMessageText ("%s: Cannot write remote write WAL: %s", 0, g_szTask, m_WalFilename.c_str());
+            return false;
+        }
+
+        return true;
     }
 
-    WriteHelpAndType (fp, g_szDominoTrans, "seconds_total", "counter", "Total transaction time in seconds");
+    /* Copies the records not delivered yet into a new WAL. The copy is renamed over the WAL, a crash keeps the old one */
 
-    for (const auto &pszLine : g_ListTransTotalSecondsStats)
+    bool CompactWal ()
     {
-        fprintf(fp, "%s\n", pszLine.c_str());
-    }
+        std::string TempFilename = m_WalFilename + ".tmp";
+        char     Buffer[16384];
+        uint64_t Pending  = m_WalSize - m_ReadOffset;
+        uint64_t Header   = DOMPROM_REMOTE_WRITE_WAL_HEADER;
+        size_t   Len      = 0;
+        bool     bSuccess = false;
+        FILE     *fp      = NULL;
 
-    g_ListTransCountStats.clear();
-    g_ListTransTotalSecondsStats.clear();
-}
+        fp = fopen (TempFilename.c_str(), "wb");
 
+        if (NULL == fp)
+            return false;
 
-DWORD ParseTransStatsBuffer (const char *pszBuffer)
-{
-    DWORD dwStatsCount = 0;
-    const char *pszLine = NULL;
-    STAT_ROW stRow = {0};
+        if ((1 != fwrite (DOMPROM_REMOTE_WRITE_WAL_MAGIC, sizeof (DOMPROM_REMOTE_WRITE_WAL_MAGIC) - 1, 1, fp)) ||
+            (1 != fwrite (&Header, sizeof (Header), 1, fp)) ||
+            fseek (m_fpWal, (long) m_ReadOffset, SEEK_SET))
+            goto Done;
 
-    if (IsNullStr (pszBuffer))
-        return 0;
+        while (Pending)
+        {
+            Len = (size_t) std::min (Pending, (uint64_t) sizeof (Buffer));
 
-    /* find header line */
-    pszLine = strstr (pszBuffer, "Function");
+            if ((1 != fread (Buffer, Len, 1, m_fpWal)) || (1 != fwrite (Buffer, Len, 1, fp)))
+                goto Done;
 
-    if (NULL == pszLine)
-        return 0;
+            Pending -= Len;
+        }
 
-    /* skip to next line */
-    if (false == ParseSkipToNextLine (&pszLine))
-        goto Done;
+        bSuccess = (0 == fflush (fp));
 
-    /* skip another empty line */
-    if (false == ParseSkipToNextLine (&pszLine))
-        goto Done;
+Done:
 
-    while (ParseOneTransStatsRow (&pszLine, &stRow))
-    {
-        /* Replace blanks and other invalid chars for transaction names */
-        ReplaceChars (stRow.szName);
+        fclose (fp);
+        fp = NULL;
 
-        if (AddTransactionStats (g_szDominoTrans, stRow.szName, stRow.iCount, stRow.iTotal))
+        if (false == bSuccess)
         {
-            dwStatsCount++;
+            remove (TempFilename.c_str());
+            AddInLogMessageText ("%s: Cannot compact remote write WAL: %s", 0, g_szTask, m_WalFilename.c_str());
+            return false;
         }
-    }
 
-Done:
+        /* The WAL is closed for the rename, Windows does not replace open files */
+        fclose (m_fpWal);
+        m_fpWal = NULL;
 
-    return dwStatsCount;
-}
+#ifdef _WIN32
+        bSuccess = (FALSE != MoveFileExA (TempFilename.c_str(), m_WalFilename.c_str(), MOVEFILE_REPLACE_EXISTING));
+#else
+        bSuccess = (0 == rename (TempFilename.c_str(), m_WalFilename.c_str()));
+#endif
 
+        if (false == bSuccess)
+            remove (TempFilename.c_str());
 
-STATUS ProcessIOStat ( DWORD dwIntervalSeconds)
-{
-    STATUS   error = NOERROR;
-    TIMEDATE tNow  = {0};
+        m_fpWal = fopen (m_WalFilename.c_str(), "r+b");
 
-    OSCurrentTIMEDATE (&tNow);
+        if (NULL == m_fpWal)
+        {
+            AddInLogMessageText ("%s: Cannot open remote write WAL: %s", 0, g_szTask, m_WalFilename.c_str());
+            return false;
+        }
+
+        if (bSuccess)
+        {
+            m_WalSize   -= m_ReadOffset - Header;
+            m_ReadOffset = Header;
+        }
 
-    if (TimeDateCompare (&tNow, &g_tNextIOStatUpdate) < 0)
+        return bSuccess;
+    }
+
+    void CloseWal ()
     {
-        return NOERROR;
+        if (m_fpWal)
+        {
+            fclose (m_fpWal);
+            m_fpWal = NULL;
+        }
     }
 
-    OSCurrentTIMEDATE (&g_tNextIOStatUpdate);
-    TimeDateAdjust(&g_tNextIOStatUpdate, dwIntervalSeconds, 0, 0, 0, 0, 0);
+    bool ReadRecord (std::string &Payload)
+    {
+        uint32_t Header[2] = {0};
 
-    error = NSFRemoteConsole (g_szLocalUser, "!show iostat", NULL);
+        if (NULL == m_fpWal)
+            return false;
 
-    if (error)
-    {
-        AddInLogMessageText ("%s: Remote console command failed: show iostat", error, g_szTask);
-        goto Done;
+        if (fseek (m_fpWal, (long) m_ReadOffset, SEEK_SET) || (1 != fread (Header, sizeof (Header), 1, m_fpWal)))
+            return false;
+
+        Payload.resize (Header[0]);
+
+        if (Header[0] && (1 != fread (&Payload[0], Header[0], 1, m_fpWal)))
+            return false;
+
+        return true;
     }
 
-Done:
+    void PushThread ()
+    {
+        std::string Payload;
+        DWORD dwBackoffMsec = 0;
+        int   Status = 0;
 
-    return error;
-}
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> Lock (m_Mutex);
 
+                if (dwBackoffMsec)
+                    m_Wakeup.wait_for (Lock, std::chrono::milliseconds (dwBackoffMsec), [this] { return m_bStop; });
+                else
+                    m_Wakeup.wait_for (Lock, std::chrono::seconds (1), [this] { return m_bStop || (m_ReadOffset < m_WalSize); });
 
-STATUS ProcessTransStats (const char *pszFilename, DWORD dwIntervalSeconds)
-{
-    STATUS  error        = NOERROR;
-    DHANDLE hRetInfo     = NULLHANDLE;
-    BYTE    *pInfoBuffer = NULL;
-    FILE    *fp          = NULL;
-    char    szTempFilename[MAXPATH+1] = {0};
+                if (m_bStop)
+                    break;
 
-    DWORD dwStatsCount = 0;
+                if (m_ReadOffset >= m_WalSize)
+                    continue;
 
-    TIMEDATE tNow = {0};
+                if (false == ReadRecord (Payload))
+                {
+                    AddInLogMessageText ("%s: Cannot read remote write WAL, discarding pending samples: %s", 0, g_szTask, m_WalFilename.c_str());
+                    ResetWal();
+                    continue;
+                }
+            }
 
-    OSCurrentTIMEDATE (&tNow);
+            Status = Post (Payload);
 
-    uint64_t EpochSec = (uint64_t) time (NULL);
+            std::lock_guard<std::mutex> Lock (m_Mutex);
 
-    if (IsNullStr (pszFilename))
-    {
-        return ERR_MISC_INVALID_ARGS;
-    }
+            /* 5xx, 429 and network errors are retried. Other errors would never succeed and the record is dropped */
+            if ((Status <= 0) || (Status >= 500) || (429 == Status))
+            {
+                if (0 == m_Failed++ % 10)
+                    AddInLogMessageText ("%s: Remote write to %s:%s failed (status: %d), retrying", 0, g_szTask, m_Host.c_str(), m_Port.c_str(), Status);
 
-    if (TimeDateCompare (&tNow, &g_tNextTransStatsUpdate) < 0)
-    {
-        return NOERROR;
-    }
+                dwBackoffMsec = dwBackoffMsec ? std::min (dwBackoffMsec * 2, (DWORD) DOMPROM_REMOTE_WRITE_MAX_BACKOFF_MSEC) : DOMPROM_REMOTE_WRITE_MIN_BACKOFF_MSEC;
+                continue;
+            }
 
-    OSCurrentTIMEDATE (&g_tNextTransStatsUpdate);
-    TimeDateAdjust(&g_tNextTransStatsUpdate, dwIntervalSeconds, 0, 0, 0, 0, 0);
+            if (Status >= 300)
+            {
+                m_Dropped++;
+                AddInLogMessageText ("%s: Remote write rejected (status: %d), dropping batch", 0, g_szTask, Status);
+            }
+            else
+            {
+                m_Sent++;
+            }
 
-    error = NSFRemoteConsole (g_szLocalUser, "!show trans", &hRetInfo);
+            dwBackoffMsec = 0;
+            m_ReadOffset += 2 * sizeof (uint32_t) + Payload.size();
 
-    if (error)
-    {
-        AddInLogMessageText ("%s: Remote console command failed: show trans", error, g_szTask);
-        goto Done;
-    }
+            /* Start over with an empty WAL once everything was delivered.
+               While new records keep coming in, the delivered records are removed once they take more space than the pending ones */
+            if (m_ReadOffset >= m_WalSize)
+                ResetWal();
 
-    if (NULLHANDLE == hRetInfo)
-    {
-        error = ERR_MEMORY;
-        goto Done;
+            else if ((m_ReadOffset - DOMPROM_REMOTE_WRITE_WAL_HEADER >= DOMPROM_REMOTE_WRITE_COMPACT_BYTES) && (m_ReadOffset - DOMPROM_REMOTE_WRITE_WAL_HEADER >= m_WalSize - m_ReadOffset))
+                CompactWal();
+
+            else
+                CommitReadOffset();
+        }
     }
 
-    pInfoBuffer = OSLock (BYTE, hRetInfo);
+    /* Sends one request and returns the HTTP status or -1 on network errors */
 
-    if (NULL == pInfoBuffer)
+    int Post (const std::string &Payload)
     {
-        error = ERR_MEMORY;
-        goto Done;
-    }
+        struct addrinfo Hints = {0};
+        struct addrinfo *pResult = NULL;
+        SOCKET_TYPE Socket = INVALID_SOCKET;
+        char szHeader[1024] = {0};
+        char szResponse[256] = {0};
+        size_t Received = 0;
+        SOCKET_IO_TYPE ret = 0;
+        int  Status = -1;
 
-    snprintf (szTempFilename, sizeof (szTempFilename),  "%s.tmp", pszFilename);
+        Hints.ai_family   = AF_UNSPEC;
+        Hints.ai_socktype = SOCK_STREAM;
 
-    fp = fopen (szTempFilename, "w");
+        if (getaddrinfo (m_Host.c_str(), m_Port.c_str(), &Hints, &pResult))
+            return -1;
 
-    if (NULL == fp)
-    {
-        AddInLogMessageText ("%s: Cannot create transaction file: %s", 0, g_szTask, pszFilename);
-        perror ("Cannot create stats temp file");
-        goto Done;
-    }
+        for (struct addrinfo *p = pResult; p; p = p->ai_next)
+        {
+            Socket = socket (p->ai_family, p->ai_socktype, p->ai_protocol);
 
-    dwStatsCount = ParseTransStatsBuffer ((const char *) pInfoBuffer);
+            if (INVALID_SOCKET == Socket)
+                continue;
 
-    if (dwStatsCount)
-    {
-        PrintAndClearTransStats (fp);
-    }
+            SetTimeouts (Socket);
 
-    WriteStatsEntryToFile (fp, g_szDominoTrans, "stat_transactions_update_timestamp", "Domino Transactions last update epoch time", EpochSec);
+            if (0 == connect (Socket, p->ai_addr, (int) p->ai_addrlen))
+                break;
 
-Done:
+            CloseSocket (Socket);
+            Socket = INVALID_SOCKET;
+        }
 
-    if (pInfoBuffer)
-    {
-        OSUnlock (hRetInfo);
-        pInfoBuffer = NULL;
+        freeaddrinfo (pResult);
+
+        if (INVALID_SOCKET == Socket)
+            return -1;
+
+        snprintf (szHeader, sizeof (szHeader),
+                  "POST %s HTTP/1.1\r\n"
+                  "Host: %s:%s\r\n"
+                  "User-Agent: domprom/%s\r\n"
+                  "Content-Type: application/x-protobuf\r\n"
+                  "Content-Encoding: snappy\r\n"
+                  "X-Prometheus-Remote-Write-Version: 0.1.0\r\n"
+                  "Content-Length: %zu\r\n"
+                  "Connection: close\r\n\r\n",
+                  m_Path.c_str(), m_Host.c_str(), m_Port.c_str(), g_szVersion, Payload.size());
+
+        if (SendAll (Socket, szHeader, strlen (szHeader)) && SendAll (Socket, Payload.data(), Payload.size()))
+        {
+            /* Only the status line is evaluated */
+            while (Received < sizeof (szResponse) - 1)
+            {
+                ret = recv (Socket, szResponse + Received, (int) (sizeof (szResponse) - 1 - Received), 0);
+
+                if (ret <= 0)
+                    break;
+
+                Received += (size_t) ret;
+                szResponse[Received] = '\0';
+
+                if (strchr (szResponse, '\n'))
+                    break;
+            }
+
+            if (0 == strncmp (szResponse, "HTTP/1.", 7))
+                Status = atoi (szResponse + 9);
+        }
+
+        CloseSocket (Socket);
+        return Status;
     }
 
-    if (hRetInfo)
+    static void SetTimeouts (SOCKET_TYPE Socket)
     {
-        OSMemFree (hRetInfo);
-        hRetInfo = NULLHANDLE;
+#ifdef _WIN32
+        DWORD dwTimeoutMsec = DOMPROM_REMOTE_WRITE_TIMEOUT_SEC * 1000;
+        setsockopt (Socket, SOL_SOCKET, SO_RCVTIMEO, (const char *) &dwTimeoutMsec, sizeof (dwTimeoutMsec));
+        setsockopt (Socket, SOL_SOCKET, SO_SNDTIMEO, (const char *) &dwTimeoutMsec, sizeof (dwTimeoutMsec));
+#else
+        struct timeval Timeout = {DOMPROM_REMOTE_WRITE_TIMEOUT_SEC, 0};
+        setsockopt (Socket, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof (Timeout));
+        setsockopt (Socket, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof (Timeout));
+#endif
     }
 
-    if (fp)
+    static bool SendAll (SOCKET_TYPE Socket, const char *pData, size_t len)
     {
-        fclose (fp);
-        fp = NULL;
+        SOCKET_IO_TYPE ret = 0;
 
-        rename (szTempFilename, pszFilename);
-    }
+        while (len)
+        {
+            ret = send (Socket, pData, (int) std::min (len, (size_t) 0x40000000), SEND_FLAGS);
 
-    return NOERROR;
-}
+            if (ret <= 0)
+                return false;
 
+            pData += ret;
+            len   -= (size_t) ret;
+        }
 
-WORD IsInMaintenanceMode()
-{
-    TIMEDATE tNow = {0};
+        return true;
+    }
 
-    if (g_wMaintenanceEnabled)
-        return 1;
+    std::string m_Host;
+    std::string m_Port;
+    std::string m_Path;
+    std::string m_WalFilename;
+    DWORD       m_BatchSamples = DOMPROM_REMOTE_WRITE_DEFAULT_BATCH;
+    uint64_t    m_WalMaxBytes  = 0;
+
+    // Protected by m_ApiMutex
+    std::vector<REMOTE_WRITE_LABEL> m_Labels;
+    std::string m_Label;
+    std::string m_Series;
+    std::string m_Request;
+    std::string m_Compressed;
+
+    // Protected by m_Mutex
+    FILE       *m_fpWal      = NULL;
+    uint64_t    m_WalSize    = 0;
+    uint64_t    m_ReadOffset = 0;
+    bool        m_bStop      = false;
+
+    std::atomic<bool>     m_bActive {false};
+    std::atomic<uint64_t> m_Sent    {0};
+    std::atomic<uint64_t> m_Failed  {0};
+    std::atomic<uint64_t> m_Dropped {0};
+
+    std::mutex              m_ApiMutex;
+    std::mutex              m_Mutex;
+    std::condition_variable m_Wakeup;
+    std::thread             m_Thread;
+};
 
-    if (false == g_bMaintenanceStartSet)
-        return 0;
 
-    OSCurrentTIMEDATE (&tNow);
+RemoteWriteSink g_RemoteWrite;
 
-    if (TimeDateCompare (&tNow, &g_tMaintenanceStart) < 0)
-        return 0;
 
-    if (false == g_bMaintenanceEndSet)
-        return 3;
+/* Optional in-place updated statistics file (notes.ini domprom_inplace=1).
+   The file is memory mapped and all values are written into fixed width slots.
+   As long as the layout (everything except the values) does not change, only changed values are patched.
+   Else the file is rewritten and mapped again. In-place updates are not atomic for readers,
+   a reader can see values of two different cycles. Only supported on Linux/UNIX.
+   The snapshot is still rendered completely and hashed every cycle. Only the file write is replaced by patching the changed slots */
 
-    if (TimeDateCompare (&tNow, &g_tMaintenanceEnd) > 0)
-        return 0;
+class InPlaceExpositionFile
+{
 
-    return 3;
-}
+public:
 
+    ~InPlaceExpositionFile ()
+    {
+        Unmap();
+    }
+
+    /* Returns the number of bytes written into the file in pBytesWritten */
+
+    bool Commit (const ExpositionBuffer &Out, const char *pszFilename, bool bFsync, size_t *pBytesWritten)
+    {
+        uint64_t LayoutHash = ComputeLayoutHash (Out);
+
+        if (pBytesWritten)
+            *pBytesWritten = 0;
+
+#ifndef _WIN32
+        struct stat FileStat = {0};
+        size_t Patched = 0;
+
+        if (m_pMap && (m_MapSize == Out.Size()) && (m_LayoutHash == LayoutHash) && (m_Slots == Out.Slots()) &&
+            (0 == stat (pszFilename, &FileStat)) && (FileStat.st_ino == m_Inode) && (m_Filename == pszFilename))
+        {
+            Patched = PatchValues (Out, bFsync);
+
+            m_PatchCycles++;
+            m_PatchedValues += Patched;
+
+            if (pBytesWritten)
+                *pBytesWritten = Patched * DOMPROM_VALUE_SLOT_WIDTH;
+
+            return true;
+        }
+#endif
+
+        /* Layout changed: rewrite the complete file and map the new file */
+        Unmap();
+
+        if (false == Out.CommitToFile (pszFilename, bFsync))
+            return false;
+
+        m_LayoutHash = LayoutHash;
+        m_Slots      = Out.Slots();
+        m_Filename   = pszFilename;
+        m_Rewrites++;
+
+        if (pBytesWritten)
+            *pBytesWritten = Out.Size();
+
+        Map (pszFilename, Out.Size());
+        return true;
+    }
+
+    /* Read by the collection thread for the DominoHealth self-metrics */
+
+    uint64_t GetRewrites () const
+    {
+        return m_Rewrites;
+    }
+
+    uint64_t GetPatchCycles () const
+    {
+        return m_PatchCycles;
+    }
+
+    uint64_t GetPatchedValues () const
+    {
+        return m_PatchedValues;
+    }
+
+    void Unmap ()
+    {
+#ifndef _WIN32
+        if (m_pMap)
+        {
+            munmap (m_pMap, m_MapSize);
+            m_pMap    = NULL;
+            m_MapSize = 0;
+        }
+#endif
+    }
+
+
+private:
+
+    // Hash over everything except the value slots
+    static uint64_t ComputeLayoutHash (const ExpositionBuffer &Out)
+    {
+        uint64_t Hash  = 14695981039346656037ULL;
+        size_t   Start = 0;
+
+        auto HashRange = [&Hash] (const char *p, size_t len)
+        {
+            while (len--)
+                Hash = (Hash ^ (uint8_t) *p++) * 1099511628211ULL;
+        };
+
+        for (size_t Slot : Out.Slots())
+        {
+            HashRange (Out.Data() + Start, Slot - Start);
+            Start = Slot + DOMPROM_VALUE_SLOT_WIDTH;
+        }
+
+        HashRange (Out.Data() + Start, Out.Size() - Start);
+
+        return Hash;
+    }
+
+    void Map (const char *pszFilename, size_t Size)
+    {
+#ifndef _WIN32
+        struct stat FileStat = {0};
+        int  fd   = -1;
+        void *pMap = NULL;
+
+        if (0 == Size)
+            return;
+
+        fd = open (pszFilename, O_RDWR);
+
+        if (fd < 0)
+            return;
+
+        if (0 == fstat (fd, &FileStat))
+        {
+            pMap = mmap (NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+            if (MAP_FAILED != pMap)
+            {
+                m_pMap    = (char *) pMap;
+                m_MapSize = Size;
+                m_Inode   = FileStat.st_ino;
+            }
+        }
+
+        /* The mapping stays valid after closing the file descriptor */
+        close (fd);
+#endif
+    }
+
+    // Returns the number of changed values
+    size_t PatchValues (const ExpositionBuffer &Out, bool bFsync)
+    {
+        size_t Patched = 0;
+
+#ifndef _WIN32
+        const char *pNew = Out.Data();
+
+        for (size_t Slot : m_Slots)
+        {
+            if (memcmp (m_pMap + Slot, pNew + Slot, DOMPROM_VALUE_SLOT_WIDTH))
+            {
+                memcpy (m_pMap + Slot, pNew + Slot, DOMPROM_VALUE_SLOT_WIDTH);
+                Patched++;
+            }
+        }
+
+        if (bFsync)
+            msync (m_pMap, m_MapSize, MS_SYNC);
+#endif
+
+        return Patched;
+    }
+
+    char     *m_pMap       = NULL;
+    size_t   m_MapSize     = 0;
+    uint64_t m_LayoutHash  = 0;
+    uint64_t m_Inode       = 0;
+
+    std::atomic<uint64_t> m_Rewrites      {0};
+    std::atomic<uint64_t> m_PatchCycles   {0};
+    std::atomic<uint64_t> m_PatchedValues {0};
+
+    std::string         m_Filename;
+    std::vector<size_t> m_Slots;
+};
+
+
+InPlaceExpositionFile g_InPlaceStatsFile;
+
+
+int FileExists (const char *pszFilename)
+{
+    int ret = 0;
+
+#ifdef _WIN32
+    struct _stat Filestat = {0};
+#else
+    struct stat Filestat = {0};
+#endif
+
+    if (IsNullStr (pszFilename))
+        return 0;
+
+#ifdef _WIN32
+        ret = _stat (pszFilename, &Filestat);
+#else
+        ret = stat (pszFilename, &Filestat);
+
+#endif
+
+    if (ret)
+        return 0;
+
+    if (S_IFDIR & Filestat.st_mode)
+        return 2;
+    else
+        return 1;
+}
+
+
+int RemoveFile (const char *pszFilename, WORD wLogLevel)
+{
+    int ret = 0;
+
+    if (IsNullStr (pszFilename))
+        return 0;
+
+    if (0 == FileExists (pszFilename))
+    {
+        if (wLogLevel > 1)
+        {
+            AddInLogMessageText ("%s: File does not exist when deleting: %s", 0, g_szTask, pszFilename);
+        }
+
+        return 0;
+    }
+
+    ret = remove (pszFilename);
+
+    if (FileExists (pszFilename))
+    {
+        AddInLogMessageText ("%s: File cannot be deleted: %s", 0, g_szTask, pszFilename);
+    }
+    else
+    {
+        if (wLogLevel)
+        {
+            AddInLogMessageText ("%s: Info: File deleted %s", 0, g_szTask, pszFilename);
+        }
+    }
+
+    return ret;
+}
+
+
+/* Snapshot writer thread. The add-in thread renders a snapshot and hands it over with a buffer swap.
+   Publishing to the HTTP listener, remote write and the file I/O run on the writer thread,
+   so a slow disk or NFS mounted stats directory does not delay collection and console commands.
+   When the writer falls behind, a newer snapshot replaces the pending one and the stale snapshot is skipped */
+
+enum SNAPSHOT_TARGET
+{
+    SNAPSHOT_STATS = 0,
+    SNAPSHOT_TRANS = 1,
+    SNAPSHOT_TARGETS
+};
+
+struct SNAPSHOT_SLOT
+{
+    ExpositionBuffer Pending;
+    ExpositionBuffer Working;
+    std::string PendingFilename;
+    std::string WorkingFilename;
+    bool bPending   = false;
+    bool bRemove    = false;  // Remove the file and the published snapshot instead of writing it
+    bool bWriteFile = true;
+    bool bFsync     = false;
+};
+
+
+class SnapshotWriter
+{
+
+public:
+
+    ~SnapshotWriter ()
+    {
+        Stop();
+    }
+
+    void Start ()
+    {
+        if (m_Thread.joinable())
+            return;
+
+        m_bStop  = false;
+        m_Thread = std::thread (&SnapshotWriter::WriterThread, this);
+    }
+
+    /* Pending snapshots are written before the thread terminates */
+    void Stop ()
+    {
+        if (false == m_Thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
+            m_bStop = true;
+        }
+
+        m_Wakeup.notify_all();
+        m_Thread.join();
+    }
+
+    /* Called on the add-in thread. Out receives a previously written buffer for the next cycle. It keeps its capacity */
+    void Submit (SNAPSHOT_TARGET Target, ExpositionBuffer &Out, const char *pszFilename, bool bWriteFile, bool bFsync)
+    {
+        SNAPSHOT_SLOT &Slot = m_Slots[Target];
+
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
+
+            if (Slot.bPending)
+                m_Skipped++;
+
+            Slot.Pending.Swap (Out);
+            Slot.PendingFilename = pszFilename ? pszFilename : "";
+            Slot.bPending   = true;
+            Slot.bRemove    = false;
+            Slot.bWriteFile = bWriteFile;
+            Slot.bFsync     = bFsync;
+        }
+
+        if (m_Thread.joinable())
+            m_Wakeup.notify_all();
+        else
+            WritePending();
+    }
+
+    /* Removes the file and the published snapshot in order with previously submitted snapshots */
+    void Remove (SNAPSHOT_TARGET Target, const char *pszFilename)
+    {
+        SNAPSHOT_SLOT &Slot = m_Slots[Target];
+
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
+
+            if (Slot.bPending)
+                m_Skipped++;
+
+            Slot.Pending.Reset();
+            Slot.PendingFilename = pszFilename ? pszFilename : "";
+            Slot.bPending = true;
+            Slot.bRemove  = true;
+        }
+
+        if (m_Thread.joinable())
+            m_Wakeup.notify_all();
+        else
+            WritePending();
+    }
+
+    uint64_t SkippedSnapshots () const
+    {
+        return m_Skipped;
+    }
+
+    uint64_t WriteErrors () const
+    {
+        return m_WriteErrors;
+    }
+
+
+private:
+
+    void WriterThread ()
+    {
+        TraceSetThreadName ("writer");
+
+        std::unique_lock<std::mutex> Lock (m_Mutex);
+
+        while (true)
+        {
+            m_Wakeup.wait (Lock, [this] { return m_bStop || HasPending(); });
+
+            if (false == HasPending())
+                break;
+
+            Lock.unlock();
+            WritePending();
+            Lock.lock();
+        }
+    }
+
+    bool HasPending () const
+    {
+        for (const auto &Slot : m_Slots)
+        {
+            if (Slot.bPending)
+                return true;
+        }
+
+        return false;
+    }
+
+    /* Only one thread writes at a time: the writer thread, or the add-in thread while no writer thread runs */
+    void WritePending ()
+    {
+        bool bRemove    = false;
+        bool bWriteFile = false;
+        bool bFsync     = false;
+        int  Target     = 0;
+
+        for (Target = 0; Target < SNAPSHOT_TARGETS; Target++)
+        {
+            SNAPSHOT_SLOT &Slot = m_Slots[Target];
+
+            {
+                std::lock_guard<std::mutex> Lock (m_Mutex);
+
+                if (false == Slot.bPending)
+                    continue;
+
+                Slot.Working.Swap (Slot.Pending);
+                Slot.WorkingFilename.swap (Slot.PendingFilename);
+                Slot.bPending = false;
+
+                bRemove    = Slot.bRemove;
+                bWriteFile = Slot.bWriteFile;
+                bFsync     = Slot.bFsync;
+            }
+
+            if (SNAPSHOT_STATS == Target)
+                WriteStats (Slot.Working, Slot.WorkingFilename.c_str(), bWriteFile, bFsync);
+            else if (bRemove)
+                RemoveTrans (Slot.WorkingFilename.c_str());
+            else
+                WriteTrans (Slot.Working, Slot.WorkingFilename.c_str(), bWriteFile, bFsync);
+        }
+    }
+
+    void WriteStats (const ExpositionBuffer &Out, const char *pszFilename, bool bWriteFile, bool bFsync)
+    {
+        bool   bSuccess = false;
+        size_t Written  = Out.Size();
+
+        g_HttpServer.PublishStats (Out);
+        g_RemoteWrite.Enqueue (Out);
+
+        if (false == bWriteFile)
+            return;
+
+        PhaseTimer Timer (PHASE_FILE_WRITE);
+
+        /* Buffers rendered with value slots are in-place updated. Switching the mode back releases the mapping */
+        if (Out.HasValueSlots())
+        {
+            bSuccess = g_InPlaceStatsFile.Commit (Out, pszFilename, bFsync, &Written);
+        }
+        else
+        {
+            g_InPlaceStatsFile.Unmap();
+            bSuccess = Out.CommitToFile (pszFilename, bFsync);
+        }
+
+        if (bSuccess)
+        {
+            g_BytesWrittenTotal += Written;
+        }
+        else
+        {
+            m_WriteErrors++;
+            AddInLogMessageText ("%s: Cannot write statistics file: %s", 0, g_szTask, pszFilename);
+        }
+    }
+
+    void WriteTrans (const ExpositionBuffer &Out, const char *pszFilename, bool bWriteFile, bool bFsync)
+    {
+        g_HttpServer.PublishTrans (Out);
+        g_RemoteWrite.Enqueue (Out);
+
+        if (false == bWriteFile)
+            return;
+
+        PhaseTimer Timer (PHASE_FILE_WRITE);
+
+        if (Out.CommitToFile (pszFilename, bFsync))
+        {
+            g_BytesWrittenTotal += Out.Size();
+        }
+        else
+        {
+            m_WriteErrors++;
+            AddInLogMessageText ("%s: Cannot create transaction file: %s", 0, g_szTask, pszFilename);
+        }
+    }
+
+    void RemoveTrans (const char *pszFilename)
+    {
+        g_HttpServer.ClearTrans();
+        RemoveFile (pszFilename, 1);
+    }
+
+    SNAPSHOT_SLOT m_Slots[SNAPSHOT_TARGETS];
+    bool          m_bStop = false;
+
+    std::atomic<uint64_t> m_Skipped     {0};
+    std::atomic<uint64_t> m_WriteErrors {0};
+
+    std::mutex              m_Mutex;
+    std::condition_variable m_Wakeup;
+    std::thread             m_Thread;
+};
+
+
+SnapshotWriter g_SnapshotWriter;
+
+
+bool CreateDirIfNotExists (const char *pszFilename)
+{
+    int  ret = 0;
+    bool bCreated = false;
+
+    if (IsNullStr (pszFilename))
+        return false;
+
+    ret = FileExists (pszFilename);
+
+    /* Directory already exists */
+    if (2 == ret)
+        return true;
+
+    /* A file with the same name already exists */
+    if (1 == ret)
+    {
+        AddInLogMessageText ("%s: Cannot create directory because a file with the same name exists: %s", 0, g_szTask, pszFilename);
+        return false;
+    }
+
+#ifdef _WIN32
+        if (TRUE == CreateDirectory (pszFilename, NULL))
+        {
+            bCreated = true;
+        }
+        else
+        {
+            perror ("Cannot create directory");
+        }
+
+#else
+        if (0 == mkdir (pszFilename, 0770))
+        {
+            bCreated = true;
+        }
+        else
+        {
+            perror ("Cannot create directory");
+        }
+
+#endif
+
+    if (bCreated)
+        AddInLogMessageText ("%s: Directory created: %s", 0, g_szTask, pszFilename);
+    else
+        AddInLogMessageText ("%s: Cannot create directory: %s", 0, g_szTask, pszFilename);
+
+    return bCreated;
+}
+
+
+BOOL GetNotesTimeDateSting (TIMEDATE *pTimedate, WORD wRetBufferSize, char *retpszBuffer)
+{
+    BOOL bError = TRUE;
+    TIME NotesTime  = {0};
+
+    if ((NULL == retpszBuffer) || (0 == wRetBufferSize))
+        return FALSE;
+
+     *retpszBuffer = '\0';
+
+    if (NULL == pTimedate)
+        return FALSE;
+
+    memcpy (&(NotesTime.GM), pTimedate, sizeof (TIMEDATE));
+
+    bError = TimeGMToLocalZone (&NotesTime);
+
+    if (bError)
+    {
+        *retpszBuffer = '\0';
+        goto Done;
+    }
+
+    snprintf (retpszBuffer,
+              wRetBufferSize,
+              "%04u-%02u-%02uT%02u:%02u:%02u:%02uZ",
+              NotesTime.year,
+              NotesTime.month,
+              NotesTime.day,
+              NotesTime.hour,
+              NotesTime.minute,
+              NotesTime.second,
+              NotesTime.hundredth);
+
+Done:
+    return bError;
+}
+
+
+STATUS DumpBufferToFile (const char *pszFileName, const char *pszBuffer)
+{
+    STATUS error = NOERROR;
+    FILE *pFile = NULL;
+    pFile = fopen (pszFileName, "wb");
+
+    if (IsNullStr (pszFileName))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (IsNullStr (pszBuffer))
+        return ERR_MISC_INVALID_ARGS;
+
+    fwrite ((const char *) pszBuffer, 1, strlen (pszBuffer), pFile);
+
+    if (pFile)
+    {
+        fclose (pFile);
+        pFile = NULL;
+    }
+
+    return error;
+}
+
+
+#ifdef _WIN32
+bool LmbcsToWide (const char *pszPathLMBCS, wchar_t *retpwszBuffer, DWORD dwBufferLen)
+{
+    if (retpwszBuffer && dwBufferLen)
+        *retpwszBuffer = '\0';
+
+    if (NULL == pszPathLMBCS)
+        return false;
+
+    OSTranslate32 (OS_TRANSLATE_LMBCS_TO_UNICODE, pszPathLMBCS, MAXDWORD, (char *) retpwszBuffer, dwBufferLen);
+    return true;
+}
+#else
+bool LmbcsToUtf8 (const char *pszPathLMBCS, char *retpszBuffer, DWORD dwBufferLen)
+{
+    if (retpszBuffer && dwBufferLen)
+        *retpszBuffer = '\0';
+
+    if (NULL == pszPathLMBCS)
+        return false;
+
+    OSTranslate32 (OS_TRANSLATE_LMBCS_TO_UTF8, pszPathLMBCS, MAXDWORD, (char *) retpszBuffer, dwBufferLen);
+    return true;
+}
+#endif
+
+
+bool GetDiskUsageFrom (const char *pszPathLMBCS,
+                       uint64_t   *retpTotalBytes,
+                       uint64_t   *retpFreeBytes,
+                       uint64_t   *retpTotalInodes,
+                       uint64_t   *retpFreeInodes)
+{
+#ifdef _WIN32
+    wchar_t pwszPath[MAX_PATH+1] = {0};
+    ULARGE_INTEGER freeAvail  = {0};
+    ULARGE_INTEGER total      = {0};
+    ULARGE_INTEGER freeTotal  = {0};
+
+    if (!LmbcsToWide (pszPathLMBCS, pwszPath, sizeof (pwszPath)-1))
+        return false;
+
+    if (!GetDiskFreeSpaceExW (pwszPath, &freeAvail, &total, &freeTotal))
+        return false;
+
+    if (retpTotalBytes)
+        *retpTotalBytes = (uint64_t)total.QuadPart;
+
+    if (retpFreeBytes)
+        *retpFreeBytes = (uint64_t)freeAvail.QuadPart;
+
+    /* NTFS has no fixed inode table */
+    if (retpTotalInodes)
+        *retpTotalInodes = 0;
+
+    if (retpFreeInodes)
+        *retpFreeInodes = 0;
+
+    return true;
+
+#else
+    char pszPathUtf8[PATH_MAX+1] = {0};
+    struct statvfs s  = {0};
+
+    if (!LmbcsToUtf8 (pszPathLMBCS, pszPathUtf8, sizeof(pszPathUtf8)-1))
+        return false;
+
+    if (statvfs(pszPathUtf8, &s) != 0)
+        return false;
+
+    uint64_t blockSize = (s.f_frsize != 0) ? (uint64_t)s.f_frsize : (uint64_t)s.f_bsize;
+
+    if (retpTotalBytes)
+        *retpTotalBytes = (uint64_t)s.f_blocks * blockSize;
+
+    if (retpFreeBytes)
+        *retpFreeBytes = (uint64_t)s.f_bavail * blockSize;
+
+    if (retpTotalInodes)
+        *retpTotalInodes = (uint64_t)s.f_files;
+
+    if (retpFreeInodes)
+        *retpFreeInodes = (uint64_t)s.f_favail;
+
+    return true;
+#endif
+}
+
+
+/* Identifies the filesystem of a path. Linux: "major:minor" of st_dev, Windows: volume mount point like "C:\" */
+
+bool GetDiskDeviceFrom (const char *pszPathLMBCS, std::string &retKey, unsigned *retpMajor, unsigned *retpMinor)
+{
+    char szKey[MAXPATH+1] = {0};
+
+    retKey.clear();
+
+    if (retpMajor)
+        *retpMajor = 0;
+
+    if (retpMinor)
+        *retpMinor = 0;
+
+#ifdef _WIN32
+    wchar_t pwszPath[MAX_PATH+1]   = {0};
+    wchar_t pwszVolume[MAX_PATH+1] = {0};
+
+    if (!LmbcsToWide (pszPathLMBCS, pwszPath, sizeof (pwszPath)-1))
+        return false;
+
+    if (!GetVolumePathNameW (pwszPath, pwszVolume, MAX_PATH))
+        return false;
+
+    if (0 == WideCharToMultiByte (CP_UTF8, 0, pwszVolume, -1, szKey, sizeof (szKey), NULL, NULL))
+        return false;
+
+#else
+    char pszPathUtf8[PATH_MAX+1] = {0};
+    struct stat st = {0};
+
+    if (!LmbcsToUtf8 (pszPathLMBCS, pszPathUtf8, sizeof(pszPathUtf8)-1))
+        return false;
+
+    if (stat (pszPathUtf8, &st) != 0)
+        return false;
+
+    if (retpMajor)
+        *retpMajor = major (st.st_dev);
+
+    if (retpMinor)
+        *retpMinor = minor (st.st_dev);
+
+    snprintf (szKey, sizeof (szKey), "%u:%u", (unsigned) major (st.st_dev), (unsigned) minor (st.st_dev));
+#endif
+
+    retKey = szKey;
+    return true;
+}
+
+
+int CompareCaseInsensitive (const char *pszStr1, const char *pszStr2)
+{
+    if (NULL == pszStr1)
+        return 0;
+
+    if (NULL == pszStr2)
+        return 0;
+
+    return ( IntlTextCompare (pszStr1, (WORD)strlen(pszStr1), pszStr2,(WORD)strlen (pszStr2), 0));
+}
+
+
+uint64_t EpochFromUtcTm (struct tm* pUtcTm)
+{
+#ifdef _WIN32
+    return static_cast<uint64_t>(_mkgmtime64(pUtcTm));
+#else
+    return static_cast<uint64_t>(timegm(pUtcTm));
+#endif
+}
+
+
+uint64_t TimeDateToEpoch (const TIMEDATE* pTimeDate)
+{
+    if (NULL == pTimeDate)
+        return 0;
+
+    TIME t = {};
+    struct tm utc_tm = {};
+
+    t.GM = *pTimeDate;
+    t.zone = 0;
+    t.dst  = 0;
+
+    if (TimeGMToLocalZone (&t))
+    {
+        return 0;
+    }
+
+    if (t.year < 1900)
+    {
+        return 0;
+    }
+
+    utc_tm.tm_year  = t.year - 1900;
+    utc_tm.tm_mon   = t.month - 1;
+    utc_tm.tm_mday  = t.day;
+    utc_tm.tm_hour  = t.hour;
+    utc_tm.tm_min   = t.minute;
+    utc_tm.tm_sec   = t.second;
+    utc_tm.tm_isdst = 0;
+
+    return EpochFromUtcTm (&utc_tm);
+}
+
+
+STATUS StatUpdateText (const char *pszStatPkg, const char *pszName, const char *pszText)
+{
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (NULL == pszText)
+        return ERR_MISC_INVALID_ARGS;
+
+    return StatUpdate (pszStatPkg, pszName, ST_UNIQUE, VT_TEXT, pszText);
+}
+
+
+STATUS StatUpdateLong (const char *pszStatPkg, const char *pszName, LONG lValue)
+{
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    return StatUpdate(pszStatPkg, pszName, ST_UNIQUE, VT_LONG, &lValue);
+}
+
+
+STATUS StatUpdateNumber (const char *pszStatPkg, const char *pszName, NUMBER *pnValue)
+{
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (NULL == pnValue)
+    {
+        StatDelete (pszStatPkg, pszName);
+        return NOERROR;
+    }
+
+    return StatUpdate(pszStatPkg, pszName, ST_UNIQUE, VT_NUMBER, pnValue);
+}
+
+
+STATUS StatUpdateNumber (const char *pszStatPkg, const char *pszName, uint64_t Int64Value)
+{
+    NUMBER nNumber = {0};
+
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    nNumber = (NUMBER) Int64Value;
+
+    return StatUpdate(pszStatPkg, pszName, ST_UNIQUE, VT_NUMBER, &nNumber);
+}
+
+
+STATUS StatUpdateNumberBytesInMB (const char *pszStatPkg, const char *pszName, NUMBER *pnBytes)
+{
+    NUMBER nMB = {0};
+
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    nMB = round (((*pnBytes) / 1048576.0) * 1000.0)/1000.0;
+
+    return StatUpdateNumber (pszStatPkg, pszName, &nMB);
+}
+
+
+STATUS StatUpdateNumberBytesInMB (const char *pszStatPkg, const char *pszName, uint64_t Int64Value)
+{
+    NUMBER nMB = {0};
+
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    nMB = round (((NUMBER) Int64Value / 1048576.0)*1000.0)/1000.0;
+
+    return StatUpdateNumber (pszStatPkg, pszName, &nMB);
+}
+
+
+STATUS StatUpdateTimedate (const char *pszStatPkg, const char *pszName, TIMEDATE *ptdTimedateValue)
+{
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (NULL == ptdTimedateValue)
+    {
+        StatDelete (pszStatPkg, pszName);
+        return NOERROR;
+    }
+
+    return StatUpdate (pszStatPkg, pszName, ST_UNIQUE, VT_TIMEDATE, ptdTimedateValue);
+}
+
+
+STATUS DeleteStat (const char *pszStatPkg, const char *pszName)
+{
+    if (IsNullStr (pszStatPkg) || IsNullStr (pszName))
+        return ERR_MISC_INVALID_ARGS;
+
+    return NOERROR;
+}
+
+STATUS DeleteAllStatsForPackage (const char *pszStatPkg)
+{
+    if (IsNullStr (pszStatPkg))
+        return ERR_MISC_INVALID_ARGS;
+
+    StatDelete (pszStatPkg, "");
+
+    return NOERROR;
+}
+
+
+void UpdateIdleStatus()
+{
+    char szStatus [MAXSPRINTF+1] = {0};
+
+    if (g_wCollectDominoTransStats)
+
+        snprintf (szStatus, sizeof (szStatus), "Idle (collect int: %u sec / trans int: %u sec)", g_dwIntervalSec, g_dwTransIntervalSec);
+    else
+        snprintf (szStatus, sizeof (szStatus), "Idle (collect interval: %u sec)", g_dwIntervalSec);
+
+    AddInSetStatusText (szStatus);
+}
+
+
+size_t GetTranslogExtendNumber (const char *pszFilename)
+{
+    size_t num   = 0;
+    size_t digit = 0;
+    const char *p = pszFilename;
+
+    if (NULL == p)
+        return 0;
+
+    if ('S' != *p)
+        return 0;
+
+    p++;
+
+    while (*p)
+    {
+        if ((*p >= '0') && (*p <= '9'))
+        {
+            digit = *p - '0';
+            num = num * 10 + digit;
+        }
+        else if ('.' == *p)
+        {
+            break;
+        }
+        else
+        {
+            return 0;
+        }
+
+        p++;
+    }
+
+    return num;
+}
+
+
+bool WriteHelpAndType (ExpositionBuffer *pOut, const char *pszPrefix, const char *pszStatName, const char *pszType, const char *pszDescription)
+{
+    if (NULL == pOut)
+        return false;
+
+    if (NULL == pszPrefix)
+        return false;
+
+    if (NULL == pszStatName)
+        return false;
+
+    if (IsNullStr (pszType))
+        pszType = g_szPromTypeGauge;
+
+    if (NULL == pszDescription)
+        pszDescription = g_szEmpty;
+
+    pOut->Append ("# HELP ");
+    pOut->AppendMetricName (pszPrefix, pszStatName);
+    pOut->Append (' ');
+    pOut->Append (pszDescription);
+    pOut->Append ("\n# TYPE ");
+    pOut->AppendMetricName (pszPrefix, pszStatName);
+    pOut->Append (' ');
+    pOut->Append (pszType);
+    pOut->Append ('\n');
+
+    return true;
+}
+
+
+bool WriteStatsEntryToFile (ExpositionBuffer *pOut, const char *pszPrefix, const char *pszStatName, const char *pszDescription, uint64_t ValueNum)
+{
+    if (NULL == pOut)
+        return false;
+
+    if (NULL == pszPrefix)
+        return false;
+
+    if (NULL == pszStatName)
+        return false;
+
+    if (false == WriteHelpAndType (pOut, pszPrefix, pszStatName, NULL, pszDescription))
+        return false;
+
+    pOut->AppendMetricName (pszPrefix, pszStatName);
+    pOut->Append (' ');
+    pOut->AppendU64 (ValueNum);
+    pOut->Append ('\n');
+
+    return true;
+}
+
+
+bool WriteStatsEntryToFile (ExpositionBuffer *pOut, const char *pszPrefix, const char *pszStatName, const char *pszDescription, const char *pszValueString)
+{
+    if (NULL == pOut)
+        return false;
+
+    if (NULL == pszPrefix)
+        return false;
+
+    if (NULL == pszStatName)
+        return false;
+
+    if (NULL == pszValueString)
+        return false;
+
+    if (false == WriteHelpAndType (pOut, pszPrefix, pszStatName, NULL, pszDescription))
+        return false;
+
+    pOut->AppendMetricName (pszPrefix, pszStatName);
+    pOut->Append (' ');
+    pOut->AppendValue (pszValueString);
+    pOut->Append ('\n');
+
+    return true;
+}
+
+
+static bool WriteStatsEntryToFileMSecToSeconds (ExpositionBuffer *pOut, const char *pszPrefix, const char *pszStatName, const char *pszDescription, DWORD dwValue)
+{
+    if (NULL == pOut)
+        return false;
+    if (NULL == pszPrefix)
+        return false;
+    if (NULL == pszStatName)
+        return false;
+
+    if (!WriteHelpAndType(pOut, pszPrefix, pszStatName, NULL, pszDescription))
+        return false;
+
+    pOut->AppendMetricName (pszPrefix, pszStatName);
+    pOut->Append (' ');
+    pOut->AppendMSecToSeconds (dwValue);
+    pOut->Append ('\n');
+
+    return true;
+}
+
+
+static bool WriteTimedateStat (ExpositionBuffer *pOut, const char *pszStatName, const char *pszDescription, void *pValue)
+{
+    uint64_t EpochTime = 0;
+
+
+    if (NULL == pOut)
+        return false;
+
+    if (NULL == pszStatName)
+        return false;
+
+    if (NULL == pValue)
+        return false;
+
+    EpochTime = TimeDateToEpoch ((TIMEDATE *) pValue);
+
+    if (0 == EpochTime)
+        return false;
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, pszStatName, pszDescription, EpochTime);
+
+    return true;
+}
+
+
+/* Appends a description in Prometheus HELP format: Control characters are removed, spaces collapsed and trimmed.
+   Backslash and newline are escaped as required by the exposition format */
+
+void AppendHelpText (std::string &Out, const char *pszText)
+{
+    size_t Start   = Out.size();
+    size_t TextEnd = Start;   // End of the last non-space character, trailing spaces are cut there
+    bool fLastWasSpace = true;   // treat start as "space" to trim leading spaces
+    unsigned char ch = 0;
+
+    if (NULL == pszText)
+        return;
+
+    for (; *pszText; pszText++)
+    {
+        ch = (unsigned char) *pszText;
+
+        if ('\n' == ch)
+        {
+            Out.resize (TextEnd);
+
+            if (TextEnd > Start)
+            {
+                Out += "\\n";
+                TextEnd = Out.size();
+            }
+
+            fLastWasSpace = true;
+            continue;
+        }
+
+        // Skip all other control characters
+        if (ch < 32)
+            continue;
+
+        if (' ' == ch)
+        {
+            if (fLastWasSpace)
+                continue;  // collapse multiple / leading spaces
+
+            fLastWasSpace = true;
+            Out += ' ';
+            continue;
+        }
+
+        if ('\\' == ch)
+            Out += '\\';
+
+        Out += (char) ch;
+        TextEnd = Out.size();
+        fLastWasSpace = false;
+    }
+
+    // Trim trailing space and newlines
+    Out.resize (TextEnd);
+}
+
+
+void AppendEscapedLabelValue (std::string &Str, const char *pszValue, size_t Len)
+{
+    for (size_t i=0; i<Len; i++)
+    {
+        switch (pszValue[i])
+        {
+            case '\\':
+                Str += "\\\\";
+                break;
+
+            case '"':
+                Str += "\\\"";
+                break;
+
+            case '\n':
+                Str += "\\n";
+                break;
+
+            default:
+                Str += pszValue[i];
+                break;
+        }
+    }
+}
+
+
+/* Samples of one metric family with a small, fixed number of series.
+   Label sets are rendered once as {name="value", ...} and referenced by index, a sample is a plain record.
+   Writing a family appends the interned labels and the formatted value without building sample lines */
+
+template <size_t VALUES, size_t MAX_SAMPLES, typename VALUE_TYPE = uint64_t> class LabeledSamples
+{
+public:
+
+    struct SAMPLE
+    {
+        uint32_t   LabelId;
+        VALUE_TYPE Values[VALUES];
+    };
+
+    /* Identical label sets share one entry. Meant for a few label sets, the lookup is linear */
+    uint32_t InternLabels (std::string_view Labels)
+    {
+        for (uint32_t i = 0; i < m_LabelRefs.size(); i++)
+        {
+            if (Labels == GetLabels (i))
+                return i;
+        }
+
+        m_LabelRefs.push_back ({ (uint32_t) m_LabelArena.size(), (uint32_t) Labels.size() });
+        m_LabelArena.append (Labels.data(), Labels.size());
+
+        return (uint32_t) (m_LabelRefs.size() - 1);
+    }
+
+    std::string_view GetLabels (uint32_t LabelId) const
+    {
+        return std::string_view (m_LabelArena.data() + m_LabelRefs[LabelId].Offset, m_LabelRefs[LabelId].Len);
+    }
+
+    void Clear ()
+    {
+        m_Count = 0;
+    }
+
+    /* Returns the record to fill in or NULL if all slots are used */
+    SAMPLE *Add (uint32_t LabelId)
+    {
+        if (m_Count >= MAX_SAMPLES)
+            return NULL;
+
+        m_Samples[m_Count].LabelId = LabelId;
+        return &m_Samples[m_Count++];
+    }
+
+    size_t Size () const
+    {
+        return m_Count;
+    }
+
+    void Write (ExpositionBuffer *pOut, const char *pszPrefix, const char *pszMetric, const char *pszType, const char *pszDescription, size_t ValueIndex, bool bMsecToSeconds) const
+    {
+        std::string_view Labels;
+
+        if ((NULL == pOut) || (0 == m_Count) || (ValueIndex >= VALUES))
+            return;
+
+        WriteHelpAndType (pOut, pszPrefix, pszMetric, pszType, pszDescription);
+
+        for (size_t i = 0; i < m_Count; i++)
+        {
+            Labels = GetLabels (m_Samples[i].LabelId);
+
+            pOut->AppendMetricName (pszPrefix, pszMetric);
+            pOut->Append (Labels.data(), Labels.size());
+            pOut->Append (' ');
+
+            AppendSampleValue (pOut, m_Samples[i].Values[ValueIndex], bMsecToSeconds);
+            pOut->Append ('\n');
+        }
+    }
+
+
+private:
+
+    static void AppendSampleValue (ExpositionBuffer *pOut, uint64_t Value, bool bMsecToSeconds)
+    {
+        if (bMsecToSeconds)
+            pOut->AppendMSecToSeconds (Value);
+        else
+            pOut->AppendU64 (Value);
+    }
+
+    static void AppendSampleValue (ExpositionBuffer *pOut, double Value, bool bMsecToSeconds)
+    {
+        pOut->AppendDouble (bMsecToSeconds ? Value / 1000.0 : Value);
+    }
+
+    struct LABEL_REF
+    {
+        uint32_t Offset;
+        uint32_t Len;
+    };
+
+    SAMPLE m_Samples[MAX_SAMPLES] = {};
+    size_t m_Count = 0;
+    std::vector<LABEL_REF> m_LabelRefs;
+    std::string m_LabelArena;
+};
+
+
+/* Statistic descriptions from events4.nsf, interned into one arena.
+   Texts are stored once already escaped for HELP lines and are referenced by offset.
+   Two open addressing tables map lowercase stat names and identical texts to their arena offsets */
+
+struct HELP_TEXT
+{
+    uint32_t Offset;
+    uint32_t Len;
+};
+
+
+class HelpTextArena
+{
+public:
+
+    HelpTextArena ()
+    {
+        m_Names.resize (DOMSTAT_HELP_INITIAL_SLOTS, m_EmptyName);
+        m_Texts.resize (DOMSTAT_HELP_INITIAL_SLOTS, m_EmptyText);
+    }
+
+    /* The first description of a stat name wins. bEscaped for texts already in HELP format (recordings) */
+    bool Add (const char *pszStatNameLower, const char *pszText, bool bEscaped)
+    {
+        size_t   NameLen = strlen (pszStatNameLower);
+        uint32_t Hash    = HashString (pszStatNameLower, NameLen);
+        size_t   Pos     = 0;
+        size_t   Start   = 0;
+        HELP_TEXT Text   = {0};
+
+        if (FindName (std::string_view (pszStatNameLower, NameLen), Hash, Pos))
+            return false;
+
+        Start = m_Arena.size();
+
+        if (bEscaped)
+            m_Arena.append (pszText);
+        else
+            AppendHelpText (m_Arena, pszText);
+
+        if (m_Arena.size() == Start)
+            return false;
+
+        Text = InternText (Start);
+
+        /* The position is still valid if the table does not grow */
+        if (2 * (m_NameCount + 1) > m_Names.size())
+        {
+            Grow (m_Names, m_EmptyName);
+            FindName (std::string_view (pszStatNameLower, NameLen), Hash, Pos);
+        }
+
+        Start = m_Arena.size();
+        m_Arena.append (pszStatNameLower, NameLen);
+        m_Arena.push_back ('\0');
+
+        m_Names[Pos] = { Hash, (uint32_t) Start, (uint32_t) NameLen, Text.Offset, Text.Len };
+        m_NameCount++;
+
+        return true;
+    }
+
+    bool Find (const char *pszStatNameLower, HELP_TEXT &Text) const
+    {
+        size_t   NameLen = strlen (pszStatNameLower);
+        uint32_t Hash    = HashString (pszStatNameLower, NameLen);
+        size_t   Pos     = 0;
+
+        if (false == FindName (std::string_view (pszStatNameLower, NameLen), Hash, Pos))
+            return false;
+
+        Text.Offset = m_Names[Pos].TextOffset;
+        Text.Len    = m_Names[Pos].TextLen;
+        return true;
+    }
+
+    /* Null terminated, the pointer is only valid until the next Add() */
+    const char *Get (const HELP_TEXT &Text) const
+    {
+        return m_Arena.data() + Text.Offset;
+    }
+
+    template <typename FUNC> void ForEach (FUNC Func) const
+    {
+        for (const auto &Slot : m_Names)
+        {
+            if (DOMSTAT_HELP_NONE == Slot.NameOffset)
+                continue;
+
+            Func (std::string_view (m_Arena.data() + Slot.NameOffset, Slot.NameLen), std::string_view (m_Arena.data() + Slot.TextOffset, Slot.TextLen));
+        }
+    }
+
+    size_t Size () const
+    {
+        return m_NameCount;
+    }
+
+    size_t TextCount () const
+    {
+        return m_TextCount;
+    }
+
+    size_t Bytes () const
+    {
+        return m_Arena.size();
+    }
+
+
+private:
+
+    struct HELP_NAME_SLOT
+    {
+        uint32_t Hash;
+        uint32_t NameOffset;
+        uint32_t NameLen;
+        uint32_t TextOffset;
+        uint32_t TextLen;
+    };
+
+    struct HELP_TEXT_SLOT
+    {
+        uint32_t Hash;
+        uint32_t Offset;
+        uint32_t Len;
+    };
+
+    static uint32_t HashString (const char *pszText, size_t Len)
+    {
+        uint32_t Hash = 2166136261U;
+
+        for (size_t i = 0; i < Len; i++)
+            Hash = (Hash ^ (unsigned char) pszText[i]) * 16777619U;
+
+        return Hash;
+    }
+
+    /* Returns the slot of the name or the empty slot to insert it */
+    bool FindName (std::string_view Name, uint32_t Hash, size_t &Pos) const
+    {
+        size_t Mask = m_Names.size() - 1;
+
+        for (Pos = Hash & Mask; DOMSTAT_HELP_NONE != m_Names[Pos].NameOffset; Pos = (Pos + 1) & Mask)
+        {
+            const HELP_NAME_SLOT &Slot = m_Names[Pos];
+
+            if ((Slot.Hash == Hash) && (Name == std::string_view (m_Arena.data() + Slot.NameOffset, Slot.NameLen)))
+                return true;
+        }
+
+        return false;
+    }
+
+    /* The text was appended at Start. An identical text already in the arena is used instead */
+    HELP_TEXT InternText (size_t Start)
+    {
+        size_t   Len  = m_Arena.size() - Start;
+        uint32_t Hash = HashString (m_Arena.data() + Start, Len);
+        size_t   Mask = 0;
+        size_t   Pos  = 0;
+
+        std::string_view Text (m_Arena.data() + Start, Len);
+
+        if (2 * (m_TextCount + 1) > m_Texts.size())
+            Grow (m_Texts, m_EmptyText);
+
+        Mask = m_Texts.size() - 1;
+
+        for (Pos = Hash & Mask; DOMSTAT_HELP_NONE != m_Texts[Pos].Offset; Pos = (Pos + 1) & Mask)
+        {
+            const HELP_TEXT_SLOT &Slot = m_Texts[Pos];
+
+            if ((Slot.Hash == Hash) && (Text == std::string_view (m_Arena.data() + Slot.Offset, Slot.Len)))
+            {
+                m_Arena.resize (Start);
+                return { Slot.Offset, Slot.Len };
+            }
+        }
+
+        m_Arena.push_back ('\0');
+        m_Texts[Pos] = { Hash, (uint32_t) Start, (uint32_t) Len };
+        m_TextCount++;
+
+        return { (uint32_t) Start, (uint32_t) Len };
+    }
+
+    static bool IsEmpty (const HELP_NAME_SLOT &Slot)
+    {
+        return DOMSTAT_HELP_NONE == Slot.NameOffset;
+    }
+
+    static bool IsEmpty (const HELP_TEXT_SLOT &Slot)
+    {
+        return DOMSTAT_HELP_NONE == Slot.Offset;
+    }
+
+    /* Only grows, both tables are sized for the number of descriptions in events4.nsf */
+    template <typename SLOT> static void Grow (std::vector<SLOT> &Slots, const SLOT &Empty)
+    {
+        std::vector<SLOT> Old;
+        size_t Mask = 0;
+        size_t Pos  = 0;
+
+        Old.swap (Slots);
+        Slots.resize (Old.size() * 2, Empty);
+
+        Mask = Slots.size() - 1;
+
+        for (const auto &Slot : Old)
+        {
+            if (IsEmpty (Slot))
+                continue;
+
+            for (Pos = Slot.Hash & Mask; !IsEmpty (Slots[Pos]); Pos = (Pos + 1) & Mask)
+                ;
+
+            Slots[Pos] = Slot;
+        }
+    }
+
+    static constexpr HELP_NAME_SLOT m_EmptyName = { 0, DOMSTAT_HELP_NONE, 0, 0, 0 };
+    static constexpr HELP_TEXT_SLOT m_EmptyText = { 0, DOMSTAT_HELP_NONE, 0 };
+
+    std::vector<HELP_NAME_SLOT> m_Names;
+    std::vector<HELP_TEXT_SLOT> m_Texts;
+    std::string m_Arena;
+    size_t      m_NameCount = 0;
+    size_t      m_TextCount = 0;
+};
+
+
+HelpTextArena g_StatHelp;
+
+
+STATUS AddStatDescriptionToTable (const char *pszStatName, const char *pszDescription)
+{
+    char szStatsNameLower[MAX_STAT_NAME+1] = {0};
+
+    if (IsNullStr (pszStatName))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (IsNullStr (pszDescription))
+        return ERR_MISC_INVALID_ARGS;
+
+    OSTranslate32 (OS_TRANSLATE_UPPER_TO_LOWER, pszStatName, MAXDWORD, szStatsNameLower, sizeof (szStatsNameLower));
+
+    g_StatHelp.Add (szStatsNameLower, pszDescription, false);
+
+    return NOERROR;
+}
+
+
+void AddStatDescription (const char *pszStatName, const char *pszDescription, const char *pszUnits)
+{
+    char szBuffer[MAX_STAT_DESC*2] = {0};
+
+    if (*pszUnits)
+    {
+        snprintf (szBuffer, sizeof (szBuffer), "%s [%s]", pszDescription, pszUnits);
+        AddStatDescriptionToTable (pszStatName, szBuffer);
+    }
+    else
+    {
+        AddStatDescriptionToTable (pszStatName, pszDescription);
+    }
+}
+
+
+/* Fallback for Statistic documents without the items in the summary buffer */
+
+STATUS ProcessStatDocument (DBHANDLE hDb, NOTEID NoteID)
+{
+    STATUS error = NOERROR;
+    NOTEHANDLE hNote = NULLHANDLE;
+
+    char szStatName[MAX_STAT_NAME+1]    = {0};
+    char szUnits[40]                    = {0};
+    char szDescription[MAX_STAT_DESC+1] = {0};
+
+    if (NULLHANDLE == hDb)
+        return ERR_MISC_INVALID_ARGS;
+
+    if (0 == NoteID)
+        return ERR_MISC_INVALID_ARGS;
+
+    error = NSFNoteOpen (hDb, NoteID, 0, &hNote);
+
+    if (error)
+    {
+        AddInLogMessageText ("%s: Cannot open Statistics note 0x%x in %s", error, g_szTask, NoteID, g_szEvents4);
+        goto Done;
+    }
+
+    NSFItemGetText (hNote, "StatName",    szStatName,    sizeofstring (szStatName));
+    NSFItemGetText (hNote, "Description", szDescription, sizeofstring (szDescription));
+    NSFItemGetText (hNote, "Units",       szUnits,       sizeofstring (szUnits));
+
+    AddStatDescription (szStatName, szDescription, szUnits);
+
+Done:
+
+    if (hNote)
+    {
+        NSFNoteClose (hNote);
+        hNote = NULLHANDLE;
+    }
+
+    return error;
+
+}
+
+#ifdef _WIN32
+static uint64_t TickMs(void)
+{
+    LARGE_INTEGER liFreq = {0};
+    LARGE_INTEGER liCtr  = {0};
+
+    if (QueryPerformanceFrequency(&liFreq) && liFreq.QuadPart != 0 &&
+        QueryPerformanceCounter(&liCtr))
+    {
+        return (uint64_t)((liCtr.QuadPart * 1000ULL) / liFreq.QuadPart);
+    }
+    return (uint64_t)GetTickCount64();
+}
+#else  /* UNIX / Linux */
+static uint64_t TickMs(void)
+{
+    struct timespec tsNow = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &tsNow);
+    return (uint64_t)((uint64_t)tsNow.tv_sec * 1000ULL +
+                   (uint64_t)tsNow.tv_nsec / 1000000ULL);
+}
+#endif
+
+
+STATUS GetServerResponseTimeMsec(const char *pszServerName, DWORD *retpdwMsec)
+{
+    STATUS   error       = NOERROR;
+    DBHANDLE hDb         = NULLHANDLE;
+    uint64_t qwTickStart = 0;
+    uint64_t qwTickEnd   = 0;
+    uint64_t TraceStartUs = 0;
+    char     szFullDbPath [MAXPATH + 1] = {0};
+
+    if (retpdwMsec)
+        *retpdwMsec = 0;
+
+    error = OSPathNetConstruct(NULL, (pszServerName)? pszServerName : "", "names.nsf", szFullDbPath);
+
+    if (error)
+        goto Done;
+
+    TraceStartUs = TraceBegin();
+    qwTickStart = TickMs();
+    error = NSFDbOpen(szFullDbPath, &hDb);
+    qwTickEnd = TickMs();
+    TraceEnd ("NSFDbOpen names.nsf", TraceStartUs);
+
+    if (error)
+        goto Done;
+
+    if (retpdwMsec)
+        *retpdwMsec = (DWORD)(qwTickEnd - qwTickStart);
+
+Done:
+
+    if (hDb)
+    {
+        /* Close session allows to test including authenticaiton but causes a new session log entry quite often */
+        if (g_ProbeCloseSession)
+            NSFDbCloseSession(hDb);
+        else
+            NSFDbClose(hDb);
+
+        hDb = NULLHANDLE;
+    }
+
+    return error;
+}
+
+
+STATUS GetServerPingLatency (const char *pszServerName, DWORD *retpdwMsec)
+{
+    STATUS error  = NOERROR;
+    DWORD  dwMsec = 0;
+    DWORD  dwIndex = 0;
+    DWORD  dwClientToServerMS = 0;
+    DWORD  dwServerToClientMS = 0;
+    WORD   wServerVersion     = 0;
+    uint64_t TraceStartUs     = 0;
+
+    if (retpdwMsec)
+        *retpdwMsec = 0;
+
+    if (IsNullStr (pszServerName))
+    {
+        return ERR_MISC_INVALID_ARGS;
+    }
+
+    TraceStartUs = TraceBegin();
+    error = NSPingServer(const_cast<char *>(pszServerName), &dwIndex, NULL);
+    TraceEnd ("NSPingServer", TraceStartUs);
+
+    if (error)
+        goto Done;
+
+    TraceStartUs = TraceBegin();
+    error = NSFGetServerLatency((char *) pszServerName, 0, &dwClientToServerMS, &dwServerToClientMS, &wServerVersion);
+    TraceEnd ("NSFGetServerLatency", TraceStartUs);
+
+    dwMsec = dwClientToServerMS + dwServerToClientMS;
+
+    if (retpdwMsec)
+        *retpdwMsec = dwMsec;
+
+Done:
+
+    return error;
+}
+
+
+struct EVENTS4_LOAD_TYPE
+{
+    DBHANDLE hDb;
+    DWORD    dwSummary;
+    DWORD    dwOpened;
+};
+
+
+/* Reads the description items from the summary buffer of each Statistic document. The note is only opened if they are missing */
+
+STATUS LNCALLBACK StatDescriptionSearchCallback (void *pParam, SEARCH_MATCH far *pSearchInfo, ITEM_TABLE far *pSummaryInfo)
+{
+    EVENTS4_LOAD_TYPE *pCtx = (EVENTS4_LOAD_TYPE *) pParam;
+    SEARCH_MATCH SearchMatch = {0};
+
+    char szStatName[MAX_STAT_NAME+1]    = {0};
+    char szUnits[40]                    = {0};
+    char szDescription[MAX_STAT_DESC+1] = {0};
+
+    if ((NULL == pSearchInfo) || (NULL == pParam))
+        return ERR_MISC_INVALID_ARGS;
+
+    memcpy ((char*)(&SearchMatch), (char *)pSearchInfo, sizeof (SEARCH_MATCH));
+
+    if (!(SearchMatch.SERetFlags & SE_FMATCH))
+        return NOERROR;
+
+    if (pSummaryInfo &&
+        NSFGetSummaryValue (pSummaryInfo, "StatName",    szStatName,    sizeofstring (szStatName)) &&
+        NSFGetSummaryValue (pSummaryInfo, "Description", szDescription, sizeofstring (szDescription)))
+    {
+        NSFGetSummaryValue (pSummaryInfo, "Units", szUnits, sizeofstring (szUnits));
+
+        AddStatDescription (szStatName, szDescription, szUnits);
+        pCtx->dwSummary++;
+        return NOERROR;
+    }
+
+    pCtx->dwOpened++;
+    ProcessStatDocument (pCtx->hDb, SearchMatch.ID.NoteID);
+
+    return NOERROR;
+}
+
+
+STATUS ReadStatisticsInfoFromEvents4()
+{
+    STATUS   error        = NOERROR;
+    WORD     wdc          = 0;
+    WORD     wFormulaLen  = 0;
+    uint64_t TraceStartUs = 0;
+
+    char szFormula[] = "Form = \"Statistic\"";
+
+    FORMULAHANDLE     hFormula = NULLHANDLE;
+    EVENTS4_LOAD_TYPE Load     = {0};
+
+    PhaseTimer Timer (PHASE_EVENTS4_LOAD);
+
+    TraceStartUs = TraceBegin();
+    error = NSFDbOpen (g_szEvents4, &Load.hDb);
+    TraceEnd ("NSFDbOpen events4.nsf", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText ("%s: Cannot open %s", error, g_szTask, g_szEvents4);
+        goto Done;
+    }
+
+    TraceStartUs = TraceBegin();
+
+    error = NSFFormulaCompile (NULL,
+                               0,
+                               szFormula,
+                               (WORD) strlen (szFormula),
+                               &hFormula,
+                               &wFormulaLen,
+                               &wdc,
+                               &wdc,
+                               &wdc,
+                               &wdc,
+                               &wdc);
+
+    TraceEnd ("NSFFormulaCompile", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText ("%s: Error compiling search formula", error, g_szTask);
+        hFormula = NULLHANDLE;
+        goto Done;
+    }
+
+    /* One pass with the summary buffer instead of collecting note IDs and opening every note */
+    TraceStartUs = TraceBegin();
+
+    error = NSFSearch (Load.hDb,                      /* database handle */
+                       hFormula,                      /* selection formula */
+                       NULL,                          /* title of view in selection formula */
+                       SEARCH_SUMMARY,                /* return the summary buffer */
+                       NOTE_CLASS_DOCUMENT,           /* note class to find */
+                       NULL,                          /* starting date (unused) */
+                       StatDescriptionSearchCallback, /* call for each note found */
+                       &Load,                         /* argument to the callback */
+                       NULL);                         /* returned ending date (unused) */
+
+    TraceEnd ("NSFSearch", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText ("%s: Error searching statistics descriptions in %s", error, g_szTask, g_szEvents4);
+        goto Done;
+    }
+
+    if (g_wLogLevel)
+        AddInLogMessageText ("%s: Statistics descriptions found in %s: %u (%u opened), %u unique texts, %u bytes", 0, g_szTask, g_szEvents4,
+                             Load.dwSummary + Load.dwOpened, Load.dwOpened, (DWORD) g_StatHelp.TextCount(), (DWORD) g_StatHelp.Bytes());
+
+Done:
+
+    if (hFormula)
+    {
+        OSMemFree (hFormula);
+        hFormula = NULLHANDLE;
+    }
+
+    if (Load.hDb)
+    {
+        NSFDbClose (Load.hDb);
+        Load.hDb = NULLHANDLE;
+    }
+
+    return error;
+}
+
+
+/* Statistics with special handling to derive DominoHealth metrics.
+   The names are looked up in a perfect hash table generated at compile time.
+   A new derived metric only needs a handler and an entry in g_SpecialStats */
+
+struct SPECIAL_STAT_TYPE;
+
+typedef void (*SPECIAL_STAT_HANDLER) (ExpositionBuffer *pOut, const SPECIAL_STAT_TYPE *pSpecial, const char *pszDescription, void *pValue);
+
+struct SPECIAL_STAT_TYPE
+{
+    const char           *pszName;       // Sanitized metric name without prefix
+    WORD                 wValueType;
+    SPECIAL_STAT_HANDLER Handler;
+    const char           *pszHealthName; // DominoHealth metric to write
+};
+
+
+static void HandleBackupStatus (ExpositionBuffer *pOut, const SPECIAL_STAT_TYPE *pSpecial, const char *pszDescription, void *pValue)
+{
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, pSpecial->pszHealthName, pszDescription, CompareCaseInsensitive ((const char *)pValue, "Successful") ? 1 : 0);
+}
+
+
+static void HandleTimedate (ExpositionBuffer *pOut, const SPECIAL_STAT_TYPE *pSpecial, const char *pszDescription, void *pValue)
+{
+    WriteTimedateStat (pOut, pSpecial->pszHealthName, pszDescription, pValue);
+}
+
+
+static void HandleMailBoxes (ExpositionBuffer *pOut, const SPECIAL_STAT_TYPE *pSpecial, const char *pszDescription, void *pValue)
+{
+    if (*(LONG *) pValue)
+    {
+        g_MailBoxes = *(WORD *) pValue;
+    }
+}
+
+
+constexpr SPECIAL_STAT_TYPE g_SpecialStats[] =
+{
+    { "DominoBackup_LastBackup_DB_Status",        VT_TEXT,     HandleBackupStatus, "LastBackup_DB_Status"              },
+    { "DominoBackup_LastBackup_TL_Status",        VT_TEXT,     HandleBackupStatus, "LastBackup_TL_Status"              },
+    { "DominoBackup_LastBackup_TL_LastLogExtend", VT_TEXT,     HandleBackupStatus, "LastBackup_TL_LastLogExtendNumber" },
+    { "DominoBackup_LastBackup_DB_Time",          VT_TIMEDATE, HandleTimedate,     "LastBackup_DB_Time"                },
+    { "DominoBackup_LastBackup_TL_Time",          VT_TIMEDATE, HandleTimedate,     "LastBackup_TL_Time"                },
+    { "Server_Time_Start",                        VT_TIMEDATE, HandleTimedate,     "Server_Time_Start"                 },
+    { "Server_MailBoxes",                         VT_LONG,     HandleMailBoxes,    NULL                                },
+};
+
+constexpr size_t SPECIAL_STAT_COUNT = sizeof (g_SpecialStats) / sizeof (g_SpecialStats[0]);
+constexpr size_t SPECIAL_STAT_SLOTS = 16; // Power of 2, larger than the number of entries
+
+static_assert (SPECIAL_STAT_COUNT < SPECIAL_STAT_SLOTS, "Increase SPECIAL_STAT_SLOTS");
+
+
+// Case insensitive FNV-1a. Metric names are plain ASCII after ReplaceChars()
+constexpr uint32_t HashStatNameCI (const char *psz, uint32_t Seed)
+{
+    uint32_t Hash = 2166136261u ^ Seed;
+    char     ch   = 0;
+
+    while (*psz)
+    {
+        ch = *psz++;
+
+        if ((ch >= 'A') && (ch <= 'Z'))
+            ch = (char) (ch - 'A' + 'a');
+
+        Hash = (Hash ^ (uint8_t) ch) * 16777619u;
+    }
+
+    return Hash;
+}
+
+
+constexpr bool IsPerfectSeed (uint32_t Seed)
+{
+    bool bUsed[SPECIAL_STAT_SLOTS] = {};
+    size_t Slot = 0;
+
+    for (size_t i = 0; i < SPECIAL_STAT_COUNT; i++)
+    {
+        Slot = HashStatNameCI (g_SpecialStats[i].pszName, Seed) & (SPECIAL_STAT_SLOTS - 1);
+
+        if (bUsed[Slot])
+            return false;
+
+        bUsed[Slot] = true;
+    }
+
+    return true;
+}
+
+
+constexpr uint32_t FindPerfectSeed ()
+{
+    for (uint32_t Seed = 1; Seed < 100000; Seed++)
+    {
+        if (IsPerfectSeed (Seed))
+            return Seed;
+    }
+
+    return 0;
+}
+
+
+constexpr uint32_t g_SpecialStatSeed = FindPerfectSeed();
+
+static_assert (g_SpecialStatSeed != 0, "No perfect hash seed found for g_SpecialStats");
+
+
+struct SPECIAL_STAT_SLOT_TABLE
+{
+    int8_t Index[SPECIAL_STAT_SLOTS];
+};
+
+
+constexpr SPECIAL_STAT_SLOT_TABLE BuildSpecialStatSlots ()
+{
+    SPECIAL_STAT_SLOT_TABLE Table = {};
+
+    for (size_t i = 0; i < SPECIAL_STAT_SLOTS; i++)
+        Table.Index[i] = -1;
+
+    for (size_t i = 0; i < SPECIAL_STAT_COUNT; i++)
+        Table.Index[HashStatNameCI (g_SpecialStats[i].pszName, g_SpecialStatSeed) & (SPECIAL_STAT_SLOTS - 1)] = (int8_t) i;
+
+    return Table;
+}
+
+
+constexpr SPECIAL_STAT_SLOT_TABLE g_SpecialStatSlots = BuildSpecialStatSlots();
+
+
+const SPECIAL_STAT_TYPE *FindSpecialStat (const char *pszMetric)
+{
+    int8_t Index = 0;
+
+    if (IsNullStr (pszMetric))
+        return NULL;
+
+    Index = g_SpecialStatSlots.Index[HashStatNameCI (pszMetric, g_SpecialStatSeed) & (SPECIAL_STAT_SLOTS - 1)];
+
+    if (Index < 0)
+        return NULL;
+
+    if (strcasecmp (pszMetric, g_SpecialStats[Index].pszName))
+        return NULL;
+
+    return &g_SpecialStats[Index];
+}
+
+
+/* Relabel rules convert indexed Domino statistics into one metric family with labels.
+   Rules are read once at startup from the file configured via notes.ini domprom_relabel_rules:
+
+   relabel <pattern> [<family>]
+
+   The pattern is matched case insensitive against facility.stat. Each dot separated element matches one segment:
+
+   literal  Segment must match
+   *        Any segment, kept in the family name
+   {name}   Any segment, exported as label "name"
+   **       One or more remaining segments kept in the family name (last element only)
+
+   Example: relabel platform.logicaldisk.{disk}.** -> Domino_Platform_LogicalDisk_AvgQueueLen{disk="1"}
+
+   Overlapping rules or a fixed family name can map different stats to the same series. Only the first stat is exported */
+
+#define DOMPROM_RELABEL_MAX_SEGMENTS 64
+#define DOMPROM_RELABEL_COLLISION    -2
+
+enum RELABEL_SEGMENT_KIND
+{
+    RELABEL_LITERAL,
+    RELABEL_ANY,
+    RELABEL_LABEL,
+    RELABEL_REST
+};
+
+struct RELABEL_SEGMENT
+{
+    RELABEL_SEGMENT_KIND Kind;
+    std::string Text; // Lowercase literal or label name
+};
+
+struct RELABEL_RULE
+{
+    std::vector<RELABEL_SEGMENT> Segments;
+    std::string Pattern;
+    std::string Family;   // Optional fixed family name
+};
+
+struct RELABEL_SAMPLE
+{
+    size_t Offset;        // Start of "name{labels} " in the cycle arena
+    size_t HeaderLen;
+    size_t ValueLen;      // Value follows the header in the arena
+};
+
+struct RELABEL_FAMILY
+{
+    std::string Name;     // Sanitized family name without prefix
+    std::string Description;
+    std::vector<RELABEL_SAMPLE> Samples;
+};
+
+
+class StatRelabeler
+{
+
+public:
+
+    size_t Load (const char *pszFilename)
+    {
+        FILE   *fp     = NULL;
+        DWORD  dwLine  = 0;
+        char   szLine[1024] = {0};
+        char   szPattern[1024] = {0};
+        char   szFamily[256]   = {0};
+        char   szKeyword[32]   = {0};
+        int    Count  = 0;
+
+        Clear();
+
+        if (IsNullStr (pszFilename))
+            return 0;
+
+        fp = fopen (pszFilename, "r");
+
+        if (NULL == fp)
+        {
+            AddInLogMessageText ("%s: Cannot open relabel rules file: %s", 0, g_szTask, pszFilename);
+            return 0;
+        }
+
+        while (fgets (szLine, sizeof (szLine), fp))
+        {
+            dwLine++;
+
+            *szKeyword = '\0';
+            *szPattern = '\0';
+            *szFamily  = '\0';
+
+            Count = sscanf (szLine, "%31s %1023s %255s", szKeyword, szPattern, szFamily);
+
+            if ((Count <= 0) || ('#' == *szKeyword))
+                continue;
+
+            if ((Count < 2) || CompareCaseInsensitive (szKeyword, "relabel"))
+            {
+                AddInLogMessageText ("%s: Invalid relabel rule in %s line %u", 0, g_szTask, pszFilename, dwLine);
+                continue;
+            }
+
+            if (false == AddRule (szPattern, szFamily))
+            {
+                AddInLogMessageText ("%s: Invalid relabel pattern in %s line %u: %s", 0, g_szTask, pszFilename, dwLine, szPattern);
+            }
+        }
+
+        fclose (fp);
+        fp = NULL;
+
+        if (m_Rules.size())
+        {
+            AddInLogMessageText ("%s: Loaded %u relabel rules from %s", 0, g_szTask, (DWORD) m_Rules.size(), pszFilename);
+        }
+
+        return m_Rules.size();
+    }
+
+    bool AddRule (const char *pszPattern, const char *pszFamily)
+    {
+        RELABEL_RULE Rule;
+        RELABEL_SEGMENT Segment;
+        const char *pStart = pszPattern;
+        const char *p      = pszPattern;
+        size_t Len = 0;
+
+        if (IsNullStr (pszPattern))
+            return false;
+
+        while (true)
+        {
+            if (('.' != *p) && ('\0' != *p))
+            {
+                p++;
+                continue;
+            }
+
+            Len = p - pStart;
+
+            if (0 == Len)
+                return false;
+
+            // A rest element must be the last one
+            if (Rule.Segments.size() && (RELABEL_REST == Rule.Segments.back().Kind))
+                return false;
+
+            if (Rule.Segments.size() >= DOMPROM_RELABEL_MAX_SEGMENTS)
+                return false;
+
+            Segment.Text.clear();
+
+            if ((1 == Len) && ('*' == *pStart))
+            {
+                Segment.Kind = RELABEL_ANY;
+            }
+            else if ((2 == Len) && ('*' == pStart[0]) && ('*' == pStart[1]))
+            {
+                Segment.Kind = RELABEL_REST;
+            }
+            else if (('{' == *pStart) && ('}' == pStart[Len-1]))
+            {
+                Segment.Kind = RELABEL_LABEL;
+                Segment.Text.assign (pStart+1, Len-2);
+
+                if (false == IsValidLabelName (Segment.Text))
+                    return false;
+            }
+            else
+            {
+                Segment.Kind = RELABEL_LITERAL;
+
+                for (size_t i=0; i<Len; i++)
+                    Segment.Text.push_back ((char) tolower ((unsigned char) pStart[i]));
+            }
+
+            Rule.Segments.push_back (Segment);
+
+            if ('\0' == *p)
+                break;
+
+            p++;
+            pStart = p;
+        }
+
+        Rule.Pattern = pszPattern;
+
+        if (false == IsNullStr (pszFamily))
+        {
+            Rule.Family = pszFamily;
+            ReplaceChars (&Rule.Family[0]);
+        }
+
+        // Rules are indexed by a literal facility, others are checked for every statistic
+        if (RELABEL_LITERAL == Rule.Segments[0].Kind)
+            m_ByFacility[Rule.Segments[0].Text].push_back (m_Rules.size());
+        else
+            m_AnyFacility.push_back (m_Rules.size());
+
+        m_Rules.push_back (Rule);
+        return true;
+    }
+
+    void Clear ()
+    {
+        m_Rules.clear();
+        m_ByFacility.clear();
+        m_AnyFacility.clear();
+        m_FamilyIndex.clear();
+        m_Families.clear();
+        m_Series.clear();
+        m_Arena.clear();
+        m_Collisions = 0;
+    }
+
+    size_t RuleCount () const
+    {
+        return m_Rules.size();
+    }
+
+    size_t FamilyCount () const
+    {
+        return m_Families.size();
+    }
+
+    size_t CollisionCount () const
+    {
+        return m_Collisions;
+    }
+
+    /* Called once per new statistic. Returns the family index, -1 if no rule matches or DOMPROM_RELABEL_COLLISION
+       if another stat already owns the series. The sample header "<family>{labels} " without prefix is returned in Sample */
+
+    int Match (const char *pszMetric, const char *pszMetricLower, const char *pszDescription, std::string &Sample)
+    {
+        const char *pSeg[DOMPROM_RELABEL_MAX_SEGMENTS+1] = {0};
+        size_t SegCount = 0;
+        size_t BestRule = (size_t) -1;
+        const char *p = pszMetricLower;
+
+        if (m_Rules.empty())
+            return -1;
+
+        /* Segment start offsets are shared between the original and the lowercase name */
+        pSeg[SegCount++] = p;
+
+        while (*p)
+        {
+            if ('.' == *p)
+            {
+                if (SegCount >= DOMPROM_RELABEL_MAX_SEGMENTS)
+                    return -1;
+
+                pSeg[SegCount++] = p+1;
+            }
+            p++;
+        }
+
+        pSeg[SegCount] = p+1;
+
+        m_Key.assign (pSeg[0], pSeg[1] - pSeg[0] - 1);
+
+        auto it = m_ByFacility.find (m_Key);
+
+        if (it != m_ByFacility.end())
+        {
+            for (size_t Index : it->second)
+            {
+                if (Matches (m_Rules[Index], pSeg, SegCount))
+                {
+                    BestRule = Index;
+                    break;
+                }
+            }
+        }
+
+        // First rule in file order wins
+        for (size_t Index : m_AnyFacility)
+        {
+            if (Index > BestRule)
+                break;
+
+            if (Matches (m_Rules[Index], pSeg, SegCount))
+            {
+                BestRule = Index;
+                break;
+            }
+        }
+
+        if ((size_t) -1 == BestRule)
+            return -1;
+
+        return Render (m_Rules[BestRule], pszMetric, pszMetricLower, pSeg, SegCount, pszDescription, Sample);
+    }
+
+    void BeginCycle ()
+    {
+        m_Arena.clear();
+
+        for (auto &Family : m_Families)
+            Family.Samples.clear();
+    }
+
+    // Header is the complete "<prefix>_<family>{labels} " of the sample line
+    void AddSample (int FamilyIndex, const std::string &Header, const char *pszValue)
+    {
+        RELABEL_SAMPLE Sample;
+
+        if ((FamilyIndex < 0) || ((size_t) FamilyIndex >= m_Families.size()) || (NULL == pszValue))
+            return;
+
+        Sample.Offset    = m_Arena.size();
+        Sample.HeaderLen = Header.size();
+        Sample.ValueLen  = strlen (pszValue);
+
+        m_Arena.append (Header);
+        m_Arena.append (pszValue, Sample.ValueLen);
+
+        m_Families[FamilyIndex].Samples.push_back (Sample);
+    }
+
+    /* Families are written after the traversal with one HELP and TYPE line each */
+
+    void Flush (ExpositionBuffer *pOut, const char *pszPrefix)
+    {
+        if (NULL == pOut)
+            return;
+
+        for (const auto &Family : m_Families)
+        {
+            if (Family.Samples.empty())
+                continue;
+
+            pOut->Append ("# HELP ");
+            pOut->AppendMetricName (pszPrefix, Family.Name.c_str());
+            pOut->Append (' ');
+            pOut->Append (Family.Description.data(), Family.Description.size());
+            pOut->Append ("\n# TYPE ");
+            pOut->AppendMetricName (pszPrefix, Family.Name.c_str());
+            pOut->Append (' ');
+            pOut->Append (g_szPromTypeGauge);
+            pOut->Append ('\n');
+
+            for (const auto &Sample : Family.Samples)
+            {
+                pOut->Append (m_Arena.data() + Sample.Offset, Sample.HeaderLen);
+                pOut->AppendValue (m_Arena.data() + Sample.Offset + Sample.HeaderLen, Sample.ValueLen);
+                pOut->Append ('\n');
+            }
+        }
+    }
+
+
+private:
+
+    static bool IsValidLabelName (const std::string &Name)
+    {
+        if (Name.empty())
+            return false;
+
+        // Labels starting with __ are reserved for Prometheus
+        if ((Name.size() > 1) && ('_' == Name[0]) && ('_' == Name[1]))
+            return false;
+
+        for (size_t i=0; i<Name.size(); i++)
+        {
+            char c = Name[i];
+
+            if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ('_' == c))
+                continue;
+
+            if ((i > 0) && (c >= '0') && (c <= '9'))
+                continue;
+
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool Matches (const RELABEL_RULE &Rule, const char **pSeg, size_t SegCount)
+    {
+        size_t i   = 0;
+        size_t Len = 0;
+
+        for (i=0; i<Rule.Segments.size(); i++)
+        {
+            const RELABEL_SEGMENT &Segment = Rule.Segments[i];
+
+            if (i >= SegCount)
+                return false;
+
+            if (RELABEL_REST == Segment.Kind)
+                return true;
+
+            Len = pSeg[i+1] - pSeg[i] - 1;
+
+            if (RELABEL_LITERAL == Segment.Kind)
+            {
+                if ((Len != Segment.Text.size()) || memcmp (pSeg[i], Segment.Text.data(), Len))
+                    return false;
+            }
+            else if (0 == Len)
+            {
+                return false;
+            }
+        }
+
+        return (i == SegCount);
+    }
+
+    int Render (const RELABEL_RULE &Rule, const char *pszMetric, const char *pszMetricLower, const char **pSeg, size_t SegCount, const char *pszDescription, std::string &Sample)
+    {
+        std::string Family;
+        std::string Labels;
+        size_t i      = 0;
+        size_t Offset = 0;
+        size_t Len    = 0;
+        int    Index  = 0;
+
+        for (i=0; i<Rule.Segments.size(); i++)
+        {
+            const RELABEL_SEGMENT &Segment = Rule.Segments[i];
+
+            Offset = pSeg[i] - pszMetricLower;
+
+            if (RELABEL_REST == Segment.Kind)
+                Len = strlen (pszMetric + Offset);
+            else
+                Len = pSeg[i+1] - pSeg[i] - 1;
+
+            if (RELABEL_LABEL == Segment.Kind)
+            {
+                Labels += Labels.empty() ? '{' : ',';
+                Labels += Segment.Text;
+                Labels += "=\"";
+                AppendEscapedLabelValue (Labels, pszMetric + Offset, Len);
+                Labels += '"';
+                continue;
+            }
+
+            if (Family.size())
+                Family += '_';
+
+            Family.append (pszMetric + Offset, Len);
+        }
+
+        if (Labels.size())
+            Labels += '}';
+
+        if (Rule.Family.size())
+            Family = Rule.Family;
+        else
+            ReplaceChars (&Family[0]);
+
+        /* The series is owned by the first stat mapped to it. The owner itself can be looked up again after a cache reset */
+        m_Key = Family;
+        m_Key += Labels;
+        std::transform (m_Key.begin(), m_Key.end(), m_Key.begin(), [] (unsigned char c) { return (char) tolower (c); });
+
+        auto itSeries = m_Series.find (m_Key);
+
+        if (itSeries == m_Series.end())
+        {
+            m_Series.emplace (m_Key, pszMetricLower);
+        }
+        else if (itSeries->second != pszMetricLower)
+        {
+            m_Collisions++;
+            AddInLogMessageText ("%s: Relabel rule %s maps %s to the series of %s, only the first stat is exported", 0, g_szTask, Rule.Pattern.c_str(), pszMetric, itSeries->second.c_str());
+            return DOMPROM_RELABEL_COLLISION;
+        }
+
+        auto it = m_FamilyIndex.find (Family);
+
+        if (it == m_FamilyIndex.end())
+        {
+            RELABEL_FAMILY NewFamily;
+
+            NewFamily.Name = Family;
+
+            if (IsNullStr (pszDescription))
+                AppendHelpText (NewFamily.Description, ("Domino Stat family - " + Rule.Pattern).c_str());
+            else
+                NewFamily.Description = pszDescription;
+
+            Index = (int) m_Families.size();
+            m_Families.push_back (NewFamily);
+            m_FamilyIndex[Family] = Index;
+        }
+        else
+        {
+            Index = it->second;
+        }
+
+        Sample  = Family;
+        Sample += Labels;
+        Sample += ' ';
+
+        return Index;
+    }
+
+    std::vector<RELABEL_RULE> m_Rules;
+    std::unordered_map<std::string, std::vector<size_t>> m_ByFacility;
+    std::vector<size_t> m_AnyFacility;
+    std::unordered_map<std::string, int> m_FamilyIndex;
+    std::vector<RELABEL_FAMILY> m_Families;
+    std::unordered_map<std::string, std::string> m_Series; // Lowercase family{labels} -> facility.stat of the first stat
+    size_t      m_Collisions = 0;
+    std::string m_Arena;  // Per cycle sample storage, keeps its capacity
+    std::string m_Key;
+};
+
+
+StatRelabeler g_Relabeler;
+
+
+/* Per statistic metadata, which does not change between cycles.
+   Filter decision, Prometheus name, description and the pre-rendered HELP/TYPE header are computed once per stat */
+
+#define DOMPROM_STAT_CACHE_MAX 200000
+
+struct STAT_CACHE_ENTRY
+{
+    bool        bExcluded;
+    int         FilterRule;   // Longest matching include/exclude rule or -1
+    int         Family;       // Relabel family index or -1
+    std::string MetricLower;  // facility.stat or family{labels} in lowercase for duplicate detection
+    std::string MetricName;   // Sanitized Prometheus name without prefix
+    HELP_TEXT   Help;         // Description in g_StatHelp. Offset DOMSTAT_HELP_NONE for the default description
+    const SPECIAL_STAT_TYPE *pSpecial; // Derived DominoHealth metric or NULL
+    std::string DefaultDescription;
+    std::string Header;       // HELP and TYPE lines without the description followed by the metric name of the sample line. Sample name only for relabeled stats
+    size_t      HelpPos;      // Position in the header where the description is written
+};
+
+
+/* The cache works on the filter, description arena and relabel rules it is constructed with.
+   The server uses the global instances, a replay its own */
+
+class StatMetadataCache
+{
+
+public:
+
+    StatMetadataCache (PrefixFilter &Filter, HelpTextArena &Help, StatRelabeler &Relabeler)
+        : m_Filter (Filter), m_Help (Help), m_Relabeler (Relabeler)
+    {
+    }
+
+    const STAT_CACHE_ENTRY *Lookup (const char *pszPrefix, const char *pszFacility, const char *pszStatName)
+    {
+        if (m_Prefix != pszPrefix)
+        {
+            Clear();
+            m_Prefix = pszPrefix;
+        }
+
+        // The key buffer keeps its capacity, building the key does not allocate in steady state
+        m_Key.assign (pszFacility);
+        m_Key.push_back ('.');
+        m_Key.append (pszStatName);
+
+        auto it = m_Cache.find (m_Key);
+
+        if (it != m_Cache.end())
+            return &it->second;
+
+        // Stats containing changing names (like PIDs) must not grow the cache endlessly
+        if (m_Cache.size() >= DOMPROM_STAT_CACHE_MAX)
+            Clear();
+
+        STAT_CACHE_ENTRY &Entry = m_Cache[m_Key];
+        Build (Entry, pszFacility, pszStatName);
+
+        return &Entry;
+    }
+
+    void Clear ()
+    {
+        m_Cache.clear();
+    }
+
+    size_t Size () const
+    {
+        return m_Cache.size();
+    }
+
+    /* Descriptions are not copied into the cache, they are written from the arena */
+    std::string_view GetDescription (const STAT_CACHE_ENTRY *pEntry) const
+    {
+        if (DOMSTAT_HELP_NONE == pEntry->Help.Offset)
+            return pEntry->DefaultDescription;
+
+        return std::string_view (m_Help.Get (pEntry->Help), pEntry->Help.Len);
+    }
+
+    PrefixFilter &Filter ()
+    {
+        return m_Filter;
+    }
+
+    StatRelabeler &Relabeler ()
+    {
+        return m_Relabeler;
+    }
+
+
+private:
+
+    void Build (STAT_CACHE_ENTRY &Entry, const char *pszFacility, const char *pszStatName)
+    {
+        char szMetric[1024]      = {0};
+        char szMetricLower[1024] = {0};
+        char szDescription[MAX_STAT_DESC+1] = {0};
+
+        Entry.bExcluded      = false;
+        Entry.FilterRule     = -1;
+        Entry.Family         = -1;
+        Entry.Help           = { DOMSTAT_HELP_NONE, 0 };
+        Entry.pSpecial       = NULL;
+        Entry.HelpPos        = 0;
+
+        /* Exclude Domino Health stats because they are maintained in this application */
+        if (g_wWriteDominoHealthStats)
+        {
+            if (0 == CompareCaseInsensitive (pszFacility, g_szDominoHealth))
+            {
+                Entry.bExcluded = true;
+                return;
+            }
+        }
+
+        snprintf (szMetric, sizeof (szMetric), "%s.%s", pszFacility, pszStatName);
+
+        OSTranslate32 (OS_TRANSLATE_UPPER_TO_LOWER, szMetric, MAXDWORD, szMetricLower, sizeof (szMetricLower));
+
+        Entry.FilterRule = m_Filter.Match (szMetricLower);
+
+        if (m_Filter.IsExcludeRule (Entry.FilterRule))
+        {
+            Entry.bExcluded = true;
+            return;
+        }
+
+        Entry.MetricLower = szMetricLower;
+
+        if (false == m_Help.Find (szMetricLower, Entry.Help))
+            Entry.Help = { DOMSTAT_HELP_NONE, 0 };
+
+        Entry.Family = m_Relabeler.Match (szMetric, szMetricLower, (DOMSTAT_HELP_NONE == Entry.Help.Offset) ? NULL : m_Help.Get (Entry.Help), Entry.MetricName);
+
+        if (DOMPROM_RELABEL_COLLISION == Entry.Family)
+        {
+            Entry.bExcluded = true;
+            return;
+        }
+
+        if (Entry.Family >= 0)
+        {
+            /* The labeled series name is used for duplicate detection, different stats must not map to the same series */
+            Entry.MetricLower.resize (Entry.MetricName.size() - 1);
+            std::transform (Entry.MetricName.begin(), Entry.MetricName.end() - 1, Entry.MetricLower.begin(), [] (unsigned char c) { return (char) tolower (c); });
+
+            Entry.Header.clear();
+            AppendMetricName (Entry.Header, Entry.MetricName);
+        }
+
+        /* Use the combined and converted metric for statistic name conversion */
+        ReplaceChars (szMetric);
+        Entry.pSpecial = FindSpecialStat (szMetric);
+
+        if (DOMSTAT_HELP_NONE == Entry.Help.Offset)
+        {
+            snprintf (szDescription, sizeof (szDescription), "Domino Stat - %s.%s", pszFacility, pszStatName);
+            AppendHelpText (Entry.DefaultDescription, szDescription);
+        }
+
+        if (Entry.Family >= 0)
+            return;
+
+        Entry.MetricName = szMetric;
+
+        Entry.Header.reserve (3 * (m_Prefix.size() + Entry.MetricName.size()) + 64);
+
+        Entry.Header  = "# HELP ";
+        AppendMetricName (Entry.Header, Entry.MetricName);
+        Entry.Header += ' ';
+        Entry.HelpPos = Entry.Header.size();
+        Entry.Header += "\n# TYPE ";
+        AppendMetricName (Entry.Header, Entry.MetricName);
+        Entry.Header += ' ';
+        Entry.Header += g_szPromTypeGauge;
+        Entry.Header += '\n';
+        AppendMetricName (Entry.Header, Entry.MetricName);
+        Entry.Header += ' ';
+    }
+
+    void AppendMetricName (std::string &Str, const std::string &Name) const
+    {
+        Str += m_Prefix;
+        Str += '_';
+        Str += Name;
+    }
+
+    PrefixFilter  &m_Filter;
+    HelpTextArena &m_Help;
+    StatRelabeler &m_Relabeler;
+    std::string m_Prefix;
+    std::string m_Key;
+    std::unordered_map<std::string, STAT_CACHE_ENTRY> m_Cache;
+};
+
+
+StatMetadataCache g_StatCache (g_StatsFilter, g_StatHelp, g_Relabeler);
+
+
+STATUS LNCALLBACK DomExportTraverse (void *pContext, char *pszFacility, char *pszStatName, WORD wValueType, void *pValue);
+
+
+/* Facility scoped traversal.
+   A discovery cycle traverses all statistics and records the facilities. Until the next discovery each facility is
+   skipped if the filter rules exclude all its statistics, queried stat by stat if only a few statistics are included
+   below an excluded facility (like Traveler) or traversed on its own otherwise.
+   Facilities added between two discoveries (for example a server task started later) are exported after the next discovery.
+   The facility rules are checked against the filter the planner is constructed with, the server uses the global filter */
+
+#define DOMPROM_FACILITY_TARGETED_MAX 32
+
+enum FACILITY_MODE
+{
+    FACILITY_FULL = 0,
+    FACILITY_TARGETED,
+    FACILITY_SKIPPED,
+    FACILITY_MODES
+};
+
+struct FACILITY_PLAN_TYPE
+{
+    std::string   Name;
+    FACILITY_MODE Mode;
+    bool          bExcludedPrefix;    // The facility itself is excluded
+    bool          bIncludeBelow;      // Include rules for single stats or groups of the facility
+    std::vector<std::string> Stats;   // Included stats of a targeted facility
+    std::vector<std::pair<int, uint64_t>> ExcludedHits; // Excluded stats per filter rule, counted for skipped and targeted facilities between discoveries
+};
+
+
+class FacilityPlanner
+{
+public:
+
+    FacilityPlanner (PrefixFilter &Filter)
+        : m_Filter (Filter)
+    {
+    }
+
+    void Traverse (CONTEXT_STRUCT_TYPE *pStats)
+    {
+        uint64_t NowSec = GetTimeSec();
+
+        if (m_Facilities.empty() || (NowSec >= m_NextDiscoverySec))
+        {
+            BeginDiscovery();
+            StatTraverse (NULL, NULL, DomExportTraverse, pStats);
+            EndDiscovery();
+
+            m_NextDiscoverySec = NowSec + g_dwFacilityDiscoverySec;
+            return;
+        }
+
+        for (const auto &Facility : m_Facilities)
+        {
+            /* Statistics not traversed still count for their rule, with the numbers of the last discovery */
+            for (const auto &Hits : Facility.ExcludedHits)
+                pStats->pCache->Filter().CountHit (Hits.first, Hits.second);
+
+            switch (Facility.Mode)
+            {
+                case FACILITY_FULL:
+                    StatTraverse (Facility.Name.c_str(), NULL, DomExportTraverse, pStats);
+                    break;
+
+                case FACILITY_TARGETED:
+                    for (const auto &Stat : Facility.Stats)
+                        StatTraverse (Facility.Name.c_str(), Stat.c_str(), DomExportTraverse, pStats);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    /* Called from the traversal callback for every statistic during a discovery */
+    void Observe (const char *pszFacility, const char *pszStatName, const STAT_CACHE_ENTRY *pEntry)
+    {
+        if (false == m_bDiscovering)
+            return;
+
+        /* StatTraverse returns the statistics grouped by facility */
+        if ((NULL == m_pCurrent) || strcmp (m_pCurrent->Name.c_str(), pszFacility))
+            m_pCurrent = FindOrAdd (pszFacility);
+
+        if (m_pCurrent->bExcludedPrefix && m_pCurrent->bIncludeBelow && (false == pEntry->bExcluded) && (m_pCurrent->Stats.size() <= DOMPROM_FACILITY_TARGETED_MAX))
+            m_pCurrent->Stats.push_back (pszStatName);
+
+        if (pEntry->bExcluded && (pEntry->FilterRule >= 0))
+            AddExcludedHit (m_pCurrent, pEntry->FilterRule);
+    }
+
+    void WriteStats (ExpositionBuffer *pOut) const
+    {
+        static const char *pszModes[FACILITY_MODES] = { "full", "targeted", "skipped" };
+        char szLine[MAXSPRINTF+1] = {0};
+
+        if ((NULL == pOut) || m_Facilities.empty())
+            return;
+
+        WriteHelpAndType (pOut, g_szDominoHealth, "stat_facilities", NULL, "Domino statistic facilities by traversal mode (full, targeted, skipped)");
+
+        for (int i = 0; i < FACILITY_MODES; i++)
+        {
+            snprintf (szLine, sizeof (szLine), "%s_stat_facilities{mode=\"%s\"} %u", g_szDominoHealth, pszModes[i], (DWORD) m_Count[i]);
+            pOut->AppendSampleLine (szLine);
+        }
+    }
+
+
+private:
+
+    void BeginDiscovery ()
+    {
+        m_Facilities.clear();
+        m_pCurrent     = NULL;
+        m_bDiscovering = true;
+    }
+
+    void EndDiscovery ()
+    {
+        m_bDiscovering = false;
+        m_pCurrent     = NULL;
+
+        memset (m_Count, 0, sizeof (m_Count));
+
+        for (auto &Facility : m_Facilities)
+        {
+            if (g_wWriteDominoHealthStats && (0 == CompareCaseInsensitive (Facility.Name.c_str(), g_szDominoHealth)))
+                Facility.Mode = FACILITY_SKIPPED;
+
+            else if (false == Facility.bExcludedPrefix)
+                Facility.Mode = FACILITY_FULL;
+
+            else if (false == Facility.bIncludeBelow)
+                Facility.Mode = FACILITY_SKIPPED;
+
+            else if (Facility.Stats.size() > DOMPROM_FACILITY_TARGETED_MAX)
+                Facility.Mode = FACILITY_FULL;
+
+            else if (Facility.Stats.size())
+                Facility.Mode = FACILITY_TARGETED;
+
+            else
+                Facility.Mode = FACILITY_SKIPPED;
+
+            if (FACILITY_TARGETED != Facility.Mode)
+                Facility.Stats.clear();
+
+            /* Excluded stats of a full traversed facility are counted by the traversal */
+            if (FACILITY_FULL == Facility.Mode)
+                Facility.ExcludedHits.clear();
+
+            m_Count[Facility.Mode]++;
+        }
+    }
+
+    void AddExcludedHit (FACILITY_PLAN_TYPE *pFacility, int Rule)
+    {
+        /* Only a few rules match the statistics of one facility */
+        for (auto &Hits : pFacility->ExcludedHits)
+        {
+            if (Hits.first == Rule)
+            {
+                Hits.second++;
+                return;
+            }
+        }
+
+        pFacility->ExcludedHits.push_back ({ Rule, 1 });
+    }
+
+    FACILITY_PLAN_TYPE *FindOrAdd (const char *pszFacility)
+    {
+        std::string Prefix;
+
+        for (auto &Facility : m_Facilities)
+        {
+            if (Facility.Name == pszFacility)
+                return &Facility;
+        }
+
+        Prefix = pszFacility;
+        Prefix += '.';
+        std::transform (Prefix.begin(), Prefix.end(), Prefix.begin(), [] (unsigned char c) { return (char) tolower (c); });
+
+        FACILITY_PLAN_TYPE Facility;
+
+        Facility.Name = pszFacility;
+        Facility.Mode = FACILITY_FULL;
+
+        /* The facility is excluded as a whole unless include rules start below it */
+        Facility.bExcludedPrefix = m_Filter.IsExcludeRule (m_Filter.Match (Prefix.c_str()));
+        Facility.bIncludeBelow   = m_Filter.HasIncludeRuleBelow (Prefix.c_str());
+
+        m_Facilities.push_back (Facility);
+
+        return &m_Facilities.back();
+    }
+
+    PrefixFilter &m_Filter;
+    std::list<FACILITY_PLAN_TYPE> m_Facilities;
+    FACILITY_PLAN_TYPE *m_pCurrent = NULL;
+    bool     m_bDiscovering     = false;
+    uint64_t m_NextDiscoverySec = 0;
+    size_t   m_Count[FACILITY_MODES] = {0};
+};
+
+
+FacilityPlanner g_FacilityPlan (g_StatsFilter);
+
+
+void WriteCachedStatsEntry (ExpositionBuffer *pOut, StatMetadataCache *pCache, const STAT_CACHE_ENTRY *pEntry, const char *pszValueString)
+{
+    /* Relabeled stats are collected per family and written after the traversal */
+    if (pEntry->Family >= 0)
+    {
+        pCache->Relabeler().AddSample (pEntry->Family, pEntry->Header, pszValueString);
+        return;
+    }
+
+    std::string_view Description = pCache->GetDescription (pEntry);
+
+    pOut->Append (pEntry->Header.data(), pEntry->HelpPos);
+    pOut->Append (Description.data(), Description.size());
+    pOut->Append (pEntry->Header.data() + pEntry->HelpPos, pEntry->Header.size() - pEntry->HelpPos);
+    pOut->AppendValue (pszValueString);
+    pOut->Append ('\n');
+}
+
+
+STATUS LNCALLBACK DomExportTraverse (void *pContext, char *pszFacility, char *pszStatName, WORD wValueType, void *pValue)
+{
+    STATUS error = NOERROR;
+
+    char   szValue[1024] = {0};
+
+    const char *szDescription  = NULL;
+    const STAT_CACHE_ENTRY *pEntry = NULL;
+
+    CONTEXT_STRUCT_TYPE *pStats = (CONTEXT_STRUCT_TYPE*)pContext;
+
+    if (NULL == pStats)
+        return ERR_MISC_INVALID_ARGS;
+
+    if ((NULL == pStats->pOut) || (NULL == pStats->pCache) || (NULL == pStats->pDuplicates))
+        return ERR_MISC_INVALID_ARGS;
+
+    pStats->CountAll++;
+
+    if (NULL == pszFacility)
+    {
+        pStats->CountInvalid++;
+        return ERR_MISC_INVALID_ARGS;
+    }
+
+    if (NULL == pszStatName)
+    {
+        pStats->CountInvalid++;
+        return ERR_MISC_INVALID_ARGS;
+    }
+
+    if (NULL == pValue)
+        return NOERROR;
+
+    pEntry = pStats->pCache->Lookup (pStats->szPrefix, pszFacility, pszStatName);
+
+    if (pStats->pPlanner)
+        pStats->pPlanner->Observe (pszFacility, pszStatName, pEntry);
+
+    if (pEntry->FilterRule >= 0)
+        pStats->pCache->Filter().CountHit (pEntry->FilterRule);
+
+    if (pEntry->bExcluded)
+    {
+        if (DOMPROM_RELABEL_COLLISION == pEntry->Family)
+            pStats->CountDuplicate++;
+        else
+            pStats->CountFiltered++;
+
+        return NOERROR;
+    }
+
+    /* Compare if the statistic case insensitive was written before and log case sensitive */
+    if (pStats->pDuplicates->Register (pEntry->MetricLower.c_str(), 0))
+    {
+        pStats->CountDuplicate++;
+
+        if (g_wLogLevel)
+        {
+            AddInLogMessageText ("%s: Duplicate Domino statistic found for: %s.%s", 0, g_szTask, pszFacility, pszStatName);
+        }
+        return NOERROR;
+    }
+
+    if (pEntry->pSpecial && (pEntry->pSpecial->wValueType == wValueType))
+    {
+        /* Arena texts and the default description are null terminated */
+        szDescription = pStats->pCache->GetDescription (pEntry).data();
+        pEntry->pSpecial->Handler (pStats->pOut, pEntry->pSpecial, szDescription, pValue);
+    }
+
+    switch (wValueType)
+    {
+        case VT_TEXT:
+
+            pStats->CountText++;
+
+            if (pStats->bExportText)
+            {
+                snprintf (szValue, sizeof (szValue), "%s", (char *)pValue);
+
+                TruncateAtFirstBlank (szValue);
+                WriteCachedStatsEntry (pStats->pOut, pStats->pCache, pEntry, szValue);
+            }
+            break;
+
+        case VT_LONG:
+
+            pStats->CountLong++;
+
+            if (pStats->bExportLong)
+            {
+                /* LONG stats are signed */
+                FormatPromI64 (szValue, *(LONG *) pValue);
+                WriteCachedStatsEntry (pStats->pOut, pStats->pCache, pEntry, szValue);
+            }
+            break;
+
+        case VT_NUMBER:
+
+            pStats->CountNumber++;
+
+            if (pStats->bExportNumber)
+            {
+                /* 3 decimal fixed-point, NaN and Inf in Prometheus spelling */
+                FormatPromFixed3 (szValue, *(NUMBER *)pValue);
+                WriteCachedStatsEntry (pStats->pOut, pStats->pCache, pEntry, szValue);
+            }
+
+            break;
+
+        case VT_TIMEDATE:
+
+            pStats->CountTime++;
+
+            if (pStats->bExportTime)
+            {
+                if (GetNotesTimeDateSting ((TIMEDATE *)pValue, sizeof (szValue), szValue))
+                {
+                    pStats->CountInvalid++;
+                }
+                else
+                {
+                    WriteCachedStatsEntry (pStats->pOut, pStats->pCache, pEntry, szValue);
+                }
+            }
+            break;
+
+        default:
+
+            pStats->CountUnknown++;
+            break;
+
+    } /* switch */
+
+    return error;
+}
+
+
+/* Growth rate of a value from a ring buffer of samples, at least g_dwForecastIntervalSec apart.
+   Theil-Sen estimator: The median of the slopes between all sample pairs. Single jumps like a cleanup
+   or a large copy don't tilt the rate like they would with a least squares fit */
+
+class GrowthEstimator
+{
+
+public:
+
+    void Add (uint64_t NowUs, double Value)
+    {
+        size_t Last = (m_Next + DOMPROM_FORECAST_SAMPLES - 1) % DOMPROM_FORECAST_SAMPLES;
+
+        if (m_Count && (NowUs - m_TimeUs[Last] < (uint64_t) g_dwForecastIntervalSec * 1000000))
+            return;
+
+        m_TimeUs[m_Next] = NowUs;
+        m_Value[m_Next]  = Value;
+        m_Next = (m_Next + 1) % DOMPROM_FORECAST_SAMPLES;
+
+        if (m_Count < DOMPROM_FORECAST_SAMPLES)
+            m_Count++;
+    }
+
+    void Reset ()
+    {
+        m_Count = 0;
+        m_Next  = 0;
+    }
+
+    /* Change per second. False until enough samples are collected */
+    bool GetRate (double &PerSec) const
+    {
+        double Slopes[DOMPROM_FORECAST_SAMPLES * (DOMPROM_FORECAST_SAMPLES - 1) / 2];
+        size_t Count = 0;
+        size_t Mid   = 0;
+
+        if (m_Count < DOMPROM_FORECAST_MIN_SAMPLES)
+            return false;
+
+        /* The slope of a pair does not depend on the order, the ring buffer does not need to be unrolled */
+        for (size_t i = 0; i < m_Count; i++)
+        {
+            for (size_t j = i + 1; j < m_Count; j++)
+            {
+                int64_t DiffUs = (int64_t) (m_TimeUs[j] - m_TimeUs[i]);
+
+                if (DiffUs)
+                    Slopes[Count++] = (m_Value[j] - m_Value[i]) * 1000000.0 / (double) DiffUs;
+            }
+        }
+
+        if (0 == Count)
+            return false;
+
+        Mid = Count / 2;
+        std::nth_element (Slopes, Slopes + Mid, Slopes + Count);
+        PerSec = Slopes[Mid];
+
+        /* Even number of slopes: Average with the largest value of the lower half */
+        if (0 == (Count % 2))
+            PerSec = (PerSec + *std::max_element (Slopes, Slopes + Mid)) / 2;
+
+        return true;
+    }
+
+
+private:
+
+    uint64_t m_TimeUs[DOMPROM_FORECAST_SAMPLES] = {0};
+    double   m_Value[DOMPROM_FORECAST_SAMPLES]  = {0};
+    size_t   m_Count = 0;
+    size_t   m_Next  = 0;
+};
+
+
+/* Disk statistics for the Domino data paths. Paths are mapped to their filesystem first,
+   so statvfs and /proc/diskstats are queried once per filesystem instead of once per component */
+
+class DiskCollector
+{
+
+public:
+
+    ~DiskCollector ()
+    {
+#ifndef _WIN32
+        if (m_DiskStatsFd >= 0)
+            close (m_DiskStatsFd);
+#endif
+    }
+
+    /* Called once the paths are read from notes.ini. The component and path labels are escaped here once */
+    void Init ()
+    {
+        const struct
+        {
+            const char *pszComponent;
+            const char *pszPath;
+        } Components[DOMPROM_DISK_MAX_COMPONENTS] =
+        {
+            { DOMPROM_DISK_COMPONENT_NOTESDATA,     g_szDataDir     },
+            { DOMPROM_DISK_COMPONENT_TRANSLOG,      g_szDirTranslog },
+            { DOMPROM_DISK_COMPONENT_DAOS,          g_szDirDAOS     },
+            { DOMPROM_DISK_COMPONENT_NIF,           g_szDirNIF      },
+            { DOMPROM_DISK_COMPONENT_FT,            g_szDirFT       },
+            { DOMPROM_DISK_COMPONENT_NOTES_TEMP,    g_szNotesTemp   },
+            { DOMPROM_DISK_COMPONENT_VIEW_REBUILD,  g_szViewRebuild },
+            { DOMPROM_DISK_COMPONENT_NOTES_LOG_DIR, g_szNotesLogDir },
+        };
+
+        m_ComponentCount = 0;
+
+        for (const auto &Component : Components)
+        {
+            if (IsNullStr (Component.pszPath))
+                continue;
+
+            DISK_COMPONENT_TYPE &Entry = m_Components[m_ComponentCount++];
+
+            Entry.pszComponent = Component.pszComponent;
+            Entry.pszPath      = Component.pszPath;
+            Entry.Filesystem   = -1;
+            Entry.LabelId      = 0;
+            Entry.LabelDevice.clear();
+
+            Entry.Labels  = "component=\"";
+            AppendEscapedLabelValue (Entry.Labels, Component.pszComponent, strlen (Component.pszComponent));
+            Entry.Labels += "\", path=\"";
+            AppendEscapedLabelValue (Entry.Labels, Component.pszPath, strlen (Component.pszPath));
+            Entry.Labels += '"';
+        }
+    }
+
+    void Collect ()
+    {
+        uint64_t NowUs = GetTimeUs();
+        double   Rate  = 0;
+
+        m_FilesystemCount = 0;
+
+        for (size_t i = 0; i < m_ComponentCount; i++)
+        {
+            m_Components[i].Filesystem = FindFilesystem (m_Components[i]);
+            UpdateDominoHealthStats (m_Components[i]);
+        }
+
+        ReadDiskStats();
+
+        /* Samples are filled after the device names are known from /proc/diskstats */
+        m_ComponentSamples.Clear();
+        m_InodeSamples.Clear();
+        m_DeviceSamples.Clear();
+        m_ForecastSamples.Clear();
+
+        for (size_t i = 0; i < m_ComponentCount; i++)
+        {
+            DISK_COMPONENT_TYPE &Component = m_Components[i];
+
+            if (Component.Filesystem < 0)
+                continue;
+
+            const DISK_FILESYSTEM_TYPE &Fs = m_Filesystems[Component.Filesystem];
+
+            if (Component.LabelDevice != Fs.Device)
+                InternComponentLabels (Component, Fs.Device);
+
+            if (auto *pSample = m_ComponentSamples.Add (Component.LabelId))
+            {
+                pSample->Values[DISK_VALUE_TOTAL] = Fs.TotalBytes;
+                pSample->Values[DISK_VALUE_FREE]  = Fs.FreeBytes;
+            }
+
+            /* Usage grows when free space shrinks. A disk not filling up is never full */
+            Component.FreeGrowth.Add (NowUs, (double) Fs.FreeBytes);
+
+            if (Component.FreeGrowth.GetRate (Rate))
+            {
+                if (auto *pSample = m_ForecastSamples.Add (Component.ForecastLabelId))
+                {
+                    pSample->Values[DISK_VALUE_GROWTH]  = Rate ? -Rate : 0;
+                    pSample->Values[DISK_VALUE_TO_FULL] = (Rate < 0) ? (double) Fs.FreeBytes / -Rate : INFINITY;
+                }
+            }
+
+            if (0 == Fs.TotalInodes)
+                continue;
+
+            if (auto *pSample = m_InodeSamples.Add (Component.InodeLabelId))
+            {
+                pSample->Values[DISK_VALUE_TOTAL] = Fs.TotalInodes;
+                pSample->Values[DISK_VALUE_FREE]  = Fs.FreeInodes;
+            }
+        }
+
+        /* I/O counters are per device. Components sharing a device are listed in one label to not count the I/O twice */
+        for (size_t i = 0; i < m_FilesystemCount; i++)
+        {
+            DISK_FILESYSTEM_TYPE &Fs = m_Filesystems[i];
+
+            if (false == Fs.bIO)
+                continue;
+
+            InternDeviceLabels (Fs);
+
+            if (auto *pSample = m_DeviceSamples.Add (Fs.LabelId))
+            {
+                pSample->Values[DISK_VALUE_READ_BYTES]    = Fs.ReadBytes;
+                pSample->Values[DISK_VALUE_WRITTEN_BYTES] = Fs.WrittenBytes;
+                pSample->Values[DISK_VALUE_IO_MSEC]       = Fs.IoTimeMsec;
+            }
+        }
+    }
+
+    void Write (ExpositionBuffer *pOut) const
+    {
+        if (NULL == pOut)
+            return;
+
+        m_ComponentSamples.Write (pOut, g_szDominoHealth, "disk_total_bytes", NULL, "Total disk size in bytes", DISK_VALUE_TOTAL, false);
+        m_ComponentSamples.Write (pOut, g_szDominoHealth, "disk_free_bytes",  NULL, "Free disk space in bytes", DISK_VALUE_FREE,  false);
+
+        /* Small files on NIF and FT volumes exhaust inodes before bytes */
+        m_InodeSamples.Write (pOut, g_szDominoHealth, "disk_inodes_total", NULL, "Total number of inodes of the filesystem", DISK_VALUE_TOTAL, false);
+        m_InodeSamples.Write (pOut, g_szDominoHealth, "disk_inodes_free",  NULL, "Free inodes of the filesystem",            DISK_VALUE_FREE,  false);
+
+        m_ForecastSamples.Write (pOut, g_szDominoHealth, "disk_usage_growth_bytes_per_second", NULL, "Growth rate of the used disk space (bytes per second, Theil-Sen estimate)", DISK_VALUE_GROWTH,  false);
+        m_ForecastSamples.Write (pOut, g_szDominoHealth, "disk_seconds_to_full",               NULL, "Predicted time until the disk is full at the current growth rate",       DISK_VALUE_TO_FULL, false);
+
+        m_DeviceSamples.Write (pOut, g_szDominoHealth, "disk_read_bytes_total",      "counter", "Bytes read from the device",                  DISK_VALUE_READ_BYTES,    false);
+        m_DeviceSamples.Write (pOut, g_szDominoHealth, "disk_written_bytes_total",   "counter", "Bytes written to the device",                 DISK_VALUE_WRITTEN_BYTES, false);
+        m_DeviceSamples.Write (pOut, g_szDominoHealth, "disk_io_time_seconds_total", "counter", "Time the device was busy with I/O (seconds)", DISK_VALUE_IO_MSEC,       true);
+    }
+
+    size_t FilesystemCount () const
+    {
+        return m_FilesystemCount;
+    }
+
+    /* Free bytes of a component from the last cycle */
+    bool GetComponentFree (const char *pszComponent, uint64_t &FreeBytes) const
+    {
+        for (size_t i = 0; i < m_ComponentCount; i++)
+        {
+            if (strcmp (m_Components[i].pszComponent, pszComponent) || (m_Components[i].Filesystem < 0))
+                continue;
+
+            FreeBytes = m_Filesystems[m_Components[i].Filesystem].FreeBytes;
+            return true;
+        }
+
+        return false;
+    }
+
+
+private:
+
+    enum
+    {
+        DISK_VALUE_TOTAL         = 0,
+        DISK_VALUE_FREE          = 1,
+        DISK_VALUE_READ_BYTES    = 0,
+        DISK_VALUE_WRITTEN_BYTES = 1,
+        DISK_VALUE_IO_MSEC       = 2,
+        DISK_VALUE_GROWTH        = 0,
+        DISK_VALUE_TO_FULL       = 1
+    };
+
+    struct DISK_COMPONENT_TYPE
+    {
+        const char *pszComponent;
+        const char *pszPath;
+        int         Filesystem;   // Index into m_Filesystems or -1 if the path cannot be accessed
+        std::string Labels;       // Escaped component and path labels
+        std::string LabelDevice;  // Device the label IDs were interned for
+        uint32_t    LabelId;
+        uint32_t    InodeLabelId;
+        uint32_t    ForecastLabelId;
+        GrowthEstimator FreeGrowth;
+    };
+
+    struct DISK_FILESYSTEM_TYPE
+    {
+        std::string Key;          // "major:minor" or the Windows volume path
+        std::string Device;       // Block device from /proc/diskstats. Key if not found
+        std::string Components;   // Comma separated components on this filesystem
+        std::string LabelDevice;  // Device and components the label ID was interned for
+        std::string LabelComponents;
+        uint32_t    LabelId;
+        unsigned    Major;
+        unsigned    Minor;
+        bool        bIO;          // Device found in /proc/diskstats
+        uint64_t    TotalBytes;
+        uint64_t    FreeBytes;
+        uint64_t    TotalInodes;
+        uint64_t    FreeInodes;
+        uint64_t    ReadBytes;
+        uint64_t    WrittenBytes;
+        uint64_t    IoTimeMsec;
+    };
+
+    /* Label sets only change if a path moves to another device */
+    void InternComponentLabels (DISK_COMPONENT_TYPE &Component, const std::string &Device)
+    {
+        m_Labels  = '{';
+        m_Labels += Component.Labels;
+        m_Labels += ", device=\"";
+        AppendEscapedLabelValue (m_Labels, Device.data(), Device.size());
+        m_Labels += "\"}";
+
+        Component.LabelId      = m_ComponentSamples.InternLabels (m_Labels);
+        Component.InodeLabelId = m_InodeSamples.InternLabels (m_Labels);
+        Component.ForecastLabelId = m_ForecastSamples.InternLabels (m_Labels);
+        Component.LabelDevice  = Device;
+
+        /* Free space of another filesystem is not comparable */
+        Component.FreeGrowth.Reset();
+    }
+
+    void InternDeviceLabels (DISK_FILESYSTEM_TYPE &Fs)
+    {
+        if ((Fs.LabelDevice == Fs.Device) && (Fs.LabelComponents == Fs.Components))
+            return;
+
+        m_Labels  = "{device=\"";
+        AppendEscapedLabelValue (m_Labels, Fs.Device.data(), Fs.Device.size());
+        m_Labels += "\", components=\"";
+        AppendEscapedLabelValue (m_Labels, Fs.Components.data(), Fs.Components.size());
+        m_Labels += "\"}";
+
+        Fs.LabelId         = m_DeviceSamples.InternLabels (m_Labels);
+        Fs.LabelDevice     = Fs.Device;
+        Fs.LabelComponents = Fs.Components;
+    }
+    int FindFilesystem (const DISK_COMPONENT_TYPE &Component)
+    {
+        unsigned Major = 0;
+        unsigned Minor = 0;
+
+        if (false == GetDiskDeviceFrom (Component.pszPath, m_Key, &Major, &Minor))
+            return -1;
+
+        for (size_t i = 0; i < m_FilesystemCount; i++)
+        {
+            if (m_Filesystems[i].Key == m_Key)
+            {
+                m_Filesystems[i].Components += ',';
+                m_Filesystems[i].Components += Component.pszComponent;
+                return (int) i;
+            }
+        }
+
+        DISK_FILESYSTEM_TYPE &Fs = m_Filesystems[m_FilesystemCount];
+
+        if (false == GetDiskUsageFrom (Component.pszPath, &Fs.TotalBytes, &Fs.FreeBytes, &Fs.TotalInodes, &Fs.FreeInodes))
+            return -1;
+
+        Fs.Key.swap (m_Key);
+        Fs.Device     = Fs.Key;
+        Fs.Components = Component.pszComponent;
+        Fs.Major      = Major;
+        Fs.Minor      = Minor;
+        Fs.bIO        = false;
+
+        Fs.ReadBytes    = 0;
+        Fs.WrittenBytes = 0;
+        Fs.IoTimeMsec   = 0;
+
+        return (int) m_FilesystemCount++;
+    }
+
+    void UpdateDominoHealthStats (const DISK_COMPONENT_TYPE &Component)
+    {
+        char szMetric[1024] = {0};
+        uint64_t TotalBytes = 0;
+        uint64_t FreeBytes  = 0;
+
+        if (0 == g_wWriteDominoHealthStats)
+            return;
+
+        if (Component.Filesystem >= 0)
+        {
+            TotalBytes = m_Filesystems[Component.Filesystem].TotalBytes;
+            FreeBytes  = m_Filesystems[Component.Filesystem].FreeBytes;
+        }
+
+        snprintf (szMetric, sizeof (szMetric), "Disk.%s.Total_MB", Component.pszComponent);
+        StatUpdateNumberBytesInMB (g_szDominoHealth, szMetric, TotalBytes);
+
+        snprintf (szMetric, sizeof (szMetric), "Disk.%s.Free_MB", Component.pszComponent);
+        StatUpdateNumberBytesInMB (g_szDominoHealth, szMetric, FreeBytes);
+
+        snprintf (szMetric, sizeof (szMetric), "Disk.%s.Path", Component.pszComponent);
+        StatUpdateText (g_szDominoHealth, szMetric, Component.pszPath);
+    }
+
+    /* /proc/diskstats is kept open and read from offset 0 each cycle. Sectors are always 512 bytes in this file */
+    void ReadDiskStats ()
+    {
+#ifndef _WIN32
+        ssize_t Read   = 0;
+        size_t  Len    = 0;
+        unsigned Major = 0;
+        unsigned Minor = 0;
+        char    szName[64] = {0};
+        unsigned long long ReadSectors    = 0;
+        unsigned long long WrittenSectors = 0;
+        unsigned long long IoTimeMsec     = 0;
+
+        if (0 == m_FilesystemCount)
+            return;
+
+        if (m_DiskStatsFd < 0)
+        {
+            if (m_bDiskStatsFailed)
+                return;
+
+            m_DiskStatsFd = open (DOMPROM_DISKSTATS_FILE, O_RDONLY | O_CLOEXEC);
+
+            if (m_DiskStatsFd < 0)
+            {
+                m_bDiskStatsFailed = true;
+                AddInLogMessageText ("%s: Cannot open %s: %s", 0, g_szTask, DOMPROM_DISKSTATS_FILE, strerror (errno));
+                return;
+            }
+        }
+
+        if (m_Buffer.empty())
+            m_Buffer.resize (16384);
+
+        /* The file is generated on read. Grow the buffer until the whole file fits into one read */
+        while (true)
+        {
+            Read = pread (m_DiskStatsFd, &m_Buffer[0], m_Buffer.size() - 1, 0);
+
+            if (Read < 0)
+                return;
+
+            if ((size_t) Read < m_Buffer.size() - 1)
+                break;
+
+            m_Buffer.resize (m_Buffer.size() * 2);
+        }
+
+        Len = (size_t) Read;
+        m_Buffer[Len] = '\0';
+
+        for (char *pLine = &m_Buffer[0]; pLine < &m_Buffer[0] + Len; )
+        {
+            char *pEnd = strchr (pLine, '\n');
+
+            if (pEnd)
+                *pEnd = '\0';
+
+            /* major minor name reads merged sectors ms writes merged sectors ms in-flight io_ms ... */
+            if (6 == sscanf (pLine, "%u %u %63s %*u %*u %llu %*u %*u %*u %llu %*u %*u %llu", &Major, &Minor, szName, &ReadSectors, &WrittenSectors, &IoTimeMsec))
+            {
+                for (size_t i = 0; i < m_FilesystemCount; i++)
+                {
+                    DISK_FILESYSTEM_TYPE &Fs = m_Filesystems[i];
+
+                    if ((Fs.Major != Major) || (Fs.Minor != Minor))
+                        continue;
+
+                    Fs.Device       = szName;
+                    Fs.bIO          = true;
+                    Fs.ReadBytes    = (uint64_t) ReadSectors    * DOMPROM_DISKSTATS_SECTOR_BYTES;
+                    Fs.WrittenBytes = (uint64_t) WrittenSectors * DOMPROM_DISKSTATS_SECTOR_BYTES;
+                    Fs.IoTimeMsec   = (uint64_t) IoTimeMsec;
+                }
+            }
+
+            if (NULL == pEnd)
+                break;
+
+            pLine = pEnd + 1;
+        }
+#endif
+    }
+
+    DISK_COMPONENT_TYPE  m_Components[DOMPROM_DISK_MAX_COMPONENTS]  = {};
+    DISK_FILESYSTEM_TYPE m_Filesystems[DOMPROM_DISK_MAX_COMPONENTS] = {};
+    size_t      m_ComponentCount   = 0;
+    size_t      m_FilesystemCount  = 0;
+
+    LabeledSamples<2, DOMPROM_DISK_MAX_COMPONENTS> m_ComponentSamples;
+    LabeledSamples<2, DOMPROM_DISK_MAX_COMPONENTS> m_InodeSamples;
+    LabeledSamples<3, DOMPROM_DISK_MAX_COMPONENTS> m_DeviceSamples;
+    LabeledSamples<2, DOMPROM_DISK_MAX_COMPONENTS, double> m_ForecastSamples;
+
+    std::string m_Key;
+    std::string m_Labels;
+    std::string m_Buffer;
+    int         m_DiskStatsFd      = -1;
+    bool        m_bDiskStatsFailed = false;
+};
+
+
+DiskCollector g_DiskCollector;
+
+
+STATUS ProcessDiskStats (ExpositionBuffer *pOut)
+{
+    if (NULL == pOut)
+        return ERR_MISC_INVALID_ARGS;
+
+    g_DiskCollector.Collect();
+    g_DiskCollector.Write (pOut);
+
+    return NOERROR;
+}
+
+
+STATUS ProcessDaosStats (ExpositionBuffer *pOut)
+{
+    if (NULL == pOut)
+        return ERR_MISC_INVALID_ARGS;
+
+    if (g_wWriteDominoHealthStats)
+    {
+        StatUpdateNumber (g_szDominoHealth, "DAOS.Status", g_StatusDAOS);
+        StatUpdateNumber (g_szDominoHealth, "DAOS.Catalog.Status", g_dwDAOSCatalogStatus);
+    }
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "daos_status", "Domino DAOS enabled", g_StatusDAOS);
+
+    if (g_StatusDAOS)
+    {
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "daos_catalog_status",     "DAOS Catalog status (0=Unavailable, 1=Synced, 2=Needs Resync, 3=Resyncing, 4=Readonly, 5=Rebuilding)", g_dwDAOSCatalogStatus);
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "daos_catalog_not_synced", "Domino DAOS Catalog status (0 = in sync)", (1 == g_dwDAOSCatalogStatus) ? 0:1);
+    }
+
+    return NOERROR;
+}
+
+
+int HasFileExtension (const char *pszFilename, const char *pszExt)
+{
+    size_t len_f = strlen (pszFilename);
+    size_t len_e = strlen (pszExt);
+
+    if (len_f < len_e)
+        return 0;
+
+    return strcmp (pszFilename + len_f - len_e, pszExt) == 0;
+}
+
+
+/* Keeps count, lowest/highest extent number and size of the translog extents up to date.
+   On Linux an inotify watch on the translog directory delivers the changes. The directory is only scanned
+   at startup and after the event queue overflowed. Without inotify (Windows) the directory is scanned every cycle */
+
+class TranslogTracker
+{
+
+public:
+
+    ~TranslogTracker ()
+    {
+        StopWatch();
+    }
+
+    void Update (const char *pszDir)
+    {
+        if (m_Dir != pszDir)
+        {
+            StopWatch();
+            m_Dir = pszDir;
+            m_bRescan = true;
+            m_bWatchFailed = false;
+
+            m_CountGrowth.Reset();
+            m_BytesGrowth.Reset();
+        }
+
+#ifdef _WIN32
+        m_bRescan = true;
+#else
+        /* The watch is added before scanning, changes during the scan are applied afterwards again */
+        if ((m_InotifyFd < 0) && (false == m_bWatchFailed))
+            StartWatch();
+
+        if (m_InotifyFd >= 0)
+            ReadEvents();
+        else
+            m_bRescan = true;
+#endif
+
+        if (m_bRescan)
+        {
+            m_bRescan = false;
+            m_Rescans++;
+            Rescan();
+        }
+        else
+        {
+            RefreshNewest();
+        }
+
+        m_CountGrowth.Add (GetTimeUs(), (double) m_Extents.size());
+        m_BytesGrowth.Add (GetTimeUs(), (double) m_Bytes);
+    }
+
+    /* Growth in extents and bytes per second */
+    bool GetCountRate (double &PerSec) const
+    {
+        return m_CountGrowth.GetRate (PerSec);
+    }
+
+    bool GetBytesRate (double &PerSec) const
+    {
+        return m_BytesGrowth.GetRate (PerSec);
+    }
+
+    size_t Count () const
+    {
+        return m_Extents.size();
+    }
+
+    size_t Min () const
+    {
+        return m_Extents.empty() ? 0 : m_Extents.begin()->first;
+    }
+
+    size_t Max () const
+    {
+        return m_Extents.empty() ? 0 : m_Extents.rbegin()->first;
+    }
+
+    uint64_t Bytes () const
+    {
+        return m_Bytes;
+    }
+
+    uint64_t Rescans () const
+    {
+        return m_Rescans;
+    }
+
+
+private:
+
+    void Clear ()
+    {
+        m_Extents.clear();
+        m_Bytes = 0;
+    }
+
+    void SetExtent (const char *pszName, uint64_t Bytes)
+    {
+        size_t Num = GetTranslogExtendNumber (pszName);
+
+        if (0 == Num)
+            return;
+
+        auto Result = m_Extents.emplace (Num, Bytes);
+
+        if (false == Result.second)
+        {
+            m_Bytes -= Result.first->second;
+            Result.first->second = Bytes;
+        }
+
+        m_Bytes += Bytes;
+    }
+
+    void RemoveExtent (const char *pszName)
+    {
+        auto it = m_Extents.find (GetTranslogExtendNumber (pszName));
+
+        if (it == m_Extents.end())
+            return;
+
+        m_Bytes -= it->second;
+        m_Extents.erase (it);
+    }
+
+    /* Returns false if the file does not exist (anymore) */
+    bool GetExtentSize (const char *pszName, uint64_t &Bytes)
+    {
+        m_Path  = m_Dir;
+        m_Path += g_DirSep;
+        m_Path += pszName;
+
+#ifdef _WIN32
+        struct _stat64 st = {0};
+
+        if (_stat64 (m_Path.c_str(), &st))
+            return false;
+#else
+        struct stat st = {0};
+
+        if (stat (m_Path.c_str(), &st))
+            return false;
+#endif
+
+        Bytes = (uint64_t) st.st_size;
+        return true;
+    }
+
+    /* The active extent is written without close events */
+    void RefreshNewest ()
+    {
+        char     szName[40] = {0};
+        uint64_t Bytes      = 0;
+
+        if (m_Extents.empty())
+            return;
+
+        auto it = std::prev (m_Extents.end());
+
+        snprintf (szName, sizeof (szName), "S%07zu%s", it->first, DOMPROM_TRANSLOG_EXTENSION);
+
+        if (GetExtentSize (szName, Bytes))
+        {
+            m_Bytes += Bytes - it->second;
+            it->second = Bytes;
+        }
+    }
+
+#ifdef _WIN32
+
+    void Rescan ()
+    {
+        char szPattern[MAX_PATH] = {0};
+        WIN32_FIND_DATAA FindData;
+        HANDLE hFile = INVALID_HANDLE_VALUE;
+
+        Clear();
+
+        snprintf (szPattern, sizeof (szPattern), "%s\\*%s", m_Dir.c_str(), DOMPROM_TRANSLOG_EXTENSION);
+
+        hFile = FindFirstFileA (szPattern, &FindData);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return;
+
+        do
+        {
+            if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                if (HasFileExtension (FindData.cFileName, DOMPROM_TRANSLOG_EXTENSION))
+                    SetExtent (FindData.cFileName, ((uint64_t) FindData.nFileSizeHigh << 32) | FindData.nFileSizeLow);
+            }
+        } while (FindNextFileA(hFile, &FindData));
+
+        FindClose(hFile);
+    }
+
+    void StopWatch ()
+    {
+    }
+
+#else
+
+    void Rescan ()
+    {
+        struct dirent *pEntry = NULL;
+        uint64_t Bytes = 0;
+
+        Clear();
+
+        DIR *pDir = opendir (m_Dir.c_str());
+
+        if (NULL == pDir)
+        {
+            perror("opendir");
+            goto Done;
+        }
+
+        while ((pEntry = readdir(pDir)) != NULL)
+        {
+            if (pEntry->d_type == DT_DIR)
+                continue;
+
+            if (false == HasFileExtension (pEntry->d_name, DOMPROM_TRANSLOG_EXTENSION))
+                continue;
+
+            if (GetExtentSize (pEntry->d_name, Bytes))
+                SetExtent (pEntry->d_name, Bytes);
+        }
+
+    Done:
+
+        if (pDir)
+        {
+            closedir (pDir);
+            pDir = NULL;
+        }
+    }
+
+    void StartWatch ()
+    {
+        m_InotifyFd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+        if (m_InotifyFd < 0)
+        {
+            m_bWatchFailed = true;
+            AddInLogMessageText ("%s: Cannot initialize inotify, scanning translog directory every cycle: %s", 0, g_szTask, strerror (errno));
+            return;
+        }
+
+        m_Watch = inotify_add_watch (m_InotifyFd, m_Dir.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+
+        if (m_Watch < 0)
+        {
+            m_bWatchFailed = true;
+            AddInLogMessageText ("%s: Cannot watch translog directory %s, scanning it every cycle: %s", 0, g_szTask, m_Dir.c_str(), strerror (errno));
+            StopWatch();
+            return;
+        }
+
+        m_bRescan = true;
+    }
+
+    void StopWatch ()
+    {
+        if (m_InotifyFd >= 0)
+            close (m_InotifyFd);
+
+        m_InotifyFd = -1;
+        m_Watch     = -1;
+    }
+
+    void ReadEvents ()
+    {
+        alignas (struct inotify_event) char Buffer[16384];
+        const struct inotify_event *pEvent = NULL;
+        ssize_t  Len   = 0;
+        uint64_t Bytes = 0;
+        bool     bWatchLost = false;
+
+        while ((Len = read (m_InotifyFd, Buffer, sizeof (Buffer))) > 0)
+        {
+            for (char *p = Buffer; p < Buffer + Len; p += sizeof (struct inotify_event) + pEvent->len)
+            {
+                pEvent = (const struct inotify_event *) p;
+
+                if (pEvent->mask & IN_Q_OVERFLOW)
+                {
+                    if (false == m_bRescan)
+                        AddInLogMessageText ("%s: Translog directory event queue overflow, rescanning", 0, g_szTask);
+
+                    m_bRescan = true;
+                    continue;
+                }
+
+                /* The directory was removed or renamed. Watch it again next cycle */
+                if (pEvent->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                {
+                    bWatchLost = true;
+                    continue;
+                }
+
+                if (m_bRescan || (0 == pEvent->len) || (pEvent->mask & IN_ISDIR))
+                    continue;
+
+                if (false == HasFileExtension (pEvent->name, DOMPROM_TRANSLOG_EXTENSION))
+                    continue;
+
+                if (pEvent->mask & (IN_DELETE | IN_MOVED_FROM))
+                    RemoveExtent (pEvent->name);
+
+                else if (GetExtentSize (pEvent->name, Bytes))
+                    SetExtent (pEvent->name, Bytes);
+            }
+        }
+
+        if (bWatchLost)
+        {
+            StopWatch();
+            m_bRescan = true;
+        }
+    }
+
+#endif
+
+    std::map<size_t, uint64_t> m_Extents;   // Extent number and size
+    GrowthEstimator m_CountGrowth;
+    GrowthEstimator m_BytesGrowth;
+    uint64_t    m_Bytes   = 0;
+    uint64_t    m_Rescans = 0;
+    std::string m_Dir;
+    std::string m_Path;
+    bool        m_bRescan      = true;
+    bool        m_bWatchFailed = false;
+    int         m_InotifyFd    = -1;
+    int         m_Watch        = -1;
+};
+
+
+TranslogTracker g_TranslogTracker;
+
+
+STATUS ProcessTranslogStats (ExpositionBuffer *pOut)
+{
+    size_t   NumTranslogFiles = 0;
+    double   Rate      = 0;
+    uint64_t FreeBytes = 0;
+    char     szValue[MAX_PROM_VALUE] = {0};
+
+    if (NULL == pOut)
+        return ERR_MISC_INVALID_ARGS;
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_style", "Domino Statistic Database.RM.Sys.Log.Type", g_wTranslogLogType);
+
+    if (g_wWriteDominoHealthStats)
+    {
+        StatUpdateNumber (g_szDominoHealth, "Translog.Style", g_wTranslogLogType);
+    }
+
+    if (g_wTranslogLogType != TRANSLOG_STYLE_ARCHIVE)
+    {
+        goto Done;
+    }
+
+    if (IsNullStr (g_szDirTranslog))
+    {
+        goto Done;
+    }
+
+    g_TranslogTracker.Update (g_szDirTranslog);
+
+    NumTranslogFiles = g_TranslogTracker.Count();
+
+    if (g_wWriteDominoHealthStats)
+    {
+        StatUpdateNumber (g_szDominoHealth, "Translog.File.Count", NumTranslogFiles);
+        StatUpdateNumber (g_szDominoHealth, "Translog.File.Min",   g_TranslogTracker.Min());
+        StatUpdateNumber (g_szDominoHealth, "Translog.File.Max",   g_TranslogTracker.Max());
+        StatUpdateNumberBytesInMB (g_szDominoHealth, "Translog.File.Size_MB", g_TranslogTracker.Bytes());
+    }
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_file_count", "Number of current Transaction Log Extends in Translog directory", NumTranslogFiles);
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_file_bytes", "Size of all Transaction Log Extends in Translog directory in bytes", g_TranslogTracker.Bytes());
+
+    WriteHelpAndType (pOut, g_szDominoHealth, "translog_rescans_total", "counter", "Full scans of the Translog directory (startup, event queue overflow or no inotify)");
+    pOut->AppendMetricName (g_szDominoHealth, "translog_rescans_total");
+    pOut->Append (' ');
+    pOut->AppendU64 (g_TranslogTracker.Rescans());
+    pOut->Append ('\n');
+
+    if (g_TranslogTracker.GetCountRate (Rate))
+    {
+        FormatPromDouble (szValue, Rate);
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_file_growth_per_second", "Growth rate of the number of Transaction Log Extends (per second, Theil-Sen estimate)", szValue);
+    }
+
+    if (g_TranslogTracker.GetBytesRate (Rate))
+    {
+        FormatPromDouble (szValue, Rate);
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_bytes_growth_per_second", "Growth rate of the Transaction Log Extends size (bytes per second, Theil-Sen estimate)", szValue);
+
+        /* Free space of the translog disk from the last disk collection */
+        if (g_DiskCollector.GetComponentFree (DOMPROM_DISK_COMPONENT_TRANSLOG, FreeBytes))
+        {
+            FormatPromDouble (szValue, (Rate > 0) ? (double) FreeBytes / Rate : INFINITY);
+            WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_seconds_to_full", "Predicted time until the Translog disk is full at the current Transaction Log growth rate", szValue);
+        }
+    }
+
+    if (0 == NumTranslogFiles)
+    {
+        goto Done;
+    }
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_file_min", "Lowest Transaction Log Extend Number in Translog directory", g_TranslogTracker.Min());
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "translog_file_max", "Highest Transaction Log Extend Number in Translog directory", g_TranslogTracker.Max());
+
+Done:
+
+    return NOERROR;
+}
+
+
+/* Parser for the "show trans" console output. One pass over the locked buffer, fields are string_views into it.
+   Only the sanitized operation names are copied into an arena, a small open addressing table over the arena
+   drops operations reported twice */
+
+class TransStatsParser
+{
+public:
+
+    TransStatsParser ()
+    {
+        m_Slots.resize (DOMPROM_TRANS_INITIAL_SLOTS, m_EmptySlot);
+    }
+
+    /* Lines up to the "Function" header are skipped. After it the first line which is not a row (the separator)
+       is skipped as well, the first line after the rows ends the table. Returns the number of unique operations */
+    DWORD Parse (const char *pszBuffer)
+    {
+        std::string_view Line;
+        std::string_view Name;
+        TRANS_ROW Row   = {0};
+        bool   bHeader  = false;
+        bool   bRows    = false;
+
+        m_Rows.clear();
+        m_Arena.clear();
+        std::fill (m_Slots.begin(), m_Slots.end(), m_EmptySlot);
+
+        if (NULL == pszBuffer)
+            return 0;
+
+        while (NextLine (&pszBuffer, Line))
+        {
+            if (false == bHeader)
+            {
+                bHeader = (std::string_view::npos != Line.find ("Function"));
+                continue;
+            }
+
+            if (false == ParseRow (Line, Name, Row))
+            {
+                if (false == bRows)
+                    continue;
+
+                break;
+            }
+
+            bRows = true;
+
+            /* Operations reported twice are written once */
+            if (AddName (Name, Row))
+                m_Rows.push_back (Row);
+        }
+
+        return (DWORD) m_Rows.size();
+    }
+
+    void Write (ExpositionBuffer *pOut) const
+    {
+        if ((NULL == pOut) || m_Rows.empty())
+            return;
+
+        WriteHelpAndType (pOut, g_szDominoTrans, "count", "counter", "Transaction count");
+
+        for (const auto &Row : m_Rows)
+        {
+            AppendSample (pOut, "count", Row);
+            pOut->AppendI64 (Row.Count);
+            pOut->Append ('\n');
+        }
+
+        WriteHelpAndType (pOut, g_szDominoTrans, "total_seconds", "counter", "Total transaction time in seconds");
+
+        for (const auto &Row : m_Rows)
+        {
+            AppendSample (pOut, "total_seconds", Row);
+            pOut->AppendFixed3 ((double) Row.TotalMsec / 1000.0);
+            pOut->Append ('\n');
+        }
+    }
+
+
+private:
+
+    struct TRANS_ROW
+    {
+        uint32_t Offset;      // Sanitized name in the arena
+        uint32_t Len;
+        int64_t  Count;
+        int64_t  TotalMsec;
+    };
+
+    struct TRANS_SLOT
+    {
+        uint32_t Hash;
+        uint32_t Row;
+    };
+
+    static constexpr TRANS_SLOT m_EmptySlot = { 0, 0xFFFFFFFF };
+
+    /* Line breaks and other control characters separate lines, empty lines are skipped */
+    static bool NextLine (const char **ppsz, std::string_view &Line)
+    {
+        const char *psz   = *ppsz;
+        const char *pStart = NULL;
+
+        while (*psz && ((unsigned char) *psz < 32))
+            psz++;
+
+        if ('\0' == *psz)
+            return false;
+
+        pStart = psz;
+
+        while ((unsigned char) *psz >= 32)
+            psz++;
+
+        Line  = std::string_view (pStart, (size_t) (psz - pStart));
+        *ppsz = psz;
+        return true;
+    }
+
+    /* The name ends with two blanks and can contain single blanks. Five numbers follow: count, min, max, total and average */
+    static bool ParseRow (std::string_view Line, std::string_view &Name, TRANS_ROW &Row)
+    {
+        int64_t Values[5] = {0};
+        size_t  Pos = Line.find ("  ");
+
+        if ((0 == Pos) || (std::string_view::npos == Pos))
+            return false;
+
+        const char *p    = Line.data() + Pos;
+        const char *pEnd = Line.data() + Line.size();
+
+        for (auto &Value : Values)
+        {
+            while ((p < pEnd) && (' ' == *p))
+                p++;
+
+            std::from_chars_result Result = std::from_chars (p, pEnd, Value);
+
+            if (Result.ec != std::errc())
+                return false;
+
+            p = Result.ptr;
+        }
+
+        Name          = Line.substr (0, Pos);
+        Row.Count     = Values[0];
+        Row.TotalMsec = Values[3];
+
+        return true;
+    }
+
+    /* Sanitizes the name into the arena. False for a name already seen */
+    bool AddName (std::string_view Name, TRANS_ROW &Row)
+    {
+        uint32_t Hash  = 2166136261U;
+        size_t   Start = m_Arena.size();
+        size_t   Mask  = 0;
+        size_t   Pos   = 0;
+        char     ch    = 0;
+
+        for (char c : Name)
+        {
+            ch = GetMetricNameChar (c);
+            m_Arena.push_back (ch);
+            Hash = (Hash ^ (unsigned char) ch) * 16777619U;
+        }
+
+        std::string_view Sanitized (m_Arena.data() + Start, Name.size());
+
+        /* Keep the load factor at or below 1/2 */
+        if (2 * (m_Rows.size() + 1) > m_Slots.size())
+            Grow();
+
+        Mask = m_Slots.size() - 1;
+
+        for (Pos = Hash & Mask; m_EmptySlot.Row != m_Slots[Pos].Row; Pos = (Pos + 1) & Mask)
+        {
+            const TRANS_ROW &Other = m_Rows[m_Slots[Pos].Row];
+
+            if ((m_Slots[Pos].Hash == Hash) && (Sanitized == std::string_view (m_Arena.data() + Other.Offset, Other.Len)))
+            {
+                m_Arena.resize (Start);
+                return false;
+            }
+        }
+
+        m_Slots[Pos] = { Hash, (uint32_t) m_Rows.size() };
+
+        Row.Offset = (uint32_t) Start;
+        Row.Len    = (uint32_t) Name.size();
+
+        return true;
+    }
+
+    void Grow ()
+    {
+        size_t Mask = 0;
+        size_t Pos  = 0;
+
+        m_Slots.assign (m_Slots.size() * 2, m_EmptySlot);
+        Mask = m_Slots.size() - 1;
+
+        for (uint32_t i = 0; i < m_Rows.size(); i++)
+        {
+            const TRANS_ROW &Row = m_Rows[i];
+            uint32_t Hash = 2166136261U;
+
+            for (uint32_t c = 0; c < Row.Len; c++)
+                Hash = (Hash ^ (unsigned char) m_Arena[Row.Offset + c]) * 16777619U;
+
+            for (Pos = Hash & Mask; m_EmptySlot.Row != m_Slots[Pos].Row; Pos = (Pos + 1) & Mask)
+                ;
+
+            m_Slots[Pos] = { Hash, i };
+        }
+    }
+
+    void AppendSample (ExpositionBuffer *pOut, const char *pszMetric, const TRANS_ROW &Row) const
+    {
+        pOut->AppendMetricName (g_szDominoTrans, pszMetric);
+        pOut->Append ("{op=\"");
+        pOut->Append (m_Arena.data() + Row.Offset, Row.Len);
+        pOut->Append ("\"} ");
+    }
+
+    std::vector<TRANS_ROW>  m_Rows;
+    std::vector<TRANS_SLOT> m_Slots;
+    std::string m_Arena;
+};
+
+
+/* Only the trans collector uses it, the collector pool never runs it twice at the same time */
+TransStatsParser g_TransParser;
+
+
+STATUS ProcessIOStat ()
+{
+    STATUS   error = NOERROR;
+    uint64_t TraceStartUs = TraceBegin();
+
+    error = NSFRemoteConsole (g_szLocalUser, "!show iostat", NULL);
+
+    TraceEnd ("NSFRemoteConsole show iostat", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText ("%s: Remote console command failed: show iostat", error, g_szTask);
+        goto Done;
+    }
+
+Done:
+
+    return error;
+}
+
+
+STATUS ProcessTransStats (const char *pszFilename)
+{
+    STATUS  error        = NOERROR;
+    DHANDLE hRetInfo     = NULLHANDLE;
+    BYTE    *pInfoBuffer = NULL;
+    bool    bWrite       = false;
+
+    DWORD dwStatsCount = 0;
+
+    uint64_t EpochSec = (uint64_t) time (NULL);
+    uint64_t TraceStartUs = 0;
+
+    if (IsNullStr (pszFilename))
+    {
+        return ERR_MISC_INVALID_ARGS;
+    }
+
+    TraceStartUs = TraceBegin();
+    error = NSFRemoteConsole (g_szLocalUser, "!show trans", &hRetInfo);
+    TraceEnd ("NSFRemoteConsole show trans", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText ("%s: Remote console command failed: show trans", error, g_szTask);
+        goto Done;
+    }
+
+    if (NULLHANDLE == hRetInfo)
+    {
+        error = ERR_MEMORY;
+        goto Done;
+    }
+
+    pInfoBuffer = OSLock (BYTE, hRetInfo);
+
+    if (NULL == pInfoBuffer)
+    {
+        error = ERR_MEMORY;
+        goto Done;
+    }
+
+    g_TransOut.Reset();
+    bWrite = true;
+
+    dwStatsCount = g_TransParser.Parse ((const char *) pInfoBuffer);
+
+    if (dwStatsCount)
+    {
+        g_TransParser.Write (&g_TransOut);
+    }
+
+    WriteStatsEntryToFile (&g_TransOut, g_szDominoTrans, "stat_transactions_update_timestamp", "Domino Transactions last update epoch time", EpochSec);
+
+Done:
+
+    if (pInfoBuffer)
+    {
+        OSUnlock (hRetInfo);
+        pInfoBuffer = NULL;
+    }
+
+    if (hRetInfo)
+    {
+        OSMemFree (hRetInfo);
+        hRetInfo = NULLHANDLE;
+    }
+
+    if (bWrite)
+    {
+        g_SnapshotWriter.Submit (SNAPSHOT_TRANS, g_TransOut, pszFilename, (0 == g_wHttpNoFile) || (0 == g_HttpServer.GetPort()), g_wFsync != 0);
+    }
+
+    return NOERROR;
+}
+
+
+WORD IsInMaintenanceMode()
+{
+    TIMEDATE tNow = {0};
+
+    if (g_wMaintenanceEnabled)
+        return 1;
+
+    if (false == g_bMaintenanceStartSet)
+        return 0;
+
+    OSCurrentTIMEDATE (&tNow);
+
+    if (TimeDateCompare (&tNow, &g_tMaintenanceStart) < 0)
+        return 0;
+
+    if (false == g_bMaintenanceEndSet)
+        return 3;
+
+    if (TimeDateCompare (&tNow, &g_tMaintenanceEnd) > 0)
+        return 0;
+
+    return 3;
+}
+
+
+STATUS MailBoxSearchCallback(void *pParam, SEARCH_MATCH far *pSearchInfo, ITEM_TABLE far *pSummaryInfo)
+{
+    STATUS error = NOERROR;
+    MAILBOX_STATS_TYPE *pCtx = (MAILBOX_STATS_TYPE *)pParam;
+    SEARCH_MATCH SearchMatch = {0};
+
+    NOTEHANDLE hNote = NULLHANDLE;
+    TIMEDATE   tNoteAdded = {0};
+    LONG       lWaitSec   = 0;
+
+    if ((NULL == pSearchInfo) || (NULL == pParam))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (NULL == pSearchInfo)
+        return ERR_MISC_INVALID_ARGS;
+
+    memcpy((char*)(&SearchMatch), (char *)pSearchInfo, sizeof (SEARCH_MATCH));
+
+    if (!(SearchMatch.SERetFlags & SE_FMATCH))
+        return(NOERROR);
+
+    if (!(SearchMatch.NoteClass & NOTE_CLASS_DOCUMENT))
+        return NOERROR;
+
+    if (NULLHANDLE == pCtx->hCurrentMailbox)
+    {
+        return ERR_MISC_INVALID_ARGS;
+    }
+
+    error = NSFNoteOpen (pCtx->hCurrentMailbox, SearchMatch.ID.NoteID, OPEN_SUMMARY, &hNote);
+
+    if (error)
+    {
+        /* Document can be deleted or just be gone */
+        return NOERROR;
+    }
+
+    NSFNoteGetInfo(hNote, _NOTE_ADDED_TO_FILE, &tNoteAdded);
+    NSFNoteClose (hNote);
+    hNote = NULLHANDLE;
+
+    lWaitSec = TimeDateDifference(&pCtx->tCurrentScanTime, &tNoteAdded);
+
+    if (lWaitSec < 0)
+        return NOERROR;
+
+    pCtx->total_wait_seconds += (uint64_t)lWaitSec;
+    pCtx->total_count++;
+
+    /* Buckets */
+    if (lWaitSec < 5 * 60)
+    {
+        pCtx->bucket_lt_5++;
+    }
+    else if (lWaitSec < 15 * 60)
+    {
+        pCtx->bucket_5_15++;
+    }
+    else if (lWaitSec < 60 * 60)
+    {
+        pCtx->bucket_15_60++;
+    }
+    else
+    {
+        pCtx->bucket_ge_60++;
+    }
+
+    return NOERROR;
+}
+
+
+void InitMailBoxStatsCtx(MAILBOX_STATS_TYPE *pCtx)
+{
+    memset(pCtx, 0, sizeof(MAILBOX_STATS_TYPE));
+    OSCurrentTIMEDATE(&pCtx->tCurrentScanTime);
+}
+
+
+STATUS ProcessOneMailBox(const char *pszMailBoxName, MAILBOX_STATS_TYPE *pMailboxStatsCtx, FORMULAHANDLE hFormula, TIMEDATE *ptStartTime)
+{
+    STATUS   error = NOERROR;
+    uint64_t TraceStartUs = 0;
+
+    if (IsNullStr(pszMailBoxName))
+        return ERR_MISC_INVALID_ARGS;
+
+    TraceStartUs = TraceBegin();
+    error = NSFDbOpen(pszMailBoxName, &(pMailboxStatsCtx->hCurrentMailbox));
+    TraceEnd ("NSFDbOpen mail.box", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText("%s: Error opening: %s", error, g_szTask, pszMailBoxName);
+        goto Done;
+    }
+
+    TraceStartUs = TraceBegin();
+
+    error = NSFSearch(pMailboxStatsCtx->hCurrentMailbox,
+                      hFormula,
+                      NULL,
+                      0,
+                      NOTE_CLASS_DOCUMENT,
+                      ptStartTime,
+                      MailBoxSearchCallback,
+                      pMailboxStatsCtx,
+                      NULL);
+
+    TraceEnd ("NSFSearch mail.box", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText("%s: Error searching: %s", error, g_szTask, pszMailBoxName);
+        goto Done;
+    }
+
+Done:
+
+    if (pMailboxStatsCtx->hCurrentMailbox)
+    {
+        NSFDbClose(pMailboxStatsCtx->hCurrentMailbox);
+        pMailboxStatsCtx->hCurrentMailbox = NULLHANDLE;
+    }
+
+    return error;
+}
+
+
+STATUS ProcessMailBoxStats ()
+{
+    STATUS  error = NOERROR;
+
+    WORD   wIdx        = 0;
+    WORD   wdc         = 0;
+    WORD   wFormulaLen = 0;
+    WORD   wMailBoxes  = 0;
+
+    MAILBOX_STATS_TYPE MailboxStats = {0};
+
+    TIMEDATE tStartTime = {0};
+
+    char szMailBoxName[MAXPATH+1] = {0};
+
+    char szFormula[] =
+        "(DeliveryPriority != {L}) & "
+        "(!@IsAvailable($SendAt) & "
+        "(@AddedToThisFile <= @Adjust(@Now; 0; 0; 0; 0; -5; 0)))";
+
+    FORMULAHANDLE hFormula = NULLHANDLE;
+
+    uint64_t t64BeginMsec = 0;
+    uint64_t t64EndMsec   = 0;
+    uint64_t TraceStartUs = 0;
+
+    if (0 == g_wCollectMailboxStats)
+        return NOERROR;
+
+    OSCurrentTIMEDATE(&tStartTime);
+
+    /* Check only the last 72h */
+    TimeDateAdjust(&tStartTime, 0, 0, -72, 0, 0, 0);
+
+    wMailBoxes = g_MailBoxes;
+
+    if (0 == wMailBoxes)
+        goto Done;
+
+    t64BeginMsec = GetTimeMs();
+    TraceStartUs = TraceBegin();
+
+    error = NSFFormulaCompile(NULL,
+                              0,
+                              szFormula,
+                              (WORD)strlen(szFormula),
+                              &hFormula,
+                              &wFormulaLen,
+                              &wdc,
+                              &wdc,
+                              &wdc,
+                              &wdc,
+                              &wdc);
+
+    TraceEnd ("NSFFormulaCompile mail.box", TraceStartUs);
+
+    if (error)
+    {
+        AddInLogMessageText("%s: Error compiling search formula", error, g_szTask);
+        hFormula = NULLHANDLE;
+        goto Done;
+    }
+
+    /* Scan into a local context. The result is published when the scan completed, it runs on a collector thread */
+    InitMailBoxStatsCtx(&MailboxStats);
+
+    if (1 == wMailBoxes)
+    {
+        error = ProcessOneMailBox("mail.box", &MailboxStats, hFormula, &tStartTime);
+    }
+    else
+    {
+        for (wIdx = 1; wIdx <= wMailBoxes; wIdx++)
+        {
+            snprintf(szMailBoxName, sizeof(szMailBoxName), "mail%u.box", wIdx);
+            error = ProcessOneMailBox(szMailBoxName, &MailboxStats, hFormula, &tStartTime);
+        }
+    }
+
+    t64EndMsec = GetTimeMs();
+    MailboxStats.MailBoxScanMsec = t64EndMsec - t64BeginMsec;
+
+    {
+        std::lock_guard<std::mutex> Lock (g_MailboxStatsMutex);
+        g_MailboxStats = MailboxStats;
+    }
+
+Done:
+
+    if (hFormula)
+    {
+        OSMemFree(hFormula);
+        hFormula = NULLHANDLE;
+    }
+
+    return error;
+}
+
+
+STATUS WriteMailBoxStats(ExpositionBuffer *pOut)
+{
+    STATUS error = NOERROR;
+    DWORD avg_lWaitSec = 0;
+    MAILBOX_STATS_TYPE MailboxStats = {0};
+
+    if (0 == g_wCollectMailboxStats)
+        return NOERROR;
+
+    {
+        std::lock_guard<std::mutex> Lock (g_MailboxStatsMutex);
+        MailboxStats = g_MailboxStats;
+    }
+
+    if (0 == MailboxStats.total_count)
+        avg_lWaitSec = 0;
+    else
+        avg_lWaitSec = (DWORD)(MailboxStats.total_wait_seconds / MailboxStats.total_count);
+
+    WriteStatsEntryToFile(pOut, g_szDominoHealth,
+        "mail_pending_avg_age_seconds",
+        "Average age of pending mail (seconds) in the mailbox waiting longer than 5 minutes",
+        avg_lWaitSec);
+
+    WriteStatsEntryToFile(pOut, g_szDominoHealth,
+        "mailbox_check_errors",
+        "Documents which cannot be opened in mailbox when checking pending messages",
+        MailboxStats.error_count);
+
+    WriteTimedateStat (pOut, "mailbox_check_timestamp", "Mailbox check last epoch time", &MailboxStats.tCurrentScanTime);
+
+    WriteStatsEntryToFileMSecToSeconds(pOut, g_szDominoHealth,
+        "mailbox_check_time",
+        "Mailbox check time in seconds",
+        (DWORD) MailboxStats.MailBoxScanMsec);
+
+    WriteStatsEntryToFile(pOut, g_szDominoHealth,
+        "mail_pending_age_5m_15m",
+        "Mailbox pending mail age 5–15 minutes",
+        MailboxStats.bucket_5_15);
+
+    WriteStatsEntryToFile(pOut, g_szDominoHealth,
+        "mail_pending_age_15m_60m",
+        "Mailbox pending mail age 15–60 minutes",
+        MailboxStats.bucket_15_60);
+
+    WriteStatsEntryToFile(pOut, g_szDominoHealth,
+        "mail_pending_age_ge_60m",
+        "Mailbox pending mail age >= 60 minutes",
+        MailboxStats.bucket_ge_60);
+
+    return error;
+}
+
+
+void WriteExporterCommonStats (ExpositionBuffer *pOut)
+{
+    char szTmp[MAXSPRINTF+1] = {0};
+    uint64_t EpochSec = (uint64_t) time (NULL);
+
+    if (NULL == pOut)
+        return;
+
+    snprintf (szTmp, sizeof (szTmp), "Domino Prometheus Exporter build version %s", g_szVersion);
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "Exporter_Build", szTmp, DOMPROM_VERSION_BUILD);
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "stat_update_timestamp", "Domino Statistic last update epoch time", EpochSec);
+
+    if (g_bMaintenanceStartSet)
+    {
+        AddInFormatErrorText(szTmp, "Start of maintenance window in epoch time (%z)", &g_tMaintenanceStart);
+        WriteTimedateStat (pOut, "maintenance_start_timestamp", szTmp, &g_tMaintenanceStart);
+    }
+
+    if (g_bMaintenanceEndSet)
+    {
+        AddInFormatErrorText(szTmp, "End of maintenance window in epoch time (%z)", &g_tMaintenanceEnd);
+        WriteTimedateStat (pOut, "maintenance_end_timestamp", szTmp, &g_tMaintenanceEnd);
+    }
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "maintenance_status", "Domino maintenance status", IsInMaintenanceMode());
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "server_restricted_status", "Domino server restricted status (notes.ini server_restricted)", g_wServerRestricted);
+
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "writer_skipped_snapshots_total", "Snapshots replaced by a newer one before the writer thread processed them", g_SnapshotWriter.SkippedSnapshots());
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "writer_errors_total", "Snapshots the writer thread could not write to disk", g_SnapshotWriter.WriteErrors());
+
+    if (g_wInPlace)
+    {
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "inplace_rewrites_total", "In-place statistics file rewritten because the layout changed", g_InPlaceStatsFile.GetRewrites());
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "inplace_patched_cycles_total", "Snapshots written by patching the values of the mapped statistics file", g_InPlaceStatsFile.GetPatchCycles());
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "inplace_patched_values_total", "Changed values patched into the mapped statistics file", g_InPlaceStatsFile.GetPatchedValues());
+    }
+
+    if (g_RemoteWrite.IsActive())
+    {
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "remote_write_pending_bytes", "Remote write data waiting in the WAL (bytes)", g_RemoteWrite.PendingBytes());
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "remote_write_sent_total", "Remote write requests accepted by the receiver", g_RemoteWrite.SentRequests());
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "remote_write_failed_total", "Remote write requests failed and retried", g_RemoteWrite.FailedRequests());
+        WriteStatsEntryToFile (pOut, g_szDominoHealth, "remote_write_dropped_total", "Remote write batches dropped (rejected or WAL full)", g_RemoteWrite.DroppedRequests());
+    }
+}
+
+
+
+int TimeToSeconds(int Hour, int Minute, int Second)
+{
+    return (Hour * 3600) + (Minute * 60) + Second;
+}
+
+
+BOOL ReadBusinessDays(BUSINESS_DAYS_TYPE &BusinessHours)
+{
+    BOOL bValid = TRUE;
+    char szBusinessDays[MAXSPRINTF+1] = {0};
+    char *pszToken = NULL;
+    char *pszNext  = NULL;
+
+    int StartDay = 0;
+    int EndDay   = 0;
+    int Day      = 0;
+
+    memset(&BusinessHours, 0, sizeof(BusinessHours));
+
+    if (OSGetEnvironmentString(ENV_DOMPROM_BUSINESSDAYS, szBusinessDays, sizeof(szBusinessDays)-1))
+    {
+        g_bBusinessHoursEnabled = TRUE;
+    }
+    else
+    {
+        if (0 == OSGetEnvironmentLong (ENV_DOMPROM_BUSINESSDAYS_ENABLED))
+        {
+            g_bBusinessHoursEnabled = FALSE;
+            return TRUE;
+        }
+
+        g_bBusinessHoursEnabled = TRUE;
+
+        /* Default: Monday-Friday */
+        BusinessHours.Days[1].bIsBusinessDay = TRUE;
+        BusinessHours.Days[2].bIsBusinessDay = TRUE;
+        BusinessHours.Days[3].bIsBusinessDay = TRUE;
+        BusinessHours.Days[4].bIsBusinessDay = TRUE;
+        BusinessHours.Days[5].bIsBusinessDay = TRUE;
+
+        if (g_wLogLevel)
+        {
+            AddInLogMessageText("%s: Notes.ini [Days] not found - using default Mon-Fri", 0, g_szTask);
+        }
+
+        return TRUE;
+    }
+
+    pszToken = strtok_r(szBusinessDays, ",", &pszNext);
+
+    while (pszToken)
+    {
+        /* Range: 1-5 */
+        if (strchr(pszToken, '-'))
+        {
+            if (2 != sscanf(pszToken, "%d-%d", &StartDay, &EndDay))
+            {
+                bValid = FALSE;
+            }
+            else if ((StartDay < 0) || (StartDay > 6) || (EndDay < 0) || (EndDay > 6))
+            {
+                bValid = FALSE;
+            }
+            else
+            {
+                Day = StartDay;
+
+                while (TRUE)
+                {
+                    BusinessHours.Days[Day].bIsBusinessDay = TRUE;
+
+                    if (Day == EndDay)
+                        break;
+
+                    Day++;
+
+                    if (Day > 6)
+                        Day = 0;
+                }
+            }
+        }
+        else
+        {
+            /* Single day */
+            if (1 != sscanf(pszToken, "%d", &Day))
+            {
+                bValid = FALSE;
+            }
+            else if ((Day < 0) || (Day > 6))
+            {
+                bValid = FALSE;
+            }
+            else
+            {
+                BusinessHours.Days[Day].bIsBusinessDay = TRUE;
+            }
+        }
+
+        pszToken = strtok_r(NULL, ",", &pszNext);
+    }
+
+    return bValid;
+}
+
+
+BOOL ReadBusinesHours (BUSINESS_DAYS_TYPE &BusinessHours)
+{
+    BOOL bValid = TRUE;
+    char szEnvName [MAXSPRINTF+1]     = {0};
+    char szBusinessHours[MAXSPRINTF+1]= {0};
+    char szDefaultBusinessHours[MAXSPRINTF+1]= {0};
+    char *pszBusinessHours = szDefaultBusinessHours;
+
+    LONG lWeekDay  = 0;
+    TIMEDATE tNow  = {0};
+    TIME NotesTime = {0};
+
+    if (FALSE == ReadBusinessDays(BusinessHours))
+        bValid = FALSE;
+
+    OSCurrentTIMEDATE (&tNow);
+
+    memcpy (&(NotesTime.GM), &tNow, sizeof (TIMEDATE));
+
+    if (TimeGMToLocal (&NotesTime))
+    {
+        AddInLogMessageText ("%s: Cannot convert time", 0, g_szTask);
+        bValid = FALSE;
+    }
+
+    if (FALSE == GetEnviromentLong (ENV_DOMPROM_BUSINESSHOURS_ZONE, &BusinessHours.lZone))
+    {
+        BusinessHours.lZone = NotesTime.zone;
+    }
+
+    if (FALSE == GetEnviromentLong (ENV_DOMPROM_BUSINESSHOURS_DST, &BusinessHours.lDST))
+    {
+        BusinessHours.lDST = NotesTime.dst;
+    }
+
+    NotesTime.zone = BusinessHours.lZone;
+    NotesTime.dst  = BusinessHours.lDST;
+
+    if (TimeGMToLocalZone (&NotesTime))
+    {
+        AddInLogMessageText ("%s: Cannot convert time", 0, g_szTask);
+        bValid = FALSE;
+    }
+
+    /* Notes Weekday starts at 1 */
+    if ((NotesTime.weekday < 1) || (NotesTime.weekday > 7))
+    {
+        AddInLogMessageText ("%s: Invalid Week day: %d", 0, g_szTask, NotesTime.weekday);
+        bValid = FALSE;
+    }
+
+    /* Get default business hours */
+    if (FALSE == OSGetEnvironmentString (ENV_DOMPROM_BUSINESSHOURS, szDefaultBusinessHours, sizeof (szDefaultBusinessHours)-1))
+    {
+        snprintf (szDefaultBusinessHours, sizeof (szDefaultBusinessHours), "%s", DOMPROM_DEFAULT_BUSINESSHOURS);
 
-STATUS MailBoxSearchCallback(void *pParam, SEARCH_MATCH far *pSearchInfo, ITEM_TABLE far *pSummaryInfo)
-{
-    STATUS error = NOERROR;
-    MAILBOX_STATS_TYPE *pCtx = (MAILBOX_STATS_TYPE *)pParam;
-    SEARCH_MATCH SearchMatch = {0};
+        if (g_wLogLevel)
+        {
+            AddInLogMessageText ("%s: Notes.ini %s=%s", 0, g_szTask, ENV_DOMPROM_BUSINESSHOURS, szBusinessHours);
+        }
+    }
 
-    NOTEHANDLE hNote = NULLHANDLE;
-    TIMEDATE   tNoteAdded = {0};
-    LONG       lWaitSec   = 0;
+    /* Normalize to Unix weekday: 0 = Sunday, 6 = Saturday */
+    for (lWeekDay = 0; lWeekDay < MAX_WEEKDAYS; lWeekDay++)
+    {
+        snprintf (szEnvName, sizeof (szEnvName), "%s%d", ENV_DOMPROM_BUSINESSHOURS, lWeekDay);
 
-    if ((NULL == pSearchInfo) || (NULL == pParam))
-        return ERR_MISC_INVALID_ARGS;
+        if (OSGetEnvironmentString (szEnvName, szBusinessHours, sizeof (szBusinessHours)-1))
+        {
+            /* Found */
+            pszBusinessHours = szBusinessHours;
+        }
+        else
+        {
+            /* Use default if not found */
+            pszBusinessHours = szDefaultBusinessHours;
 
-    if (NULL == pSearchInfo)
-        return ERR_MISC_INVALID_ARGS;
+            if (g_wLogLevel)
+            {
+                AddInLogMessageText ("%s: Notes.ini [%s] not found", 0, g_szTask, szEnvName);
+            }
+        }
 
-    memcpy((char*)(&SearchMatch), (char *)pSearchInfo, sizeof (SEARCH_MATCH));
+        if (IsNullStr (pszBusinessHours))
+        {
+            continue;
+        }
 
-    if (!(SearchMatch.SERetFlags & SE_FMATCH))
-        return(NOERROR);
+        /* Format: hh:mm:ss-hh:mm:ss */
+        if (6 != sscanf (pszBusinessHours, "%d:%d:%d-%d:%d:%d",
+            &BusinessHours.Days[lWeekDay].StartHour,
+            &BusinessHours.Days[lWeekDay].StartMinute,
+            &BusinessHours.Days[lWeekDay].StartSecond,
+            &BusinessHours.Days[lWeekDay].EndHour,
+            &BusinessHours.Days[lWeekDay].EndMinute,
+            &BusinessHours.Days[lWeekDay].EndSecond))
+        {
+            BusinessHours.Days[lWeekDay].StartSecond = 0;
+            BusinessHours.Days[lWeekDay].EndSecond   = 0;
 
-    if (!(SearchMatch.NoteClass & NOTE_CLASS_DOCUMENT))
-        return NOERROR;
+            /* Format: hh:mm-hh:mm */
+            if (4 != sscanf (pszBusinessHours, "%d:%d-%d:%d",
+                &BusinessHours.Days[lWeekDay].StartHour,
+                &BusinessHours.Days[lWeekDay].StartMinute,
+                &BusinessHours.Days[lWeekDay].EndHour,
+                &BusinessHours.Days[lWeekDay].EndMinute))
+            {
+                BusinessHours.Days[lWeekDay].StartMinute = 0;
+                BusinessHours.Days[lWeekDay].StartSecond = 0;
+                BusinessHours.Days[lWeekDay].EndMinute   = 0;
+                BusinessHours.Days[lWeekDay].EndSecond   = 0;
 
-    if (NULLHANDLE == pCtx->hCurrentMailbox)
+                /* Format: hh-hh */
+                if (2 != sscanf (pszBusinessHours, "%d-%d",
+                        &BusinessHours.Days[lWeekDay].StartHour,
+                        &BusinessHours.Days[lWeekDay].EndHour))
+                {
+                    AddInLogMessageText ("%s: Invalid business hours configuration [%s]: [%s]", 0, g_szTask, szEnvName, pszBusinessHours);
+                    bValid = FALSE;
+                }
+            }
+        }
+
+        BusinessHours.Days[lWeekDay].StartSeconds = TimeToSeconds (
+            BusinessHours.Days[lWeekDay].StartHour,
+            BusinessHours.Days[lWeekDay].StartMinute,
+            BusinessHours.Days[lWeekDay].StartSecond);
+
+        BusinessHours.Days[lWeekDay].EndSeconds = TimeToSeconds (
+            BusinessHours.Days[lWeekDay].EndHour,
+            BusinessHours.Days[lWeekDay].EndMinute,
+            BusinessHours.Days[lWeekDay].EndSecond);
+    } /* for */
+
+    if (g_wLogLevel)
     {
-        return ERR_MISC_INVALID_ARGS;
+        for (lWeekDay = 0; lWeekDay < MAX_WEEKDAYS; lWeekDay++)
+        {
+            AddInLogMessageText ("%s: BusinessHours[%d]: %02d:%02d:%02d - %02d:%02d:%02d, BusinessDay: %d", 0, g_szTask,
+                lWeekDay,
+                BusinessHours.Days[lWeekDay].StartHour,
+                BusinessHours.Days[lWeekDay].StartMinute,
+                BusinessHours.Days[lWeekDay].StartSecond,
+                BusinessHours.Days[lWeekDay].EndHour,
+                BusinessHours.Days[lWeekDay].EndMinute,
+                BusinessHours.Days[lWeekDay].EndSecond,
+                BusinessHours.Days[lWeekDay].bIsBusinessDay);
+        }
     }
 
-    error = NSFNoteOpen (pCtx->hCurrentMailbox, SearchMatch.ID.NoteID, OPEN_SUMMARY, &hNote);
+    return bValid;
+}
 
-    if (error)
+
+BOOL CheckBusinessHours (TIMEDATE *ptNow)
+{
+    TIME   NotesTime = {0};
+    LONG   lWeekDay  = 0;
+    int    CurrentSeconds = 0;
+
+    TIMEDATE tNow = {0};
+    char szNow [MAXALPHATIMEDATE+1] = {0};
+
+    if (FALSE == g_bBusinessHoursEnabled)
     {
-        /* Document can be deleted or just be gone */
-        return NOERROR;
+        g_bBusinessDay   = TRUE;
+        g_bBusinessHours = TRUE;
+        goto Done;
     }
 
-    NSFNoteGetInfo(hNote, _NOTE_ADDED_TO_FILE, &tNoteAdded);
-    NSFNoteClose (hNote);
-    hNote = NULLHANDLE;
+    if (NULL == ptNow)
+    {
+        OSCurrentTIMEDATE (&tNow);
+        ptNow = &tNow;
+    }
 
-    lWaitSec = TimeDateDifference(&pCtx->tCurrentScanTime, &tNoteAdded);
+    GetNotesTimeDateSting (ptNow, sizeof (szNow), szNow);
 
-    if (lWaitSec < 0)
-        return NOERROR;
+    memcpy (&(NotesTime.GM), ptNow, sizeof (TIMEDATE));
 
-    pCtx->total_wait_seconds += (uint64_t)lWaitSec;
-    pCtx->total_count++;
+    NotesTime.zone = g_BusinessHours.lZone;
+    NotesTime.dst  = g_BusinessHours.lDST;
 
-    /* Buckets */
-    if (lWaitSec < 5 * 60)
+    if (TimeGMToLocalZone (&NotesTime))
     {
-        pCtx->bucket_lt_5++;
+        AddInLogMessageText ("%s: Cannot convert time", 0, g_szTask);
+        goto Done;
     }
-    else if (lWaitSec < 15 * 60)
+
+    if ((NotesTime.weekday < 1) || (NotesTime.weekday > 7))
     {
-        pCtx->bucket_5_15++;
+        g_bBusinessDay   = TRUE;
+        g_bBusinessHours = TRUE;
+        goto Done;
     }
-    else if (lWaitSec < 60 * 60)
+
+    lWeekDay = NotesTime.weekday-1;
+
+    if (g_wLogLevel)
+        AddInLogMessageText ("%s: UNIX WeekDay: %d", 0, g_szTask, lWeekDay);
+
+    CurrentSeconds = TimeToSeconds (NotesTime.hour, NotesTime.minute, NotesTime.second);
+
+    if (FALSE == g_BusinessHours.Days[lWeekDay].bIsBusinessDay)
     {
-        pCtx->bucket_15_60++;
+        if (g_wLogLevel)
+            AddInLogMessageText ("%s: Not a work day", 0, g_szTask);
+
+        g_bBusinessDay   = FALSE;
+        g_bBusinessHours = FALSE;
+        goto Done;
     }
     else
     {
-        pCtx->bucket_ge_60++;
+        g_bBusinessDay = TRUE;
+    }
+
+    if (g_BusinessHours.Days[lWeekDay].StartSeconds <= g_BusinessHours.Days[lWeekDay].EndSeconds)
+    {
+        if ( (CurrentSeconds < g_BusinessHours.Days[lWeekDay].StartSeconds) ||
+             (CurrentSeconds > g_BusinessHours.Days[lWeekDay].EndSeconds))
+        {
+            if (g_wLogLevel)
+                AddInLogMessageText ("%s: Not in range (%d [%d - %d])", 0, g_szTask,
+                    CurrentSeconds, g_BusinessHours.Days[lWeekDay].StartSeconds, g_BusinessHours.Days[lWeekDay].EndSeconds);
+
+            g_bBusinessHours = FALSE;
+            goto Done;
+        }
+    }
+    else
+    {
+        if ( (CurrentSeconds < g_BusinessHours.Days[lWeekDay].StartSeconds) &&
+             (CurrentSeconds > g_BusinessHours.Days[lWeekDay].EndSeconds))
+        {
+            if (g_wLogLevel)
+                AddInLogMessageText ("%s: Not in range (%d [%d - %d])", 0, g_szTask,
+                    CurrentSeconds, g_BusinessHours.Days[lWeekDay].StartSeconds, g_BusinessHours.Days[lWeekDay].EndSeconds);
+
+            g_bBusinessHours = FALSE;
+            goto Done;
+        }
     }
 
+    g_bBusinessHours = TRUE;
+
+Done:
+
+    return g_bBusinessHours;
+}
+
+
+STATUS ProcessBusinesHours(ExpositionBuffer *pOut)
+{
+    CheckBusinessHours(NULL);
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "business_day",   "Domino Business Day (0 = Not a business day, 1 = Business day)",           g_bBusinessDay);
+    WriteStatsEntryToFile (pOut, g_szDominoHealth, "business_hours", "Domino Business Hours (0 = Not in business hours, 1 = In business hours)", g_bBusinessHours);
     return NOERROR;
 }
 
 
-void InitMailBoxStatsCtx(MAILBOX_STATS_TYPE *pCtx)
+/* Collectors which can block (remote console commands, mail.box scans, NRPC probes) run as independent jobs on a
+   small worker pool (notes.ini domprom_workers, default: 4). Each worker thread is registered with the Notes runtime.
+   The add-in thread waits for the jobs until the collector deadline and writes the statistics with the results ready by then.
+   A collector still running at that time is marked stale and is not started again until it returned */
+
+#define DOMPROM_MAX_WORKERS 16
+
+enum COLLECTOR_ID
+{
+    COLLECTOR_PROBE = 0,
+    COLLECTOR_TRANS,
+    COLLECTOR_IOSTAT,
+    COLLECTOR_MAILBOX,
+    COLLECTOR_COUNT
+};
+
+struct COLLECTOR_TYPE
+{
+    const char *pszName;
+    void (*pfnRun) ();
+    PHASE_ID    Phase;
+
+    // Protected by the pool mutex
+    bool     bUsed;
+    bool     bRunning;
+    bool     bStale;
+    uint64_t StartMsec;
+    uint64_t DurationMsec;
+};
+
+
+/* Result of the NSPing and names.nsf response time probe */
+
+struct PROBE_RESULT_TYPE
+{
+    bool  bValid;
+    DWORD dwServerState;
+    DWORD dwLatencyMsec;
+    DWORD dwResponseTimeMsec;
+};
+
+std::mutex g_ProbeMutex;
+PROBE_RESULT_TYPE g_ProbeResult = {0};
+
+
+void CollectServerProbe ()
+{
+    PROBE_RESULT_TYPE Result = {0};
+    STATUS PingErr     = NOERROR;
+    STATUS ResponseErr = NOERROR;
+
+    PingErr = GetServerPingLatency (g_szLocalUser, &Result.dwLatencyMsec);
+
+    if (PingErr)
+    {
+        switch (PingErr)
+        {
+            case ERR_SERVER_RESTRICTED:
+                Result.dwServerState = SERVER_STATE_RESTRICTED;
+                break;
+
+            case ERR_SERVER_UNAVAILABLE:
+                Result.dwServerState = SERVER_STATE_UNAVAILABLE;
+                break;
+
+            default:
+                Result.dwServerState = SERVER_STATE_NOT_REACHABLE;
+                break;
+        }
+    }
+    else
+    {
+        ResponseErr = GetServerResponseTimeMsec (g_szLocalUser, &Result.dwResponseTimeMsec);
+
+        if (NOERROR == ResponseErr)
+            Result.dwServerState = SERVER_STATE_AVAILABLE;
+        else
+            Result.dwServerState = SERVER_STATE_NOT_REACHABLE;
+    }
+
+    Result.bValid = true;
+
+    std::lock_guard<std::mutex> Lock (g_ProbeMutex);
+    g_ProbeResult = Result;
+}
+
+void CollectTransStats ()
+{
+    ProcessTransStats (g_szTransFilename);
+}
+
+void CollectIOStat ()
+{
+    ProcessIOStat();
+}
+
+void CollectMailBoxStats ()
 {
-    memset(pCtx, 0, sizeof(MAILBOX_STATS_TYPE));
-    OSCurrentTIMEDATE(&pCtx->tCurrentScanTime);
+    ProcessMailBoxStats();
 }
 
 
-STATUS ProcessOneMailBox(const char *pszMailBoxName, MAILBOX_STATS_TYPE *pMailboxStatsCtx, FORMULAHANDLE hFormula, TIMEDATE *ptStartTime)
+class CollectorPool
 {
-    STATUS error = NOERROR;
 
-    if (IsNullStr(pszMailBoxName))
-        return ERR_MISC_INVALID_ARGS;
+public:
 
-    error = NSFDbOpen(pszMailBoxName, &(pMailboxStatsCtx->hCurrentMailbox));
-    if (error)
+    ~CollectorPool ()
     {
-        AddInLogMessageText("%s: Error opening: %s", error, g_szTask, pszMailBoxName);
-        goto Done;
+        Stop (0);
     }
 
-    error = NSFSearch(pMailboxStatsCtx->hCurrentMailbox,
-                      hFormula,
-                      NULL,
-                      0,
-                      NOTE_CLASS_DOCUMENT,
-                      ptStartTime,
-                      MailBoxSearchCallback,
-                      pMailboxStatsCtx,
-                      NULL);
-
-    if (error)
+    void Start (DWORD dwWorkers)
     {
-        AddInLogMessageText("%s: Error searching: %s", error, g_szTask, pszMailBoxName);
-        goto Done;
-    }
+        if (dwWorkers > DOMPROM_MAX_WORKERS)
+            dwWorkers = DOMPROM_MAX_WORKERS;
 
-Done:
+        m_bStop = false;
 
-    if (pMailboxStatsCtx->hCurrentMailbox)
-    {
-        NSFDbClose(pMailboxStatsCtx->hCurrentMailbox);
-        pMailboxStatsCtx->hCurrentMailbox = NULLHANDLE;
+        for (DWORD i = 0; i < dwWorkers; i++)
+            m_Workers.emplace_back (&CollectorPool::WorkerThread, this);
     }
 
-    return error;
-}
+    /* Jobs still running after the timeout (for example a hanging NSFDbOpen) don't block the shutdown */
+    void Stop (DWORD dwTimeoutSec)
+    {
+        bool bJoin = true;
 
+        {
+            std::unique_lock<std::mutex> Lock (m_Mutex);
 
-STATUS ProcessMailBoxStats (DWORD dwIntervalSeconds)
-{
-    STATUS  error = NOERROR;
+            if (m_Workers.empty())
+                return;
 
-    WORD   wIdx        = 0;
-    WORD   wdc         = 0;
-    WORD   wFormulaLen = 0;
+            m_bStop = true;
 
-    TIMEDATE tNow       = {0};
-    TIMEDATE tStartTime = {0};
+            /* Queued collectors are not started anymore */
+            for (COLLECTOR_TYPE *pCollector : m_Queue)
+            {
+                pCollector->bRunning = false;
+                m_Active--;
+            }
 
-    char szMailBoxName[MAXPATH+1] = {0};
+            m_Queue.clear();
+        }
 
-    char szFormula[] =
-        "(DeliveryPriority != {L}) & "
-        "(!@IsAvailable($SendAt) & "
-        "(@AddedToThisFile <= @Adjust(@Now; 0; 0; 0; 0; -5; 0)))";
+        /* Idle workers exit right away, busy workers after their current job */
+        m_Wakeup.notify_all();
 
-    FORMULAHANDLE hFormula = NULLHANDLE;
+        {
+            std::unique_lock<std::mutex> Lock (m_Mutex);
 
-    uint64_t t64BeginMsec = 0;
-    uint64_t t64EndMsec   = 0;
+            m_Done.wait_for (Lock, std::chrono::seconds (dwTimeoutSec), [this] { return 0 == m_Active; });
 
-    OSCurrentTIMEDATE (&tNow);
+            bJoin = (0 == m_Active);
 
-    if (0 == g_wCollectMailboxStats)
-        return NOERROR;
+            if (false == bJoin)
+                AddInLogMessageText ("%s: %u collector jobs still running at shutdown", 0, g_szTask, m_Active);
+        }
 
-    if (TimeDateCompare (&tNow, &g_tNextMailboxStatsUpdate) < 0)
-    {
-        return NOERROR;
+        for (auto &Worker : m_Workers)
+        {
+            if (bJoin)
+                Worker.join();
+            else
+                Worker.detach();
+        }
+
+        m_Workers.clear();
     }
 
-    OSCurrentTIMEDATE (&g_tNextMailboxStatsUpdate);
-    TimeDateAdjust(&g_tNextMailboxStatsUpdate, dwIntervalSeconds, 0, 0, 0, 0, 0);
+    /* Queues a collector. Without workers the collector runs on the calling thread */
+    void Submit (COLLECTOR_TYPE &Collector)
+    {
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
 
-    OSCurrentTIMEDATE(&tStartTime);
+            Collector.bUsed = true;
 
-    /* Check only the last 72h */
-    TimeDateAdjust(&tStartTime, 0, 0, -72, 0, 0, 0);
+            // A collector still busy from an earlier cycle is not started twice
+            if (Collector.bRunning)
+                return;
 
-    if (0 == g_MailBoxes)
-        goto Done;
+            Collector.bRunning  = true;
+            Collector.StartMsec = GetTimeMs();
 
-    t64BeginMsec = GetTimeMs();
+            if (m_Workers.size())
+            {
+                m_Queue.push_back (&Collector);
+                m_Active++;
+                m_Wakeup.notify_one();
+                return;
+            }
+        }
 
-    error = NSFFormulaCompile(NULL,
-                              0,
-                              szFormula,
-                              (WORD)strlen(szFormula),
-                              &hFormula,
-                              &wFormulaLen,
-                              &wdc,
-                              &wdc,
-                              &wdc,
-                              &wdc,
-                              &wdc);
+        Run (Collector);
+        Complete (Collector, false);
+    }
 
-    if (error)
+    /* Waits until all collectors returned or the deadline is reached. Returns the number of stale collectors */
+    DWORD Wait (COLLECTOR_TYPE *pCollectors, size_t Count, DWORD dwTimeoutSec)
     {
-        AddInLogMessageText("%s: Error compiling search formula", error, g_szTask);
-        hFormula = NULLHANDLE;
-        goto Done;
-    }
+        DWORD dwStale = 0;
+        std::unique_lock<std::mutex> Lock (m_Mutex);
 
-    InitMailBoxStatsCtx(&g_MailboxStats);
+        m_Done.wait_for (Lock, std::chrono::seconds (dwTimeoutSec), [&]
+        {
+            for (size_t i = 0; i < Count; i++)
+            {
+                if (pCollectors[i].bRunning)
+                    return false;
+            }
 
-    if (1 == g_MailBoxes)
-    {
-        error = ProcessOneMailBox("mail.box", &g_MailboxStats, hFormula, &tStartTime);
-    }
-    else
-    {
-        for (wIdx = 1; wIdx <= g_MailBoxes; wIdx++)
+            return true;
+        });
+
+        for (size_t i = 0; i < Count; i++)
         {
-            snprintf(szMailBoxName, sizeof(szMailBoxName), "mail%u.box", wIdx);
-            error = ProcessOneMailBox(szMailBoxName, &g_MailboxStats, hFormula, &tStartTime);
-        }
-    }
+            pCollectors[i].bStale = pCollectors[i].bRunning;
 
-    t64EndMsec = GetTimeMs();
-    g_MailboxStats.MailBoxScanMsec = t64EndMsec - t64BeginMsec;
+            if (pCollectors[i].bStale)
+                dwStale++;
+        }
 
-Done:
+        return dwStale;
+    }
 
-    if (hFormula)
+    /* Copies the state for writing the collector metrics on the add-in thread */
+    COLLECTOR_TYPE GetState (const COLLECTOR_TYPE &Collector)
     {
-        OSMemFree(hFormula);
-        hFormula = NULLHANDLE;
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        return Collector;
     }
 
-    return error;
-}
-
-
-STATUS WriteMailBoxStats(FILE *fp)
-{
-    STATUS error = NOERROR;
-    DWORD avg_lWaitSec = 0;
+    size_t Workers () const
+    {
+        return m_Workers.size();
+    }
 
-    if (0 == g_wCollectMailboxStats)
-        return NOERROR;
 
-    if (0 == g_MailboxStats.total_count)
-        avg_lWaitSec = 0;
-    else
-        avg_lWaitSec = (DWORD)(g_MailboxStats.total_wait_seconds / g_MailboxStats.total_count);
+private:
 
-    WriteStatsEntryToFile(fp, g_szDominoHealth,
-        "mail_pending_avg_age_seconds",
-        "Average age of pending mail (seconds) in the mailbox waiting longer than 5 minutes",
-        avg_lWaitSec);
+    void WorkerThread ()
+    {
+        COLLECTOR_TYPE *pCollector = NULL;
+        STATUS error = NotesInitThread();
 
-    WriteStatsEntryToFile(fp, g_szDominoHealth,
-        "mailbox_check_errors",
-        "Documents which cannot be opened in mailbox when checking pending messages",
-        g_MailboxStats.error_count);
+        TraceSetThreadName ("collector");
 
-    WriteTimedateStat (fp, "mailbox_check_timestamp", "Mailbox check last epoch time", &g_MailboxStats.tCurrentScanTime);
+        if (error)
+        {
+            AddInLogMessageText ("%s: Cannot initialize collector thread", error, g_szTask);
+        }
 
-    WriteStatsEntryToFileMSecToSeconds(fp, g_szDominoHealth,
-        "mailbox_check_time",
-        "Mailbox check time in seconds",
-        (DWORD) g_MailboxStats.MailBoxScanMsec);
+        std::unique_lock<std::mutex> Lock (m_Mutex);
 
-    WriteStatsEntryToFile(fp, g_szDominoHealth,
-        "mail_pending_age_5m_15m",
-        "Mailbox pending mail age 5–15 minutes",
-        g_MailboxStats.bucket_5_15);
+        while (true)
+        {
+            m_Wakeup.wait (Lock, [this] { return m_bStop || (false == m_Queue.empty()); });
 
-    WriteStatsEntryToFile(fp, g_szDominoHealth,
-        "mail_pending_age_15m_60m",
-        "Mailbox pending mail age 15–60 minutes",
-        g_MailboxStats.bucket_15_60);
+            if (m_bStop)
+                break;
 
-    WriteStatsEntryToFile(fp, g_szDominoHealth,
-        "mail_pending_age_ge_60m",
-        "Mailbox pending mail age >= 60 minutes",
-        g_MailboxStats.bucket_ge_60);
+            pCollector = m_Queue.front();
+            m_Queue.pop_front();
 
-    return error;
-}
+            Lock.unlock();
 
+            if (NOERROR == error)
+                Run (*pCollector);
 
-void WriteExporterCommonStats (FILE *fp)
-{
-    char szTmp[MAXSPRINTF+1] = {0};
-    uint64_t EpochSec = (uint64_t) time (NULL);
+            Complete (*pCollector, true);
 
-    if (NULL == fp)
-        return;
+            Lock.lock();
+        }
 
-    snprintf (szTmp, sizeof (szTmp), "Domino Prometheus Exporter build version %s", g_szVersion);
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "Exporter_Build", szTmp, DOMPROM_VERSION_BUILD);
+        Lock.unlock();
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "stat_update_timestamp", "Domino Statistic last update epoch time", EpochSec);
+        if (NOERROR == error)
+            NotesTermThread();
+    }
 
-    if (g_bMaintenanceStartSet)
+    void Run (COLLECTOR_TYPE &Collector)
     {
-        AddInFormatErrorText(szTmp, "Start of maintenance window in epoch time (%z)", &g_tMaintenanceStart);
-        WriteTimedateStat (fp, "maintenance_start_timestamp", szTmp, &g_tMaintenanceStart);
+        PhaseTimer Timer (Collector.Phase);
+        Collector.pfnRun();
     }
 
-    if (g_bMaintenanceEndSet)
+    void Complete (COLLECTOR_TYPE &Collector, bool bQueued)
     {
-        AddInFormatErrorText(szTmp, "End of maintenance window in epoch time (%z)", &g_tMaintenanceEnd);
-        WriteTimedateStat (fp, "maintenance_end_timestamp", szTmp, &g_tMaintenanceEnd);
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
+
+            Collector.bRunning     = false;
+            Collector.DurationMsec = GetTimeMs() - Collector.StartMsec;
+
+            if (bQueued)
+                m_Active--;
+        }
+
+        m_Done.notify_all();
     }
 
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "maintenance_status", "Domino maintenance status", IsInMaintenanceMode());
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "server_restricted_status", "Domino server restricted status (notes.ini server_restricted)", g_wServerRestricted);
-}
+    std::vector<std::thread>     m_Workers;
+    std::list<COLLECTOR_TYPE *>  m_Queue;
+    DWORD                        m_Active = 0;
+    bool                         m_bStop  = false;
 
+    std::mutex              m_Mutex;
+    std::condition_variable m_Wakeup;
+    std::condition_variable m_Done;
+};
 
 
-int TimeToSeconds(int Hour, int Minute, int Second)
+CollectorPool g_CollectorPool;
+
+COLLECTOR_TYPE g_Collectors[COLLECTOR_COUNT] =
 {
-    return (Hour * 3600) + (Minute * 60) + Second;
-}
+    { "probe",   CollectServerProbe,  PHASE_PROBE   },
+    { "trans",   CollectTransStats,   PHASE_TRANS   },
+    { "iostat",  CollectIOStat,       PHASE_IOSTAT  },
+    { "mailbox", CollectMailBoxStats, PHASE_MAILBOX },
+};
 
 
-BOOL ReadBusinessDays(BUSINESS_DAYS_TYPE &BusinessHours)
+/* Runs the server probe and waits for all collectors still running until the collector deadline.
+   The other collectors are submitted by the scheduler when their own interval is due */
+
+void RunCollectors ()
 {
-    BOOL bValid = TRUE;
-    char szBusinessDays[MAXSPRINTF+1] = {0};
-    char *pszToken = NULL;
-    char *pszNext  = NULL;
+    DWORD dwTimeoutSec = g_dwCollectorTimeoutSec;
 
-    int StartDay = 0;
-    int EndDay   = 0;
-    int Day      = 0;
+    /* The statistics must be written within the interval */
+    if (dwTimeoutSec > g_dwIntervalSec / 2)
+        dwTimeoutSec = g_dwIntervalSec / 2;
 
-    memset(&BusinessHours, 0, sizeof(BusinessHours));
+    g_CollectorPool.Submit (g_Collectors[COLLECTOR_PROBE]);
 
-    if (OSGetEnvironmentString(ENV_DOMPROM_BUSINESSDAYS, szBusinessDays, sizeof(szBusinessDays)-1))
-    {
-        g_bBusinessHoursEnabled = TRUE;
-    }
-    else
+    if (g_CollectorPool.Wait (g_Collectors, COLLECTOR_COUNT, dwTimeoutSec) && g_wLogLevel)
     {
-        if (0 == OSGetEnvironmentLong (ENV_DOMPROM_BUSINESSDAYS_ENABLED))
+        for (const auto &Collector : g_Collectors)
         {
-            g_bBusinessHoursEnabled = FALSE;
-            return TRUE;
+            if (g_CollectorPool.GetState (Collector).bStale)
+                AddInLogMessageText ("%s: Collector did not finish in time: %s", 0, g_szTask, Collector.pszName);
         }
+    }
+}
 
-        g_bBusinessHoursEnabled = TRUE;
-
-        /* Default: Monday-Friday */
-        BusinessHours.Days[1].bIsBusinessDay = TRUE;
-        BusinessHours.Days[2].bIsBusinessDay = TRUE;
-        BusinessHours.Days[3].bIsBusinessDay = TRUE;
-        BusinessHours.Days[4].bIsBusinessDay = TRUE;
-        BusinessHours.Days[5].bIsBusinessDay = TRUE;
 
-        if (g_wLogLevel)
-        {
-            AddInLogMessageText("%s: Notes.ini [Days] not found - using default Mon-Fri", 0, g_szTask);
-        }
+void WriteCollectorStats (ExpositionBuffer *pOut)
+{
+    COLLECTOR_TYPE State = {0};
+    char szLine[MAXSPRINTF+1] = {0};
 
-        return TRUE;
-    }
+    if (NULL == pOut)
+        return;
 
-    pszToken = strtok_r(szBusinessDays, ",", &pszNext);
+    WriteHelpAndType (pOut, g_szDominoHealth, "collector_stale", NULL, "Collector did not finish before the statistics were written (1=stale)");
 
-    while (pszToken)
+    for (const auto &Collector : g_Collectors)
     {
-        /* Range: 1-5 */
-        if (strchr(pszToken, '-'))
-        {
-            if (2 != sscanf(pszToken, "%d-%d", &StartDay, &EndDay))
-            {
-                bValid = FALSE;
-            }
-            else if ((StartDay < 0) || (StartDay > 6) || (EndDay < 0) || (EndDay > 6))
-            {
-                bValid = FALSE;
-            }
-            else
-            {
-                Day = StartDay;
+        State = g_CollectorPool.GetState (Collector);
 
-                while (TRUE)
-                {
-                    BusinessHours.Days[Day].bIsBusinessDay = TRUE;
+        if (false == State.bUsed)
+            continue;
 
-                    if (Day == EndDay)
-                        break;
+        snprintf (szLine, sizeof (szLine), "%s_collector_stale{collector=\"%s\"} %u", g_szDominoHealth, State.pszName, State.bStale ? 1 : 0);
+        pOut->AppendSampleLine (szLine);
+    }
 
-                    Day++;
+    WriteHelpAndType (pOut, g_szDominoHealth, "collector_duration_seconds", NULL, "Duration of the last completed collector run (seconds)");
 
-                    if (Day > 6)
-                        Day = 0;
-                }
-            }
-        }
-        else
-        {
-            /* Single day */
-            if (1 != sscanf(pszToken, "%d", &Day))
-            {
-                bValid = FALSE;
-            }
-            else if ((Day < 0) || (Day > 6))
-            {
-                bValid = FALSE;
-            }
-            else
-            {
-                BusinessHours.Days[Day].bIsBusinessDay = TRUE;
-            }
-        }
+    for (const auto &Collector : g_Collectors)
+    {
+        State = g_CollectorPool.GetState (Collector);
 
-        pszToken = strtok_r(NULL, ",", &pszNext);
-    }
+        if (false == State.bUsed)
+            continue;
 
-    return bValid;
+        snprintf (szLine, sizeof (szLine), "%s_collector_duration_seconds{collector=\"%s\"} %" PRIu64 ".%03u",
+                  g_szDominoHealth, State.pszName, State.DurationMsec / 1000, (unsigned) (State.DurationMsec % 1000));
+        pOut->AppendSampleLine (szLine);
+    }
 }
 
 
-BOOL ReadBusinesHours (BUSINESS_DAYS_TYPE &BusinessHours)
-{
-    BOOL bValid = TRUE;
-    char szEnvName [MAXSPRINTF+1]     = {0};
-    char szBusinessHours[MAXSPRINTF+1]= {0};
-    char szDefaultBusinessHours[MAXSPRINTF+1]= {0};
-    char *pszBusinessHours = szDefaultBusinessHours;
+/* Scheduler for the periodic jobs of the main loop.
+   Deadlines are kept in a min-heap on the monotonic clock and are aligned to multiples of the interval in wall clock time.
+   The next deadline is always derived from the previous one, so the time spent collecting does not add up to the interval */
 
-    LONG lWeekDay  = 0;
-    TIMEDATE tNow  = {0};
-    TIME NotesTime = {0};
+enum SCHEDULE_JOB
+{
+    SCHEDULE_TRANS = 0,
+    SCHEDULE_IOSTAT,
+    SCHEDULE_MAILBOX,
+    SCHEDULE_ENV,
+    SCHEDULE_STATS,       /* Last: Collectors due at the same deadline are submitted before the statistics are written */
+    SCHEDULE_JOB_COUNT
+};
 
-    if (FALSE == ReadBusinessDays(BusinessHours))
-        bValid = FALSE;
+struct SCHEDULE_JOB_TYPE
+{
+    const char *pszName;
+    uint64_t IntervalMsec;
+    uint64_t NextSlotMsec;
+    DWORD    Generation;
+    uint64_t Runs;
+    uint64_t MissedSlots;
+    uint64_t LagMsec;
+    double   JitterMsec;
+};
 
-    OSCurrentTIMEDATE (&tNow);
 
-    memcpy (&(NotesTime.GM), &tNow, sizeof (TIMEDATE));
+class DeadlineScheduler
+{
+public:
 
-    if (TimeGMToLocal (&NotesTime))
+    DeadlineScheduler ()
     {
-        AddInLogMessageText ("%s: Cannot convert time", 0, g_szTask);
-        bValid = FALSE;
-    }
+        static const char *pszNames[SCHEDULE_JOB_COUNT] = { "trans", "iostat", "mailbox", "env", "stats" };
 
-    if (FALSE == GetEnviromentLong (ENV_DOMPROM_BUSINESSHOURS_ZONE, &BusinessHours.lZone))
-    {
-        BusinessHours.lZone = NotesTime.zone;
+        memset (m_Jobs, 0, sizeof (m_Jobs));
+
+        for (int i = 0; i < SCHEDULE_JOB_COUNT; i++)
+            m_Jobs[i].pszName = pszNames[i];
     }
 
-    if (FALSE == GetEnviromentLong (ENV_DOMPROM_BUSINESSHOURS_DST, &BusinessHours.lDST))
+    /* Schedules a job at the next interval boundary. bRunNow runs it once immediately before the first boundary */
+    void Schedule (SCHEDULE_JOB Job, DWORD dwIntervalSec, bool bRunNow)
     {
-        BusinessHours.lDST = NotesTime.dst;
-    }
+        SCHEDULE_JOB_TYPE &Entry = m_Jobs[Job];
+        uint64_t NowMsec = GetTimeMs();
+        uint64_t BoundaryMsec = 0;
 
-    NotesTime.zone = BusinessHours.lZone;
-    NotesTime.dst  = BusinessHours.lDST;
+        if (0 == dwIntervalSec)
+            dwIntervalSec = 1;
 
-    if (TimeGMToLocalZone (&NotesTime))
-    {
-        AddInLogMessageText ("%s: Cannot convert time", 0, g_szTask);
-        bValid = FALSE;
-    }
+        /* Entries of an earlier schedule still in the heap are skipped by their generation */
+        Entry.Generation++;
+        Entry.IntervalMsec = (uint64_t) dwIntervalSec * 1000;
 
-    /* Notes Weekday starts at 1 */
-    if ((NotesTime.weekday < 1) || (NotesTime.weekday > 7))
-    {
-        AddInLogMessageText ("%s: Invalid Week day: %d", 0, g_szTask, NotesTime.weekday);
-        bValid = FALSE;
+        BoundaryMsec = AlignToBoundary (NowMsec, Entry.IntervalMsec);
+
+        if (bRunNow)
+        {
+            Push (Job, NowMsec, BoundaryMsec);
+        }
+        else
+        {
+            Push (Job, BoundaryMsec, BoundaryMsec + Entry.IntervalMsec);
+        }
     }
 
-    /* Get default business hours */
-    if (FALSE == OSGetEnvironmentString (ENV_DOMPROM_BUSINESSHOURS, szDefaultBusinessHours, sizeof (szDefaultBusinessHours)-1))
+    /* Reschedules a job only if the interval changed */
+    void SetInterval (SCHEDULE_JOB Job, DWORD dwIntervalSec)
     {
-        snprintf (szDefaultBusinessHours, sizeof (szDefaultBusinessHours), "%s", DOMPROM_DEFAULT_BUSINESSHOURS);
+        if ((uint64_t) dwIntervalSec * 1000 == m_Jobs[Job].IntervalMsec)
+            return;
 
-        if (g_wLogLevel)
-        {
-            AddInLogMessageText ("%s: Notes.ini %s=%s", 0, g_szTask, ENV_DOMPROM_BUSINESSHOURS, szBusinessHours);
-        }
+        Schedule (Job, dwIntervalSec, false);
     }
 
-    /* Normalize to Unix weekday: 0 = Sunday, 6 = Saturday */
-    for (lWeekDay = 0; lWeekDay < MAX_WEEKDAYS; lWeekDay++)
+    /* Returns the next job due at NowMsec and schedules its next run */
+    bool PopDue (uint64_t NowMsec, SCHEDULE_JOB &Job)
     {
-        snprintf (szEnvName, sizeof (szEnvName), "%s%d", ENV_DOMPROM_BUSINESSHOURS, lWeekDay);
+        uint64_t LagMsec  = 0;
+        uint64_t NextMsec = 0;
+        uint64_t Missed   = 0;
 
-        if (OSGetEnvironmentString (szEnvName, szBusinessHours, sizeof (szBusinessHours)-1))
-        {
-            /* Found */
-            pszBusinessHours = szBusinessHours;
-        }
-        else
+        while (false == m_Heap.empty())
         {
-            /* Use default if not found */
-            pszBusinessHours = szDefaultBusinessHours;
+            SCHEDULE_ENTRY Top = m_Heap.top();
+            SCHEDULE_JOB_TYPE &Entry = m_Jobs[Top.Job];
 
-            if (g_wLogLevel)
+            if (Top.Generation != Entry.Generation)
             {
-                AddInLogMessageText ("%s: Notes.ini [%s] not found", 0, g_szTask, szEnvName);
+                m_Heap.pop();
+                continue;
             }
-        }
 
-        if (IsNullStr (pszBusinessHours))
-        {
-            continue;
-        }
+            if (Top.DeadlineMsec > NowMsec)
+                return false;
 
-        /* Format: hh:mm:ss-hh:mm:ss */
-        if (6 != sscanf (pszBusinessHours, "%d:%d:%d-%d:%d:%d",
-            &BusinessHours.Days[lWeekDay].StartHour,
-            &BusinessHours.Days[lWeekDay].StartMinute,
-            &BusinessHours.Days[lWeekDay].StartSecond,
-            &BusinessHours.Days[lWeekDay].EndHour,
-            &BusinessHours.Days[lWeekDay].EndMinute,
-            &BusinessHours.Days[lWeekDay].EndSecond))
-        {
-            BusinessHours.Days[lWeekDay].StartSecond = 0;
-            BusinessHours.Days[lWeekDay].EndSecond   = 0;
+            m_Heap.pop();
 
-            /* Format: hh:mm-hh:mm */
-            if (4 != sscanf (pszBusinessHours, "%d:%d-%d:%d",
-                &BusinessHours.Days[lWeekDay].StartHour,
-                &BusinessHours.Days[lWeekDay].StartMinute,
-                &BusinessHours.Days[lWeekDay].EndHour,
-                &BusinessHours.Days[lWeekDay].EndMinute))
-            {
-                BusinessHours.Days[lWeekDay].StartMinute = 0;
-                BusinessHours.Days[lWeekDay].StartSecond = 0;
-                BusinessHours.Days[lWeekDay].EndMinute   = 0;
-                BusinessHours.Days[lWeekDay].EndSecond   = 0;
+            LagMsec = NowMsec - Top.DeadlineMsec;
 
-                /* Format: hh-hh */
-                if (2 != sscanf (pszBusinessHours, "%d-%d",
-                        &BusinessHours.Days[lWeekDay].StartHour,
-                        &BusinessHours.Days[lWeekDay].EndHour))
-                {
-                    AddInLogMessageText ("%s: Invalid business hours configuration [%s]: [%s]", 0, g_szTask, szEnvName, pszBusinessHours);
-                    bValid = FALSE;
-                }
+            /* Interarrival jitter smoothed like RFC 3550 */
+            if (Entry.Runs)
+                Entry.JitterMsec += (fabs ((double) LagMsec - (double) Entry.LagMsec) - Entry.JitterMsec) / 16.0;
+
+            Entry.LagMsec = LagMsec;
+            Entry.Runs++;
+
+            /* Boundaries which already passed are skipped instead of running the job several times in a row */
+            NextMsec = Entry.NextSlotMsec;
+
+            if (NextMsec <= NowMsec)
+            {
+                Missed = (NowMsec - NextMsec) / Entry.IntervalMsec + 1;
+                Entry.MissedSlots += Missed;
+                NextMsec += Missed * Entry.IntervalMsec;
             }
+
+            Push (Top.Job, NextMsec, NextMsec + Entry.IntervalMsec);
+
+            Job = Top.Job;
+            return true;
         }
 
-        BusinessHours.Days[lWeekDay].StartSeconds = TimeToSeconds (
-            BusinessHours.Days[lWeekDay].StartHour,
-            BusinessHours.Days[lWeekDay].StartMinute,
-            BusinessHours.Days[lWeekDay].StartSecond);
+        return false;
+    }
 
-        BusinessHours.Days[lWeekDay].EndSeconds = TimeToSeconds (
-            BusinessHours.Days[lWeekDay].EndHour,
-            BusinessHours.Days[lWeekDay].EndMinute,
-            BusinessHours.Days[lWeekDay].EndSecond);
-    } /* for */
+    /* Time until the next deadline. 0 if a job is due */
+    uint64_t MsecUntilNext (uint64_t NowMsec)
+    {
+        while ((false == m_Heap.empty()) && (m_Heap.top().Generation != m_Jobs[m_Heap.top().Job].Generation))
+            m_Heap.pop();
 
-    if (g_wLogLevel)
+        if (m_Heap.empty())
+            return DOMPROM_MAX_WAIT_SLICE_MSEC;
+
+        if (m_Heap.top().DeadlineMsec <= NowMsec)
+            return 0;
+
+        return m_Heap.top().DeadlineMsec - NowMsec;
+    }
+
+    const SCHEDULE_JOB_TYPE &GetJob (int Job) const
     {
-        for (lWeekDay = 0; lWeekDay < MAX_WEEKDAYS; lWeekDay++)
-        {
-            AddInLogMessageText ("%s: BusinessHours[%d]: %02d:%02d:%02d - %02d:%02d:%02d, BusinessDay: %d", 0, g_szTask,
-                lWeekDay,
-                BusinessHours.Days[lWeekDay].StartHour,
-                BusinessHours.Days[lWeekDay].StartMinute,
-                BusinessHours.Days[lWeekDay].StartSecond,
-                BusinessHours.Days[lWeekDay].EndHour,
-                BusinessHours.Days[lWeekDay].EndMinute,
-                BusinessHours.Days[lWeekDay].EndSecond,
-                BusinessHours.Days[lWeekDay].bIsBusinessDay);
-        }
+        return m_Jobs[Job];
     }
 
-    return bValid;
-}
 
+private:
 
-BOOL CheckBusinessHours (TIMEDATE *ptNow)
-{
-    TIME   NotesTime = {0};
-    LONG   lWeekDay  = 0;
-    int    CurrentSeconds = 0;
+    struct SCHEDULE_ENTRY
+    {
+        uint64_t     DeadlineMsec;
+        SCHEDULE_JOB Job;
+        DWORD        Generation;
 
-    TIMEDATE tNow = {0};
-    char szNow [MAXALPHATIMEDATE+1] = {0};
+        bool operator> (const SCHEDULE_ENTRY &Other) const
+        {
+            if (DeadlineMsec != Other.DeadlineMsec)
+                return DeadlineMsec > Other.DeadlineMsec;
 
-    if (FALSE == g_bBusinessHoursEnabled)
+            return Job > Other.Job;
+        }
+    };
+
+    void Push (SCHEDULE_JOB Job, uint64_t DeadlineMsec, uint64_t NextSlotMsec)
     {
-        g_bBusinessDay   = TRUE;
-        g_bBusinessHours = TRUE;
-        goto Done;
+        m_Jobs[Job].NextSlotMsec = NextSlotMsec;
+        m_Heap.push ({ DeadlineMsec, Job, m_Jobs[Job].Generation });
     }
 
-    if (NULL == ptNow)
+    /* Next multiple of the interval in wall clock time, converted to the monotonic clock.
+       The offset between both clocks is taken once, so later wall clock changes do not move the deadlines */
+    uint64_t AlignToBoundary (uint64_t NowMsec, uint64_t IntervalMsec)
     {
-        OSCurrentTIMEDATE (&tNow);
-        ptNow = &tNow;
+        uint64_t WallMsec = 0;
+
+        if (false == m_bOffsetSet)
+        {
+            WallMsec = (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::system_clock::now().time_since_epoch()).count();
+            m_WallOffsetMsec = WallMsec - NowMsec;
+            m_bOffsetSet = true;
+        }
+
+        WallMsec = NowMsec + m_WallOffsetMsec;
+
+        return NowMsec + IntervalMsec - (WallMsec % IntervalMsec);
     }
 
-    GetNotesTimeDateSting (ptNow, sizeof (szNow), szNow);
+    std::priority_queue<SCHEDULE_ENTRY, std::vector<SCHEDULE_ENTRY>, std::greater<SCHEDULE_ENTRY>> m_Heap;
 
-    memcpy (&(NotesTime.GM), ptNow, sizeof (TIMEDATE));
+    SCHEDULE_JOB_TYPE m_Jobs[SCHEDULE_JOB_COUNT];
+    uint64_t m_WallOffsetMsec = 0;
+    bool     m_bOffsetSet     = false;
+};
 
-    NotesTime.zone = g_BusinessHours.lZone;
-    NotesTime.dst  = g_BusinessHours.lDST;
 
-    if (TimeGMToLocalZone (&NotesTime))
-    {
-        AddInLogMessageText ("%s: Cannot convert time", 0, g_szTask);
-        goto Done;
-    }
+DeadlineScheduler g_Scheduler;
 
-    if ((NotesTime.weekday < 1) || (NotesTime.weekday > 7))
+
+void WriteSchedulerStats (ExpositionBuffer *pOut)
+{
+    char szLine[MAXSPRINTF+1] = {0};
+
+    if (NULL == pOut)
+        return;
+
+    WriteHelpAndType (pOut, g_szDominoHealth, "scheduler_lag_seconds", NULL, "Delay between the scheduled deadline and the start of the last run (seconds)");
+
+    for (int i = 0; i < SCHEDULE_JOB_COUNT; i++)
     {
-        g_bBusinessDay   = TRUE;
-        g_bBusinessHours = TRUE;
-        goto Done;
-    }
+        const SCHEDULE_JOB_TYPE &Job = g_Scheduler.GetJob (i);
 
-    lWeekDay = NotesTime.weekday-1;
+        if (0 == Job.Runs)
+            continue;
 
-    if (g_wLogLevel)
-        AddInLogMessageText ("%s: UNIX WeekDay: %d", 0, g_szTask, lWeekDay);
+        snprintf (szLine, sizeof (szLine), "%s_scheduler_lag_seconds{job=\"%s\"} %" PRIu64 ".%03u",
+                  g_szDominoHealth, Job.pszName, Job.LagMsec / 1000, (unsigned) (Job.LagMsec % 1000));
+        pOut->AppendSampleLine (szLine);
+    }
 
-    CurrentSeconds = TimeToSeconds (NotesTime.hour, NotesTime.minute, NotesTime.second);
+    WriteHelpAndType (pOut, g_szDominoHealth, "scheduler_jitter_seconds", NULL, "Smoothed variation of the scheduling lag (seconds)");
 
-    if (FALSE == g_BusinessHours.Days[lWeekDay].bIsBusinessDay)
+    for (int i = 0; i < SCHEDULE_JOB_COUNT; i++)
     {
-        if (g_wLogLevel)
-            AddInLogMessageText ("%s: Not a work day", 0, g_szTask);
+        const SCHEDULE_JOB_TYPE &Job = g_Scheduler.GetJob (i);
 
-        g_bBusinessDay   = FALSE;
-        g_bBusinessHours = FALSE;
-        goto Done;
+        if (0 == Job.Runs)
+            continue;
+
+        snprintf (szLine, sizeof (szLine), "%s_scheduler_jitter_seconds{job=\"%s\"} %.3f", g_szDominoHealth, Job.pszName, Job.JitterMsec / 1000.0);
+        pOut->AppendSampleLine (szLine);
     }
-    else
+
+    WriteHelpAndType (pOut, g_szDominoHealth, "scheduler_missed_total", "counter", "Interval boundaries skipped because a job ran late");
+
+    for (int i = 0; i < SCHEDULE_JOB_COUNT; i++)
     {
-        g_bBusinessDay = TRUE;
+        const SCHEDULE_JOB_TYPE &Job = g_Scheduler.GetJob (i);
+
+        if (0 == Job.Runs)
+            continue;
+
+        snprintf (szLine, sizeof (szLine), "%s_scheduler_missed_total{job=\"%s\"} %" PRIu64, g_szDominoHealth, Job.pszName, Job.MissedSlots);
+        pOut->AppendSampleLine (szLine);
     }
+}
 
-    if (g_BusinessHours.Days[lWeekDay].StartSeconds <= g_BusinessHours.Days[lWeekDay].EndSeconds)
+
+void PrefixFilter::WriteStats (ExpositionBuffer *pOut) const
+{
+    std::string Line;
+
+    if ((NULL == pOut) || m_Rules.empty())
+        return;
+
+    WriteHelpAndType (pOut, g_szDominoHealth, "filter_rule_hits_total", "counter", "Domino statistics matched by an include/exclude filter rule");
+
+    for (size_t r = 0; r < m_Rules.size(); r++)
     {
-        if ( (CurrentSeconds < g_BusinessHours.Days[lWeekDay].StartSeconds) ||
-             (CurrentSeconds > g_BusinessHours.Days[lWeekDay].EndSeconds))
+        const FILTER_RULE &Rule = m_Rules[r];
+
+        Line  = g_szDominoHealth;
+        Line += "_filter_rule_hits_total{rule=\"";
+
+        for (char ch : Rule.Prefix)
         {
-            if (g_wLogLevel)
-                AddInLogMessageText ("%s: Not in range (%d [%d - %d])", 0, g_szTask,
-                    CurrentSeconds, g_BusinessHours.Days[lWeekDay].StartSeconds, g_BusinessHours.Days[lWeekDay].EndSeconds);
+            if (('"' == ch) || ('\\' == ch))
+                Line += '\\';
 
-            g_bBusinessHours = FALSE;
-            goto Done;
+            Line += ch;
         }
+
+        Line += Rule.bInclude ? "\",action=\"include\"} " : "\",action=\"exclude\"} ";
+        Line += std::to_string (m_Hits[r].load (std::memory_order_relaxed));
+
+        pOut->AppendSampleLine (Line);
     }
-    else
+}
+
+
+void WritePhaseStats (ExpositionBuffer *pOut)
+{
+    PHASE_STATS_TYPE Phase = {0};
+    uint64_t Cumulative = 0;
+    char szLine[MAXSPRINTF+1] = {0};
+
+    if (NULL == pOut)
+        return;
+
+    WriteHelpAndType (pOut, g_szDominoHealth, "phase_duration_seconds", "histogram", "Wall clock time of exporter phases (seconds)");
+
+    for (int i = 0; i < PHASE_COUNT; i++)
     {
-        if ( (CurrentSeconds < g_BusinessHours.Days[lWeekDay].StartSeconds) &&
-             (CurrentSeconds > g_BusinessHours.Days[lWeekDay].EndSeconds))
+        Phase = g_PhaseStats.Get (i);
+
+        if (0 == Phase.Count)
+            continue;
+
+        Cumulative = 0;
+
+        for (size_t b = 0; b < PHASE_BUCKETS; b++)
         {
-            if (g_wLogLevel)
-                AddInLogMessageText ("%s: Not in range (%d [%d - %d])", 0, g_szTask,
-                    CurrentSeconds, g_BusinessHours.Days[lWeekDay].StartSeconds, g_BusinessHours.Days[lWeekDay].EndSeconds);
+            Cumulative += Phase.Buckets[b];
 
-            g_bBusinessHours = FALSE;
-            goto Done;
+            snprintf (szLine, sizeof (szLine), "%s_phase_duration_seconds_bucket{phase=\"%s\",le=\"%g\"} %" PRIu64,
+                      g_szDominoHealth, g_pszPhaseNames[i], (double) g_PhaseBucketsUs[b] / 1000000.0, Cumulative);
+            pOut->AppendSampleLine (szLine);
         }
+
+        snprintf (szLine, sizeof (szLine), "%s_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %" PRIu64, g_szDominoHealth, g_pszPhaseNames[i], Phase.Count);
+        pOut->AppendSampleLine (szLine);
+
+        snprintf (szLine, sizeof (szLine), "%s_phase_duration_seconds_sum{phase=\"%s\"} %.6f", g_szDominoHealth, g_pszPhaseNames[i], (double) Phase.WallUs / 1000000.0);
+        pOut->AppendSampleLine (szLine);
+
+        snprintf (szLine, sizeof (szLine), "%s_phase_duration_seconds_count{phase=\"%s\"} %" PRIu64, g_szDominoHealth, g_pszPhaseNames[i], Phase.Count);
+        pOut->AppendSampleLine (szLine);
     }
 
-    g_bBusinessHours = TRUE;
+    WriteHelpAndType (pOut, g_szDominoHealth, "phase_cpu_seconds", "summary", "CPU time of the thread running the exporter phase (seconds)");
+
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        Phase = g_PhaseStats.Get (i);
+
+        if (0 == Phase.Count)
+            continue;
+
+        snprintf (szLine, sizeof (szLine), "%s_phase_cpu_seconds_sum{phase=\"%s\"} %.6f", g_szDominoHealth, g_pszPhaseNames[i], (double) Phase.CpuUs / 1000000.0);
+        pOut->AppendSampleLine (szLine);
 
-Done:
+        snprintf (szLine, sizeof (szLine), "%s_phase_cpu_seconds_count{phase=\"%s\"} %" PRIu64, g_szDominoHealth, g_pszPhaseNames[i], Phase.Count);
+        pOut->AppendSampleLine (szLine);
+    }
 
-    return g_bBusinessHours;
-}
+    WriteHelpAndType (pOut, g_szDominoHealth, "stats_seen_total", "counter", "Domino statistics returned by StatTraverse");
+    snprintf (szLine, sizeof (szLine), "%s_stats_seen_total %" PRIu64, g_szDominoHealth, g_StatsSeenTotal.load());
+    pOut->AppendSampleLine (szLine);
 
+    WriteHelpAndType (pOut, g_szDominoHealth, "stats_filtered_total", "counter", "Domino statistics excluded by filter rules");
+    snprintf (szLine, sizeof (szLine), "%s_stats_filtered_total %" PRIu64, g_szDominoHealth, g_StatsFilteredTotal.load());
+    pOut->AppendSampleLine (szLine);
 
-STATUS ProcessBusinesHours(FILE *fp)
-{
-    CheckBusinessHours(NULL);
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "business_day",   "Domino Business Day (0 = Not a business day, 1 = Business day)",           g_bBusinessDay);
-    WriteStatsEntryToFile (fp, g_szDominoHealth, "business_hours", "Domino Business Hours (0 = Not in business hours, 1 = In business hours)", g_bBusinessHours);
-    return NOERROR;
+    WriteHelpAndType (pOut, g_szDominoHealth, "stats_duplicate_total", "counter", "Domino statistics skipped as case insensitive duplicates");
+    snprintf (szLine, sizeof (szLine), "%s_stats_duplicate_total %" PRIu64, g_szDominoHealth, g_StatsDuplicateTotal.load());
+    pOut->AppendSampleLine (szLine);
+
+    WriteHelpAndType (pOut, g_szDominoHealth, "bytes_written_total", "counter", "Bytes written to statistics files");
+    snprintf (szLine, sizeof (szLine), "%s_bytes_written_total %" PRIu64, g_szDominoHealth, g_BytesWrittenTotal.load());
+    pOut->AppendSampleLine (szLine);
 }
 
 
 STATUS ProcessDominoStatistics (const char *pszFilename, bool bWriteShutdownStats = false)
 {
     STATUS   error       = NOERROR;
-    STATUS   PingErr     = NOERROR;
-    STATUS   ResponseErr = NOERROR;
 
-    char     szTempFilename[MAXPATH+1] = {0};
-    DWORD    dwLatencyMsec      = 0;
-    DWORD    dwResponseTimeMsec = 0;
-    DWORD    dwServerState      = 0;
+    PROBE_RESULT_TYPE Probe = {0};
+    bool     bProbeStale    = false;
 
     CONTEXT_STRUCT_TYPE Stats = {0};
 
+    PhaseTimer Timer (PHASE_RENDER);
+
     if (NULL == pszFilename)
         return ERR_MISC_INVALID_ARGS;
 
@@ -3108,19 +8787,16 @@ STATUS ProcessDominoStatistics (const char *pszFilename, bool bWriteShutdownStat
     Stats.bExportLong   = TRUE;
     Stats.bExportNumber = TRUE;
 
-    snprintf (szTempFilename, sizeof (szTempFilename),  "%s.tmp", pszFilename);
-
-    Stats.fp = fopen (szTempFilename, "w");
-
-    if (NULL == Stats.fp)
-    {
-        perror ("Cannot create stats temp file");
-        goto Done;
-    }
+    g_StatsOut.Reset();
+    g_StatsOut.SetValueSlots (g_wInPlace != 0);
+    Stats.pOut        = &g_StatsOut;
+    Stats.pCache      = &g_StatCache;
+    Stats.pDuplicates = &g_DominoStatSet;
+    Stats.pPlanner    = &g_FacilityPlan;
 
     OSGetIntlSettings (&(Stats.Intl), sizeof (Stats.Intl));
 
-    WriteExporterCommonStats (Stats.fp);
+    WriteExporterCommonStats (Stats.pOut);
 
     if (g_wWriteDominoHealthStats)
     {
@@ -3132,57 +8808,56 @@ STATUS ProcessDominoStatistics (const char *pszFilename, bool bWriteShutdownStat
     {
         TIMEDATE tNow  = {0};
         OSCurrentTIMEDATE (&tNow);
-        WriteTimedateStat (Stats.fp, "stat_shutdown_timestamp", "Domino statistic shutdown epoch time", &tNow);
+        WriteTimedateStat (Stats.pOut, "stat_shutdown_timestamp", "Domino statistic shutdown epoch time", &tNow);
         goto Done;
     }
 
-    PingErr = GetServerPingLatency (g_szLocalUser, &dwLatencyMsec);
-
-    if (PingErr)
+    /* The probe runs on the collector pool. A probe hanging past the collector deadline means the server does not respond */
     {
-        switch (PingErr)
-        {
-            case ERR_SERVER_RESTRICTED:
-                dwServerState = SERVER_STATE_RESTRICTED;
-                break;
+        std::lock_guard<std::mutex> Lock (g_ProbeMutex);
+        Probe = g_ProbeResult;
+    }
 
-            case ERR_SERVER_UNAVAILABLE:
-                dwServerState = SERVER_STATE_UNAVAILABLE;
-                break;
+    bProbeStale = g_CollectorPool.GetState (g_Collectors[COLLECTOR_PROBE]).bStale;
 
-            default:
-                dwServerState = SERVER_STATE_NOT_REACHABLE;
-                break;
-        }
-    }
-    else
-    {
-        ResponseErr = GetServerResponseTimeMsec(g_szLocalUser, &dwResponseTimeMsec);
+    if (bProbeStale || (false == Probe.bValid))
+        Probe.dwServerState = SERVER_STATE_NOT_REACHABLE;
 
-        if (NOERROR == ResponseErr)
-            dwServerState = SERVER_STATE_AVAILABLE;
-        else
-            dwServerState = SERVER_STATE_NOT_REACHABLE;
-    }
+    WriteStatsEntryToFile (Stats.pOut, g_szDominoHealth, "state", "State (0=Available, 1=Restricted, 2=Busy, 3=Not reachable)", (uint64_t)Probe.dwServerState);
 
-    WriteStatsEntryToFile (Stats.fp, g_szDominoHealth, "state", "State (0=Available, 1=Restricted, 2=Busy, 3=Not reachable)", (uint64_t)dwServerState);
+    if (Probe.dwServerState < SERVER_STATE_NOT_REACHABLE)
+        WriteStatsEntryToFileMSecToSeconds (Stats.pOut, g_szDominoHealth, "ping_latency_seconds", "Domino NSPing (NRPC) response time (seconds)", Probe.dwLatencyMsec);
 
-    if (dwServerState < SERVER_STATE_NOT_REACHABLE)
-        WriteStatsEntryToFileMSecToSeconds (Stats.fp, g_szDominoHealth, "ping_latency_seconds", "Domino NSPing (NRPC) response time (seconds)", dwLatencyMsec);
+    if (Probe.dwServerState < SERVER_STATE_RESTRICTED)
+        WriteStatsEntryToFileMSecToSeconds (Stats.pOut, g_szDominoHealth, "response_time_seconds", "Domino response time opening names.nsf over NRPC (seconds)", Probe.dwResponseTimeMsec);
 
-    if (dwServerState < SERVER_STATE_RESTRICTED)
-        WriteStatsEntryToFileMSecToSeconds (Stats.fp, g_szDominoHealth, "response_time_seconds", "Domino response time opening names.nsf over NRPC (seconds)", dwResponseTimeMsec);
+    WriteCollectorStats (Stats.pOut);
+    WriteSchedulerStats (Stats.pOut);
 
-    ProcessDaosStats     (Stats.fp);
-    ProcessTranslogStats (Stats.fp);
-    ProcessDiskStats     (Stats.fp);
-    WriteMailBoxStats    (Stats.fp);
-    ProcessBusinesHours  (Stats.fp);
+    ProcessDaosStats     (Stats.pOut);
+    ProcessTranslogStats (Stats.pOut);
+    ProcessDiskStats     (Stats.pOut);
+    WriteMailBoxStats    (Stats.pOut);
+    ProcessBusinesHours  (Stats.pOut);
 
     /* Reset Domino statistics buffer for making sure we don't get a stat more than once */
-    BeginDominoStatCollection();
+    g_DominoStatSet.Begin();
+    g_Relabeler.BeginCycle();
+
+    {
+        PhaseTimer TraverseTimer (PHASE_STAT_TRAVERSE);
+        g_FacilityPlan.Traverse (&Stats);
+    }
+
+    g_Relabeler.Flush (Stats.pOut, Stats.szPrefix);
 
-    StatTraverse (NULL, NULL, DomExportTraverse, &Stats);
+    g_StatsSeenTotal      += Stats.CountAll;
+    g_StatsFilteredTotal  += Stats.CountFiltered;
+    g_StatsDuplicateTotal += Stats.CountDuplicate;
+
+    WritePhaseStats (Stats.pOut);
+    g_StatsFilter.WriteStats (Stats.pOut);
+    g_FacilityPlan.WriteStats (Stats.pOut);
 
     if (g_wLogLevel)
     {
@@ -3214,13 +8889,8 @@ STATUS ProcessDominoStatistics (const char *pszFilename, bool bWriteShutdownStat
 
 Done:
 
-    if (Stats.fp)
-    {
-        fclose (Stats.fp);
-        Stats.fp = NULL;
-
-        rename (szTempFilename, pszFilename);
-    }
+    /* Publishing and file I/O run on the writer thread */
+    g_SnapshotWriter.Submit (SNAPSHOT_STATS, g_StatsOut, pszFilename, (0 == g_wHttpNoFile) || (0 == g_HttpServer.GetPort()), g_wFsync != 0);
 
     return error;
 }
@@ -3233,6 +8903,10 @@ BOOL GetEnvironmentVars (BOOL bFirstTime)
     DWORD  dwInterval  = 0;
     WORD   wValue      = 0;
     BOOL   bUpdated    = FALSE; /* Return true if config got updated and set status in this case */
+    char   szBindAddress[MAXSPRINTF+1] = {0};
+    char   szRemoteWriteUrl[MAXSPRINTF+1] = {0};
+    char   szWalFilename[2*MAXPATH+210]   = {0};
+
     wTempSeqNo = OSGetEnvironmentSeqNo();
 
     if (FALSE == bFirstTime)
@@ -3262,7 +8936,7 @@ BOOL GetEnvironmentVars (BOOL bFirstTime)
 
             if (0 == wValue)
             {
-                RemoveFile (g_szTransFilename, 1);
+                g_SnapshotWriter.Remove (SNAPSHOT_TRANS, g_szTransFilename);
             }
         }
     }
@@ -3386,6 +9060,79 @@ BOOL GetEnvironmentVars (BOOL bFirstTime)
     g_bMaintenanceStartSet = OSGetEnvironmentTIMEDATE (ENV_DOMPROM_MAINTENANCE_START, &g_tMaintenanceStart);
     g_bMaintenanceEndSet   = OSGetEnvironmentTIMEDATE (ENV_DOMPROM_MAINTENANCE_END,   &g_tMaintenanceEnd);
     g_ProbeCloseSession    = (WORD)  OSGetEnvironmentLong (ENV_DOMPROM_PROBE_CLOSE_SESSION);
+    g_wFsync               = (WORD)  OSGetEnvironmentLong (ENV_DOMPROM_FSYNC);
+
+    /* Deadline for collector jobs before the statistics are written without their results */
+    dwInterval = (DWORD) OSGetEnvironmentLong (ENV_DOMPROM_COLLECTOR_TIMEOUT);
+    g_dwCollectorTimeoutSec = dwInterval ? dwInterval : DOMPROM_DEFAULT_COLLECTOR_TIMEOUT_SEC;
+
+    /* Full traversal discovering the facilities. Between discoveries only facilities with included stats are traversed */
+    dwInterval = (DWORD) OSGetEnvironmentLong (ENV_DOMPROM_FACILITY_DISCOVERY);
+    g_dwFacilityDiscoverySec = dwInterval ? dwInterval : DOMPROM_DEFAULT_FACILITY_DISCOVERY_SEC;
+
+    /* Spacing of the samples for the disk and translog growth forecast. The window covers DOMPROM_FORECAST_SAMPLES intervals */
+    dwInterval = (DWORD) OSGetEnvironmentLong (ENV_DOMPROM_FORECAST_INTERVAL);
+    g_dwForecastIntervalSec = dwInterval ? dwInterval : DOMPROM_DEFAULT_FORECAST_INTERVAL_SEC;
+
+    /* --- Built-in HTTP /metrics listener --- */
+
+    wValue = (WORD) OSGetEnvironmentLong (ENV_DOMPROM_HTTP_PORT);
+
+    if (g_wHttpPort != wValue)
+    {
+        g_wHttpPort = wValue;
+
+        if (g_wHttpPort)
+        {
+            if (FALSE == OSGetEnvironmentString (ENV_DOMPROM_HTTP_BIND, szBindAddress, sizeof (szBindAddress)-1))
+                *szBindAddress = '\0';
+
+            g_HttpServer.Start (g_wHttpPort, szBindAddress);
+        }
+        else
+        {
+            g_HttpServer.Stop();
+            AddInLogMessageText ("%s: HTTP metrics listener stopped", 0, g_szTask);
+        }
+    }
+
+    g_wHttpNoFile = (WORD) OSGetEnvironmentLong (ENV_DOMPROM_HTTP_NO_FILE);
+
+    /* --- Remote write push sink --- */
+
+    if (FALSE == OSGetEnvironmentString (ENV_DOMPROM_REMOTE_WRITE_URL, szRemoteWriteUrl, sizeof (szRemoteWriteUrl)-1))
+        *szRemoteWriteUrl = '\0';
+
+    if (strcmp (g_szRemoteWriteUrl, szRemoteWriteUrl))
+    {
+        snprintf (g_szRemoteWriteUrl, sizeof (g_szRemoteWriteUrl), "%s", szRemoteWriteUrl);
+
+        if (*g_szRemoteWriteUrl)
+        {
+            if (FALSE == OSGetEnvironmentString (ENV_DOMPROM_REMOTE_WRITE_WAL, szWalFilename, sizeof (szWalFilename)-1))
+                snprintf (szWalFilename, sizeof (szWalFilename), "%s.wal", g_szStatsFilename);
+
+            g_RemoteWrite.Start (g_szRemoteWriteUrl,
+                                 szWalFilename,
+                                 (DWORD) OSGetEnvironmentLong (ENV_DOMPROM_REMOTE_WRITE_BATCH),
+                                 (DWORD) OSGetEnvironmentLong (ENV_DOMPROM_REMOTE_WRITE_WAL_MB));
+        }
+        else
+        {
+            g_RemoteWrite.Stop();
+            AddInLogMessageText ("%s: Remote write stopped", 0, g_szTask);
+        }
+    }
+
+#ifndef _WIN32
+    wValue = (WORD) OSGetEnvironmentLong (ENV_DOMPROM_INPLACE);
+
+    if (g_wInPlace != wValue)
+    {
+        AddInLogMessageText ("%s: In-place statistics file update: %s", 0, g_szTask, wValue ? "enabled":"disabled");
+        g_wInPlace = wValue;
+    }
+#endif
     g_wServerRestricted    = (WORD)  OSGetEnvironmentLong ("SERVER_RESTRICTED");
     g_dwDAOSCatalogStatus  = (DWORD) OSGetEnvironmentLong ("DAOSCATALOGSTATE");
     g_StatusDAOS           = (DWORD) OSGetEnvironmentLong ("DAOSENABLE");
@@ -3505,6 +9252,9 @@ void GetDiskStatNamesFromNotesIni()
     GetDiskPathFromNotesIni ("notes_tempdir",    sizeof (g_szNotesTemp),   g_szNotesTemp);
     GetDiskPathFromNotesIni ("view_rebuild_dir", sizeof (g_szViewRebuild), g_szViewRebuild);
     GetDiskPathFromNotesIni ("logfile_dir",      sizeof (g_szNotesLogDir), g_szNotesLogDir);
+
+    /* Component and path labels are built once */
+    g_DiskCollector.Init();
 }
 
 
@@ -3540,6 +9290,23 @@ void PrintHelp()
     AddInLogMessageText ("domprom_outfile               Override Domino Stats file (default: %s)", 0, g_szDominoProm);
     AddInLogMessageText ("domprom_trans_outfile         Override Domino Transactions Stats file (default: %s)", 0, g_szDominoTransProm);
     AddInLogMessageText ("domprom_no_domino_prefix      Disable the new 'Domino_' prefix ", 0);
+    AddInLogMessageText ("domprom_fsync                 Flush *.prom files to disk before renaming them (1=enabled)", 0);
+    AddInLogMessageText ("domprom_http_port             Serve metrics on http://<host>:<port>/metrics (default: disabled)", 0);
+    AddInLogMessageText ("domprom_http_bind             IP address for the HTTP listener (default: all interfaces)", 0);
+    AddInLogMessageText ("domprom_http_no_file          Don't write *.prom files while the HTTP listener is active (1=enabled)", 0);
+    AddInLogMessageText ("domprom_inplace               Patch changed values in a memory mapped statistics file (1=enabled, Linux only)", 0);
+    AddInLogMessageText ("domprom_relabel_rules         File with rules converting indexed stat names into labeled metric families", 0);
+    AddInLogMessageText ("domprom_filter_rules          File with include/exclude <prefix> rules for Domino statistics", 0);
+    AddInLogMessageText ("domprom_filter_exclude        Comma separated list of statistic prefixes to exclude", 0);
+    AddInLogMessageText ("domprom_filter_include        Comma separated list of statistic prefixes to include", 0);
+    AddInLogMessageText ("domprom_workers               Collector worker threads, 0 runs collectors on the servertask thread (default: 4)", 0);
+    AddInLogMessageText ("domprom_collector_timeout     Seconds to wait for collectors before writing statistics (default: 20, max: half the interval)", 0);
+    AddInLogMessageText ("domprom_facility_discovery    Seconds between full traversals discovering statistic facilities (default: %u)", 0, DOMPROM_DEFAULT_FACILITY_DISCOVERY_SEC);
+    AddInLogMessageText ("domprom_forecast_interval     Seconds between samples of the disk and translog growth forecast (default: %u)", 0, DOMPROM_DEFAULT_FORECAST_INTERVAL_SEC);
+    AddInLogMessageText ("domprom_remote_write_url      Push each snapshot via Prometheus remote write to http://<host>:<port>/<path>", 0);
+    AddInLogMessageText ("domprom_remote_write_wal      Remote write WAL file (default: <statistics file>.wal)", 0);
+    AddInLogMessageText ("domprom_remote_write_batch    Samples per remote write request (default: %u)", 0, DOMPROM_REMOTE_WRITE_DEFAULT_BATCH);
+    AddInLogMessageText ("domprom_remote_write_wal_max_mb  Maximum remote write WAL size in MB (default: %u)", 0, DOMPROM_REMOTE_WRITE_DEFAULT_WAL_MB);
     AddInLogMessageText ("domprom_businessdays_enabled  Enable main business time monitoring (1=enabled)", 0);
     AddInLogMessageText ("domprom_businessdays          Business days using Unix weekday format (0-6)", 0);
     AddInLogMessageText ("domprom_businesshours         Default business hours for days without specific setting (default: %s)", 0, DOMPROM_DEFAULT_BUSINESSHOURS);
@@ -3587,6 +9354,14 @@ void PrintConfig()
 
     AddInLogMessageText ("Statistics File      :  %s", 0, g_szStatsFilename);
 
+    if (g_RemoteWrite.IsActive())
+        AddInLogMessageText ("Remote Write         :  %s (pending: %u bytes)", 0, g_szRemoteWriteUrl, (DWORD) g_RemoteWrite.PendingBytes());
+
+    AddInLogMessageText ("Filter Rules         :  %u rules", 0, (DWORD) g_StatsFilter.RuleCount());
+
+    if (g_Relabeler.RuleCount())
+        AddInLogMessageText ("Relabel Rules        :  %u rules, %u families, %u colliding stats", 0, (DWORD) g_Relabeler.RuleCount(), (DWORD) g_Relabeler.FamilyCount(), (DWORD) g_Relabeler.CollisionCount());
+
     if (g_wCollectDominoTransStats)
         AddInLogMessageText ("Transactions File    :  %s", 0, g_szTransFilename);
 
@@ -3828,6 +9603,174 @@ Done:
 }
 
 
+/* Stat snapshot recorder ("tell domprom record <file>"). Recordings are replayed with "domprom_bench replay <file> [cycles]" (see tests/).
+   A recording contains one complete StatTraverse stream with raw values and the events4 description table.
+   So a customer's stat mix can be profiled and compared between exporter builds without a Domino server.
+
+   File layout (little endian):
+
+   "DPREC001"
+   u32 facility count, facilities  [u16 len, bytes]
+   u32 stat count, stats           [u16 facility index, u16 name len, name, u16 value type, u16 value len, raw value]
+   u32 description count, entries  [u16 name len, lowercase name, u16 description len, description] */
+
+#define DOMPROM_RECORD_MAGIC "DPREC001"
+
+struct STAT_RECORDER
+{
+    std::string Stats;
+    std::vector<std::string> Facilities;
+    std::unordered_map<std::string, WORD> FacilityIndex;
+    DWORD dwStats;
+};
+
+
+static void RecordAppendU16 (std::string &Out, WORD wValue)
+{
+    Out.push_back ((char) (wValue & 0xFF));
+    Out.push_back ((char) (wValue >> 8));
+}
+
+static void RecordAppendU32 (std::string &Out, DWORD dwValue)
+{
+    RecordAppendU16 (Out, (WORD) (dwValue & 0xFFFF));
+    RecordAppendU16 (Out, (WORD) (dwValue >> 16));
+}
+
+static void RecordAppendString (std::string &Out, const char *pData, size_t Len)
+{
+    if (Len > 0xFFFF)
+        Len = 0xFFFF;
+
+    RecordAppendU16 (Out, (WORD) Len);
+    Out.append (pData, Len);
+}
+
+
+STATUS LNCALLBACK RecordStatTraverse (void *pContext, char *pszFacility, char *pszStatName, WORD wValueType, void *pValue)
+{
+    STAT_RECORDER *pRecorder = (STAT_RECORDER *) pContext;
+    size_t ValueLen = 0;
+
+    if ((NULL == pRecorder) || (NULL == pszFacility) || (NULL == pszStatName) || (NULL == pValue))
+        return NOERROR;
+
+    switch (wValueType)
+    {
+        case VT_LONG:     ValueLen = sizeof (LONG);     break;
+        case VT_NUMBER:   ValueLen = sizeof (NUMBER);   break;
+        case VT_TIMEDATE: ValueLen = sizeof (TIMEDATE); break;
+        case VT_TEXT:     ValueLen = strlen ((char *) pValue); break;
+        default:          return NOERROR;
+    }
+
+    auto it = pRecorder->FacilityIndex.find (pszFacility);
+
+    if (it == pRecorder->FacilityIndex.end())
+    {
+        it = pRecorder->FacilityIndex.emplace (pszFacility, (WORD) pRecorder->Facilities.size()).first;
+        pRecorder->Facilities.push_back (pszFacility);
+    }
+
+    RecordAppendU16    (pRecorder->Stats, it->second);
+    RecordAppendString (pRecorder->Stats, pszStatName, strlen (pszStatName));
+    RecordAppendU16    (pRecorder->Stats, wValueType);
+    RecordAppendString (pRecorder->Stats, (const char *) pValue, ValueLen);
+
+    pRecorder->dwStats++;
+    return NOERROR;
+}
+
+
+void RecordStatSnapshot (const char *pszFilename)
+{
+    STAT_RECORDER Recorder;
+    std::string   Out;
+    FILE  *fp = NULL;
+
+    if (IsNullStr (pszFilename))
+    {
+        AddInLogMessageText ("%s: No recording file specified", 0, g_szTask);
+        return;
+    }
+
+    Recorder.dwStats = 0;
+
+    StatTraverse (NULL, NULL, RecordStatTraverse, &Recorder);
+
+    Out.reserve (Recorder.Stats.size() + g_StatHelp.Bytes() + 32 * g_StatHelp.Size() + 1024);
+    Out = DOMPROM_RECORD_MAGIC;
+
+    RecordAppendU32 (Out, (DWORD) Recorder.Facilities.size());
+
+    for (const auto &Facility : Recorder.Facilities)
+        RecordAppendString (Out, Facility.data(), Facility.size());
+
+    RecordAppendU32 (Out, Recorder.dwStats);
+    Out += Recorder.Stats;
+
+    /* Descriptions are recorded in HELP format */
+    RecordAppendU32 (Out, (DWORD) g_StatHelp.Size());
+
+    g_StatHelp.ForEach ([&Out] (std::string_view Name, std::string_view Text)
+    {
+        RecordAppendString (Out, Name.data(), Name.size());
+        RecordAppendString (Out, Text.data(), Text.size());
+    });
+
+    fp = fopen (pszFilename, "wb");
+
+    if (NULL == fp)
+    {
+        AddInLogMessageText ("%s: Cannot create recording file: %s", 0, g_szTask, pszFilename);
+        return;
+    }
+
+    if (1 != fwrite (Out.data(), Out.size(), 1, fp))
+        AddInLogMessageText ("%s: Cannot write recording file: %s", 0, g_szTask, pszFilename);
+    else
+        AddInLogMessageText ("%s: Recorded %u statistics and %u descriptions to %s (%u bytes)", 0, g_szTask,
+                             Recorder.dwStats, (DWORD) g_StatHelp.Size(), pszFilename, (DWORD) Out.size());
+
+    fclose (fp);
+    fp = NULL;
+}
+
+
+void StartTrace (const char *pszParam)
+{
+    char  szFilename[2*MAXPATH+1] = {0};
+    DWORD dwCycles = 0;
+    char  *p       = NULL;
+    size_t Len     = 0;
+
+    /* The file name is the rest of the line and may contain blanks */
+    dwCycles = (DWORD) strtoul (pszParam, &p, 10);
+
+    while ((' ' == *p) || ('\t' == *p))
+        p++;
+
+    Len = strlen (p);
+    while ((Len > 0) && ((' ' == p[Len-1]) || ('\t' == p[Len-1])))
+        Len--;
+
+    snprintf (szFilename, sizeof (szFilename), "%.*s", (int) Len, p);
+
+    if ((0 == dwCycles) || (dwCycles > DOMPROM_TRACE_MAX_CYCLES))
+    {
+        AddInLogMessageText ("%s: Specify 1-%u cycles to trace", 0, g_szTask, DOMPROM_TRACE_MAX_CYCLES);
+        return;
+    }
+
+    if (IsNullStr (szFilename))
+        snprintf (szFilename, sizeof (szFilename), "%s%c%s", IsNullStr (g_szNotesLogDir) ? g_szDataDir : g_szNotesLogDir, g_DirSep, DOMPROM_TRACE_FILENAME);
+
+    g_Trace.Start (dwCycles, szFilename);
+
+    AddInLogMessageText ("%s: Tracing the next %u collection cycles to %s", 0, g_szTask, dwCycles, szFilename);
+}
+
+
 void ProcessCommand (const char *pszCmdBuffer)
 {
     const char *pszCommand = NULL;
@@ -3858,6 +9801,16 @@ void ProcessCommand (const char *pszCmdBuffer)
         UpdateMaintenance (pszCommand);
     }
 
+    else if ((pszCommand = GetStringAfterPrefix (pszCmdBuffer, "trace ")))
+    {
+        StartTrace (pszCommand);
+    }
+
+    else if ((pszCommand = GetStringAfterPrefix (pszCmdBuffer, "record ")))
+    {
+        RecordStatSnapshot (pszCommand);
+    }
+
     else
     {
         AddInLogMessageText ("%s: Invalid command: %s", 0, g_szTask, pszCmdBuffer);
@@ -3865,19 +9818,32 @@ void ProcessCommand (const char *pszCmdBuffer)
 }
 
 
-BOOL CheckAndProcessCommand (MQHANDLE hQueue)
+/* Waits for a console command until the wait time elapsed. Returns TRUE if the task should terminate */
+
+BOOL WaitForCommand (MQHANDLE hQueue, uint64_t WaitMsec)
 {
     STATUS error   = NOERROR;
     WORD   wMsgLen = 0;
     char   szMsgBuffer[MQ_MAX_MSGSIZE+1] = {0};
 
+    /* Wait in slices to notice a server shutdown without a quit message */
+    if (WaitMsec > DOMPROM_MAX_WAIT_SLICE_MSEC)
+        WaitMsec = DOMPROM_MAX_WAIT_SLICE_MSEC;
+
     if (NULLHANDLE == hQueue)
-        return FALSE;
+        return AddInIdleDelay ((DWORD) WaitMsec);
 
     if (MQIsQuitPending (hQueue))
         return TRUE;
 
-    error = MQGet (hQueue, szMsgBuffer, MQ_MAX_MSGSIZE, 0, 0, &wMsgLen);
+    /* A timeout of 0 would wait without limit */
+    if (WaitMsec)
+        error = MQGet (hQueue, szMsgBuffer, MQ_MAX_MSGSIZE, MQ_WAIT_FOR_MSG, (DWORD) WaitMsec, &wMsgLen);
+    else
+        error = MQGet (hQueue, szMsgBuffer, MQ_MAX_MSGSIZE, 0, 0, &wMsgLen);
+
+    if (ERR_MQ_QUITTING == error)
+        return TRUE;
 
     if (NOERROR == error)
     {
@@ -3888,7 +9854,112 @@ BOOL CheckAndProcessCommand (MQHANDLE hQueue)
         }
     }
 
-    return FALSE;
+    return AddInIdle();
+}
+
+
+void UpdateScheduleIntervals ()
+{
+    g_Scheduler.SetInterval (SCHEDULE_STATS,   g_dwIntervalSec);
+    g_Scheduler.SetInterval (SCHEDULE_TRANS,   g_dwTransIntervalSec);
+    g_Scheduler.SetInterval (SCHEDULE_IOSTAT,  g_dwIOStatIntervalSec);
+    g_Scheduler.SetInterval (SCHEDULE_MAILBOX, g_dwMboxStatIntervalSec);
+}
+
+
+STATUS RunScheduledJob (SCHEDULE_JOB Job)
+{
+    STATUS error = NOERROR;
+
+    switch (Job)
+    {
+        case SCHEDULE_TRANS:
+            if (g_wCollectDominoTransStats)
+                g_CollectorPool.Submit (g_Collectors[COLLECTOR_TRANS]);
+            break;
+
+        case SCHEDULE_IOSTAT:
+            if (g_wCollectDominoIOStat)
+                g_CollectorPool.Submit (g_Collectors[COLLECTOR_IOSTAT]);
+            break;
+
+        case SCHEDULE_MAILBOX:
+            if (g_wCollectMailboxStats)
+                g_CollectorPool.Submit (g_Collectors[COLLECTOR_MAILBOX]);
+            break;
+
+        case SCHEDULE_ENV:
+            GetEnvironmentVars (FALSE);
+            UpdateScheduleIntervals();
+            break;
+
+        case SCHEDULE_STATS:
+            g_Trace.BeginCycle();
+            AddInSetStatusText ("Collecting Stats");
+
+            RunCollectors();
+            error = ProcessDominoStatistics (g_szStatsFilename);
+
+            UpdateIdleStatus();
+            break;
+
+        default:
+            break;
+    }
+
+    return error;
+}
+
+
+/* Default filter rules and the filter and relabel rules configured in notes.ini */
+
+void LoadStatRules (PrefixFilter &Filter, StatRelabeler &Relabeler)
+{
+    char szRelabelRules[MAXPATH+1]   = {0};
+    char szFilterRules[MAXSPRINTF+1] = {0};
+
+    // Add Include/Exclude rules - Names must be specified all LOWERCASE!
+
+    // Exclude platform stats in general and just include relevant stats to not pollute stats
+    Filter.AddExclude ("platform.");
+    Filter.AddInclude ("platform.network.total.");
+
+    Filter.AddExclude ("disk.");
+
+    // Exclude sensitive stats containing names
+    Filter.AddExclude ("replica.cluster.currency.");
+    Filter.AddExclude ("server.cluster.member.");
+    Filter.AddExclude ("net.log.");
+
+    // Exclude statistics which contain PIDs which change too often and don't fit for monitoring
+    Filter.AddExclude ("mem.pid.");
+    Filter.AddExclude ("mem.local.max.used.");
+
+    // Exclude Traveler stats in general and just include relevant stats to not pollute stats
+    Filter.AddExclude ("traveler.");
+
+    Filter.AddInclude ("traveler.memory.");
+    Filter.AddInclude ("traveler.status.state.severity");
+    Filter.AddInclude ("traveler.push.");
+    Filter.AddInclude ("traveler.primesync.count");
+    Filter.AddInclude ("traveler.constrained.");
+    Filter.AddInclude ("traveler.http.status.");
+    Filter.AddInclude ("traveler.monitor.users");
+
+    // Additional rules from notes.ini and the rules file. The same prefix replaces a default rule
+    if (OSGetEnvironmentString (ENV_DOMPROM_FILTER_EXCLUDE, szFilterRules, sizeof (szFilterRules)-1))
+        Filter.AddList (szFilterRules, false);
+
+    if (OSGetEnvironmentString (ENV_DOMPROM_FILTER_INCLUDE, szFilterRules, sizeof (szFilterRules)-1))
+        Filter.AddList (szFilterRules, true);
+
+    if (OSGetEnvironmentString (ENV_DOMPROM_FILTER_RULES, szFilterRules, sizeof (szFilterRules)-1))
+        Filter.LoadFile (szFilterRules);
+
+    Filter.Finalize();
+
+    if (OSGetEnvironmentString (ENV_DOMPROM_RELABEL_RULES, szRelabelRules, sizeof (szRelabelRules)-1))
+        Relabeler.Load (szRelabelRules);
 }
 
 
@@ -3900,9 +9971,10 @@ STATUS LNPUBLIC AddInMain (HMODULE hResourceModule, int argc, char *argv[])
     DHANDLE hStatusLineDesc = NULLHANDLE;
     HMODULE hMod            = NULLHANDLE;
 
-    DWORD   dwSeconds = 0;
+    SCHEDULE_JOB Job = SCHEDULE_STATS;
 
     char    szStatsDirName[MAXPATH+100]    = {0};
+    char    szWorkers[20]                  = {0};
     char    *pEnv = NULL;
     int     a = 0;
     char    ch = '\0';
@@ -3926,9 +9998,6 @@ STATUS LNPUBLIC AddInMain (HMODULE hResourceModule, int argc, char *argv[])
         goto Done;
     }
 
-    OSCurrentTIMEDATE (&g_tNextTransStatsUpdate);
-    OSCurrentTIMEDATE (&g_tNextIOStatUpdate);
-    OSCurrentTIMEDATE (&g_tNextMailboxStatsUpdate);
     OSGetDataDirectory (g_szDataDir);
 
     for (a=1; a<argc; a++)
@@ -4023,35 +10092,7 @@ STATUS LNPUBLIC AddInMain (HMODULE hResourceModule, int argc, char *argv[])
         goto Done;
     }
 
-    // Add Include/Exclude rules - Names must be specified all LOWERCASE!
-
-    // Exclude platform stats in general and just include relevant stats to not pollute stats
-    g_StatsFilter.AddExclude ("platform.");
-    g_StatsFilter.AddInclude ("platform.network.total.");
-
-    g_StatsFilter.AddExclude ("disk.");
-
-    // Exclude sensitive stats containing names
-    g_StatsFilter.AddExclude ("replica.cluster.currency.");
-    g_StatsFilter.AddExclude ("server.cluster.member.");
-    g_StatsFilter.AddExclude ("net.log.");
-
-    // Exclude statistics which contain PIDs which change too often and don't fit for monitoring
-    g_StatsFilter.AddExclude ("mem.pid.");
-    g_StatsFilter.AddExclude ("mem.local.max.used.");
-
-    // Exclude Traveler stats in general and just include relevant stats to not pollute stats
-    g_StatsFilter.AddExclude ("traveler.");
-
-    g_StatsFilter.AddInclude ("traveler.memory.");
-    g_StatsFilter.AddInclude ("traveler.status.state.severity");
-    g_StatsFilter.AddInclude ("traveler.push.");
-    g_StatsFilter.AddInclude ("traveler.primesync.count");
-    g_StatsFilter.AddInclude ("traveler.constrained.");
-    g_StatsFilter.AddInclude ("traveler.http.status.");
-    g_StatsFilter.AddInclude ("traveler.monitor.users");
-
-    g_StatsFilter.Finalize();
+    LoadStatRules (g_StatsFilter, g_Relabeler);
 
     error = NSFGetTransLogStyle (&g_wTranslogLogType);
 
@@ -4112,6 +10153,13 @@ STATUS LNPUBLIC AddInMain (HMODULE hResourceModule, int argc, char *argv[])
 
     GetEnvironmentVars (TRUE);
 
+    g_SnapshotWriter.Start();
+
+    if (OSGetEnvironmentString (ENV_DOMPROM_WORKERS, szWorkers, sizeof (szWorkers)-1))
+        g_CollectorPool.Start ((DWORD) atoi (szWorkers));
+    else
+        g_CollectorPool.Start (DOMPROM_DEFAULT_WORKERS);
+
     AddInLogMessageText ("%s: Domino Prometheus Exporter %s", 0, g_szTask, g_szVersion);
 
     AddInLogMessageText ("%s: Statistics Interval: %u seconds, File: %s", 0, g_szTask, g_dwIntervalSec, g_szStatsFilename);
@@ -4137,40 +10185,23 @@ STATUS LNPUBLIC AddInMain (HMODULE hResourceModule, int argc, char *argv[])
 
     AddInSetStatusText ("Ready");
 
+    /* Collectors run once at startup and then on their interval boundaries */
+    g_Scheduler.Schedule (SCHEDULE_TRANS,   g_dwTransIntervalSec,   true);
+    g_Scheduler.Schedule (SCHEDULE_IOSTAT,  g_dwIOStatIntervalSec,  true);
+    g_Scheduler.Schedule (SCHEDULE_MAILBOX, g_dwMboxStatIntervalSec, true);
+    g_Scheduler.Schedule (SCHEDULE_ENV,     DOMPROM_ENV_CHECK_INTERVAL_SEC, false);
+    g_Scheduler.Schedule (SCHEDULE_STATS,   g_dwIntervalSec,        true);
+
     while (0 == g_ShutdownPending)
     {
-        AddInSetStatusText ("Collecting Stats");
-
-        if (g_wCollectDominoTransStats)
-            ProcessTransStats (g_szTransFilename, g_dwTransIntervalSec);
-
-        if (g_wCollectDominoIOStat)
-            ProcessIOStat (g_dwIOStatIntervalSec);
-
-        if (g_wCollectMailboxStats)
-            ProcessMailBoxStats (g_dwMboxStatIntervalSec);
-
-        error = ProcessDominoStatistics (g_szStatsFilename);
-
-        UpdateIdleStatus();
-
-        for (dwSeconds = 0; dwSeconds < g_dwIntervalSec; dwSeconds++)
+        while (g_Scheduler.PopDue (GetTimeMs(), Job))
         {
-            if (CheckAndProcessCommand (hQueue))
-            {
-                g_ShutdownPending = 1;
-                break;
-            }
-
-            /* Don't check environment vars too often */
-            if ( 0 == (dwSeconds % 30))
-                GetEnvironmentVars (FALSE);
+            error = RunScheduledJob (Job);
+        }
 
-            if (AddInIdleDelay (1000))
-            {
-                g_ShutdownPending = 1;
-                break;
-            }
+        if (WaitForCommand (hQueue, g_Scheduler.MsecUntilNext (GetTimeMs())))
+        {
+            g_ShutdownPending = 1;
         }
 
     } /* while */
@@ -4183,8 +10214,16 @@ invalid_syntax:
 
 Done:
 
+    /* Collector jobs submit transaction snapshots to the writer */
+    g_CollectorPool.Stop (g_dwCollectorTimeoutSec);
+
     ProcessDominoStatistics (g_szStatsFilename, true);
 
+    /* Write the final snapshot before the listeners and the push thread stop */
+    g_SnapshotWriter.Stop();
+    g_HttpServer.Stop();
+    g_RemoteWrite.Stop();
+
     /* Remove Transaction Domino stats file if present */
     RemoveFile (g_szTransFilename, 1);
 
@@ -0,0 +1,117 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - Collector pool tests                       #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* Tests of the collector worker pool shutdown */
+
+#include "../domprom.cpp"
+
+
+static int g_Failures = 0;
+
+#define CHECK(Cond) \
+    do { if (!(Cond)) { printf ("FAILED %s:%d: %s\n", __FILE__, __LINE__, #Cond); g_Failures++; } } while (0)
+
+
+static std::atomic<int> g_Runs {0};
+
+static void SlowCollector ()
+{
+    std::this_thread::sleep_for (std::chrono::milliseconds (1500));
+    g_Runs++;
+}
+
+static void FastCollector ()
+{
+    g_Runs++;
+}
+
+
+/* A job queued behind a running one is dropped at shutdown. Stop returns when the running job is done */
+
+static void TestStopWithQueuedJob ()
+{
+    CollectorPool  Pool;
+    COLLECTOR_TYPE Slow   = { "slow",   SlowCollector, PHASE_PROBE };
+    COLLECTOR_TYPE Queued = { "queued", FastCollector, PHASE_TRANS };
+
+    printf ("Test: stop with a queued job\n");
+    g_Runs = 0;
+
+    Pool.Start (1);
+    Pool.Submit (Slow);
+
+    /* Let the worker pick up the slow job, the second one stays in the queue */
+    std::this_thread::sleep_for (std::chrono::milliseconds (200));
+    Pool.Submit (Queued);
+
+    auto Start = std::chrono::steady_clock::now();
+    Pool.Stop (5);
+    auto Msec  = std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::steady_clock::now() - Start).count();
+
+    CHECK (Msec < 3000);
+    CHECK (0 == Pool.Workers());
+    CHECK (1 == g_Runs);
+    CHECK (false == Pool.GetState (Slow).bRunning);
+    CHECK (false == Pool.GetState (Queued).bRunning);
+}
+
+
+/* A job running past the timeout does not block the shutdown */
+
+static void TestStopTimeout ()
+{
+    CollectorPool  Pool;
+    COLLECTOR_TYPE Slow = { "slow", SlowCollector, PHASE_PROBE };
+
+    printf ("Test: stop with a job running past the timeout\n");
+    g_Runs = 0;
+
+    Pool.Start (2);
+    Pool.Submit (Slow);
+    std::this_thread::sleep_for (std::chrono::milliseconds (200));
+
+    auto Start = std::chrono::steady_clock::now();
+    Pool.Stop (0);
+    auto Msec  = std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::steady_clock::now() - Start).count();
+
+    CHECK (Msec < 1000);
+    CHECK (0 == Pool.Workers());
+
+    /* The detached worker still completes the job on this pool */
+    std::this_thread::sleep_for (std::chrono::milliseconds (2000));
+    CHECK (1 == g_Runs);
+}
+
+
+int main ()
+{
+    TestStopWithQueuedJob();
+    TestStopTimeout();
+
+    if (g_Failures)
+    {
+        printf ("collector_test: %d checks FAILED\n", g_Failures);
+        return 1;
+    }
+
+    printf ("collector_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,1027 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - Benchmarks                                 #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* Benchmarks of the export hot path. Built against the Notes API stubs in notesapi/ and runs without a Domino server (see makefile).
+   The exporter source is included to reach its internal classes. The add-in entry point is not used */
+
+#include "../domprom.cpp"
+
+
+/* Micro benchmark: compare the std::to_chars based formatting with the previous snprintf paths.
+   Runs on a fixed pseudo random value mix similar to Domino statistics (counters, byte counts, percentages, msec) */
+
+#define DOMPROM_BENCH_VALUES 10000
+
+static size_t SnprintfFixed3 (char *pBuffer, double val)
+{
+    int64_t scaled    = (int64_t)(val * 1000.0 + (val >= 0 ? 0.5 : -0.5));
+    int64_t int_part  = scaled / 1000;
+    int64_t frac_part = llabs(scaled % 1000);
+
+    return (size_t) snprintf (pBuffer, MAX_PROM_VALUE, "%" PRId64 ".%03" PRId64, int_part, frac_part);
+}
+
+
+void RunFormatBenchmark (DWORD dwRounds)
+{
+    std::vector<double>   Numbers;
+    std::vector<uint64_t> Longs;
+    std::vector<DWORD>    Msecs;
+
+    char     szValue[MAX_PROM_VALUE] = {0};
+    char     szCheck[MAX_PROM_VALUE] = {0};
+    uint64_t Random   = 0x2545F4914F6CDD1DULL;
+    uint64_t Bytes    = 0;
+    size_t   Mismatch = 0;
+    DWORD    dwRound  = 0;
+    size_t   i        = 0;
+    double   dNsec[6] = {0};
+
+    if (0 == dwRounds)
+        dwRounds = 100;
+
+    Numbers.reserve (DOMPROM_BENCH_VALUES);
+    Longs.reserve   (DOMPROM_BENCH_VALUES);
+    Msecs.reserve   (DOMPROM_BENCH_VALUES);
+
+    for (i = 0; i < DOMPROM_BENCH_VALUES; i++)
+    {
+        /* xorshift64 */
+        Random ^= Random << 13;
+        Random ^= Random >> 7;
+        Random ^= Random << 17;
+
+        switch (i % 4)
+        {
+            case 0:  Numbers.push_back ((double) (Random % 1000)); break;                     // small counters
+            case 1:  Numbers.push_back ((double) (Random % 4000000000000ULL)); break;         // byte counts
+            case 2:  Numbers.push_back ((double) (Random % 100000) / 997.0); break;           // percentages, rates
+            default: Numbers.push_back (-((double) (Random % 100000) / 31.0)); break;         // rare negative values
+        }
+
+        Longs.push_back ((i % 2) ? (Random % 1000) : (Random % 0xFFFFFFFFULL));
+        Msecs.push_back ((DWORD) (Random % 120000));
+    }
+
+    /* Validate fixed-point output against the previous implementation. Values between -1 and 0 lost the sign before */
+    for (i = 0; i < DOMPROM_BENCH_VALUES; i++)
+    {
+        SnprintfFixed3   (szCheck, Numbers[i]);
+        FormatPromFixed3 (szValue, Numbers[i]);
+
+        if (strcmp (szCheck, szValue) && (Numbers[i] <= -1.0 || Numbers[i] >= 0))
+            Mismatch++;
+    }
+
+    auto Measure = [&] (double &dResult, auto Func)
+    {
+        auto Start = std::chrono::steady_clock::now();
+
+        for (dwRound = 0; dwRound < dwRounds; dwRound++)
+        {
+            for (i = 0; i < DOMPROM_BENCH_VALUES; i++)
+                Bytes += Func (i);
+        }
+
+        dResult = (double) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - Start).count() / ((double) dwRounds * DOMPROM_BENCH_VALUES);
+    };
+
+    Measure (dNsec[0], [&] (size_t n) { return SnprintfFixed3 (szValue, Numbers[n]); });
+    Measure (dNsec[1], [&] (size_t n) { return FormatPromFixed3 (szValue, Numbers[n]); });
+    Measure (dNsec[2], [&] (size_t n) { return (size_t) snprintf (szValue, sizeof (szValue), "%" PRIu64, Longs[n]); });
+    Measure (dNsec[3], [&] (size_t n) { return FormatPromU64 (szValue, Longs[n]); });
+    Measure (dNsec[4], [&] (size_t n) { return (size_t) snprintf (szValue, sizeof (szValue), "%u.%03u", Msecs[n] / 1000, Msecs[n] % 1000); });
+    Measure (dNsec[5], [&] (size_t n) { return FormatPromMSecToSeconds (szValue, Msecs[n]); });
+
+    printf ("Format benchmark: %u rounds x %u values (%u bytes)\n", dwRounds, DOMPROM_BENCH_VALUES, (DWORD) (Bytes / dwRounds));
+    printf ("  NUMBER fixed-3   snprintf: %6.1f ns  to_chars: %6.1f ns\n", dNsec[0], dNsec[1]);
+    printf ("  uint64           snprintf: %6.1f ns  to_chars: %6.1f ns\n", dNsec[2], dNsec[3]);
+    printf ("  msec to seconds  snprintf: %6.1f ns  to_chars: %6.1f ns\n", dNsec[4], dNsec[5]);
+
+    if (Mismatch)
+        printf ("  Warning: %u fixed-point values differ from the snprintf output\n", (DWORD) Mismatch);
+}
+
+
+/* Allocation counter for the benchmarks. The replaced global operator new only adds a relaxed atomic increment */
+
+std::atomic<uint64_t> g_AllocCount {0};
+
+void *operator new (size_t Size)
+{
+    void *p = NULL;
+
+    g_AllocCount.fetch_add (1, std::memory_order_relaxed);
+
+    p = malloc (Size ? Size : 1);
+
+    if (NULL == p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete (void *p) noexcept
+{
+    free (p);
+}
+
+void operator delete (void *p, size_t) noexcept
+{
+    free (p);
+}
+
+
+/* Statistic set loaded into the statistics of the Notes API stubs and returned by their StatTraverse */
+
+struct REPLAY_STAT
+{
+    std::string Facility;
+    std::string Name;
+    WORD        wValueType;
+    std::string Text;
+
+    union
+    {
+        LONG     Long;
+        NUMBER   Number;
+        TIMEDATE Timedate;
+    } Value;
+
+    void *ValuePtr ()
+    {
+        if (VT_TEXT == wValueType)
+            return &Text[0];
+
+        return &Value;
+    }
+};
+
+
+void BuildSyntheticStats (size_t Count, std::vector<REPLAY_STAT> &Stats)
+{
+    static const char *Facilities[] = { "Server", "Database", "Mem", "Net", "NSF", "Replica", "Mail", "Http",
+                                        "Update", "Agent", "Calendar", "Domino", "Platform", "Traveler", "Disk", "Monitor" };
+    REPLAY_STAT Stat;
+    TIMEDATE tNow    = {0};
+    uint64_t Random  = 0x2545F4914F6CDD1DULL;
+    char     szName[MAXSPRINTF+1] = {0};
+
+    OSCurrentTIMEDATE (&tNow);
+
+    Stats.clear();
+    Stats.reserve (Count);
+
+    for (size_t i = 0; i < Count; i++)
+    {
+        /* xorshift64 */
+        Random ^= Random << 13;
+        Random ^= Random >> 7;
+        Random ^= Random << 17;
+
+        /* Indexed names like per port, per pool or per database statistics */
+        snprintf (szName, sizeof (szName), "Group%u.Instance%u.Value%u", (unsigned) (i % 97), (unsigned) (i / 97), (unsigned) (i % 7));
+
+        Stat.Facility = Facilities[i % (sizeof (Facilities) / sizeof (Facilities[0]))];
+        Stat.Name     = szName;
+        Stat.Text.clear();
+
+        /* Type mix similar to a Domino server: mostly LONG and NUMBER */
+        switch (i % 20)
+        {
+            case 12: case 13: case 14: case 15: case 16:
+                Stat.wValueType   = VT_NUMBER;
+                Stat.Value.Number = (NUMBER) (Random % 100000000) / 1000.0;
+                break;
+
+            case 17: case 18:
+                Stat.wValueType = VT_TEXT;
+                Stat.Text       = (Random % 2) ? "Enabled" : "Disabled";
+                break;
+
+            case 19:
+                Stat.wValueType     = VT_TIMEDATE;
+                Stat.Value.Timedate = tNow;
+                break;
+
+            default:
+                Stat.wValueType = VT_LONG;
+                Stat.Value.Long = (LONG) (Random % 1000000);
+                break;
+        }
+
+        Stats.push_back (Stat);
+    }
+}
+
+
+void LoadStubStats (std::vector<REPLAY_STAT> &Stats)
+{
+    for (auto &Stat : Stats)
+        StatUpdate (&Stat.Facility[0], &Stat.Name[0], 0, Stat.wValueType, Stat.ValuePtr());
+}
+
+
+/* Filter, descriptions, relabel rules, metadata cache, duplicate set and facility plan of a replay.
+   Separate from the server's instances, the filter rule hits and caches of a running exporter are not touched */
+
+struct REPLAY_PIPELINE
+{
+    PrefixFilter      Filter;
+    HelpTextArena     Help;
+    StatRelabeler     Relabeler;
+    DuplicateStatSet  Duplicates;
+    StatMetadataCache Cache {Filter, Help, Relabeler};
+    FacilityPlanner   Planner {Filter};
+
+    REPLAY_PIPELINE ()
+    {
+        LoadStatRules (Filter, Relabeler);
+    }
+
+    void InitContext (CONTEXT_STRUCT_TYPE &Context, ExpositionBuffer &Out)
+    {
+        snprintf (Context.szPrefix, sizeof (Context.szPrefix), "Domino");
+        Context.bExportLong   = TRUE;
+        Context.bExportNumber = TRUE;
+        Context.pOut        = &Out;
+        Context.pCache      = &Cache;
+        Context.pDuplicates = &Duplicates;
+        Context.pPlanner    = &Planner;
+    }
+};
+
+
+/* One collection cycle like ProcessDominoStatistics: the facility plan traverses the stub statistics into the snapshot */
+
+void ReplayStatsCycle (CONTEXT_STRUCT_TYPE &Context)
+{
+    Context.pOut->Reset();
+    Context.CountAll = 0;
+
+    Context.pDuplicates->Begin();
+    Context.pCache->Relabeler().BeginCycle();
+
+    Context.pPlanner->Traverse (&Context);
+
+    Context.pCache->Relabeler().Flush (Context.pOut, Context.szPrefix);
+}
+
+
+/* Traverses the loaded statistics through StatTraverse, the facility plan and the export hot path (cache, filter, duplicate check, formatting, relabeling).
+   The first cycle discovers the facilities and fills the metadata cache. Following cycles show the steady state of a running server.
+   The time of the stub StatTraverse copying the statistics is measured separately and included in the cycle times.
+   The output of the last cycle is kept in Out */
+
+static STATUS LNCALLBACK CountStubStat (void *pContext, char *, char *, WORD, void *)
+{
+    (*(size_t *) pContext)++;
+    return NOERROR;
+}
+
+void RunReplayCycles (const char *pszName, REPLAY_PIPELINE &Pipeline, size_t StatCount, DWORD dwCycles, ExpositionBuffer &Out)
+{
+    CONTEXT_STRUCT_TYPE Context = {0};
+
+    char     szLine[MAXSPRINTF+1] = {0};
+    size_t   StubCount = 0;
+    double   dStubMsec = 0;
+    double   dColdMsec = 0;
+    double   dMinMsec  = 0;
+    double   dMaxMsec  = 0;
+    double   dSumMsec  = 0;
+    double   dMsec     = 0;
+    uint64_t ColdAllocs = 0;
+    uint64_t WarmAllocs = 0;
+    uint64_t Allocs     = 0;
+    DWORD    dwCycle    = 0;
+
+    if (0 == dwCycles)
+        dwCycles = 10;
+
+    Pipeline.InitContext (Context, Out);
+
+    for (dwCycle = 0; dwCycle <= dwCycles; dwCycle++)
+    {
+        Allocs = g_AllocCount.load (std::memory_order_relaxed);
+        auto Start = std::chrono::steady_clock::now();
+
+        ReplayStatsCycle (Context);
+
+        dMsec  = (double) std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now() - Start).count() / 1000.0;
+        Allocs = g_AllocCount.load (std::memory_order_relaxed) - Allocs;
+
+        if (0 == dwCycle)
+        {
+            dColdMsec  = dMsec;
+            ColdAllocs = Allocs;
+            continue;
+        }
+
+        if ((1 == dwCycle) || (dMsec < dMinMsec))
+            dMinMsec = dMsec;
+
+        if (dMsec > dMaxMsec)
+            dMaxMsec = dMsec;
+
+        dSumMsec   += dMsec;
+        WarmAllocs += Allocs;
+    }
+
+    /* Cost of the stub itself for a full traversal */
+    Allocs = g_AllocCount.load (std::memory_order_relaxed);
+    auto Start = std::chrono::steady_clock::now();
+
+    StatTraverse (NULL, NULL, CountStubStat, &StubCount);
+
+    dStubMsec = (double) std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now() - Start).count() / 1000.0;
+    Allocs    = g_AllocCount.load (std::memory_order_relaxed) - Allocs;
+
+    printf ("%s: %u stats, %u traversed per warm cycle, %u cycles, %u bytes output\n", pszName, (DWORD) StatCount, (DWORD) Context.CountAll, dwCycles, (DWORD) Out.Size());
+
+    snprintf (szLine, sizeof (szLine), "Cold cycle: %8.2f ms  %10" PRIu64 " allocations", dColdMsec, ColdAllocs);
+    printf ("  %s\n", szLine);
+
+    snprintf (szLine, sizeof (szLine), "Warm cycle: %8.2f ms avg, %.2f ms min, %.2f ms max  %" PRIu64 " allocations/cycle",
+              dSumMsec / dwCycles, dMinMsec, dMaxMsec, WarmAllocs / dwCycles);
+    printf ("  %s\n", szLine);
+
+    snprintf (szLine, sizeof (szLine), "Throughput: %.0f stats/s", dSumMsec > 0 ? (double) StatCount * dwCycles * 1000.0 / dSumMsec : 0.0);
+    printf ("  %s\n", szLine);
+
+    snprintf (szLine, sizeof (szLine), "Stub StatTraverse of all %u stats: %.2f ms  %" PRIu64 " allocations (included above)", (DWORD) StubCount, dStubMsec, Allocs);
+    printf ("  %s\n", szLine);
+}
+
+
+#define DOMPROM_BENCH_TRAVERSE_DEFAULT_STATS   50000
+#define DOMPROM_BENCH_TRAVERSE_MAX_STATS     1000000
+
+void RunTraverseBenchmark (DWORD dwStats, DWORD dwCycles)
+{
+    std::vector<REPLAY_STAT> Stats;
+    REPLAY_PIPELINE  Pipeline;
+    ExpositionBuffer Out;
+
+    if (0 == dwStats)
+        dwStats = DOMPROM_BENCH_TRAVERSE_DEFAULT_STATS;
+
+    if (dwStats > DOMPROM_BENCH_TRAVERSE_MAX_STATS)
+        dwStats = DOMPROM_BENCH_TRAVERSE_MAX_STATS;
+
+    BuildSyntheticStats (dwStats, Stats);
+    LoadStubStats (Stats);
+
+    RunReplayCycles ("Traverse benchmark", Pipeline, Stats.size(), dwCycles, Out);
+}
+
+
+/* Compares the duplicate detection of the flat set with the std::unordered_map used before ("domprom_bench dupes [stats] [cycles]") */
+
+#define DOMPROM_BENCH_DUPES_DEFAULT_CYCLES 20
+
+void RunDuplicateBenchmarkSize (DWORD dwStats, DWORD dwCycles)
+{
+    std::vector<REPLAY_STAT> Stats;
+    std::vector<std::string> Names;
+    std::unordered_map<std::string, double> Map;
+    DuplicateStatSet Set;
+
+    char     szLine[MAXSPRINTF+1] = {0};
+    size_t   MapMax   = 0;
+    size_t   MapDupes = 0;
+    size_t   SetDupes = 0;
+    uint64_t Allocs   = 0;
+    uint64_t MapAllocs = 0;
+    uint64_t SetAllocs = 0;
+    double   dMapNsec = 0;
+    double   dSetNsec = 0;
+    DWORD    dwCycle  = 0;
+
+    BuildSyntheticStats (dwStats, Stats);
+    Names.reserve (Stats.size() + Stats.size() / 50);
+
+    for (const auto &Stat : Stats)
+        Names.push_back (Stat.Facility + "." + Stat.Name);
+
+    /* Some stats are reported twice with a different case */
+    for (size_t i = 0; i < Stats.size(); i += 50)
+    {
+        std::string Upper = Names[i];
+        std::transform (Upper.begin(), Upper.end(), Upper.begin(), [] (unsigned char c) { return (char) toupper (c); });
+        Names.push_back (Upper);
+    }
+
+    /* Both receive the lower case name from the cache entry like the export path */
+    std::vector<std::string> LowerNames (Names);
+
+    for (auto &Name : LowerNames)
+        std::transform (Name.begin(), Name.end(), Name.begin(), [] (unsigned char c) { return (char) tolower (c); });
+
+    /* First cycle of both warms up the table sizes like the first collection on a server */
+    for (dwCycle = 0; dwCycle <= dwCycles; dwCycle++)
+    {
+        auto Start = std::chrono::steady_clock::now();
+        Allocs = g_AllocCount.load (std::memory_order_relaxed);
+
+        Map.clear();
+
+        if (MapMax)
+            Map.reserve (MapMax);
+
+        MapDupes = 0;
+
+        for (const auto &Name : LowerNames)
+        {
+            if (false == Map.emplace (Name, 0).second)
+                MapDupes++;
+        }
+
+        MapMax = std::max (MapMax, Map.size());
+
+        if (dwCycle)
+        {
+            dMapNsec  += (double) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - Start).count();
+            MapAllocs += g_AllocCount.load (std::memory_order_relaxed) - Allocs;
+        }
+
+        Start  = std::chrono::steady_clock::now();
+        Allocs = g_AllocCount.load (std::memory_order_relaxed);
+
+        Set.Begin();
+        SetDupes = 0;
+
+        for (const auto &Name : LowerNames)
+        {
+            if (DOMSTAT_NEW != Set.Register (Name.c_str(), 0))
+                SetDupes++;
+        }
+
+        if (dwCycle)
+        {
+            dSetNsec  += (double) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - Start).count();
+            SetAllocs += g_AllocCount.load (std::memory_order_relaxed) - Allocs;
+        }
+    }
+
+    printf ("Duplicate benchmark: %u stats, %u duplicates, %u cycles\n", (DWORD) Names.size(), (DWORD) SetDupes, dwCycles);
+
+    snprintf (szLine, sizeof (szLine), "unordered_map: %7.1f ns/stat  %8.1f allocations/cycle", dMapNsec / ((double) dwCycles * (double) Names.size()), (double) MapAllocs / dwCycles);
+    printf ("  %s\n", szLine);
+
+    snprintf (szLine, sizeof (szLine), "flat set:      %7.1f ns/stat  %8.1f allocations/cycle", dSetNsec / ((double) dwCycles * (double) Names.size()), (double) SetAllocs / dwCycles);
+    printf ("  %s\n", szLine);
+
+    if (MapDupes != SetDupes)
+        printf ("  Warning: unordered_map found %u duplicates\n", (DWORD) MapDupes);
+}
+
+
+void RunDuplicateBenchmark (DWORD dwStats, DWORD dwCycles)
+{
+    if (0 == dwCycles)
+        dwCycles = DOMPROM_BENCH_DUPES_DEFAULT_CYCLES;
+
+    if (dwStats > DOMPROM_BENCH_TRAVERSE_MAX_STATS)
+        dwStats = DOMPROM_BENCH_TRAVERSE_MAX_STATS;
+
+    /* Without a size compare a typical server and a large one */
+    if (dwStats)
+    {
+        RunDuplicateBenchmarkSize (dwStats, dwCycles);
+    }
+    else
+    {
+        RunDuplicateBenchmarkSize (5000,  dwCycles);
+        RunDuplicateBenchmarkSize (50000, dwCycles);
+    }
+}
+
+class RecordReader
+{
+
+public:
+
+    RecordReader (const std::string &Data) : m_Data (Data)
+    {
+    }
+
+    bool ReadU16 (WORD &wValue)
+    {
+        if (m_Pos + 2 > m_Data.size())
+            return false;
+
+        wValue = (WORD) ((unsigned char) m_Data[m_Pos] | ((unsigned char) m_Data[m_Pos+1] << 8));
+        m_Pos += 2;
+        return true;
+    }
+
+    bool ReadU32 (DWORD &dwValue)
+    {
+        WORD wLow  = 0;
+        WORD wHigh = 0;
+
+        if ((false == ReadU16 (wLow)) || (false == ReadU16 (wHigh)))
+            return false;
+
+        dwValue = wLow | ((DWORD) wHigh << 16);
+        return true;
+    }
+
+    bool ReadString (std::string &Value)
+    {
+        WORD wLen = 0;
+
+        if ((false == ReadU16 (wLen)) || (m_Pos + wLen > m_Data.size()))
+            return false;
+
+        Value.assign (m_Data, m_Pos, wLen);
+        m_Pos += wLen;
+        return true;
+    }
+
+    bool Skip (size_t Len)
+    {
+        if (m_Pos + Len > m_Data.size())
+            return false;
+
+        m_Pos += Len;
+        return true;
+    }
+
+
+private:
+
+    const std::string &m_Data;
+    size_t m_Pos = 0;
+};
+
+
+bool LoadStatRecording (const char *pszFilename, std::vector<REPLAY_STAT> &Stats, HelpTextArena &Descriptions)
+{
+    std::vector<std::string> Facilities;
+    std::string Data;
+    std::string Value;
+    std::string Key;
+    REPLAY_STAT Stat;
+    FILE  *fp       = NULL;
+    long  FileSize  = 0;
+    DWORD dwCount   = 0;
+    DWORD i         = 0;
+    WORD  wFacility = 0;
+
+    fp = fopen (pszFilename, "rb");
+
+    if (NULL == fp)
+        return false;
+
+    fseek (fp, 0, SEEK_END);
+    FileSize = ftell (fp);
+    fseek (fp, 0, SEEK_SET);
+
+    if (FileSize > 0)
+    {
+        Data.resize ((size_t) FileSize);
+
+        if (1 != fread (&Data[0], Data.size(), 1, fp))
+            Data.clear();
+    }
+
+    fclose (fp);
+    fp = NULL;
+
+    RecordReader Reader (Data);
+
+    if (0 != Data.compare (0, strlen (DOMPROM_RECORD_MAGIC), DOMPROM_RECORD_MAGIC))
+        return false;
+
+    Reader.Skip (strlen (DOMPROM_RECORD_MAGIC));
+
+    if (false == Reader.ReadU32 (dwCount))
+        return false;
+
+    for (i = 0; i < dwCount; i++)
+    {
+        if (false == Reader.ReadString (Value))
+            return false;
+
+        Facilities.push_back (Value);
+    }
+
+    if (false == Reader.ReadU32 (dwCount))
+        return false;
+
+    Stats.clear();
+    Stats.reserve (dwCount);
+
+    for (i = 0; i < dwCount; i++)
+    {
+        if ((false == Reader.ReadU16 (wFacility)) || (wFacility >= Facilities.size()))
+            return false;
+
+        if ((false == Reader.ReadString (Stat.Name)) || (false == Reader.ReadU16 (Stat.wValueType)) || (false == Reader.ReadString (Value)))
+            return false;
+
+        Stat.Facility = Facilities[wFacility];
+        Stat.Text.clear();
+        memset (&Stat.Value, 0, sizeof (Stat.Value));
+
+        if (VT_TEXT == Stat.wValueType)
+            Stat.Text = Value;
+        else
+            memcpy (&Stat.Value, Value.data(), std::min (Value.size(), sizeof (Stat.Value)));
+
+        Stats.push_back (Stat);
+    }
+
+    if (false == Reader.ReadU32 (dwCount))
+        return false;
+
+    Descriptions = HelpTextArena();
+
+    for (i = 0; i < dwCount; i++)
+    {
+        if ((false == Reader.ReadString (Key)) || (false == Reader.ReadString (Value)))
+            return false;
+
+        Descriptions.Add (Key.c_str(), Value.c_str(), true);
+    }
+
+    return true;
+}
+
+
+/* Feeds a recording through the export path with the recorded description table.
+   The output of the last cycle is written to <file>.prom for comparing exporter builds */
+
+void ReplayStatRecording (const char *pszFilename, DWORD dwCycles)
+{
+    std::vector<REPLAY_STAT> Stats;
+    REPLAY_PIPELINE  Pipeline;
+    ExpositionBuffer Out;
+    std::string OutFilename;
+
+    if (IsNullStr (pszFilename))
+    {
+        printf ("No recording file specified\n");
+        return;
+    }
+
+    /* The recorded descriptions are used instead of events4.nsf */
+    if (false == LoadStatRecording (pszFilename, Stats, Pipeline.Help))
+    {
+        printf ("Cannot read recording file: %s\n", pszFilename);
+        return;
+    }
+
+    LoadStubStats (Stats);
+
+    RunReplayCycles ("Replay", Pipeline, Stats.size(), dwCycles, Out);
+
+    OutFilename  = pszFilename;
+    OutFilename += ".prom";
+
+    if (Out.CommitToFile (OutFilename.c_str(), false))
+        printf ("Replay output written to %s\n", OutFilename.c_str());
+    else
+        printf ("Cannot write replay output: %s\n", OutFilename.c_str());
+}
+
+
+#define DOMPROM_BENCH_TRANS_DEFAULT_ROWS     200
+#define DOMPROM_BENCH_TRANS_MAX_ROWS       100000
+#define DOMPROM_BENCH_TRANS_DEFAULT_CYCLES   1000
+
+/* "show trans" layout: header, separator, one row per operation. Every 20th operation is reported twice */
+
+void BuildSyntheticTransOutput (DWORD dwRows, std::string &Out)
+{
+    char szLine[MAXSPRINTF+1] = {0};
+    char szName[80] = {0};
+
+    Out  = "Function                        Count      Min      Max       Total  Average\n";
+    Out += "----------------------------------------------------------------------------\n";
+
+    for (DWORD i = 0; i < dwRows; i++)
+    {
+        DWORD dwOp = (i % 20 == 19) ? i - 1 : i;
+
+        /* Some names contain blanks like in the real output */
+        snprintf (szName, sizeof (szName), (dwOp % 3) ? "OPEN_DB_%u" : "Get Note Info %u", dwOp);
+
+        snprintf (szLine, sizeof (szLine), "%-28s  %7u  %7u  %7u  %10u  %7u\n",
+                  szName, dwOp * 7 + 1, dwOp % 5, dwOp % 500 + 10, dwOp * 31 + 5, dwOp % 50);
+
+        Out += szLine;
+    }
+
+    Out += "\n";
+}
+
+
+/* Parses a captured "show trans" output file or a synthetic one. For a file the output is written
+   to <file>.prom to compare the results of different builds and Domino versions */
+
+void RunTransBenchmark (const char *pszParam)
+{
+    std::string Input;
+    std::string Filename;
+    ExpositionBuffer Out;
+    TransStatsParser Parser;
+
+    char     szLine[MAXSPRINTF+1] = {0};
+    char     szFilename[MAXPATH+1] = {0};
+    DWORD    dwRows    = 0;
+    DWORD    dwCycles  = 0;
+    DWORD    dwCycle   = 0;
+    DWORD    dwParsed  = 0;
+    uint64_t Allocs    = 0;
+    double   dNsec     = 0;
+    FILE     *fp       = NULL;
+
+    while (' ' == *pszParam)
+        pszParam++;
+
+    if (isdigit ((unsigned char) *pszParam) || ('\0' == *pszParam))
+    {
+        sscanf (pszParam, "%u %u", &dwRows, &dwCycles);
+
+        if (0 == dwRows)
+            dwRows = DOMPROM_BENCH_TRANS_DEFAULT_ROWS;
+
+        if (dwRows > DOMPROM_BENCH_TRANS_MAX_ROWS)
+            dwRows = DOMPROM_BENCH_TRANS_MAX_ROWS;
+
+        BuildSyntheticTransOutput (dwRows, Input);
+    }
+    else
+    {
+        sscanf (pszParam, "%255s %u", szFilename, &dwCycles);
+
+        fp = fopen (szFilename, "rb");
+
+        if (NULL == fp)
+        {
+            printf ("Cannot read show trans capture: %s\n", szFilename);
+            return;
+        }
+
+        while ((dwRows = (DWORD) fread (szLine, 1, sizeof (szLine), fp)) > 0)
+            Input.append (szLine, dwRows);
+
+        fclose (fp);
+        fp = NULL;
+
+        Filename = szFilename;
+    }
+
+    if (0 == dwCycles)
+        dwCycles = DOMPROM_BENCH_TRANS_DEFAULT_CYCLES;
+
+    /* First cycle sizes the parser and the output buffer */
+    for (dwCycle = 0; dwCycle <= dwCycles; dwCycle++)
+    {
+        auto Start = std::chrono::steady_clock::now();
+        uint64_t AllocsBefore = g_AllocCount.load (std::memory_order_relaxed);
+
+        Out.Reset();
+        dwParsed = Parser.Parse (Input.c_str());
+        Parser.Write (&Out);
+
+        if (dwCycle)
+        {
+            dNsec  += (double) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - Start).count();
+            Allocs += g_AllocCount.load (std::memory_order_relaxed) - AllocsBefore;
+        }
+    }
+
+    printf ("Trans benchmark: %u bytes input, %u operations, %u bytes output, %u cycles\n",
+            (DWORD) Input.size(), dwParsed, (DWORD) Out.Size(), dwCycles);
+
+    snprintf (szLine, sizeof (szLine), "Parse and render: %9.1f ns/cycle  %7.1f ns/operation  %.1f allocations/cycle",
+              dNsec / dwCycles, dwParsed ? dNsec / dwCycles / dwParsed : 0.0, (double) Allocs / dwCycles);
+    printf ("  %s\n", szLine);
+
+    if (Filename.empty())
+        return;
+
+    Filename += ".prom";
+
+    if (Out.CommitToFile (Filename.c_str(), false))
+        printf ("Parsed output written to %s\n", Filename.c_str());
+    else
+        printf ("Cannot write parsed output: %s\n", Filename.c_str());
+}
+
+
+/* Compares the in-place updated statistics file (domprom_inplace=1) with a full rewrite ("domprom_bench inplace [stats] [cycles]").
+   Each cycle changes a part of the values and renders the complete snapshot with value slots like the server.
+   The same buffer is committed in-place into one file and with write + rename into another one */
+
+#define DOMPROM_BENCH_INPLACE_DEFAULT_CYCLES 20
+#define DOMPROM_BENCH_INPLACE_CHANGED_PCT     5
+
+void RunInPlaceBenchmark (DWORD dwStats, DWORD dwCycles)
+{
+    std::vector<REPLAY_STAT> Stats;
+    REPLAY_PIPELINE       Pipeline;
+    ExpositionBuffer      Out;
+    InPlaceExpositionFile InPlace;
+    CONTEXT_STRUCT_TYPE   Context = {0};
+
+    const char *pszInPlaceFile = "domprom_bench_inplace.prom";
+    const char *pszRewriteFile = "domprom_bench_rewrite.prom";
+
+    char     szLine[MAXSPRINTF+1] = {0};
+    uint64_t Random      = 0x2545F4914F6CDD1DULL;
+    size_t   Written     = 0;
+    uint64_t InPlaceBytes = 0;
+    uint64_t RewriteBytes = 0;
+    double   dRenderMsec  = 0;
+    double   dInPlaceMsec = 0;
+    double   dRewriteMsec = 0;
+    DWORD    dwCycle      = 0;
+
+    if (0 == dwStats)
+        dwStats = DOMPROM_BENCH_TRAVERSE_DEFAULT_STATS;
+
+    if (dwStats > DOMPROM_BENCH_TRAVERSE_MAX_STATS)
+        dwStats = DOMPROM_BENCH_TRAVERSE_MAX_STATS;
+
+    if (0 == dwCycles)
+        dwCycles = DOMPROM_BENCH_INPLACE_DEFAULT_CYCLES;
+
+    BuildSyntheticStats (dwStats, Stats);
+    LoadStubStats (Stats);
+
+    Pipeline.InitContext (Context, Out);
+    Out.SetValueSlots (true);
+
+    auto Msec = [] (std::chrono::steady_clock::time_point Start)
+    {
+        return (double) std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now() - Start).count() / 1000.0;
+    };
+
+    /* The first cycle writes and maps the file */
+    for (dwCycle = 0; dwCycle <= dwCycles; dwCycle++)
+    {
+        for (auto &Stat : Stats)
+        {
+            /* xorshift64 */
+            Random ^= Random << 13;
+            Random ^= Random >> 7;
+            Random ^= Random << 17;
+
+            if ((VT_LONG == Stat.wValueType) && (Random % 100 < DOMPROM_BENCH_INPLACE_CHANGED_PCT))
+            {
+                Stat.Value.Long = (LONG) (Random % 1000000);
+                StatUpdate (&Stat.Facility[0], &Stat.Name[0], 0, Stat.wValueType, Stat.ValuePtr());
+            }
+        }
+
+        auto Start = std::chrono::steady_clock::now();
+        ReplayStatsCycle (Context);
+        double dRender = Msec (Start);
+
+        Start = std::chrono::steady_clock::now();
+
+        if (false == InPlace.Commit (Out, pszInPlaceFile, false, &Written))
+        {
+            printf ("Cannot write %s\n", pszInPlaceFile);
+            break;
+        }
+
+        double dInPlace = Msec (Start);
+
+        Start = std::chrono::steady_clock::now();
+
+        if (false == Out.CommitToFile (pszRewriteFile, false))
+        {
+            printf ("Cannot write %s\n", pszRewriteFile);
+            break;
+        }
+
+        double dRewrite = Msec (Start);
+
+        if (0 == dwCycle)
+            continue;
+
+        dRenderMsec  += dRender;
+        dInPlaceMsec += dInPlace;
+        dRewriteMsec += dRewrite;
+        InPlaceBytes += Written;
+        RewriteBytes += Out.Size();
+    }
+
+    InPlace.Unmap();
+    remove (pszInPlaceFile);
+    remove (pszRewriteFile);
+
+    if (dwCycle <= dwCycles)
+        return;
+
+    printf ("In-place benchmark: %u stats, %u cycles, %u bytes output, %u%% of the LONG values change per cycle\n",
+            (DWORD) Stats.size(), dwCycles, (DWORD) Out.Size(), DOMPROM_BENCH_INPLACE_CHANGED_PCT);
+
+    snprintf (szLine, sizeof (szLine), "Render:       %8.2f ms/cycle (same for both modes)", dRenderMsec / dwCycles);
+    printf ("  %s\n", szLine);
+
+    snprintf (szLine, sizeof (szLine), "In-place:     %8.2f ms/cycle  %10" PRIu64 " bytes/cycle  %" PRIu64 " rewrites  %" PRIu64 " values patched",
+              dInPlaceMsec / dwCycles, InPlaceBytes / dwCycles, InPlace.GetRewrites(), InPlace.GetPatchedValues());
+    printf ("  %s\n", szLine);
+
+    snprintf (szLine, sizeof (szLine), "Full rewrite: %8.2f ms/cycle  %10" PRIu64 " bytes/cycle", dRewriteMsec / dwCycles, RewriteBytes / dwCycles);
+    printf ("  %s\n", szLine);
+}
+
+
+void PrintUsage ()
+{
+    printf ("\nUsage: domprom_bench <command> [parameters]\n\n");
+    printf ("format [rounds]               Compare the std::to_chars based value formatting with snprintf (default: 100 rounds)\n");
+    printf ("traverse [stats] [cycles]     Replay a synthetic statistic set through the export path (default: %u stats)\n", DOMPROM_BENCH_TRAVERSE_DEFAULT_STATS);
+    printf ("dupes [stats] [cycles]        Compare the duplicate detection with a std::unordered_map (default: 5000 and 50000 stats)\n");
+    printf ("trans [rows|file] [cycles]    Parse a synthetic or captured \"show trans\" output (default: %u operations)\n", DOMPROM_BENCH_TRANS_DEFAULT_ROWS);
+    printf ("inplace [stats] [cycles]      Compare the in-place updated statistics file with a full rewrite (default: %u stats)\n", DOMPROM_BENCH_TRAVERSE_DEFAULT_STATS);
+    printf ("replay <file> [cycles]        Replay a recording of \"tell domprom record <file>\" and write the output to <file>.prom\n");
+    printf ("\nnotes.ini settings like domprom_filter_rules and domprom_relabel_rules are read from environment variables\n\n");
+}
+
+
+int main (int argc, char *argv[])
+{
+    std::string Param;
+    DWORD dwStats  = 0;
+    DWORD dwCycles = 0;
+
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    /* Parameters are parsed like the console commands */
+    for (int a = 2; a < argc; a++)
+    {
+        if (Param.size())
+            Param += ' ';
+
+        Param += argv[a];
+    }
+
+    if (0 == strcasecmp (argv[1], "format"))
+    {
+        RunFormatBenchmark ((DWORD) atoi (Param.c_str()));
+    }
+    else if (0 == strcasecmp (argv[1], "traverse"))
+    {
+        sscanf (Param.c_str(), "%u %u", &dwStats, &dwCycles);
+        RunTraverseBenchmark (dwStats, dwCycles);
+    }
+    else if (0 == strcasecmp (argv[1], "dupes"))
+    {
+        sscanf (Param.c_str(), "%u %u", &dwStats, &dwCycles);
+        RunDuplicateBenchmark (dwStats, dwCycles);
+    }
+    else if (0 == strcasecmp (argv[1], "trans"))
+    {
+        RunTransBenchmark (Param.c_str());
+    }
+    else if (0 == strcasecmp (argv[1], "inplace"))
+    {
+        sscanf (Param.c_str(), "%u %u", &dwStats, &dwCycles);
+        RunInPlaceBenchmark (dwStats, dwCycles);
+    }
+    else if (0 == strcasecmp (argv[1], "replay"))
+    {
+        char szFilename[MAXPATH+1] = {0};
+
+        sscanf (Param.c_str(), "%255s %u", szFilename, &dwCycles);
+        ReplayStatRecording (szFilename, dwCycles);
+    }
+    else
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - In-place statistics file tests             #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* Tests of the in-place updated statistics file (domprom_inplace=1) */
+
+#include "../domprom.cpp"
+
+
+static int g_Failures = 0;
+
+#define CHECK(Cond) \
+    do { if (!(Cond)) { printf ("FAILED %s:%d: %s\n", __FILE__, __LINE__, #Cond); g_Failures++; } } while (0)
+
+
+#define INPLACE_TEST_FILE "inplace_test.prom"
+
+static void Render (ExpositionBuffer &Out, const std::vector<std::pair<const char *, const char *>> &Samples)
+{
+    Out.Reset();
+    Out.SetValueSlots (true);
+
+    for (const auto &Sample : Samples)
+    {
+        Out.AppendMetricName ("Domino", Sample.first);
+        Out.Append (' ');
+        Out.AppendValue (Sample.second);
+        Out.Append ('\n');
+    }
+}
+
+static bool FileMatches (const ExpositionBuffer &Out)
+{
+    std::string Content;
+    char   szBuffer[4096] = {0};
+    size_t Len = 0;
+    FILE   *fp = fopen (INPLACE_TEST_FILE, "rb");
+
+    if (NULL == fp)
+        return false;
+
+    while ((Len = fread (szBuffer, 1, sizeof (szBuffer), fp)) > 0)
+        Content.append (szBuffer, Len);
+
+    fclose (fp);
+
+    return (Content == std::string (Out.Data(), Out.Size()));
+}
+
+static uint64_t FileInode ()
+{
+    struct stat FileStat = {0};
+
+    if (stat (INPLACE_TEST_FILE, &FileStat))
+        return 0;
+
+    return (uint64_t) FileStat.st_ino;
+}
+
+
+/* A cycle with the same layout patches the changed values in the mapped file without a rewrite */
+
+static void TestStableLayout ()
+{
+    InPlaceExpositionFile InPlace;
+    ExpositionBuffer Out;
+    size_t   Written = 0;
+    uint64_t Inode   = 0;
+
+    printf ("Test: stable layout\n");
+
+    Render (Out, { { "Server_Users", "10" }, { "Mem_Allocated", "4096" }, { "Server_Trans", "7" } });
+
+    CHECK (InPlace.Commit (Out, INPLACE_TEST_FILE, false, &Written));
+    CHECK (Written == Out.Size());
+    CHECK (1 == InPlace.GetRewrites());
+    CHECK (FileMatches (Out));
+
+    Inode = FileInode();
+
+    /* Values of different length keep the layout */
+    Render (Out, { { "Server_Users", "1234567" }, { "Mem_Allocated", "4096" }, { "Server_Trans", "8" } });
+
+    CHECK (InPlace.Commit (Out, INPLACE_TEST_FILE, false, &Written));
+    CHECK (1 == InPlace.GetRewrites());
+    CHECK (1 == InPlace.GetPatchCycles());
+    CHECK (2 == InPlace.GetPatchedValues());
+    CHECK (Written == 2 * DOMPROM_VALUE_SLOT_WIDTH);
+    CHECK (Inode == FileInode());
+    CHECK (FileMatches (Out));
+
+    InPlace.Unmap();
+    remove (INPLACE_TEST_FILE);
+}
+
+
+/* A new metric changes the layout and the file is rewritten */
+
+static void TestLayoutChange ()
+{
+    InPlaceExpositionFile InPlace;
+    ExpositionBuffer Out;
+    size_t Written = 0;
+
+    printf ("Test: layout change\n");
+
+    Render (Out, { { "Server_Users", "10" } });
+    CHECK (InPlace.Commit (Out, INPLACE_TEST_FILE, false, &Written));
+
+    Render (Out, { { "Server_Users", "10" }, { "Server_Trans", "7" } });
+    CHECK (InPlace.Commit (Out, INPLACE_TEST_FILE, false, &Written));
+
+    CHECK (2 == InPlace.GetRewrites());
+    CHECK (0 == InPlace.GetPatchCycles());
+    CHECK (Written == Out.Size());
+    CHECK (FileMatches (Out));
+
+    InPlace.Unmap();
+    remove (INPLACE_TEST_FILE);
+}
+
+
+int main ()
+{
+    TestStableLayout();
+    TestLayoutChange();
+
+    if (g_Failures)
+    {
+        printf ("inplace_test: %d checks FAILED\n", g_Failures);
+        return 1;
+    }
+
+    printf ("inplace_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef DOMPROM_STUB_ADDIN_H
+#define DOMPROM_STUB_ADDIN_H
+
+#include "global.h"
+
+void    LNPUBLIC AddInLogMessageText (const char *pszFormat, STATUS error, ...);
+void    LNPUBLIC AddInFormatErrorText (char *pszBuffer, const char *pszFormat, ...);
+void    LNPUBLIC AddInSetStatusText (const char *pszText);
+DHANDLE LNPUBLIC AddInCreateStatusLine (const char *pszTaskName);
+void    LNPUBLIC AddInDeleteStatusLine (DHANDLE hStatusLine);
+void    LNPUBLIC AddInQueryDefaults (HMODULE *phModule, DHANDLE *phStatusLine);
+void    LNPUBLIC AddInSetDefaults (HMODULE hModule, DHANDLE hStatusLine);
+BOOL    LNPUBLIC AddInIdle (void);
+BOOL    LNPUBLIC AddInIdleDelay (DWORD dwMsec);
+
+#endif
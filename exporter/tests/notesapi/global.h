@@ -0,0 +1,57 @@
+/*
+   Minimal stand-in for the HCL Notes C API headers.
+   Only the types, constants and functions used by domprom are declared.
+   Used to build the benchmarks and tests on a plain Linux box without the Notes SDK (see notesapi.cpp)
+*/
+
+#ifndef DOMPROM_STUB_GLOBAL_H
+#define DOMPROM_STUB_GLOBAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            LONG;
+typedef int            BOOL;
+typedef double         NUMBER;
+typedef WORD           STATUS;
+
+typedef DWORD   DHANDLE;
+typedef DHANDLE DBHANDLE;
+typedef DHANDLE NOTEHANDLE;
+typedef DHANDLE FORMULAHANDLE;
+typedef DHANDLE MQHANDLE;
+typedef DWORD   NOTEID;
+typedef void   *HMODULE;
+
+#define TRUE  1
+#define FALSE 0
+
+#define NOERROR    0
+#define NULLHANDLE 0
+
+#define far
+#define LNPUBLIC
+#define LNCALLBACK
+
+#define MAXWORD      0xFFFF
+#define MAXDWORD     0xFFFFFFFF
+#define MAXPATH      256
+#define MAXSPRINTF   256
+#define MAXUSERNAME  256
+
+#define ERR_MASK 0x3FFF
+#define ERR(e)   ((e) & ERR_MASK)
+
+/* Innards[0]: 1/100 seconds since midnight GMT, Innards[1]: Julian day */
+typedef struct
+{
+    DWORD Innards[2];
+} TIMEDATE;
+
+STATUS LNPUBLIC NotesInitThread (void);
+void   LNPUBLIC NotesTermThread (void);
+
+#endif
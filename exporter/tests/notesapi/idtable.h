@@ -0,0 +1,12 @@
+#ifndef DOMPROM_STUB_IDTABLE_H
+#define DOMPROM_STUB_IDTABLE_H
+
+#include "global.h"
+
+STATUS LNPUBLIC IDCreateTable (DWORD dwAlignment, DHANDLE *phTable);
+STATUS LNPUBLIC IDDestroyTable (DHANDLE hTable);
+STATUS LNPUBLIC IDInsert (DHANDLE hTable, NOTEID Id, BOOL *pbInserted);
+DWORD  LNPUBLIC IDEntries (DHANDLE hTable);
+BOOL   LNPUBLIC IDScan (DHANDLE hTable, BOOL bFirst, NOTEID *pId);
+
+#endif
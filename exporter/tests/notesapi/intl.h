@@ -0,0 +1,15 @@
+#ifndef DOMPROM_STUB_INTL_H
+#define DOMPROM_STUB_INTL_H
+
+#include "global.h"
+
+typedef struct
+{
+    char DecimalString[4];
+    char ThousandString[4];
+} INTLFORMAT;
+
+void LNPUBLIC OSGetIntlSettings (INTLFORMAT *pIntl, WORD wBufferSize);
+int  LNPUBLIC IntlTextCompare (const char *pString1, WORD wLen1, const char *pString2, WORD wLen2, DWORD dwFlags);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef DOMPROM_STUB_KFM_H
+#define DOMPROM_STUB_KFM_H
+
+#include "global.h"
+
+STATUS LNPUBLIC SECKFMGetUserName (char *retpszUserName);
+
+#endif
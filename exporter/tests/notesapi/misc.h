@@ -0,0 +1,10 @@
+#ifndef DOMPROM_STUB_MISC_H
+#define DOMPROM_STUB_MISC_H
+
+#include "global.h"
+
+#define MAXALPHATIMEDATE 80
+
+STATUS LNPUBLIC ConvertTextToTIMEDATE (void *pIntlFormat, void *pTextFormat, char **ppszText, WORD wMaxLen, TIMEDATE *retpTimeDate);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef DOMPROM_STUB_MISCERR_H
+#define DOMPROM_STUB_MISCERR_H
+
+#define ERR_MISC_INVALID_ARGS 0x0101
+
+#endif
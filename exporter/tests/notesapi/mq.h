@@ -0,0 +1,18 @@
+#ifndef DOMPROM_STUB_MQ_H
+#define DOMPROM_STUB_MQ_H
+
+#include "global.h"
+
+#define MQ_MAX_MSGSIZE  256
+#define MQ_WAIT_FOR_MSG 0x0001
+
+#define ERR_MQ_TIMEOUT  0x03F0
+#define ERR_MQ_QUITTING 0x03F1
+
+STATUS LNPUBLIC MQCreate (const char *pszQueueName, WORD wQuota, DWORD dwOptions);
+STATUS LNPUBLIC MQOpen (const char *pszQueueName, DWORD dwOptions, MQHANDLE *phQueue);
+STATUS LNPUBLIC MQClose (MQHANDLE hQueue, DWORD dwOptions);
+STATUS LNPUBLIC MQGet (MQHANDLE hQueue, char *pBuffer, WORD wBufferLen, DWORD dwOptions, DWORD dwTimeoutMsec, WORD *retwMsgLen);
+BOOL   LNPUBLIC MQIsQuitPending (MQHANDLE hQueue);
+
+#endif
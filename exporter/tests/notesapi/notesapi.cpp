@@ -0,0 +1,723 @@
+/*
+   Stub implementation of the Notes C API functions used by domprom.
+
+   - Statistics are kept in memory: StatUpdate adds or replaces a value, StatTraverse returns them grouped by facility.
+     StatTraverse is a weak symbol, a test can replace it with its own statistic stream
+   - notes.ini settings are read from and written to environment variables
+   - Time functions use the Notes TIMEDATE layout (1/100 seconds since midnight GMT and Julian day) in UTC
+   - Databases, the message queue and the remote console are not available and return errors
+*/
+
+#include "global.h"
+#include "addin.h"
+#include "idtable.h"
+#include "intl.h"
+#include "kfm.h"
+#include "misc.h"
+#include "miscerr.h"
+#include "mq.h"
+#include "ns.h"
+#include "nsfdb.h"
+#include "nsfnote.h"
+#include "nsfsearc.h"
+#include "osenv.h"
+#include "oserr.h"
+#include "osfile.h"
+#include "osmem.h"
+#include "osmisc.h"
+#include "ostime.h"
+#include "srverr.h"
+#include "stats.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define STUB_ERR_NOT_AVAILABLE 0x0F01
+#define STUB_UNIX_EPOCH_JULIAN 2440588
+#define STUB_HUNDREDTHS_PER_DAY 8640000
+
+
+/* Threads */
+
+STATUS LNPUBLIC NotesInitThread (void)
+{
+    return NOERROR;
+}
+
+void LNPUBLIC NotesTermThread (void)
+{
+}
+
+
+/* Statistics */
+
+struct STUB_STAT
+{
+    WORD        wValueType;
+    std::string Value;   // Raw value, null terminated text for VT_TEXT
+};
+
+static std::mutex g_StubStatMutex;
+static std::map<std::string, std::map<std::string, STUB_STAT>> g_StubStats;
+
+static size_t StubStatValueLen (WORD wValueType, const void *pValue)
+{
+    switch (wValueType)
+    {
+        case VT_LONG:     return sizeof (LONG);
+        case VT_NUMBER:   return sizeof (NUMBER);
+        case VT_TIMEDATE: return sizeof (TIMEDATE);
+        case VT_TEXT:     return strlen ((const char *) pValue) + 1;
+        default:          return 0;
+    }
+}
+
+STATUS LNPUBLIC StatUpdate (const char *pszFacility, const char *pszStatName, WORD, WORD wValueType, const void *pValue)
+{
+    size_t Len = 0;
+
+    if ((NULL == pszFacility) || (NULL == pszStatName) || (NULL == pValue))
+        return ERR_MISC_INVALID_ARGS;
+
+    Len = StubStatValueLen (wValueType, pValue);
+
+    if (0 == Len)
+        return ERR_MISC_INVALID_ARGS;
+
+    std::lock_guard<std::mutex> Lock (g_StubStatMutex);
+
+    STUB_STAT &Stat = g_StubStats[pszFacility][pszStatName];
+
+    Stat.wValueType = wValueType;
+    Stat.Value.assign ((const char *) pValue, Len);
+
+    return NOERROR;
+}
+
+/* An empty name deletes all statistics of the facility */
+void LNPUBLIC StatDelete (const char *pszFacility, const char *pszStatName)
+{
+    if (NULL == pszFacility)
+        return;
+
+    std::lock_guard<std::mutex> Lock (g_StubStatMutex);
+
+    auto it = g_StubStats.find (pszFacility);
+
+    if (it == g_StubStats.end())
+        return;
+
+    if ((NULL == pszStatName) || ('\0' == *pszStatName))
+        g_StubStats.erase (it);
+    else
+        it->second.erase (pszStatName);
+}
+
+struct STUB_STAT_ENTRY
+{
+    std::string Facility;
+    std::string Name;
+    STUB_STAT   Stat;
+};
+
+__attribute__((weak)) STATUS LNPUBLIC StatTraverse (const char *pszFacility, const char *pszStatName, STATTRAVERSEPROC pCallback, void *pContext)
+{
+    std::vector<STUB_STAT_ENTRY> Stats;
+    STATUS error = NOERROR;
+
+    if (NULL == pCallback)
+        return ERR_MISC_INVALID_ARGS;
+
+    /* The callback can update statistics, it runs on a copy of the selected statistics */
+    {
+        std::lock_guard<std::mutex> Lock (g_StubStatMutex);
+
+        for (const auto &Facility : g_StubStats)
+        {
+            if (pszFacility && strcasecmp (pszFacility, Facility.first.c_str()))
+                continue;
+
+            for (const auto &Stat : Facility.second)
+            {
+                if (pszStatName && strcasecmp (pszStatName, Stat.first.c_str()))
+                    continue;
+
+                Stats.push_back ({ Facility.first, Stat.first, Stat.second });
+            }
+        }
+    }
+
+    for (auto &Entry : Stats)
+    {
+        error = pCallback (pContext, (char *) Entry.Facility.c_str(), (char *) Entry.Name.c_str(), Entry.Stat.wValueType, &Entry.Stat.Value[0]);
+
+        if (error)
+            return error;
+    }
+
+    return NOERROR;
+}
+
+STATUS LNPUBLIC StatQuery (char *, char *, char *, char *, DHANDLE *rethStats, DWORD *retdwStatsSize)
+{
+    if (rethStats)
+        *rethStats = NULLHANDLE;
+
+    if (retdwStatsSize)
+        *retdwStatsSize = 0;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+
+/* Translation and international settings */
+
+DWORD LNPUBLIC OSTranslate32 (WORD wTranslateMode, const char *pszIn, DWORD dwInLength, char *pszOut, DWORD dwOutLength)
+{
+    DWORD i = 0;
+
+    if ((NULL == pszIn) || (NULL == pszOut) || (0 == dwOutLength))
+        return 0;
+
+    /* Unicode output: UTF-16 code units, ASCII only */
+    if (OS_TRANSLATE_LMBCS_TO_UNICODE == wTranslateMode)
+    {
+        uint16_t *pwOut = (uint16_t *) pszOut;
+
+        for (i = 0; (i < dwInLength) && pszIn[i] && ((i + 1) * 2 < dwOutLength); i++)
+            pwOut[i] = (uint16_t) (unsigned char) pszIn[i];
+
+        pwOut[i] = 0;
+        return i * 2;
+    }
+
+    for (i = 0; (i < dwInLength) && pszIn[i] && (i + 1 < dwOutLength); i++)
+    {
+        if (OS_TRANSLATE_UPPER_TO_LOWER == wTranslateMode)
+            pszOut[i] = (char) tolower ((unsigned char) pszIn[i]);
+        else
+            pszOut[i] = pszIn[i];
+    }
+
+    pszOut[i] = '\0';
+    return i;
+}
+
+int LNPUBLIC IntlTextCompare (const char *pString1, WORD wLen1, const char *pString2, WORD wLen2, DWORD)
+{
+    int ret = strncasecmp (pString1, pString2, (wLen1 < wLen2) ? wLen1 : wLen2);
+
+    if (ret)
+        return ret;
+
+    return (int) wLen1 - (int) wLen2;
+}
+
+void LNPUBLIC OSGetIntlSettings (INTLFORMAT *pIntl, WORD)
+{
+    if (NULL == pIntl)
+        return;
+
+    strcpy (pIntl->DecimalString, ".");
+    strcpy (pIntl->ThousandString, ",");
+}
+
+
+/* Time */
+
+static void StubTimeFromUnix (TIMEDATE *pTime, int64_t Hundredths)
+{
+    pTime->Innards[0] = (DWORD) (Hundredths % STUB_HUNDREDTHS_PER_DAY);
+    pTime->Innards[1] = (DWORD) (Hundredths / STUB_HUNDREDTHS_PER_DAY + STUB_UNIX_EPOCH_JULIAN);
+}
+
+static int64_t StubTimeToUnix (const TIMEDATE *pTime)
+{
+    return ((int64_t) (pTime->Innards[1] & 0xFFFFFF) - STUB_UNIX_EPOCH_JULIAN) * STUB_HUNDREDTHS_PER_DAY + pTime->Innards[0];
+}
+
+void LNPUBLIC OSCurrentTIMEDATE (TIMEDATE *retTimeDate)
+{
+    struct timeval Now = {0};
+
+    gettimeofday (&Now, NULL);
+    StubTimeFromUnix (retTimeDate, (int64_t) Now.tv_sec * 100 + Now.tv_usec / 10000);
+}
+
+int LNPUBLIC TimeDateCompare (const TIMEDATE *pTime1, const TIMEDATE *pTime2)
+{
+    int64_t Diff = StubTimeToUnix (pTime1) - StubTimeToUnix (pTime2);
+
+    return (Diff > 0) - (Diff < 0);
+}
+
+LONG LNPUBLIC TimeDateDifference (const TIMEDATE *pTime1, const TIMEDATE *pTime2)
+{
+    return (LONG) ((StubTimeToUnix (pTime1) - StubTimeToUnix (pTime2)) / 100);
+}
+
+/* Months are not supported */
+STATUS LNPUBLIC TimeDateAdjust (TIMEDATE *pTime, int Hundredths, int Seconds, int Minutes, int Hours, int Days, int Months)
+{
+    if (Months)
+        return ERR_MISC_INVALID_ARGS;
+
+    StubTimeFromUnix (pTime, StubTimeToUnix (pTime) + Hundredths + 100LL * (Seconds + 60LL * (Minutes + 60LL * (Hours + 24LL * Days))));
+    return NOERROR;
+}
+
+/* Local time is UTC. Returns TRUE on error like the Notes API */
+BOOL LNPUBLIC TimeGMToLocalZone (TIME *pTime)
+{
+    int64_t Julian = pTime->GM.Innards[1] & 0xFFFFFF;
+    int64_t a, b, c, d, e, m;
+    DWORD   dwHundredths = pTime->GM.Innards[0];
+
+    if (dwHundredths >= STUB_HUNDREDTHS_PER_DAY)
+        return TRUE;
+
+    /* Julian day number to Gregorian calendar date */
+    a = Julian + 32044;
+    b = (4 * a + 3) / 146097;
+    c = a - 146097 * b / 4;
+    d = (4 * c + 3) / 1461;
+    e = c - 1461 * d / 4;
+    m = (5 * e + 2) / 153;
+
+    pTime->day       = (int) (e - (153 * m + 2) / 5 + 1);
+    pTime->month     = (int) (m + 3 - 12 * (m / 10));
+    pTime->year      = (int) (100 * b + d - 4800 + m / 10);
+    pTime->weekday   = (int) ((Julian + 1) % 7) + 1;
+    pTime->hour      = (int) (dwHundredths / 360000);
+    pTime->minute    = (int) (dwHundredths / 6000 % 60);
+    pTime->second    = (int) (dwHundredths / 100 % 60);
+    pTime->hundredth = (int) (dwHundredths % 100);
+    pTime->dst       = 0;
+    pTime->zone      = 0;
+
+    return FALSE;
+}
+
+BOOL LNPUBLIC TimeGMToLocal (TIME *pTime)
+{
+    return TimeGMToLocalZone (pTime);
+}
+
+/* Only "YYYY-MM-DD HH:MM[:SS]" in UTC */
+STATUS LNPUBLIC ConvertTextToTIMEDATE (void *, void *, char **ppszText, WORD, TIMEDATE *retpTimeDate)
+{
+    int  Year = 0, Month = 0, Day = 0, Hour = 0, Minute = 0, Second = 0;
+    int64_t y, m, Julian;
+
+    if ((NULL == ppszText) || (NULL == *ppszText) || (NULL == retpTimeDate))
+        return ERR_MISC_INVALID_ARGS;
+
+    if (sscanf (*ppszText, "%d-%d-%d %d:%d:%d", &Year, &Month, &Day, &Hour, &Minute, &Second) < 5)
+        return ERR_MISC_INVALID_ARGS;
+
+    /* Gregorian calendar date to Julian day number */
+    y = Year + 4800 - (14 - Month) / 12;
+    m = Month + 12 * ((14 - Month) / 12) - 3;
+    Julian = Day + (153 * m + 2) / 5 + 365 * y + y / 4 - y / 100 + y / 400 - 32045;
+
+    retpTimeDate->Innards[0] = (DWORD) (((Hour * 60 + Minute) * 60 + Second) * 100);
+    retpTimeDate->Innards[1] = (DWORD) Julian;
+
+    return NOERROR;
+}
+
+
+/* notes.ini */
+
+BOOL LNPUBLIC OSGetEnvironmentString (const char *pszName, char *retpszValue, WORD wBufferLen)
+{
+    const char *pszValue = getenv (pszName);
+
+    if (retpszValue && wBufferLen)
+        *retpszValue = '\0';
+
+    if ((NULL == pszValue) || (NULL == retpszValue))
+        return FALSE;
+
+    snprintf (retpszValue, (size_t) wBufferLen + 1, "%s", pszValue);
+    return TRUE;
+}
+
+LONG LNPUBLIC OSGetEnvironmentLong (const char *pszName)
+{
+    const char *pszValue = getenv (pszName);
+
+    return pszValue ? (LONG) atol (pszValue) : 0;
+}
+
+WORD LNPUBLIC OSGetEnvironmentSeqNo (void)
+{
+    return 0;
+}
+
+void LNPUBLIC OSSetEnvironmentVariable (const char *pszName, const char *pszValue)
+{
+    if (pszName && pszValue)
+        setenv (pszName, pszValue, 1);
+}
+
+BOOL LNPUBLIC OSGetEnvironmentTIMEDATE (const char *, TIMEDATE *)
+{
+    return FALSE;
+}
+
+void LNPUBLIC OSSetEnvironmentTIMEDATE (const char *, TIMEDATE *)
+{
+}
+
+
+/* Add-in API */
+
+/* Notes format: printf conversions used by domprom and %z for a TIMEDATE pointer. A status is appended as error code */
+void LNPUBLIC AddInLogMessageText (const char *pszFormat, STATUS error, ...)
+{
+    std::string Line;
+    std::string Spec;
+    char    szValue[256] = {0};
+    TIME    Time = {0};
+    va_list Args;
+
+    va_start (Args, error);
+
+    for (const char *p = pszFormat; *p; p++)
+    {
+        if (('%' != *p) || ('\0' == p[1]))
+        {
+            Line.push_back (*p);
+            continue;
+        }
+
+        if ('%' == p[1])
+        {
+            Line.push_back ('%');
+            p++;
+            continue;
+        }
+
+        Spec = "%";
+
+        while (p[1] && strchr ("-+ #0123456789.lh", p[1]))
+            Spec.push_back (*++p);
+
+        if ('\0' == p[1])
+            break;
+
+        Spec.push_back (*++p);
+
+        switch (*p)
+        {
+            case 'z':
+                Time.GM = *va_arg (Args, TIMEDATE *);
+                TimeGMToLocalZone (&Time);
+                snprintf (szValue, sizeof (szValue), "%04d-%02d-%02d %02d:%02d:%02d", Time.year, Time.month, Time.day, Time.hour, Time.minute, Time.second);
+                break;
+
+            case 's':
+                snprintf (szValue, sizeof (szValue), Spec.c_str(), va_arg (Args, const char *));
+                break;
+
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'c':
+                if (std::string::npos != Spec.find ('l'))
+                    snprintf (szValue, sizeof (szValue), Spec.c_str(), va_arg (Args, long));
+                else
+                    snprintf (szValue, sizeof (szValue), Spec.c_str(), va_arg (Args, int));
+                break;
+
+            default:
+                snprintf (szValue, sizeof (szValue), "%s", Spec.c_str());
+                break;
+        }
+
+        Line += szValue;
+    }
+
+    va_end (Args);
+
+    if (error)
+        fprintf (stdout, "%s: Error 0x%04X\n", Line.c_str(), ERR (error));
+    else
+        fprintf (stdout, "%s\n", Line.c_str());
+
+    fflush (stdout);
+}
+
+/* Only used for texts without conversions */
+void LNPUBLIC AddInFormatErrorText (char *pszBuffer, const char *pszFormat, ...)
+{
+    if (pszBuffer && pszFormat)
+        strcpy (pszBuffer, pszFormat);
+}
+
+void LNPUBLIC AddInSetStatusText (const char *)
+{
+}
+
+DHANDLE LNPUBLIC AddInCreateStatusLine (const char *)
+{
+    return NULLHANDLE;
+}
+
+void LNPUBLIC AddInDeleteStatusLine (DHANDLE)
+{
+}
+
+void LNPUBLIC AddInQueryDefaults (HMODULE *phModule, DHANDLE *phStatusLine)
+{
+    if (phModule)
+        *phModule = NULL;
+
+    if (phStatusLine)
+        *phStatusLine = NULLHANDLE;
+}
+
+void LNPUBLIC AddInSetDefaults (HMODULE, DHANDLE)
+{
+}
+
+BOOL LNPUBLIC AddInIdle (void)
+{
+    return FALSE;
+}
+
+BOOL LNPUBLIC AddInIdleDelay (DWORD dwMsec)
+{
+    usleep ((useconds_t) dwMsec * 1000);
+    return FALSE;
+}
+
+
+/* Message queue: not available */
+
+STATUS LNPUBLIC MQCreate (const char *, WORD, DWORD)
+{
+    return NOERROR;
+}
+
+STATUS LNPUBLIC MQOpen (const char *, DWORD, MQHANDLE *phQueue)
+{
+    if (phQueue)
+        *phQueue = NULLHANDLE;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+STATUS LNPUBLIC MQClose (MQHANDLE, DWORD)
+{
+    return NOERROR;
+}
+
+STATUS LNPUBLIC MQGet (MQHANDLE, char *, WORD, DWORD, DWORD, WORD *retwMsgLen)
+{
+    if (retwMsgLen)
+        *retwMsgLen = 0;
+
+    return ERR_MQ_QUITTING;
+}
+
+BOOL LNPUBLIC MQIsQuitPending (MQHANDLE)
+{
+    return TRUE;
+}
+
+
+/* Files and memory */
+
+WORD LNPUBLIC OSGetDataDirectory (char *retpszPathName)
+{
+    const char *pszDir = getenv ("Notes_DataDirectory");
+
+    if (NULL == pszDir)
+        pszDir = "/tmp";
+
+    snprintf (retpszPathName, MAXPATH, "%s", pszDir);
+    return (WORD) strlen (retpszPathName);
+}
+
+STATUS LNPUBLIC OSPathNetConstruct (const char *, const char *pszServerName, const char *pszFileName, char *retpszPathName)
+{
+    if (pszServerName && *pszServerName)
+        snprintf (retpszPathName, MAXPATH, "%s!!%s", pszServerName, pszFileName);
+    else
+        snprintf (retpszPathName, MAXPATH, "%s", pszFileName);
+
+    return NOERROR;
+}
+
+void *LNPUBLIC OSLockObject (DHANDLE)
+{
+    return NULL;
+}
+
+void LNPUBLIC OSUnlockObject (DHANDLE)
+{
+}
+
+void LNPUBLIC OSMemFree (DHANDLE)
+{
+}
+
+
+/* Databases, notes and searches: no databases available */
+
+STATUS LNPUBLIC NSFDbOpen (const char *, DBHANDLE *rethDb)
+{
+    if (rethDb)
+        *rethDb = NULLHANDLE;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+STATUS LNPUBLIC NSFDbClose (DBHANDLE)
+{
+    return NOERROR;
+}
+
+STATUS LNPUBLIC NSFDbCloseSession (DBHANDLE)
+{
+    return NOERROR;
+}
+
+STATUS LNPUBLIC NSFGetTransLogStyle (WORD *retwLogType)
+{
+    if (retwLogType)
+        *retwLogType = TRANSLOG_STYLE_CIRCULAR;
+
+    return NOERROR;
+}
+
+STATUS LNPUBLIC NSFRemoteConsole (const char *, const char *, DHANDLE *rethResponse)
+{
+    if (rethResponse)
+        *rethResponse = NULLHANDLE;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+STATUS LNPUBLIC NSFNoteOpen (DBHANDLE, NOTEID, WORD, NOTEHANDLE *rethNote)
+{
+    if (rethNote)
+        *rethNote = NULLHANDLE;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+STATUS LNPUBLIC NSFNoteClose (NOTEHANDLE)
+{
+    return NOERROR;
+}
+
+void LNPUBLIC NSFNoteGetInfo (NOTEHANDLE, WORD, void *)
+{
+}
+
+WORD LNPUBLIC NSFItemGetText (NOTEHANDLE, const char *, char *retpszText, WORD wTextLen)
+{
+    if (retpszText && wTextLen)
+        *retpszText = '\0';
+
+    return 0;
+}
+
+STATUS LNPUBLIC NSFFormulaCompile (char *, WORD, const char *, WORD, FORMULAHANDLE *rethFormula, WORD *, WORD *, WORD *, WORD *, WORD *, WORD *)
+{
+    if (rethFormula)
+        *rethFormula = NULLHANDLE;
+
+    return NOERROR;
+}
+
+STATUS LNPUBLIC NSFSearch (DBHANDLE, FORMULAHANDLE, char *, WORD, WORD, TIMEDATE *, NSFSEARCHPROC, void *, TIMEDATE *)
+{
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+BOOL LNPUBLIC NSFGetSummaryValue (const void *, const char *, char *retpszValue, WORD wValueLen)
+{
+    if (retpszValue && wValueLen)
+        *retpszValue = '\0';
+
+    return FALSE;
+}
+
+STATUS LNPUBLIC IDCreateTable (DWORD, DHANDLE *phTable)
+{
+    if (phTable)
+        *phTable = NULLHANDLE;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+STATUS LNPUBLIC IDDestroyTable (DHANDLE)
+{
+    return NOERROR;
+}
+
+STATUS LNPUBLIC IDInsert (DHANDLE, NOTEID, BOOL *pbInserted)
+{
+    if (pbInserted)
+        *pbInserted = FALSE;
+
+    return STUB_ERR_NOT_AVAILABLE;
+}
+
+DWORD LNPUBLIC IDEntries (DHANDLE)
+{
+    return 0;
+}
+
+BOOL LNPUBLIC IDScan (DHANDLE, BOOL, NOTEID *)
+{
+    return FALSE;
+}
+
+
+/* Server */
+
+STATUS LNPUBLIC NSPingServer (char *, DWORD *retdwIndex, DHANDLE *rethList)
+{
+    if (retdwIndex)
+        *retdwIndex = 0;
+
+    if (rethList)
+        *rethList = NULLHANDLE;
+
+    return NOERROR;
+}
+
+STATUS LNPUBLIC NSFGetServerLatency (char *, DWORD, DWORD *retdwClientToServerMS, DWORD *retdwServerToClientMS, WORD *retwServerVersion)
+{
+    if (retdwClientToServerMS)
+        *retdwClientToServerMS = 0;
+
+    if (retdwServerToClientMS)
+        *retdwServerToClientMS = 0;
+
+    if (retwServerVersion)
+        *retwServerVersion = 0;
+
+    return NOERROR;
+}
+
+STATUS LNPUBLIC SECKFMGetUserName (char *retpszUserName)
+{
+    if (retpszUserName)
+        strcpy (retpszUserName, "CN=domprom-test/O=Test");
+
+    return NOERROR;
+}
@@ -0,0 +1,9 @@
+#ifndef DOMPROM_STUB_NS_H
+#define DOMPROM_STUB_NS_H
+
+#include "global.h"
+
+STATUS LNPUBLIC NSPingServer (char *pszServerName, DWORD *retdwIndex, DHANDLE *rethList);
+STATUS LNPUBLIC NSFGetServerLatency (char *pszServerName, DWORD dwTimeout, DWORD *retdwClientToServerMS, DWORD *retdwServerToClientMS, WORD *retwServerVersion);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef DOMPROM_STUB_NSFDB_H
+#define DOMPROM_STUB_NSFDB_H
+
+#include "global.h"
+
+#define TRANSLOG_STYLE_CIRCULAR 0
+#define TRANSLOG_STYLE_ARCHIVE  1
+
+STATUS LNPUBLIC NSFDbOpen (const char *pszPathName, DBHANDLE *rethDb);
+STATUS LNPUBLIC NSFDbClose (DBHANDLE hDb);
+STATUS LNPUBLIC NSFDbCloseSession (DBHANDLE hDb);
+STATUS LNPUBLIC NSFGetTransLogStyle (WORD *retwLogType);
+STATUS LNPUBLIC NSFRemoteConsole (const char *pszServerName, const char *pszCommand, DHANDLE *rethResponse);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef DOMPROM_STUB_NSFNOTE_H
+#define DOMPROM_STUB_NSFNOTE_H
+
+#include "global.h"
+
+#define NOTE_CLASS_DOCUMENT  0x0001
+#define OPEN_SUMMARY         0x0001
+#define _NOTE_ADDED_TO_FILE  13
+
+STATUS LNPUBLIC NSFNoteOpen (DBHANDLE hDb, NOTEID NoteId, WORD wFlags, NOTEHANDLE *rethNote);
+STATUS LNPUBLIC NSFNoteClose (NOTEHANDLE hNote);
+void   LNPUBLIC NSFNoteGetInfo (NOTEHANDLE hNote, WORD wMember, void *pValue);
+WORD   LNPUBLIC NSFItemGetText (NOTEHANDLE hNote, const char *pszItemName, char *retpszText, WORD wTextLen);
+
+#endif
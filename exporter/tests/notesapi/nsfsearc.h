@@ -0,0 +1,38 @@
+#ifndef DOMPROM_STUB_NSFSEARC_H
+#define DOMPROM_STUB_NSFSEARC_H
+
+#include "global.h"
+
+#define SE_FMATCH       0x01
+#define SEARCH_SUMMARY  0x0002
+
+typedef struct
+{
+    NOTEID NoteID;
+} GLOBALID;
+
+typedef struct
+{
+    GLOBALID ID;
+    WORD NoteClass;
+    BYTE SERetFlags;
+} SEARCH_MATCH;
+
+typedef struct
+{
+    WORD Length;
+    WORD Items;
+} ITEM_TABLE;
+
+typedef STATUS (LNCALLBACK *NSFSEARCHPROC) (void *pContext, SEARCH_MATCH *pSearchMatch, ITEM_TABLE *pSummaryBuffer);
+
+STATUS LNPUBLIC NSFFormulaCompile (char *pszFormulaName, WORD wFormulaNameLen, const char *pszFormulaText, WORD wFormulaTextLen,
+                                   FORMULAHANDLE *rethFormula, WORD *retwFormulaLen, WORD *retwCompileError,
+                                   WORD *retwCompileErrorLine, WORD *retwCompileErrorColumn, WORD *retwCompileErrorOffset, WORD *retwCompileErrorLen);
+
+STATUS LNPUBLIC NSFSearch (DBHANDLE hDb, FORMULAHANDLE hFormula, char *pszViewTitle, WORD wSearchFlags, WORD wNoteClassMask,
+                           TIMEDATE *pSince, NSFSEARCHPROC pCallback, void *pContext, TIMEDATE *retUntil);
+
+BOOL   LNPUBLIC NSFGetSummaryValue (const void *pSummaryBuffer, const char *pszName, char *retpszValue, WORD wValueLen);
+
+#endif
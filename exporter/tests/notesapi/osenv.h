@@ -0,0 +1,15 @@
+#ifndef DOMPROM_STUB_OSENV_H
+#define DOMPROM_STUB_OSENV_H
+
+#include "global.h"
+
+/* The stub reads notes.ini settings from environment variables */
+
+BOOL LNPUBLIC OSGetEnvironmentString (const char *pszName, char *retpszValue, WORD wBufferLen);
+LONG LNPUBLIC OSGetEnvironmentLong (const char *pszName);
+WORD LNPUBLIC OSGetEnvironmentSeqNo (void);
+void LNPUBLIC OSSetEnvironmentVariable (const char *pszName, const char *pszValue);
+BOOL LNPUBLIC OSGetEnvironmentTIMEDATE (const char *pszName, TIMEDATE *retpTimeDate);
+void LNPUBLIC OSSetEnvironmentTIMEDATE (const char *pszName, TIMEDATE *pTimeDate);
+
+#endif
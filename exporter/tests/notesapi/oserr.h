@@ -0,0 +1,6 @@
+#ifndef DOMPROM_STUB_OSERR_H
+#define DOMPROM_STUB_OSERR_H
+
+#define ERR_MEMORY 0x0007
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef DOMPROM_STUB_OSFILE_H
+#define DOMPROM_STUB_OSFILE_H
+
+#include "global.h"
+
+WORD   LNPUBLIC OSGetDataDirectory (char *retpszPathName);
+STATUS LNPUBLIC OSPathNetConstruct (const char *pszPortName, const char *pszServerName, const char *pszFileName, char *retpszPathName);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef DOMPROM_STUB_OSMEM_H
+#define DOMPROM_STUB_OSMEM_H
+
+#include "global.h"
+
+#define OSLock(type, handle) ((type *) OSLockObject (handle))
+#define OSUnlock(handle)     OSUnlockObject (handle)
+
+void *LNPUBLIC OSLockObject (DHANDLE hObject);
+void  LNPUBLIC OSUnlockObject (DHANDLE hObject);
+void  LNPUBLIC OSMemFree (DHANDLE hObject);
+
+#endif
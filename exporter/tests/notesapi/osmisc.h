@@ -0,0 +1,12 @@
+#ifndef DOMPROM_STUB_OSMISC_H
+#define DOMPROM_STUB_OSMISC_H
+
+#include "global.h"
+
+#define OS_TRANSLATE_LMBCS_TO_UNICODE  0x0001
+#define OS_TRANSLATE_UPPER_TO_LOWER    0x0008
+#define OS_TRANSLATE_LMBCS_TO_UTF8     0x0016
+
+DWORD LNPUBLIC OSTranslate32 (WORD wTranslateMode, const char *pszIn, DWORD dwInLength, char *pszOut, DWORD dwOutLength);
+
+#endif
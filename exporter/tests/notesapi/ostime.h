@@ -0,0 +1,28 @@
+#ifndef DOMPROM_STUB_OSTIME_H
+#define DOMPROM_STUB_OSTIME_H
+
+#include "global.h"
+
+typedef struct
+{
+    int year;
+    int month;
+    int day;
+    int weekday;
+    int hour;
+    int minute;
+    int second;
+    int hundredth;
+    int dst;
+    int zone;
+    TIMEDATE GM;
+} TIME;
+
+void   LNPUBLIC OSCurrentTIMEDATE (TIMEDATE *retTimeDate);
+int    LNPUBLIC TimeDateCompare (const TIMEDATE *pTime1, const TIMEDATE *pTime2);
+LONG   LNPUBLIC TimeDateDifference (const TIMEDATE *pTime1, const TIMEDATE *pTime2);
+STATUS LNPUBLIC TimeDateAdjust (TIMEDATE *pTime, int Hundredths, int Seconds, int Minutes, int Hours, int Days, int Months);
+BOOL   LNPUBLIC TimeGMToLocal (TIME *pTime);
+BOOL   LNPUBLIC TimeGMToLocalZone (TIME *pTime);
+
+#endif
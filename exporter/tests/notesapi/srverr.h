@@ -0,0 +1,7 @@
+#ifndef DOMPROM_STUB_SRVERR_H
+#define DOMPROM_STUB_SRVERR_H
+
+#define ERR_SERVER_RESTRICTED   0x0E01
+#define ERR_SERVER_UNAVAILABLE  0x0E02
+
+#endif
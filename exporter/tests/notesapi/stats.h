@@ -0,0 +1,20 @@
+#ifndef DOMPROM_STUB_STATS_H
+#define DOMPROM_STUB_STATS_H
+
+#include "global.h"
+
+#define VT_LONG     0
+#define VT_TEXT     1
+#define VT_TIMEDATE 2
+#define VT_NUMBER   3
+
+#define ST_UNIQUE   0x0001
+
+typedef STATUS (LNCALLBACK *STATTRAVERSEPROC) (void *pContext, char *pszFacility, char *pszStatName, WORD wValueType, void *pValue);
+
+STATUS LNPUBLIC StatTraverse (const char *pszFacility, const char *pszStatName, STATTRAVERSEPROC pCallback, void *pContext);
+STATUS LNPUBLIC StatUpdate (const char *pszFacility, const char *pszStatName, WORD wFlags, WORD wValueType, const void *pValue);
+void   LNPUBLIC StatDelete (const char *pszFacility, const char *pszStatName);
+STATUS LNPUBLIC StatQuery (char *pszHeaderString, char *pszNamePrefix, char *pszValuePrefix, char *pszLineSuffix, DHANDLE *rethStats, DWORD *retdwStatsSize);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef DOMPROM_STUB_STDNAMES_H
+#define DOMPROM_STUB_STDNAMES_H
+
+#define TASK_QUEUE_PREFIX "MQ$"
+
+#endif
@@ -0,0 +1,153 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - Relabel rule tests                         #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* Tests of the relabel rules on the export path */
+
+#include "../domprom.cpp"
+
+
+static int g_Failures = 0;
+
+#define CHECK(Cond) \
+    do { if (!(Cond)) { printf ("FAILED %s:%d: %s\n", __FILE__, __LINE__, #Cond); g_Failures++; } } while (0)
+
+
+struct RELABEL_PIPELINE
+{
+    PrefixFilter      Filter;
+    HelpTextArena     Help;
+    StatRelabeler     Relabeler;
+    DuplicateStatSet  Duplicates;
+    StatMetadataCache Cache {Filter, Help, Relabeler};
+    ExpositionBuffer  Out;
+    CONTEXT_STRUCT_TYPE Context = {0};
+
+    RELABEL_PIPELINE ()
+    {
+        Filter.Finalize();
+
+        snprintf (Context.szPrefix, sizeof (Context.szPrefix), "Domino");
+        Context.bExportLong   = TRUE;
+        Context.bExportNumber = TRUE;
+        Context.pOut        = &Out;
+        Context.pCache      = &Cache;
+        Context.pDuplicates = &Duplicates;
+    }
+
+    void Cycle (const std::vector<std::pair<std::string, LONG>> &Stats)
+    {
+        std::string Facility;
+        std::string Name;
+        LONG lValue = 0;
+
+        Out.Reset();
+        Duplicates.Begin();
+        Relabeler.BeginCycle();
+
+        for (const auto &Stat : Stats)
+        {
+            Facility = Stat.first.substr (0, Stat.first.find ('.'));
+            Name     = Stat.first.substr (Stat.first.find ('.') + 1);
+            lValue   = Stat.second;
+
+            DomExportTraverse (&Context, &Facility[0], &Name[0], VT_LONG, &lValue);
+        }
+
+        Relabeler.Flush (&Out, Context.szPrefix);
+    }
+
+    size_t Count (const char *pszText)
+    {
+        std::string Text (Out.Data(), Out.Size());
+        size_t Count = 0;
+        size_t Pos   = 0;
+
+        while (std::string::npos != (Pos = Text.find (pszText, Pos)))
+        {
+            Count++;
+            Pos += strlen (pszText);
+        }
+
+        return Count;
+    }
+};
+
+
+/* Two rules map different stats to the same series. Only the first stat is exported */
+
+static void TestOverlappingRules ()
+{
+    RELABEL_PIPELINE Pipeline;
+
+    printf ("Test: overlapping rules\n");
+
+    CHECK (Pipeline.Relabeler.AddRule ("mail.{queue}.waiting", "MailQueue"));
+    CHECK (Pipeline.Relabeler.AddRule ("mail.{queue}.**", "MailQueue"));
+
+    for (int i=0; i<2; i++)
+    {
+        Pipeline.Cycle ({ { "Mail.Dead.Waiting", 3 }, { "Mail.Dead.Hold", 7 }, { "Mail.Hold.Waiting", 5 } });
+
+        CHECK (1 == Pipeline.Count ("Domino_MailQueue{queue=\"Dead\"} "));
+        CHECK (1 == Pipeline.Count ("Domino_MailQueue{queue=\"Dead\"} 3\n"));
+        CHECK (1 == Pipeline.Count ("Domino_MailQueue{queue=\"Hold\"} 5\n"));
+        CHECK (1 == Pipeline.Count ("# TYPE Domino_MailQueue "));
+    }
+
+    /* Detected once when the stat is cached, every cycle counts it as duplicate */
+    CHECK (1 == Pipeline.Relabeler.CollisionCount());
+    CHECK (2 == Pipeline.Context.CountDuplicate);
+}
+
+
+/* A fixed family name drops a segment, the stats below it collide */
+
+static void TestFixedFamilyName ()
+{
+    RELABEL_PIPELINE Pipeline;
+
+    printf ("Test: fixed family name\n");
+
+    CHECK (Pipeline.Relabeler.AddRule ("server.{x}.*", "Foo"));
+
+    Pipeline.Cycle ({ { "Server.A.B", 1 }, { "Server.A.C", 2 }, { "Server.B.C", 4 } });
+
+    CHECK (1 == Pipeline.Count ("Domino_Foo{x=\"A\"} "));
+    CHECK (1 == Pipeline.Count ("Domino_Foo{x=\"A\"} 1\n"));
+    CHECK (1 == Pipeline.Count ("Domino_Foo{x=\"B\"} 4\n"));
+    CHECK (1 == Pipeline.Relabeler.CollisionCount());
+}
+
+
+int main ()
+{
+    TestOverlappingRules();
+    TestFixedFamilyName();
+
+    if (g_Failures)
+    {
+        printf ("relabel_test: %d checks FAILED\n", g_Failures);
+        return 1;
+    }
+
+    printf ("relabel_test: all checks passed\n");
+    return 0;
+}
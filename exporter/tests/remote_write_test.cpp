@@ -0,0 +1,882 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - Remote write tests                         #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* Tests of the remote write push sink against a stand-in receiver on localhost.
+   The receiver decodes snappy and the WriteRequest protobuf on its own, independent of the encoder in the exporter.
+
+   remote_write_test            runs the tests (payload, retry/backoff on 5xx/429, WAL restart and compaction)
+   remote_write_test <port>     runs the stand-in receiver only and prints the received series */
+
+#include "../domprom.cpp"
+
+
+#define RW_TEST_WAL  "remote_write_test.wal"
+
+static int g_Failures = 0;
+
+#define CHECK(Cond) \
+    do { if (!(Cond)) { printf ("FAILED %s:%d: %s\n", __FILE__, __LINE__, #Cond); g_Failures++; } } while (0)
+
+
+struct RW_SAMPLE
+{
+    std::map<std::string, std::string> Labels;
+    double  Value;
+    int64_t TimestampMsec;
+};
+
+struct RW_REQUEST
+{
+    int    Status;        // Status returned to the sender
+    double dSecSinceStart;
+    std::string ContentEncoding;
+    std::vector<RW_SAMPLE> Samples;
+};
+
+
+/* Snappy raw format decoder (github.com/google/snappy/blob/main/format_description.txt) */
+
+static bool ReadVarint (const std::string &In, size_t &Pos, uint64_t &Value)
+{
+    int Shift = 0;
+
+    Value = 0;
+
+    while (Pos < In.size() && Shift < 64)
+    {
+        unsigned char c = (unsigned char) In[Pos++];
+        Value |= (uint64_t) (c & 0x7F) << Shift;
+
+        if (0 == (c & 0x80))
+            return true;
+
+        Shift += 7;
+    }
+
+    return false;
+}
+
+
+static bool SnappyDecode (const std::string &In, std::string &Out)
+{
+    uint64_t Len = 0;
+    size_t   Pos = 0;
+
+    Out.clear();
+
+    if (false == ReadVarint (In, Pos, Len))
+        return false;
+
+    while (Pos < In.size())
+    {
+        unsigned char Tag = (unsigned char) In[Pos++];
+        size_t Length = 0;
+        size_t Offset = 0;
+
+        switch (Tag & 3)
+        {
+            case 0:
+                Length = Tag >> 2;
+
+                if (Length >= 60)
+                {
+                    size_t Bytes = Length - 59;
+
+                    if (Pos + Bytes > In.size())
+                        return false;
+
+                    Length = 0;
+
+                    for (size_t i = 0; i < Bytes; i++)
+                        Length |= (size_t) (unsigned char) In[Pos++] << (8 * i);
+                }
+
+                Length++;
+
+                if (Pos + Length > In.size())
+                    return false;
+
+                Out.append (In, Pos, Length);
+                Pos += Length;
+                continue;
+
+            case 1:
+                if (Pos + 1 > In.size())
+                    return false;
+
+                Length = ((Tag >> 2) & 7) + 4;
+                Offset = ((size_t) (Tag >> 5) << 8) | (unsigned char) In[Pos++];
+                break;
+
+            case 2:
+                if (Pos + 2 > In.size())
+                    return false;
+
+                Length = (Tag >> 2) + 1;
+                Offset = (unsigned char) In[Pos] | ((size_t) (unsigned char) In[Pos+1] << 8);
+                Pos += 2;
+                break;
+
+            default:
+                if (Pos + 4 > In.size())
+                    return false;
+
+                Length = (Tag >> 2) + 1;
+                Offset = 0;
+
+                for (size_t i = 0; i < 4; i++)
+                    Offset |= (size_t) (unsigned char) In[Pos++] << (8 * i);
+                break;
+        }
+
+        if ((0 == Offset) || (Offset > Out.size()))
+            return false;
+
+        /* Copies may overlap their own output */
+        for (size_t i = 0; i < Length; i++)
+            Out.push_back (Out[Out.size() - Offset]);
+    }
+
+    return Out.size() == Len;
+}
+
+
+/* Minimal protobuf reader for WriteRequest { repeated TimeSeries timeseries = 1 },
+   TimeSeries { repeated Label labels = 1; repeated Sample samples = 2 }, Label { string name = 1; string value = 2 },
+   Sample { double value = 1; int64 timestamp = 2 } */
+
+struct PB_FIELD
+{
+    uint32_t    Number;
+    uint32_t    WireType;
+    uint64_t    Varint;
+    std::string Bytes;
+};
+
+
+static bool NextField (const std::string &In, size_t &Pos, PB_FIELD &Field)
+{
+    uint64_t Tag = 0;
+    uint64_t Len = 0;
+
+    if ((Pos >= In.size()) || (false == ReadVarint (In, Pos, Tag)))
+        return false;
+
+    Field.Number   = (uint32_t) (Tag >> 3);
+    Field.WireType = (uint32_t) (Tag & 7);
+    Field.Varint   = 0;
+    Field.Bytes.clear();
+
+    switch (Field.WireType)
+    {
+        case 0:
+            return ReadVarint (In, Pos, Field.Varint);
+
+        case 1:
+            if (Pos + 8 > In.size())
+                return false;
+
+            Field.Bytes.assign (In, Pos, 8);
+            Pos += 8;
+            return true;
+
+        case 2:
+            if ((false == ReadVarint (In, Pos, Len)) || (Pos + Len > In.size()))
+                return false;
+
+            Field.Bytes.assign (In, Pos, (size_t) Len);
+            Pos += (size_t) Len;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+static bool DecodeWriteRequest (const std::string &Request, std::vector<RW_SAMPLE> &Samples)
+{
+    PB_FIELD Series, Item, Sub;
+    size_t   Pos = 0;
+
+    while (Pos < Request.size())
+    {
+        if ((false == NextField (Request, Pos, Series)) || (1 != Series.Number) || (2 != Series.WireType))
+            return false;
+
+        std::map<std::string, std::string> Labels;
+        std::vector<RW_SAMPLE> SeriesSamples;
+        size_t SeriesPos = 0;
+
+        while (SeriesPos < Series.Bytes.size())
+        {
+            size_t ItemPos = 0;
+
+            if ((false == NextField (Series.Bytes, SeriesPos, Item)) || (2 != Item.WireType))
+                return false;
+
+            if (1 == Item.Number)
+            {
+                std::string Name, Value;
+
+                while (ItemPos < Item.Bytes.size())
+                {
+                    if (false == NextField (Item.Bytes, ItemPos, Sub))
+                        return false;
+
+                    if (1 == Sub.Number)
+                        Name = Sub.Bytes;
+                    else if (2 == Sub.Number)
+                        Value = Sub.Bytes;
+                }
+
+                Labels[Name] = Value;
+            }
+            else if (2 == Item.Number)
+            {
+                RW_SAMPLE Sample = {};
+
+                while (ItemPos < Item.Bytes.size())
+                {
+                    if (false == NextField (Item.Bytes, ItemPos, Sub))
+                        return false;
+
+                    if ((1 == Sub.Number) && (1 == Sub.WireType))
+                        memcpy (&Sample.Value, Sub.Bytes.data(), sizeof (Sample.Value));
+                    else if ((2 == Sub.Number) && (0 == Sub.WireType))
+                        Sample.TimestampMsec = (int64_t) Sub.Varint;
+                }
+
+                SeriesSamples.push_back (Sample);
+            }
+        }
+
+        for (auto &Sample : SeriesSamples)
+        {
+            Sample.Labels = Labels;
+            Samples.push_back (Sample);
+        }
+    }
+
+    return true;
+}
+
+
+/* Stand-in remote write receiver. Answers the requests with the scripted status codes, then with 204 */
+
+class RemoteWriteReceiver
+{
+
+public:
+
+    ~RemoteWriteReceiver ()
+    {
+        Stop();
+    }
+
+    bool Start (unsigned short Port = 0, bool bPrint = false)
+    {
+        struct sockaddr_in Addr = {};
+        socklen_t AddrLen = sizeof (Addr);
+        int On = 1;
+
+        m_Listen = socket (AF_INET, SOCK_STREAM, 0);
+
+        if (m_Listen < 0)
+            return false;
+
+        setsockopt (m_Listen, SOL_SOCKET, SO_REUSEADDR, &On, sizeof (On));
+
+        Addr.sin_family      = AF_INET;
+        Addr.sin_port        = htons (Port);
+        Addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+        if (bind (m_Listen, (struct sockaddr *) &Addr, sizeof (Addr)) || listen (m_Listen, 8) ||
+            getsockname (m_Listen, (struct sockaddr *) &Addr, &AddrLen))
+        {
+            close (m_Listen);
+            m_Listen = -1;
+            return false;
+        }
+
+        m_Port   = ntohs (Addr.sin_port);
+        m_bPrint = bPrint;
+        m_Start  = std::chrono::steady_clock::now();
+        m_Thread = std::thread (&RemoteWriteReceiver::AcceptThread, this);
+        return true;
+    }
+
+    void Stop ()
+    {
+        if (m_Listen >= 0)
+        {
+            shutdown (m_Listen, SHUT_RDWR);
+            close (m_Listen);
+            m_Listen = -1;
+        }
+
+        if (m_Thread.joinable())
+            m_Thread.join();
+    }
+
+    /* Status codes for the next requests. bRepeatLast keeps answering with the last one */
+    void Script (std::vector<int> Statuses, bool bRepeatLast = false)
+    {
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        m_Script = Statuses;
+        m_bRepeatLast = bRepeatLast;
+    }
+
+    std::string Url () const
+    {
+        return "http://127.0.0.1:" + std::to_string (m_Port) + "/api/v1/write";
+    }
+
+    std::vector<RW_REQUEST> Requests ()
+    {
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        return m_Requests;
+    }
+
+    size_t Accepted ()
+    {
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        size_t Count = 0;
+
+        for (const auto &Request : m_Requests)
+            if (Request.Status < 300)
+                Count++;
+
+        return Count;
+    }
+
+    /* Waits until Cond is true for the requests received so far */
+    bool WaitFor (std::function<bool (RemoteWriteReceiver &)> Cond, int Seconds)
+    {
+        auto End = std::chrono::steady_clock::now() + std::chrono::seconds (Seconds);
+
+        while (std::chrono::steady_clock::now() < End)
+        {
+            if (Cond (*this))
+                return true;
+
+            std::this_thread::sleep_for (std::chrono::milliseconds (20));
+        }
+
+        return Cond (*this);
+    }
+
+
+private:
+
+    void AcceptThread ()
+    {
+        while (true)
+        {
+            int Socket = accept (m_Listen, NULL, NULL);
+
+            if (Socket < 0)
+                break;
+
+            HandleRequest (Socket);
+            close (Socket);
+        }
+    }
+
+    void HandleRequest (int Socket)
+    {
+        std::string Data;
+        std::string Raw;
+        RW_REQUEST  Request;
+        char   Buffer[65536];
+        size_t HeaderEnd = std::string::npos;
+        size_t Length = 0;
+        ssize_t ret = 0;
+        char   szResponse[128] = {0};
+
+        while (std::string::npos == (HeaderEnd = Data.find ("\r\n\r\n")))
+        {
+            if ((ret = recv (Socket, Buffer, sizeof (Buffer), 0)) <= 0)
+                return;
+
+            Data.append (Buffer, (size_t) ret);
+        }
+
+        std::string Header = Data.substr (0, HeaderEnd);
+        Data.erase (0, HeaderEnd + 4);
+
+        for (char &c : Header)
+            c = (char) tolower ((unsigned char) c);
+
+        size_t Pos = Header.find ("content-length:");
+
+        if (std::string::npos != Pos)
+            Length = (size_t) strtoul (Header.c_str() + Pos + 15, NULL, 10);
+
+        Pos = Header.find ("content-encoding:");
+
+        if (std::string::npos != Pos)
+        {
+            Pos += 17;
+
+            while (' ' == Header[Pos])
+                Pos++;
+
+            Request.ContentEncoding = Header.substr (Pos, Header.find ("\r\n", Pos) - Pos);
+        }
+
+        while (Data.size() < Length)
+        {
+            if ((ret = recv (Socket, Buffer, sizeof (Buffer), 0)) <= 0)
+                return;
+
+            Data.append (Buffer, (size_t) ret);
+        }
+
+        {
+            std::lock_guard<std::mutex> Lock (m_Mutex);
+
+            if (m_Script.empty())
+            {
+                Request.Status = 204;
+            }
+            else
+            {
+                Request.Status = m_Script.front();
+
+                if ((m_Script.size() > 1) || (false == m_bRepeatLast))
+                    m_Script.erase (m_Script.begin());
+            }
+        }
+
+        Request.dSecSinceStart = (double) std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::steady_clock::now() - m_Start).count() / 1000.0;
+
+        if ((false == SnappyDecode (Data, Raw)) || (false == DecodeWriteRequest (Raw, Request.Samples)))
+        {
+            printf ("Receiver: cannot decode request (%u bytes)\n", (DWORD) Data.size());
+            Request.Status = 400;
+        }
+
+        if (m_bPrint)
+        {
+            for (const auto &Sample : Request.Samples)
+            {
+                for (const auto &Label : Sample.Labels)
+                    printf ("%s=\"%s\" ", Label.first.c_str(), Label.second.c_str());
+
+                printf ("%g @%" PRId64 "\n", Sample.Value, Sample.TimestampMsec);
+            }
+
+            printf ("Receiver: %u samples, status %d\n", (DWORD) Request.Samples.size(), Request.Status);
+        }
+
+        snprintf (szResponse, sizeof (szResponse), "HTTP/1.1 %d Test\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", Request.Status);
+        send (Socket, szResponse, strlen (szResponse), MSG_NOSIGNAL);
+
+        std::lock_guard<std::mutex> Lock (m_Mutex);
+        m_Requests.push_back (Request);
+    }
+
+    int  m_Listen = -1;
+    unsigned short m_Port = 0;
+    bool m_bPrint = false;
+    bool m_bRepeatLast = false;
+    std::vector<int> m_Script;
+    std::vector<RW_REQUEST> m_Requests;
+    std::mutex  m_Mutex;
+    std::thread m_Thread;
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+
+static const RW_SAMPLE *FindSample (const std::vector<RW_SAMPLE> &Samples, const char *pszName)
+{
+    for (const auto &Sample : Samples)
+    {
+        auto it = Sample.Labels.find ("__name__");
+
+        if ((it != Sample.Labels.end()) && (it->second == pszName))
+            return &Sample;
+    }
+
+    return NULL;
+}
+
+
+static uint64_t ReadCommittedOffset (const char *pszFilename)
+{
+    uint64_t Offset = 0;
+    char     szMagic[8] = {0};
+    FILE     *fp = fopen (pszFilename, "rb");
+
+    if (NULL == fp)
+        return 0;
+
+    if ((1 != fread (szMagic, sizeof (szMagic), 1, fp)) || (1 != fread (&Offset, sizeof (Offset), 1, fp)))
+        Offset = 0;
+
+    fclose (fp);
+    return Offset;
+}
+
+
+static uint64_t GetFileSize (const char *pszFilename)
+{
+    struct stat Stat = {};
+
+    if (stat (pszFilename, &Stat))
+        return 0;
+
+    return (uint64_t) Stat.st_size;
+}
+
+
+/* One snapshot with a snapshot number, so the receiver can tell the batches apart */
+
+static void BuildSnapshot (ExpositionBuffer &Out, DWORD dwSnapshot, DWORD dwSamples)
+{
+    char szLine[MAXSPRINTF+1] = {0};
+
+    Out.Reset();
+
+    snprintf (szLine, sizeof (szLine), "test_snapshot %u", dwSnapshot);
+    Out.AppendSampleLine (szLine);
+
+    for (DWORD i = 1; i < dwSamples; i++)
+    {
+        snprintf (szLine, sizeof (szLine), "Domino_test_metric_%u{instance=\"%u\",snapshot=\"%u\"} %u.%03u", i % 977, i, dwSnapshot, i * 7919 + dwSnapshot, i % 1000);
+        Out.AppendSampleLine (szLine);
+    }
+}
+
+
+static std::vector<DWORD> ReceivedSnapshots (RemoteWriteReceiver &Receiver)
+{
+    std::vector<DWORD> Snapshots;
+
+    for (const auto &Request : Receiver.Requests())
+    {
+        const RW_SAMPLE *pSample = NULL;
+
+        if (Request.Status >= 300)
+            continue;
+
+        if ((pSample = FindSample (Request.Samples, "test_snapshot")))
+            Snapshots.push_back ((DWORD) pSample->Value);
+    }
+
+    return Snapshots;
+}
+
+
+/* (a) The payload decodes to the samples of the snapshot, text values and comments are skipped */
+
+static void TestPayload ()
+{
+    RemoteWriteReceiver Receiver;
+    RemoteWriteSink     Sink;
+    ExpositionBuffer    Snapshot;
+
+    printf ("Test: payload\n");
+    remove (RW_TEST_WAL);
+
+    CHECK (Receiver.Start());
+    CHECK (Sink.Start (Receiver.Url().c_str(), RW_TEST_WAL, 0, 0));
+
+    Snapshot.Append ("# HELP Domino_disk_free_bytes Free bytes\n# TYPE Domino_disk_free_bytes gauge\n");
+    Snapshot.AppendSampleLine ("Domino_disk_free_bytes{path=\"/local/a\\\"b\",component=\"nsf\"} 123");
+    Snapshot.AppendSampleLine ("Domino_Server_Users 42");
+    Snapshot.AppendSampleLine ("Domino_Platform_Load -0.25");
+    Snapshot.AppendSampleLine ("Domino_missing NaN");
+    Snapshot.AppendSampleLine ("Domino_unlimited +Inf");
+    Snapshot.AppendSampleLine ("Domino_Server_Name srv01");
+
+    Sink.Enqueue (Snapshot);
+
+    CHECK (Receiver.WaitFor ([] (RemoteWriteReceiver &r) { return r.Accepted() >= 1; }, 10));
+    Sink.Stop();
+
+    auto Requests = Receiver.Requests();
+    CHECK (1 == Requests.size());
+
+    if (Requests.empty())
+        return;
+
+    const auto &Samples = Requests[0].Samples;
+    const RW_SAMPLE *pSample = NULL;
+
+    CHECK ("snappy" == Requests[0].ContentEncoding);
+    CHECK (5 == Samples.size());
+
+    CHECK ((pSample = FindSample (Samples, "Domino_disk_free_bytes")));
+
+    if (pSample)
+    {
+        CHECK (3 == pSample->Labels.size());
+        CHECK ("/local/a\"b" == pSample->Labels.at ("path"));
+        CHECK ("nsf" == pSample->Labels.at ("component"));
+        CHECK (123.0 == pSample->Value);
+        CHECK (pSample->TimestampMsec > 1700000000000LL);
+    }
+
+    CHECK ((pSample = FindSample (Samples, "Domino_Server_Users")) && (42.0 == pSample->Value) && (1 == pSample->Labels.size()));
+    CHECK ((pSample = FindSample (Samples, "Domino_Platform_Load")) && (-0.25 == pSample->Value));
+    CHECK ((pSample = FindSample (Samples, "Domino_missing")) && std::isnan (pSample->Value));
+    CHECK ((pSample = FindSample (Samples, "Domino_unlimited")) && std::isinf (pSample->Value) && (pSample->Value > 0));
+    CHECK (NULL == FindSample (Samples, "Domino_Server_Name"));
+
+    CHECK (1 == Sink.SentRequests());
+    CHECK (0 == Sink.PendingBytes());
+}
+
+
+/* (b) 5xx and 429 are retried with exponential backoff and the same batch is sent again */
+
+static void TestRetry ()
+{
+    RemoteWriteReceiver Receiver;
+    RemoteWriteSink     Sink;
+    ExpositionBuffer    Snapshot;
+
+    printf ("Test: retry and backoff\n");
+    remove (RW_TEST_WAL);
+
+    CHECK (Receiver.Start());
+    Receiver.Script ({ 503, 429, 500 });
+
+    CHECK (Sink.Start (Receiver.Url().c_str(), RW_TEST_WAL, 0, 0));
+
+    BuildSnapshot (Snapshot, 1, 100);
+    Sink.Enqueue (Snapshot);
+
+    /* Backoff 1 + 2 + 4 seconds */
+    CHECK (Receiver.WaitFor ([] (RemoteWriteReceiver &r) { return r.Accepted() >= 1; }, 15));
+    Sink.Stop();
+
+    auto Requests = Receiver.Requests();
+    CHECK (4 == Requests.size());
+
+    if (4 != Requests.size())
+        return;
+
+    CHECK (503 == Requests[0].Status);
+    CHECK (429 == Requests[1].Status);
+    CHECK (500 == Requests[2].Status);
+    CHECK (204 == Requests[3].Status);
+
+    /* The backoff doubles from 1 second */
+    CHECK (Requests[1].dSecSinceStart - Requests[0].dSecSinceStart >= 0.9);
+    CHECK (Requests[2].dSecSinceStart - Requests[1].dSecSinceStart >= 1.9);
+    CHECK (Requests[3].dSecSinceStart - Requests[2].dSecSinceStart >= 3.9);
+
+    for (const auto &Request : Requests)
+        CHECK (100 == Request.Samples.size());
+
+    CHECK (3 == Sink.FailedRequests());
+    CHECK (1 == Sink.SentRequests());
+    CHECK (0 == Sink.PendingBytes());
+
+    /* Other errors are not retried, the batch is dropped */
+    RemoteWriteReceiver Rejecting;
+
+    CHECK (Rejecting.Start());
+    Rejecting.Script ({ 400 });
+    CHECK (Sink.Start (Rejecting.Url().c_str(), RW_TEST_WAL, 0, 0));
+
+    Sink.Enqueue (Snapshot);
+    CHECK (Rejecting.WaitFor ([] (RemoteWriteReceiver &r) { return r.Requests().size() >= 1; }, 10));
+    std::this_thread::sleep_for (std::chrono::milliseconds (1500));
+    Sink.Stop();
+
+    CHECK (1 == Rejecting.Requests().size());
+    CHECK (1 == Sink.DroppedRequests());
+    CHECK (0 == Sink.PendingBytes());
+}
+
+
+/* (c) Batches not delivered survive a restart. Sending resumes after the last accepted batch, and delivered
+   batches are compacted out of the WAL once they take more space than the pending ones */
+
+#define RW_TEST_SNAPSHOTS        24
+#define RW_TEST_DELIVERED        16
+#define RW_TEST_SNAPSHOT_SAMPLES 8000
+
+static void TestWalRestart ()
+{
+    RemoteWriteSink  Sink;
+    ExpositionBuffer Snapshot;
+    uint64_t FullSize  = 0;
+    uint64_t Committed = 0;
+
+    printf ("Test: WAL restart and compaction\n");
+    remove (RW_TEST_WAL);
+
+    {
+        /* Receiver not reachable: everything goes to the WAL */
+        RemoteWriteReceiver Down;
+
+        CHECK (Down.Start());
+        std::string Url = Down.Url();
+        Down.Stop();
+
+        CHECK (Sink.Start (Url.c_str(), RW_TEST_WAL, RW_TEST_SNAPSHOT_SAMPLES, 0));
+
+        for (DWORD i = 1; i <= RW_TEST_SNAPSHOTS; i++)
+        {
+            BuildSnapshot (Snapshot, i, RW_TEST_SNAPSHOT_SAMPLES);
+            Sink.Enqueue (Snapshot);
+        }
+
+        Sink.Stop();
+    }
+
+    FullSize = GetFileSize (RW_TEST_WAL);
+    CHECK (DOMPROM_REMOTE_WRITE_WAL_HEADER == ReadCommittedOffset (RW_TEST_WAL));
+
+    /* The delivered batches must take more than the compaction threshold */
+    CHECK (FullSize * RW_TEST_DELIVERED / RW_TEST_SNAPSHOTS > DOMPROM_REMOTE_WRITE_COMPACT_BYTES + DOMPROM_REMOTE_WRITE_WAL_HEADER);
+
+    {
+        /* Restart: the receiver accepts some batches, then fails */
+        RemoteWriteReceiver Receiver;
+        std::vector<int> Script (RW_TEST_DELIVERED, 204);
+
+        Script.push_back (503);
+
+        CHECK (Receiver.Start());
+        Receiver.Script (Script, true);
+
+        CHECK (Sink.Start (Receiver.Url().c_str(), RW_TEST_WAL, RW_TEST_SNAPSHOT_SAMPLES, 0));
+        CHECK (Receiver.WaitFor ([] (RemoteWriteReceiver &r) { return r.Requests().size() > RW_TEST_DELIVERED; }, 20));
+        Sink.Stop();
+
+        auto Snapshots = ReceivedSnapshots (Receiver);
+        CHECK (RW_TEST_DELIVERED == Snapshots.size());
+
+        for (size_t i = 0; i < Snapshots.size(); i++)
+            CHECK (i + 1 == Snapshots[i]);
+    }
+
+    /* Compacted: the WAL is smaller and still has the pending batches after the committed offset */
+    Committed = ReadCommittedOffset (RW_TEST_WAL);
+
+    CHECK (GetFileSize (RW_TEST_WAL) < FullSize);
+    CHECK (Committed >= DOMPROM_REMOTE_WRITE_WAL_HEADER);
+    CHECK (Committed < GetFileSize (RW_TEST_WAL));
+    CHECK (GetFileSize (RW_TEST_WAL) - Committed < FullSize - DOMPROM_REMOTE_WRITE_WAL_HEADER);
+
+    {
+        /* Second restart: exactly the pending batches are sent, in order and once */
+        RemoteWriteReceiver Receiver;
+
+        CHECK (Receiver.Start());
+        CHECK (Sink.Start (Receiver.Url().c_str(), RW_TEST_WAL, RW_TEST_SNAPSHOT_SAMPLES, 0));
+        CHECK (Receiver.WaitFor ([] (RemoteWriteReceiver &r) { return r.Accepted() >= RW_TEST_SNAPSHOTS - RW_TEST_DELIVERED; }, 20));
+
+        /* Nothing else arrives */
+        std::this_thread::sleep_for (std::chrono::milliseconds (1500));
+        Sink.Stop();
+
+        auto Snapshots = ReceivedSnapshots (Receiver);
+        CHECK (RW_TEST_SNAPSHOTS - RW_TEST_DELIVERED == Snapshots.size());
+
+        for (size_t i = 0; i < Snapshots.size(); i++)
+            CHECK (RW_TEST_DELIVERED + i + 1 == Snapshots[i]);
+
+        for (const auto &Request : Receiver.Requests())
+            CHECK (RW_TEST_SNAPSHOT_SAMPLES == Request.Samples.size());
+    }
+
+    /* All delivered: the WAL starts over empty */
+    CHECK (DOMPROM_REMOTE_WRITE_WAL_HEADER == GetFileSize (RW_TEST_WAL));
+    CHECK (DOMPROM_REMOTE_WRITE_WAL_HEADER == ReadCommittedOffset (RW_TEST_WAL));
+
+    /* A torn record at the end is cut off on the next start */
+    {
+        RemoteWriteReceiver Receiver;
+        FILE *fp = NULL;
+
+        BuildSnapshot (Snapshot, 100, 10);
+
+        CHECK (Receiver.Start());
+        std::string Url = Receiver.Url();
+        Receiver.Stop();
+
+        CHECK (Sink.Start (Url.c_str(), RW_TEST_WAL, 0, 0));
+        Sink.Enqueue (Snapshot);
+        Sink.Stop();
+
+        if ((fp = fopen (RW_TEST_WAL, "ab")))
+        {
+            fwrite ("\x40\x00\x00\x00torn", 8, 1, fp);
+            fclose (fp);
+        }
+
+        RemoteWriteReceiver Restarted;
+
+        CHECK (Restarted.Start());
+        CHECK (Sink.Start (Restarted.Url().c_str(), RW_TEST_WAL, 0, 0));
+        CHECK (Restarted.WaitFor ([] (RemoteWriteReceiver &r) { return r.Accepted() >= 1; }, 10));
+        std::this_thread::sleep_for (std::chrono::milliseconds (1500));
+        Sink.Stop();
+
+        auto Snapshots = ReceivedSnapshots (Restarted);
+        CHECK ((1 == Snapshots.size()) && (100 == Snapshots[0]));
+        CHECK (DOMPROM_REMOTE_WRITE_WAL_HEADER == GetFileSize (RW_TEST_WAL));
+    }
+
+    remove (RW_TEST_WAL);
+}
+
+
+int main (int argc, char *argv[])
+{
+    snprintf (g_szVersion, sizeof (g_szVersion), "test");
+
+    if (argc > 1)
+    {
+        RemoteWriteReceiver Receiver;
+
+        if (false == Receiver.Start ((unsigned short) atoi (argv[1]), true))
+        {
+            printf ("Cannot listen on port %s\n", argv[1]);
+            return 1;
+        }
+
+        printf ("Receiver listening on %s\n", Receiver.Url().c_str());
+
+        while (true)
+            std::this_thread::sleep_for (std::chrono::seconds (60));
+    }
+
+    TestPayload();
+    TestRetry();
+    TestWalRestart();
+
+    if (g_Failures)
+    {
+        printf ("remote_write_test: %d checks FAILED\n", g_Failures);
+        return 1;
+    }
+
+    printf ("remote_write_test: all checks passed\n");
+    return 0;
+}
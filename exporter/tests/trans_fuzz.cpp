@@ -0,0 +1,83 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - show trans parser fuzz target              #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* libFuzzer entry point for TransStatsParser::Parse and Write.
+
+   make fuzz                                                builds trans_fuzz_libfuzzer with clang and -fsanitize=fuzzer,address
+   ./trans_fuzz_libfuzzer -max_len=65536 fuzz_corpus trans   runs it with the show trans corpus as seed
+
+   Without DOMPROM_LIBFUZZER a small driver runs the entry point once per file given,
+   so the corpus and crash files can be replayed with any compiler (make check) */
+
+#include "../domprom.cpp"
+
+
+extern "C" int LLVMFuzzerTestOneInput (const uint8_t *pData, size_t Size)
+{
+    /* The parser is reused like in the trans collector, the tables of earlier inputs must not leak into the next one */
+    static TransStatsParser Parser;
+    static ExpositionBuffer Out;
+
+    /* The console buffer is null terminated */
+    std::string Input ((const char *) pData, Size);
+
+    Out.Reset();
+    Parser.Parse (Input.c_str());
+    Parser.Write (&Out);
+
+    return 0;
+}
+
+
+#ifndef DOMPROM_LIBFUZZER
+
+int main (int argc, char *argv[])
+{
+    std::string Data;
+    char   Buffer[16384];
+    size_t Len = 0;
+    FILE   *fp = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        fp = fopen (argv[a], "rb");
+
+        if (NULL == fp)
+        {
+            printf ("Cannot read %s\n", argv[a]);
+            return 1;
+        }
+
+        Data.clear();
+
+        while ((Len = fread (Buffer, 1, sizeof (Buffer), fp)) > 0)
+            Data.append (Buffer, Len);
+
+        fclose (fp);
+
+        LLVMFuzzerTestOneInput ((const uint8_t *) Data.data(), Data.size());
+    }
+
+    printf ("trans_fuzz: %d inputs\n", argc - 1);
+    return 0;
+}
+
+#endif
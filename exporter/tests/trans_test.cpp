@@ -0,0 +1,137 @@
+/*
+###########################################################################
+# Domino Prometheus Exporter - show trans parser tests                    #
+# (C) Copyright Daniel Nashed/Nash!Com 2024-2026                          #
+#                                                                         #
+# Licensed under the Apache License, Version 2.0 (the "License");         #
+# you may not use this file except in compliance with the License.        #
+# You may obtain a copy of the License at                                 #
+#                                                                         #
+#      http://www.apache.org/licenses/LICENSE-2.0                         #
+#                                                                         #
+# Unless required by applicable law or agreed to in writing, software     #
+# distributed under the License is distributed on an "AS IS" BASIS,       #
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.#
+# See the License for the specific language governing permissions and     #
+# limitations under the License.                                          #
+#                                                                         #
+#                                                                         #
+###########################################################################
+*/
+
+/* Golden output regression test for the "show trans" parser.
+   Each trans/<name>.txt is parsed and the rendered metrics are compared with trans/<name>.prom.
+
+   trans_test <files>        compare with the golden files (make check passes the whole corpus)
+   trans_test -u <files>     write the golden files after an intended output change (review the diff!) */
+
+#include "../domprom.cpp"
+
+
+static bool ReadFile (const std::string &Filename, std::string &Data)
+{
+    FILE *fp = fopen (Filename.c_str(), "rb");
+    char Buffer[16384];
+    size_t Len = 0;
+
+    Data.clear();
+
+    if (NULL == fp)
+        return false;
+
+    while ((Len = fread (Buffer, 1, sizeof (Buffer), fp)) > 0)
+        Data.append (Buffer, Len);
+
+    fclose (fp);
+    return true;
+}
+
+
+int main (int argc, char *argv[])
+{
+    TransStatsParser Parser;
+    ExpositionBuffer Out;
+    std::string Input;
+    std::string Golden;
+    std::string GoldenFilename;
+    bool  bUpdate   = false;
+    int   Failures  = 0;
+    int   Files     = 0;
+    DWORD dwRows    = 0;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (0 == strcmp (argv[a], "-u"))
+        {
+            bUpdate = true;
+            continue;
+        }
+
+        GoldenFilename = argv[a];
+
+        if ((GoldenFilename.size() > 4) && (0 == GoldenFilename.compare (GoldenFilename.size() - 4, 4, ".txt")))
+            GoldenFilename.resize (GoldenFilename.size() - 4);
+
+        GoldenFilename += ".prom";
+
+        if (false == ReadFile (argv[a], Input))
+        {
+            printf ("FAILED %s: cannot read input\n", argv[a]);
+            Failures++;
+            continue;
+        }
+
+        Files++;
+
+        Out.Reset();
+        dwRows = Parser.Parse (Input.c_str());
+        Parser.Write (&Out);
+
+        if (bUpdate)
+        {
+            if (false == Out.CommitToFile (GoldenFilename.c_str(), false))
+            {
+                printf ("FAILED %s: cannot write golden file\n", GoldenFilename.c_str());
+                Failures++;
+            }
+            else
+            {
+                printf ("Updated %s (%u operations)\n", GoldenFilename.c_str(), dwRows);
+            }
+
+            continue;
+        }
+
+        if (false == ReadFile (GoldenFilename, Golden))
+        {
+            printf ("FAILED %s: cannot read golden file %s\n", argv[a], GoldenFilename.c_str());
+            Failures++;
+            continue;
+        }
+
+        if ((Golden.size() != Out.Size()) || memcmp (Golden.data(), Out.Data(), Out.Size()))
+        {
+            printf ("FAILED %s: output differs from %s\n", argv[a], GoldenFilename.c_str());
+            fwrite (Out.Data(), 1, Out.Size(), stdout);
+            Failures++;
+            continue;
+        }
+
+        printf ("OK     %s (%u operations)\n", argv[a], dwRows);
+    }
+
+    if (0 == Files)
+    {
+        printf ("Usage: trans_test [-u] <file.txt> ...\n");
+        return 1;
+    }
+
+    if (Failures)
+    {
+        printf ("trans_test: %d of %d files FAILED\n", Failures, Files);
+        return 1;
+    }
+
+    printf ("trans_test: all %d files passed\n", Files);
+    return 0;
+}